@@ -0,0 +1,279 @@
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <Usagi/Runtime/Graphics/BindlessSlotAllocator.hpp>
+#include <Usagi/Runtime/Graphics/GraphicsCommandStream.hpp>
+#include <Usagi/Runtime/Graphics/ShaderResource.hpp>
+
+using namespace usagi;
+
+namespace
+{
+using Stream = GraphicsCommandStream;
+
+struct Recorder
+{
+    std::vector<std::string> ops;
+    std::vector<std::uint8_t> constant;
+
+    void operator()(const Stream::BindPipeline &c)
+    {
+        ops.push_back("pipeline " + std::to_string(c.pipeline));
+    }
+
+    void operator()(const Stream::BindResourceSet &c)
+    {
+        ops.push_back("set " + std::to_string(c.set_id) + " " +
+            std::to_string(c.resource_set));
+    }
+
+    void operator()(const Stream::BindIndexBuffer &c)
+    {
+        ops.push_back("index " + std::to_string(c.buffer) + " " +
+            std::to_string(c.offset));
+    }
+
+    void operator()(const Stream::BindVertexBuffer &c)
+    {
+        ops.push_back("vertex " + std::to_string(c.binding_index) + " " +
+            std::to_string(c.buffer) + " " + std::to_string(c.offset));
+    }
+
+    void operator()(const Stream::SetViewport &c)
+    {
+        ops.push_back("viewport " + std::to_string(c.size[0]));
+    }
+
+    void operator()(const Stream::SetScissor &c)
+    {
+        ops.push_back("scissor " + std::to_string(c.origin[1]));
+    }
+
+    void operator()(const Stream::SetLineWidth &c)
+    {
+        ops.push_back("line " + std::to_string(c.width));
+    }
+
+    void operator()(const ShaderConstantWrite &c)
+    {
+        ops.push_back("constant " + std::to_string(c.handle.offset));
+        const auto data = static_cast<const std::uint8_t *>(c.data);
+        constant.assign(data, data + c.handle.size);
+    }
+
+    void operator()(const Stream::DrawInstanced &c)
+    {
+        ops.push_back("draw " + std::to_string(c.vertex_count));
+    }
+
+    void operator()(const Stream::DrawIndexedInstanced &c)
+    {
+        ops.push_back("draw_indexed " + std::to_string(c.index_count) +
+            " " + std::to_string(c.vertex_offset));
+    }
+
+    void operator()(const Stream::DrawIndirect &c)
+    {
+        ops.push_back("draw_indirect " + std::to_string(c.buffer) + " " +
+            std::to_string(c.offset) + " " + std::to_string(c.draw_count));
+    }
+
+    void operator()(const Stream::DrawIndexedIndirect &c)
+    {
+        ops.push_back("draw_indexed_indirect " + std::to_string(c.buffer) +
+            " " + std::to_string(c.draw_count) + " " +
+            std::to_string(c.stride));
+    }
+};
+}
+
+TEST(GraphicsCommandStreamTest, DecodesInRecordedOrder)
+{
+    Stream stream;
+    ShaderConstantHandle handle;
+    handle.offset = 16;
+    handle.size = 3;
+    const std::uint8_t data[] = { 1, 2, 3 };
+
+    stream.bindPipeline(0);
+    stream.bindResourceSet(1, 2);
+    stream.bindIndexBuffer(3, 1ull << 33, GraphicsIndexType::UINT16);
+    stream.bindVertexBuffer(1, 4, 8);
+    stream.setViewport(0, { 0, 0 }, { 2, 2 });
+    stream.setScissor(0, { 0, -5 }, { 1, 1 });
+    stream.setLineWidth(1);
+    stream.setConstant(handle, data);
+    stream.drawInstanced(3, 1, 0, 0);
+    stream.drawIndexedInstanced(6, 1, 0, -2, 0);
+    stream.drawIndirect(5, 32, 100, 16);
+    stream.drawIndexedIndirect(5, 0, 7, 24);
+
+    Recorder recorder;
+    stream.visit(recorder);
+
+    const std::vector<std::string> expected {
+        "pipeline 0",
+        "set 1 2",
+        "index 3 8589934592",
+        "vertex 1 4 8",
+        "viewport 2.000000",
+        "scissor -5",
+        "line 1.000000",
+        "constant 16",
+        "draw 3",
+        "draw_indexed 6 -2",
+        "draw_indirect 5 32 100",
+        "draw_indexed_indirect 5 7 24",
+    };
+    EXPECT_EQ(recorder.ops, expected);
+    EXPECT_EQ(recorder.constant, std::vector<std::uint8_t>({ 1, 2, 3 }));
+}
+
+TEST(GraphicsCommandStreamTest, ResetKeepsNothing)
+{
+    Stream stream;
+    stream.drawInstanced(3, 1, 0, 0);
+    EXPECT_FALSE(stream.empty());
+
+    stream.reset();
+    EXPECT_TRUE(stream.empty());
+    EXPECT_EQ(stream.byteSize(), 0u);
+    EXPECT_TRUE(stream.pipelines().empty());
+
+    Recorder recorder;
+    stream.visit(recorder);
+    EXPECT_TRUE(recorder.ops.empty());
+}
+
+TEST(GraphicsCommandStreamTest, ResourceSetHandles)
+{
+    Stream stream;
+    const auto a = stream.addResourceSet({ nullptr, nullptr });
+    const auto b = stream.addResourceSet({ nullptr });
+
+    EXPECT_NE(a, b);
+    EXPECT_EQ(stream.resourceSet(a).count, 2u);
+    EXPECT_EQ(stream.resourceSet(b).count, 1u);
+    EXPECT_EQ(stream.resourceSet(b).resources,
+        stream.resourceSet(a).resources + 2);
+    EXPECT_EQ(stream.resourceSet(b).first, 2u);
+    EXPECT_EQ(stream.setResources().size(), 3u);
+}
+
+TEST(GraphicsCommandStreamTest, RetainedResources)
+{
+    Stream stream;
+    const auto a = std::make_shared<ShaderResource>();
+    const auto b = std::make_shared<ShaderResource>();
+
+    const auto ha = stream.addResource(a);
+    EXPECT_EQ(stream.addResource(b), ha + 1);
+    EXPECT_EQ(stream.addResource(a), ha);
+    // retaining a resource does not record any command
+    EXPECT_TRUE(stream.empty());
+    EXPECT_EQ(stream.resources(),
+        std::vector<std::shared_ptr<ShaderResource>>({ a, b }));
+
+    stream.reset();
+    EXPECT_TRUE(stream.resources().empty());
+    EXPECT_EQ(a.use_count(), 1);
+    EXPECT_EQ(stream.addResource(b), 0u);
+}
+
+TEST(BindlessSlotAllocatorTest, ReleasedSlotsWaitForFrame)
+{
+    BindlessSlotAllocator slots(3);
+    EXPECT_EQ(slots.allocate(), 0u);
+    EXPECT_EQ(slots.allocate(), 1u);
+
+    // a released slot is not reused before it is freed
+    slots.release(0);
+    EXPECT_EQ(slots.allocate(), 2u);
+    EXPECT_THROW(slots.allocate(), std::runtime_error);
+
+    const auto released = slots.takeReleasedSlots();
+    EXPECT_EQ(released, std::vector<std::uint32_t>({ 0 }));
+    EXPECT_TRUE(slots.takeReleasedSlots().empty());
+    EXPECT_THROW(slots.allocate(), std::runtime_error);
+
+    slots.freeSlots(released);
+    EXPECT_EQ(slots.allocate(), 0u);
+    EXPECT_THROW(slots.allocate(), std::runtime_error);
+}
+
+TEST(BindlessSlotAllocatorTest, FreedSlotsAreReused)
+{
+    BindlessSlotAllocator slots(4);
+    for(std::uint32_t i = 0; i < 4; ++i)
+        EXPECT_EQ(slots.allocate(), i);
+    slots.release(1);
+    slots.release(3);
+    EXPECT_THROW(slots.release(4), std::logic_error);
+    slots.freeSlots(slots.takeReleasedSlots());
+
+    std::vector<std::uint32_t> reused { slots.allocate(), slots.allocate() };
+    std::sort(reused.begin(), reused.end());
+    EXPECT_EQ(reused, std::vector<std::uint32_t>({ 1, 3 }));
+    EXPECT_THROW(slots.allocate(), std::runtime_error);
+}
+
+TEST(GraphicsCommandStreamTest, RecordingBenchmark)
+{
+    using Clock = std::chrono::high_resolution_clock;
+    constexpr std::uint32_t NUM_DRAWS = 100'000;
+    constexpr std::uint32_t DRAWS_PER_SET = 16;
+
+    Stream stream;
+    ShaderConstantHandle handle;
+    handle.size = 64;
+    const float transform[16] { };
+
+    // the first pass grows the stream to its final capacity, like a stream
+    // reused every frame
+    Clock::duration record_time { 0 };
+    for(int pass = 0; pass < 2; ++pass)
+    {
+        stream.reset();
+        const auto begin = Clock::now();
+        stream.bindPipeline(0);
+        stream.bindVertexBuffer(0, 0, 0);
+        stream.bindIndexBuffer(1, 0, GraphicsIndexType::UINT16);
+        for(std::uint32_t i = 0; i < NUM_DRAWS; ++i)
+        {
+            if(i % DRAWS_PER_SET == 0)
+                stream.bindResourceSet(0, stream.addResourceSet({ nullptr }));
+            stream.setConstant(handle, transform);
+            stream.drawIndexedInstanced(36, 1, 0, 0, 0);
+        }
+        record_time = Clock::now() - begin;
+    }
+
+    std::size_t num_draws = 0, num_commands = 0;
+    const auto begin = Clock::now();
+    stream.visit([&](auto &&c) {
+        using Command = std::decay_t<decltype(c)>;
+        ++num_commands;
+        if constexpr(std::is_same_v<Command, Stream::DrawIndexedInstanced>)
+            num_draws += c.instance_count;
+    });
+    const auto decode_time = Clock::now() - begin;
+
+    EXPECT_EQ(num_draws, NUM_DRAWS);
+    EXPECT_EQ(num_commands, 3 + NUM_DRAWS * 2 + NUM_DRAWS / DRAWS_PER_SET);
+
+    using std::chrono::microseconds;
+    using std::chrono::duration_cast;
+    const auto record_us = duration_cast<microseconds>(record_time).count();
+    const auto decode_us = duration_cast<microseconds>(decode_time).count();
+    RecordProperty("RecordUs", static_cast<int>(record_us));
+    RecordProperty("DecodeUs", static_cast<int>(decode_us));
+    std::cout << "[ RECORD   ] " << NUM_DRAWS << " draws, "
+        << stream.byteSize() / 1024 << " KiB: record " << record_us
+        << " us, decode " << decode_us << " us" << std::endl;
+}
@@ -0,0 +1,551 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <random>
+#include <thread>
+
+#include <Usagi/Runtime/Memory/ArenaAllocator.hpp>
+#include <Usagi/Runtime/Memory/BitmapMemoryAllocator.hpp>
+#include <Usagi/Runtime/Memory/MemoryTracker.hpp>
+#include <Usagi/Runtime/Memory/TlsfMemoryAllocator.hpp>
+#include <Usagi/Runtime/Memory/TripleBuffer.hpp>
+
+using namespace usagi;
+
+TEST(TripleBufferTest, InitialState)
+{
+    TripleBuffer<int> buffer { 42 };
+
+    EXPECT_FALSE(buffer.hasNewData());
+    EXPECT_FALSE(buffer.fetch());
+    EXPECT_EQ(buffer.readBuffer(), 42);
+    EXPECT_EQ(buffer.writeBuffer(), 42);
+    EXPECT_NE(&buffer.readBuffer(), &buffer.writeBuffer());
+}
+
+TEST(TripleBufferTest, ReadLatest)
+{
+    TripleBuffer<int> buffer;
+
+    buffer.write(1);
+    EXPECT_TRUE(buffer.hasNewData());
+    buffer.write(2);
+    buffer.write(3);
+    // stale values are skipped
+    EXPECT_EQ(buffer.read(), 3);
+    EXPECT_FALSE(buffer.hasNewData());
+    // front buffer is kept when nothing new is published
+    EXPECT_FALSE(buffer.fetch());
+    EXPECT_EQ(buffer.readBuffer(), 3);
+
+    buffer.write(4);
+    EXPECT_EQ(buffer.read(), 4);
+}
+
+TEST(TripleBufferTest, BuffersNeverAlias)
+{
+    TripleBuffer<int> buffer;
+
+    for(int i = 0; i < 100; ++i)
+    {
+        buffer.writeBuffer() = i;
+        EXPECT_NE(&buffer.readBuffer(), &buffer.writeBuffer());
+        buffer.publish();
+        EXPECT_NE(&buffer.readBuffer(), &buffer.writeBuffer());
+        if(i % 3 == 0)
+        {
+            EXPECT_TRUE(buffer.fetch());
+            EXPECT_EQ(buffer.readBuffer(), i);
+        }
+    }
+}
+
+namespace
+{
+struct StressPayload
+{
+    std::uint64_t sequence = 0;
+    std::uint64_t data[31] = { };
+};
+}
+
+TEST(TripleBufferTest, ConcurrentStress)
+{
+    constexpr std::uint64_t NUM_FRAMES = 1'000'000;
+
+    TripleBuffer<StressPayload> buffer;
+    std::atomic<bool> done { false };
+
+    std::thread producer([&]() {
+        for(std::uint64_t i = 1; i <= NUM_FRAMES; ++i)
+        {
+            auto &p = buffer.writeBuffer();
+            p.sequence = i;
+            for(auto &&d : p.data) d = i;
+            buffer.publish();
+        }
+        done = true;
+    });
+
+    std::uint64_t last_seen = 0, num_fetched = 0;
+    bool consistent = true, monotonic = true;
+    while(true)
+    {
+        const bool finished = done;
+        if(buffer.fetch())
+        {
+            const auto &p = buffer.readBuffer();
+            // the producer must never touch the buffer being read
+            for(auto &&d : p.data)
+                consistent = consistent && d == p.sequence;
+            monotonic = monotonic && p.sequence > last_seen;
+            last_seen = p.sequence;
+            ++num_fetched;
+        }
+        if(finished && !buffer.hasNewData()) break;
+    }
+    producer.join();
+
+    EXPECT_TRUE(consistent);
+    EXPECT_TRUE(monotonic);
+    EXPECT_EQ(last_seen, NUM_FRAMES);
+    EXPECT_GT(num_fetched, 0u);
+}
+
+TEST(TripleBufferTest, LatencyBenchmark)
+{
+    using Clock = std::chrono::high_resolution_clock;
+    constexpr int NUM_SAMPLES = 1'000;
+
+    // the payload is the time point of publishing
+    TripleBuffer<Clock::time_point> buffer;
+    std::atomic<int> acknowledged { 0 };
+
+    std::thread producer([&]() {
+        for(int i = 0; i < NUM_SAMPLES; ++i)
+        {
+            buffer.write(Clock::now());
+            // wait for the consumer so each sample is measured separately
+            while(acknowledged.load(std::memory_order_acquire) <= i)
+                std::this_thread::yield();
+        }
+    });
+
+    Clock::duration total { 0 }, worst { 0 };
+    for(int i = 0; i < NUM_SAMPLES; ++i)
+    {
+        while(!buffer.fetch())
+            std::this_thread::yield();
+        const auto latency = Clock::now() - buffer.readBuffer();
+        total += latency;
+        worst = std::max(worst, latency);
+        acknowledged.store(i + 1, std::memory_order_release);
+    }
+    producer.join();
+
+    using std::chrono::nanoseconds;
+    using std::chrono::duration_cast;
+    const auto mean = duration_cast<nanoseconds>(total).count() / NUM_SAMPLES;
+    const auto max = duration_cast<nanoseconds>(worst).count();
+    RecordProperty("MeanLatencyNs", static_cast<int>(mean));
+    RecordProperty("MaxLatencyNs", static_cast<int>(max));
+    std::cout << "[ LATENCY  ] mean " << mean << " ns, max "
+        << max << " ns" << std::endl;
+}
+
+TEST(TlsfMemoryAllocatorTest, AllocateAndFree)
+{
+    TlsfMemoryAllocator alloc { nullptr, 1024 * 1024, 16 };
+
+    EXPECT_EQ(alloc.usedSize(), 0u);
+    const auto a = alloc.allocate(100);
+    const auto b = alloc.allocate(1);
+    EXPECT_NE(a, b);
+    EXPECT_EQ(reinterpret_cast<std::size_t>(a) % 16, 0u);
+    EXPECT_EQ(reinterpret_cast<std::size_t>(b) % 16, 0u);
+    EXPECT_EQ(alloc.usedSize(), 112u + 16u);
+
+    alloc.deallocate(a);
+    alloc.deallocate(b);
+    EXPECT_EQ(alloc.usedSize(), 0u);
+    // freed blocks are coalesced
+    EXPECT_EQ(alloc.largestFreeBlockSize(), 1024u * 1024u);
+    EXPECT_THROW(alloc.deallocate(a), std::invalid_argument);
+}
+
+TEST(TlsfMemoryAllocatorTest, Alignment)
+{
+    TlsfMemoryAllocator alloc { nullptr, 1024 * 1024, 16 };
+
+    alloc.allocate(48);
+    for(std::size_t align = 16; align <= 64 * 1024; align *= 2)
+    {
+        const auto p = alloc.allocate(100, align);
+        EXPECT_EQ(reinterpret_cast<std::size_t>(p) % align, 0u);
+    }
+    EXPECT_THROW(alloc.allocate(100, 24), std::invalid_argument);
+    EXPECT_THROW(alloc.allocate(0), std::invalid_argument);
+}
+
+TEST(TlsfMemoryAllocatorTest, OutOfMemory)
+{
+    TlsfMemoryAllocator alloc { nullptr, 4096, 16 };
+
+    const auto a = alloc.allocate(4096);
+    EXPECT_THROW(alloc.allocate(16), std::bad_alloc);
+    alloc.deallocate(a);
+    EXPECT_NO_THROW(alloc.allocate(2048));
+    EXPECT_NO_THROW(alloc.allocate(2048));
+    EXPECT_THROW(alloc.allocate(16), std::bad_alloc);
+}
+
+TEST(TlsfMemoryAllocatorTest, RandomizedNoOverlap)
+{
+    constexpr std::size_t POOL_SIZE = 16 * 1024 * 1024;
+    TlsfMemoryAllocator alloc { nullptr, POOL_SIZE, 64 };
+
+    std::mt19937 rng { 1234 };
+    std::uniform_int_distribution<std::size_t> size_dist { 1, 64 * 1024 };
+    std::uniform_int_distribution<unsigned> align_dist { 0, 12 };
+    // address -> size
+    std::map<std::size_t, std::size_t> live;
+
+    for(int i = 0; i < 20000; ++i)
+    {
+        if(live.empty() || rng() % 3 != 0)
+        {
+            const auto size = size_dist(rng);
+            const std::size_t align = std::size_t(1) << align_dist(rng);
+            std::size_t addr;
+            try
+            {
+                addr = reinterpret_cast<std::size_t>(
+                    alloc.allocate(size, align));
+            }
+            catch(const std::bad_alloc &)
+            {
+                continue;
+            }
+            ASSERT_EQ(addr % align, 0u);
+            ASSERT_LE(addr + size, POOL_SIZE);
+            const auto next = live.lower_bound(addr);
+            if(next != live.end())
+            {
+                ASSERT_LE(addr + size, next->first);
+            }
+            if(next != live.begin())
+            {
+                ASSERT_LE(std::prev(next)->first +
+                    std::prev(next)->second, addr);
+            }
+            live.emplace(addr, size);
+        }
+        else
+        {
+            auto iter = live.begin();
+            std::advance(iter, rng() % live.size());
+            alloc.deallocate(reinterpret_cast<void*>(iter->first));
+            live.erase(iter);
+        }
+    }
+    for(auto &&a : live)
+        alloc.deallocate(reinterpret_cast<void*>(a.first));
+    EXPECT_EQ(alloc.usedSize(), 0u);
+    EXPECT_EQ(alloc.largestFreeBlockSize(), POOL_SIZE);
+}
+
+namespace
+{
+struct AllocationTraceEntry
+{
+    bool allocation;
+    std::size_t id;
+    std::size_t size;
+    std::size_t alignment;
+};
+
+/**
+ * \brief A trace shaped after the allocations done by the overlay and debug
+ * draw subsystems: many short-lived vertex/index/uniform buffers which live
+ * through a few frames in flight, mixed with occasional long-lived
+ * resources.
+ */
+std::vector<AllocationTraceEntry> generateFrameAllocationTrace(
+    const int num_frames)
+{
+    constexpr int FRAMES_IN_FLIGHT = 3;
+
+    std::mt19937 rng { 42 };
+    std::vector<AllocationTraceEntry> trace;
+    std::vector<std::vector<std::size_t>> frames(FRAMES_IN_FLIGHT);
+    std::vector<std::size_t> long_lived;
+    std::size_t next_id = 0;
+
+    for(int f = 0; f < num_frames; ++f)
+    {
+        auto &frame = frames[f % FRAMES_IN_FLIGHT];
+        for(auto &&id : frame)
+            trace.push_back({ false, id, 0, 0 });
+        frame.clear();
+
+        const auto num_allocs = 20 + rng() % 40;
+        for(std::size_t i = 0; i < num_allocs; ++i)
+        {
+            std::size_t size;
+            switch(rng() % 4)
+            {
+                // uniforms
+                case 0: size = 64 + rng() % 192; break;
+                // small vertex batches
+                case 1: size = 256 + rng() % 4096; break;
+                // index buffers
+                case 2: size = 128 + rng() % 8192; break;
+                // large vertex batches
+                default: size = 8192 + rng() % (128 * 1024); break;
+            }
+            frame.push_back(next_id);
+            trace.push_back({ true, next_id++, size, 256 });
+        }
+        if(rng() % 50 == 0)
+        {
+            long_lived.push_back(next_id);
+            trace.push_back({ true, next_id++,
+                64 * 1024 + rng() % (1024 * 1024), 256 });
+        }
+        if(long_lived.size() > 8)
+        {
+            trace.push_back({ false, long_lived.front(), 0, 0 });
+            long_lived.erase(long_lived.begin());
+        }
+    }
+    return trace;
+}
+
+struct TraceReplayResult
+{
+    double seconds = 0;
+    std::size_t num_operations = 0;
+    std::size_t failed_allocations = 0;
+    std::size_t peak_requested = 0;
+    std::size_t peak_used = 0;
+    double worst_external_fragmentation = 0;
+};
+
+template <typename Allocator>
+TraceReplayResult replayTrace(
+    Allocator &alloc,
+    const std::vector<AllocationTraceEntry> &trace,
+    const bool pass_alignment)
+{
+    using Clock = std::chrono::high_resolution_clock;
+
+    TraceReplayResult result;
+    std::map<std::size_t, std::pair<void*, std::size_t>> live;
+    std::size_t requested = 0;
+    Clock::duration elapsed { 0 };
+
+    for(auto &&e : trace)
+    {
+        if(e.allocation)
+        {
+            const auto begin = Clock::now();
+            void *ptr;
+            try
+            {
+                ptr = alloc.allocate(e.size, pass_alignment ? e.alignment : 0);
+            }
+            catch(const std::bad_alloc &)
+            {
+                ++result.failed_allocations;
+                continue;
+            }
+            elapsed += Clock::now() - begin;
+            live.emplace(e.id, std::make_pair(ptr, e.size));
+            requested += e.size;
+        }
+        else
+        {
+            const auto iter = live.find(e.id);
+            if(iter == live.end()) continue;
+            const auto begin = Clock::now();
+            alloc.deallocate(iter->second.first);
+            elapsed += Clock::now() - begin;
+            requested -= iter->second.second;
+            live.erase(iter);
+        }
+        ++result.num_operations;
+
+        const auto used = alloc.usedSize();
+        result.peak_requested = std::max(result.peak_requested, requested);
+        result.peak_used = std::max(result.peak_used, used);
+    }
+    // measured after the replay since computing it is not O(1) for all
+    // allocators
+    const auto free_size = alloc.managedSize() - alloc.usedSize();
+    if(free_size)
+        result.worst_external_fragmentation = 1.0 -
+            double(alloc.largestFreeBlockSize()) / free_size;
+    for(auto &&a : live)
+        alloc.deallocate(a.second.first);
+
+    result.seconds = std::chrono::duration<double>(elapsed).count();
+    return result;
+}
+
+void printTraceReplayResult(
+    const char *name,
+    const TraceReplayResult &r)
+{
+    std::cout << "[ " << name << " ] "
+        << r.num_operations / r.seconds / 1e6 << " Mops/s, "
+        << "peak used " << r.peak_used / 1024 << " KiB for "
+        << r.peak_requested / 1024 << " KiB requested ("
+        << 100.0 * r.peak_requested / r.peak_used << "% efficient), "
+        << "external fragmentation "
+        << 100.0 * r.worst_external_fragmentation << "%, "
+        << r.failed_allocations << " failed" << std::endl;
+}
+}
+
+TEST(TlsfMemoryAllocatorTest, TraceComparisonWithBitmapAllocator)
+{
+    constexpr std::size_t POOL_SIZE = 64 * 1024 * 1024;
+    const auto trace = generateFrameAllocationTrace(2000);
+
+    TlsfMemoryAllocator tlsf { nullptr, POOL_SIZE, 256 };
+    // the configuration used by VulkanGpuDevice before
+    BitmapMemoryAllocator bitmap { nullptr, POOL_SIZE, 32 * 1024 };
+
+    const auto tlsf_result = replayTrace(tlsf, trace, true);
+    // alignment is implied by the block size of the bitmap allocator
+    const auto bitmap_result = replayTrace(bitmap, trace, false);
+
+    printTraceReplayResult("TLSF    ", tlsf_result);
+    printTraceReplayResult("Bitmap  ", bitmap_result);
+
+    EXPECT_EQ(tlsf_result.failed_allocations, 0u);
+    EXPECT_EQ(tlsf.usedSize(), 0u);
+    EXPECT_LT(tlsf_result.peak_used, bitmap_result.peak_used);
+}
+
+TEST(LinearArenaTest, AllocateAndReset)
+{
+    LinearArena arena { 1024 };
+
+    const auto a = arena.allocate(10, 1);
+    const auto b = arena.allocate(8, 8);
+    EXPECT_EQ(reinterpret_cast<std::size_t>(b) % 8, 0u);
+    EXPECT_GE(static_cast<char*>(b), static_cast<char*>(a) + 10);
+    const auto c = arena.allocate(100, 256);
+    EXPECT_EQ(reinterpret_cast<std::size_t>(c) % 256, 0u);
+    EXPECT_EQ(arena.numAllocations(), 3u);
+    EXPECT_EQ(arena.numHeapAllocations(), 1u);
+
+    // overflow into new chunks
+    for(int i = 0; i < 10; ++i)
+        arena.allocate(1000);
+    EXPECT_GT(arena.numHeapAllocations(), 1u);
+    const auto capacity = arena.capacity();
+
+    // chunks are merged and the same workload fits without heap allocation
+    arena.reset();
+    EXPECT_EQ(arena.capacity(), capacity);
+    arena.allocate(10, 1);
+    arena.allocate(8, 8);
+    arena.allocate(100, 256);
+    for(int i = 0; i < 10; ++i)
+        arena.allocate(1000);
+    EXPECT_EQ(arena.numHeapAllocations(), 0u);
+}
+
+TEST(FrameArenaTest, FrameVectorAndStatistics)
+{
+    FrameArena::nextFrame();
+    {
+        FrameVector<int> v;
+        for(int i = 0; i < 1000; ++i)
+            v.push_back(i);
+        EXPECT_EQ(v[999], 999);
+    }
+    FrameArena::nextFrame();
+    const auto stats = FrameArena::lastFrameStatistics();
+    EXPECT_GT(stats.num_allocations, 0u);
+    EXPECT_GE(stats.used_bytes, 1000 * sizeof(int));
+
+    // the arena grown in last frame is reused
+    {
+        FrameVector<int> v;
+        for(int i = 0; i < 1000; ++i)
+            v.push_back(i);
+    }
+    FrameArena::nextFrame();
+    EXPECT_EQ(FrameArena::lastFrameStatistics().num_heap_allocations, 0u);
+}
+
+TEST(MemoryTrackerTest, TagStatistics)
+{
+    MemoryTracker::setEnabled(false);
+    const auto tag = MemoryTracker::registerTag(
+        "TestTag", MemoryTagCategory::CPU_ALLOCATOR);
+
+    // ignored when disabled
+    tag->recordAllocation(100);
+    EXPECT_EQ(tag->statistics().total_allocations, 0);
+
+    MemoryTracker::setEnabled(true);
+    tag->recordAllocation(100);
+    tag->recordAllocation(50);
+    tag->recordDeallocation(100);
+    const auto stats = tag->statistics();
+    EXPECT_EQ(stats.current_bytes, 50);
+    EXPECT_EQ(stats.peak_bytes, 150);
+    EXPECT_EQ(stats.current_allocations, 1);
+    EXPECT_EQ(stats.total_allocations, 2);
+    EXPECT_FALSE(stats.has_region_usage);
+
+    const auto snapshot = MemoryTracker::snapshot();
+    EXPECT_TRUE(std::any_of(snapshot.begin(), snapshot.end(),
+        [](auto &&s) { return s.name == "TestTag"; }));
+    EXPECT_NE(MemoryTracker::toJson().find("\"TestTag\""),
+        std::string::npos);
+
+    MemoryTracker::setEnabled(false);
+}
+
+TEST(MemoryTrackerTest, AllocatorFragmentation)
+{
+    MemoryTracker::setEnabled(true);
+    auto tag = MemoryTracker::registerTag(
+        "TestPool", MemoryTagCategory::GPU_POOL);
+    TlsfMemoryAllocator alloc { nullptr, 4096, 16 };
+    alloc.setMemoryTag(tag);
+    tag->setRegionUsageQuery([&]() {
+        MemoryRegionUsage usage;
+        usage.managed_bytes = alloc.managedSize();
+        usage.free_bytes = alloc.usableSize();
+        usage.largest_free_block = alloc.largestFreeBlockSize();
+        return usage;
+    });
+
+    const auto a = alloc.allocate(1024);
+    alloc.allocate(1024);
+    alloc.deallocate(a);
+    // free: [0, 1024) and [2048, 4096)
+    const auto stats = tag->statistics();
+    EXPECT_EQ(stats.current_bytes, 1024);
+    EXPECT_EQ(stats.peak_bytes, 2048);
+    EXPECT_TRUE(stats.has_region_usage);
+    EXPECT_EQ(stats.region_usage.free_bytes, 3072u);
+    EXPECT_NEAR(stats.fragmentation, 1.0 / 3, 1e-6);
+
+    tag->setRegionUsageQuery(nullptr);
+    // unregistered after releasing
+    std::weak_ptr<MemoryTag> weak = tag;
+    tag.reset();
+    alloc.setMemoryTag(nullptr);
+    EXPECT_TRUE(weak.expired());
+    MemoryTracker::setEnabled(false);
+}
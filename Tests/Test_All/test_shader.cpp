@@ -1,5 +1,10 @@
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <sstream>
+
+#include <Usagi/Runtime/Graphics/Shader/ShaderCompiler.hpp>
+#include <Usagi/Runtime/Graphics/Shader/ShaderVariants.hpp>
 #include <Usagi/Runtime/Graphics/Shader/SpirvBinary.hpp>
 
 using namespace usagi;
@@ -31,3 +36,218 @@ TEST(ShaderTest, FragmentShaderLoadTest)
         "data/shaders/frag.spv"
     ));
 }
+
+namespace
+{
+const char *gVariantSource = R"(#version 450 core
+layout(location = 0) out vec4 fColor;
+#ifdef RED
+layout(constant_id = 0) const float intensity = 1.0;
+#endif
+void main()
+{
+#ifdef RED
+    fColor = vec4(intensity, 0, 0, 1);
+#else
+    fColor = vec4(1);
+#endif
+}
+)";
+}
+
+TEST(ShaderTest, DefineVariantsTest)
+{
+    ShaderVariants variants("variant", gVariantSource, ShaderStage::FRAGMENT);
+
+    const auto plain = variants.variant();
+    const auto red = variants.variant({ { "RED", "1" } });
+    EXPECT_NE(plain, red);
+    EXPECT_NE(plain->bytecodes(), red->bytecodes());
+    // compiled once and shared afterwards
+    EXPECT_EQ(red, variants.variant({ { "RED", "1" } }));
+    EXPECT_EQ(plain, variants.variant());
+}
+
+TEST(ShaderTest, IncludeTest)
+{
+    const ShaderCompiler compiler({ }, [](
+        const std::string &header_name,
+        const std::string &includer_name) -> std::optional<ShaderInclude>
+    {
+        if(header_name != "color.glsl" || includer_name != "main.frag")
+            return { };
+        return ShaderInclude {
+            "color.glsl", "vec4 color() { return vec4(1); }\n"
+        };
+    });
+
+    ShaderSource source;
+    source.name = "main.frag";
+    source.stage = ShaderStage::FRAGMENT;
+    source.code = R"(#version 450 core
+#include "color.glsl"
+layout(location = 0) out vec4 fColor;
+void main() { fColor = color(); }
+)";
+    EXPECT_NO_THROW(compiler.compile(source));
+
+    source.code = R"(#version 450 core
+#include "missing.glsl"
+void main() { }
+)";
+    EXPECT_THROW(compiler.compile(source), std::runtime_error);
+}
+
+TEST(ShaderTest, BatchCompilationTest)
+{
+    const ShaderCompiler compiler;
+
+    std::vector<ShaderSource> sources(4);
+    for(auto &&s : sources)
+    {
+        s.code = gVariantSource;
+        s.stage = ShaderStage::FRAGMENT;
+    }
+    sources[1].options.defines = { { "RED", "1" } };
+    sources[2].options.debug_info = !sources[2].options.debug_info;
+    sources[3].code = "#version 450 core\nvoid main() { syntax error }\n";
+
+    EXPECT_THROW(compiler.compile(sources), std::runtime_error);
+
+    sources.pop_back();
+    const auto binaries = compiler.compile(sources);
+    ASSERT_EQ(binaries.size(), 3u);
+    for(auto &&b : binaries)
+        EXPECT_NE(b, nullptr);
+    EXPECT_NE(binaries[0]->bytecodes(), binaries[1]->bytecodes());
+}
+
+TEST(ShaderTest, ReflectionTest)
+{
+    const auto binary = SpirvBinary::fromGlslSourceFile(
+        "data/shaders/glsl_shader.vert", ShaderStage::VERTEX
+    );
+    const auto &r = binary->reflection();
+
+    ASSERT_EQ(r.push_constant_buffers.size(), 1u);
+    const auto &pc = r.push_constant_buffers.front();
+    EXPECT_EQ(pc.size, 16u);
+    ASSERT_EQ(pc.fields.size(), 2u);
+    EXPECT_EQ(pc.fields[0].name, "uScale");
+    EXPECT_EQ(pc.fields[1].name, "uTranslate");
+    EXPECT_EQ(pc.fields[1].offset, 8u);
+    EXPECT_EQ(pc.fields[1].size, 8u);
+
+    ASSERT_EQ(r.stage_inputs.size(), 3u);
+    const auto color = std::find_if(
+        r.stage_inputs.begin(), r.stage_inputs.end(),
+        [](auto &&i) { return i.name == "aColor"; });
+    ASSERT_NE(color, r.stage_inputs.end());
+    EXPECT_EQ(color->location, 2u);
+}
+
+TEST(ShaderTest, ReflectionSerializationTest)
+{
+    const auto binary = SpirvBinary::fromGlslSourceFile(
+        "data/shaders/glsl_shader.frag", ShaderStage::FRAGMENT
+    );
+    const auto &r = binary->reflection();
+
+    std::stringstream data;
+    r.serialize(data);
+    const auto d = ShaderReflection::deserialize(data);
+
+    EXPECT_EQ(d.push_constant_buffers.size(), r.push_constant_buffers.size());
+    EXPECT_EQ(d.stage_inputs.size(), r.stage_inputs.size());
+    ASSERT_EQ(d.resources.size(), r.resources.size());
+    for(std::size_t i = 0; i < d.resources.size(); ++i)
+    {
+        EXPECT_EQ(d.resources[i].type, r.resources[i].type);
+        EXPECT_EQ(d.resources[i].name, r.resources[i].name);
+        EXPECT_EQ(d.resources[i].set, r.resources[i].set);
+        EXPECT_EQ(d.resources[i].binding, r.resources[i].binding);
+    }
+
+    std::stringstream garbage("not reflection data");
+    EXPECT_THROW(ShaderReflection::deserialize(garbage), std::exception);
+}
+
+TEST(ShaderTest, ComputeReflectionTest)
+{
+    const ShaderCompiler compiler;
+
+    ShaderSource source;
+    source.name = "particles.comp";
+    source.stage = ShaderStage::COMPUTE;
+    source.code = R"(#version 450 core
+layout(local_size_x = 64) in;
+layout(push_constant) uniform PushConstant
+{
+    float uDeltaTime;
+} pc;
+layout(std430, set = 0, binding = 0) buffer Particles
+{
+    vec4 positions[];
+};
+layout(set = 0, binding = 1, rgba8) uniform writeonly image2D uDensity;
+void main()
+{
+    const uint i = gl_GlobalInvocationID.x;
+    positions[i].y -= pc.uDeltaTime;
+    imageStore(uDensity, ivec2(positions[i].xy), vec4(1));
+}
+)";
+    const auto binary = compiler.compile(source);
+    const auto &r = binary->reflection();
+
+    ASSERT_EQ(r.push_constant_buffers.size(), 1u);
+    EXPECT_EQ(r.push_constant_buffers.front().fields.front().name,
+        "uDeltaTime");
+
+    using Type = ShaderReflection::ResourceType;
+    ASSERT_EQ(r.resources.size(), 2u);
+    EXPECT_EQ(r.resources[0].type, Type::STORAGE_BUFFER);
+    EXPECT_EQ(r.resources[0].binding, 0u);
+    EXPECT_EQ(r.resources[1].type, Type::STORAGE_IMAGE);
+    EXPECT_EQ(r.resources[1].binding, 1u);
+}
+
+TEST(ShaderTest, VertexPullingReflectionTest)
+{
+    const ShaderCompiler compiler;
+
+    ShaderSource source;
+    source.name = "instanced.vert";
+    source.stage = ShaderStage::VERTEX;
+    source.code = R"(#version 450 core
+struct Vertex { vec4 position; };
+struct Instance { mat4 transform; };
+layout(std430, set = 0, binding = 0) readonly buffer Vertices
+{
+    Vertex vertices[];
+};
+layout(std430, set = 0, binding = 1) readonly buffer Instances
+{
+    Instance instances[];
+};
+void main()
+{
+    gl_Position = instances[gl_InstanceIndex].transform *
+        vertices[gl_VertexIndex].position;
+}
+)";
+    const auto binary = compiler.compile(source);
+    const auto &r = binary->reflection();
+
+    // the built-in indices are not vertex input attributes
+    EXPECT_TRUE(r.stage_inputs.empty());
+
+    using Type = ShaderReflection::ResourceType;
+    ASSERT_EQ(r.resources.size(), 2u);
+    for(auto &&resource : r.resources)
+    {
+        EXPECT_EQ(resource.type, Type::STORAGE_BUFFER);
+        EXPECT_EQ(resource.set, 0u);
+    }
+    EXPECT_NE(r.resources[0].binding, r.resources[1].binding);
+}
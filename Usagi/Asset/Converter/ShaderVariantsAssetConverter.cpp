@@ -0,0 +1,18 @@
+﻿#include "ShaderVariantsAssetConverter.hpp"
+
+#include <Usagi/Asset/AssetLoadingContext.hpp>
+#include <Usagi/Asset/Helper/ShaderInclude.hpp>
+#include <Usagi/Utility/Stream.hpp>
+
+std::shared_ptr<usagi::ShaderVariants> usagi::ShaderVariantsAssetConverter::
+    operator()(
+        AssetLoadingContext *ctx,
+        std::istream &in,
+        const ShaderStage stage,
+        const std::optional<std::filesystem::path> & cache_folder) const
+{
+    return std::make_shared<ShaderVariants>(
+        ctx->locator, readStreamAsString(in), stage,
+        ShaderCompiler(
+            cache_folder, assetShaderIncludeResolver(ctx->asset_root)));
+}
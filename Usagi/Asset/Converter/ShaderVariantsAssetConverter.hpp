@@ -0,0 +1,30 @@
+﻿#pragma once
+
+#include <memory>
+#include <filesystem>
+#include <optional>
+
+#include <Usagi/Asset/Decoder/RawAssetDecoder.hpp>
+#include <Usagi/Runtime/Graphics/Shader/ShaderVariants.hpp>
+
+namespace usagi
+{
+struct AssetLoadingContext;
+
+/**
+ * \brief Load a GLSL source whose permutations are compiled on demand. The
+ * variants are kept along with the asset as long as they are referenced.
+ */
+struct ShaderVariantsAssetConverter
+{
+    using DefaultDecoder = RawAssetDecoder;
+
+    std::shared_ptr<ShaderVariants> operator()(
+        AssetLoadingContext *ctx,
+        std::istream &in,
+        ShaderStage stage,
+        const std::optional<std::filesystem::path> & cache_folder =
+            "./.cache/shader"
+    ) const;
+};
+}
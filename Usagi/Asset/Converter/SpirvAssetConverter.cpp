@@ -1,6 +1,9 @@
 ﻿#include "SpirvAssetConverter.hpp"
 
+#include <Usagi/Asset/AssetLoadingContext.hpp>
+#include <Usagi/Asset/Helper/ShaderInclude.hpp>
 #include <Usagi/Runtime/Graphics/Shader/SpirvBinary.hpp>
+#include <Usagi/Utility/Stream.hpp>
 
 std::shared_ptr<usagi::SpirvBinary> usagi::SpirvAssetConverter::operator()(
     AssetLoadingContext *ctx,
@@ -8,5 +11,11 @@ std::shared_ptr<usagi::SpirvBinary> usagi::SpirvAssetConverter::operator()(
     const ShaderStage stage,
     const std::optional<std::filesystem::path> & cache_folder) const
 {
-    return SpirvBinary::fromGlslSourceStream(in, stage, cache_folder);
+    ShaderSource source;
+    source.name = ctx->locator;
+    source.code = readStreamAsString(in);
+    source.stage = stage;
+    return ShaderCompiler(
+        cache_folder, assetShaderIncludeResolver(ctx->asset_root)
+    ).compile(source);
 }
@@ -0,0 +1,41 @@
+﻿#include "ShaderInclude.hpp"
+
+#include <mutex>
+
+#include <Usagi/Asset/AssetRoot.hpp>
+#include <Usagi/Asset/Converter/Uncached/StringAssetConverter.hpp>
+#include <Usagi/Core/Logging.hpp>
+
+usagi::ShaderIncludeResolver usagi::assetShaderIncludeResolver(
+    AssetRoot *assets)
+{
+    return [assets, lock = std::make_shared<std::mutex>()](
+        const std::string &header_name,
+        const std::string &includer_name) -> std::optional<ShaderInclude>
+    {
+        std::string locator = header_name;
+        if(header_name.find(':') == std::string::npos)
+        {
+            // keep the package name and the folder of the includer
+            auto folder_end = includer_name.find_last_of('/');
+            if(folder_end == std::string::npos)
+                folder_end = includer_name.find(':');
+            if(folder_end != std::string::npos)
+                locator = includer_name.substr(0, folder_end + 1) +
+                    header_name;
+        }
+
+        std::lock_guard<std::mutex> guard(*lock);
+        try
+        {
+            auto code = assets->uncachedRes<StringAssetConverter>(locator);
+            return ShaderInclude { std::move(locator), std::move(code) };
+        }
+        catch(const std::exception &e)
+        {
+            LOG(error, "Failed to load shader header {}: {}",
+                locator, e.what());
+            return { };
+        }
+    };
+}
@@ -0,0 +1,17 @@
+﻿#pragma once
+
+#include <Usagi/Runtime/Graphics/Shader/ShaderCompiler.hpp>
+
+namespace usagi
+{
+class AssetRoot;
+
+/**
+ * \brief Resolve #include directives of shaders through the asset system.
+ * Header names containing a package name (package:path) are used as-is.
+ * Otherwise they are relative to the folder of the includer in the same
+ * package. The assets are looked up one at a time so the resolver may be
+ * shared by parallel compilations.
+ */
+ShaderIncludeResolver assetShaderIncludeResolver(AssetRoot *assets);
+}
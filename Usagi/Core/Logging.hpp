@@ -23,8 +23,11 @@ template <typename... Args>
 void log(const LoggingLevel level, const char *fmt, const Args &... args)
 {
     fmt::format_arg_store<fmt::format_context, Args...> as { args... };
+    // logging is used by tools which never advance the frame arena, so
+    // long messages stay on the heap
     fmt::memory_buffer buffer;
     fmt::vformat_to(buffer, fmt, as);
+    buffer.push_back('\0');
     doLog(level, buffer.data());
 }
 
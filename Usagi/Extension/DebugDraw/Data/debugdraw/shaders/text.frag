@@ -1,15 +1,32 @@
 #version 450 core
+#ifdef BINDLESS
+#extension GL_EXT_nonuniform_qualifier : require
+#endif
 
 layout(location = 0) in vec2 v_TexCoords;
 layout(location = 1) in vec4 v_Color;
 
 layout(set=0, binding=0) uniform sampler u_glyphSampler;
+#ifdef BINDLESS
+layout(set=1, binding=0) uniform texture2D u_textures[];
+
+// shares the push constant buffer with the vertex shader
+layout(push_constant) uniform PushConstant {
+    vec2 padding;
+    uint u_glyphTexture;
+} pc;
+#else
 layout(set=0, binding=1) uniform texture2D u_glyphTexture;
+#endif
 
 layout(location = 0) out vec4 out_FragColor;
 
 void main()
 {
     out_FragColor = v_Color;
+#ifdef BINDLESS
+    out_FragColor.a = texture(sampler2D(u_textures[pc.u_glyphTexture], u_glyphSampler), v_TexCoords).r;
+#else
     out_FragColor.a = texture(sampler2D(u_glyphTexture, u_glyphSampler), v_TexCoords).r;
+#endif
 }
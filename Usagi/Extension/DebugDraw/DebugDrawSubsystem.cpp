@@ -1,6 +1,7 @@
 ﻿#include "DebugDrawSubsystem.hpp"
 
 #include <Usagi/Asset/AssetRoot.hpp>
+#include <Usagi/Asset/Converter/ShaderVariantsAssetConverter.hpp>
 #include <Usagi/Asset/Converter/SpirvAssetConverter.hpp>
 #include <Usagi/Game/Game.hpp>
 #include <Usagi/Graphics/RenderTarget/RenderTarget.hpp>
@@ -30,7 +31,6 @@ void usagi::DebugDrawSubsystem::createPipelines()
 {
     auto gpu = mGame->runtime()->gpu();
     mCommandPool = gpu->createCommandPool();
-    mVertexBuffer = gpu->createBuffer(GpuBufferUsage::VERTEX);
 
     createPointLinePipeline();
     createTextPipeline();
@@ -79,21 +79,28 @@ void usagi::DebugDrawSubsystem::createPointLinePipeline()
     compiler->omSetDepthEnabled(true);
     compiler->omSetColorBlendEnabled(false);
 
-    mPointDepthEnabledPipeline = compiler->compile();
-
-    // Create child pipelines
+    // The variants are compiled in parallel
+    auto point_depth_enabled = compiler->compileAsync();
 
     compiler->omSetDepthEnabled(false);
-    mPointDepthDisabledPipeline = compiler->compile();
+    auto point_depth_disabled = compiler->compileAsync();
 
     // ~~ Line Pipelines ~~
 
     compiler->iaSetPrimitiveTopology(PrimitiveTopology::LINE_LIST);
     compiler->rsSetPolygonMode(PolygonMode::LINE);
-    mLineDepthDisabledPipeline = compiler->compile();
+    auto line_depth_disabled = compiler->compileAsync();
 
     compiler->omSetDepthEnabled(true);
-    mLineDepthEnabledPipeline = compiler->compile();
+    auto line_depth_enabled = compiler->compileAsync();
+
+    mPointDepthEnabledPipeline = point_depth_enabled.get();
+    mPointDepthDisabledPipeline = point_depth_disabled.get();
+    mLineDepthDisabledPipeline = line_depth_disabled.get();
+    mLineDepthEnabledPipeline = line_depth_enabled.get();
+
+    mMvpMatrixConstant = mPointDepthEnabledPipeline->constantHandle(
+        ShaderStage::VERTEX, "u_MvpMatrix");
 }
 
 void usagi::DebugDrawSubsystem::createTextPipeline()
@@ -101,6 +108,7 @@ void usagi::DebugDrawSubsystem::createTextPipeline()
     auto gpu = mGame->runtime()->gpu();
     auto assets = mGame->assets();
     auto compiler = gpu->createPipelineCompiler();
+    mBindless = gpu->bindlessTexturesEnabled();
 
     compiler->setRenderPass(mRenderTarget->renderPass());
     // Shaders
@@ -110,8 +118,10 @@ void usagi::DebugDrawSubsystem::createTextPipeline()
                 "dd:shaders/text.vert", ShaderStage::VERTEX)
         );
         compiler->setShader(ShaderStage::FRAGMENT,
-            assets->res<SpirvAssetConverter>(
-                "dd:shaders/text.frag", ShaderStage::FRAGMENT)
+            assets->res<ShaderVariantsAssetConverter>(
+                "dd:shaders/text.frag", ShaderStage::FRAGMENT
+            )->variant(mBindless ? ShaderDefines { { "BINDLESS", "1" } }
+                : ShaderDefines { })
         );
     }
     // Vertex Inputs
@@ -154,6 +164,13 @@ void usagi::DebugDrawSubsystem::createTextPipeline()
     }
 
     mTextPipeline = compiler->compile();
+    mScreenDimensionsConstant = mTextPipeline->constantHandle(
+        ShaderStage::VERTEX, "u_screenDimensions");
+    if(mBindless)
+    {
+        mGlyphTextureConstant = mTextPipeline->constantHandle(
+            ShaderStage::FRAGMENT, "u_glyphTexture");
+    }
 }
 
 usagi::DebugDrawSubsystem::DebugDrawSubsystem(Game *game)
@@ -170,15 +187,26 @@ usagi::DebugDrawSubsystem::~DebugDrawSubsystem()
 
 void usagi::DebugDrawSubsystem::update(const Clock &clock)
 {
+    auto &frame = mFrameData.writeBuffer();
+    frame.clear();
+    if(mWorldToNdcFunc) frame.world_to_ndc = mWorldToNdcFunc();
+    if(mWindowSizeFunc) frame.window_size = mWindowSizeFunc();
+
     for(auto &&e : mRegistry)
     {
         std::get<DebugDrawComponent*>(e.second)->draw(mContext);
     }
+    // generate the vertices into the back buffer of the frame data
+    dd::flush(mContext);
+
+    mFrameData.publish();
 }
 
 std::shared_ptr<usagi::GraphicsCommandList> usagi::DebugDrawSubsystem::render(
     const Clock &clock)
 {
+    // if the simulation didn't produce a new frame, draw the last one again
+    const auto &frame = mFrameData.read();
     const auto framebuffer = mRenderTarget->createFramebuffer();
 
     mCurrentCmdList = mCommandPool->allocateGraphicsCommandList();
@@ -187,7 +215,75 @@ std::shared_ptr<usagi::GraphicsCommandList> usagi::DebugDrawSubsystem::render(
     mCurrentCmdList->setViewport(
         0, { 0, 0 }, framebuffer->size().cast<float>());
     mCurrentCmdList->setScissor(0, { 0, 0 }, framebuffer->size());
-    dd::flush(mContext);
+
+    GpuBufferSlice vertices;
+    if(!frame.vertices.empty())
+    {
+        // upload the vertices of all batches at once
+        const auto vertex_bytes =
+            frame.vertices.size() * sizeof(dd::DrawVertex);
+        vertices = mGame->runtime()->gpu()->allocateTransient(vertex_bytes);
+        memcpy(vertices.mapped, frame.vertices.data(), vertex_bytes);
+    }
+
+    using BatchType = FrameData::BatchType;
+    for(auto &&b : frame.batches)
+    {
+        switch(b.type)
+        {
+            case BatchType::POINTS:
+                mCurrentCmdList->bindPipeline(
+                    b.depth_enabled
+                        ? mPointDepthEnabledPipeline
+                        : mPointDepthDisabledPipeline
+                );
+                mCurrentCmdList->setConstant(
+                    mMvpMatrixConstant, frame.world_to_ndc.data());
+                break;
+            case BatchType::LINES:
+                mCurrentCmdList->bindPipeline(
+                    b.depth_enabled
+                        ? mLineDepthEnabledPipeline
+                        : mLineDepthDisabledPipeline
+                );
+                // todo add a setting
+                mCurrentCmdList->setLineWidth(1.f);
+                mCurrentCmdList->setConstant(
+                    mMvpMatrixConstant, frame.world_to_ndc.data());
+                break;
+            case BatchType::GLYPHS:
+            {
+                mCurrentCmdList->bindPipeline(mTextPipeline);
+                mCurrentCmdList->setConstant(
+                    mScreenDimensionsConstant, frame.window_size.data());
+                const auto glyph_tex =
+                    reinterpret_cast<GpuImageView*>(b.glyph_tex);
+                if(mBindless)
+                {
+                    const auto index = glyph_tex->bindlessIndex();
+                    mCurrentCmdList->retainResource(
+                        glyph_tex->shared_from_this());
+                    mCurrentCmdList->bindResourceSet(0, { mFontSampler });
+                    mCurrentCmdList->setConstant(
+                        mGlyphTextureConstant, &index);
+                }
+                else
+                {
+                    mCurrentCmdList->bindResourceSet(0, {
+                        mFontSampler,
+                        glyph_tex->shared_from_this()
+                    });
+                }
+                break;
+            }
+            default: ;
+        }
+        mCurrentCmdList->bindVertexBuffer(0, vertices.buffer,
+            vertices.offset + b.first * sizeof(dd::DrawVertex));
+        mCurrentCmdList->drawInstanced(
+            static_cast<uint32_t>(b.count), 1, 0, 0);
+    }
+
     mCurrentCmdList->endRendering();
     mCurrentCmdList->endRecording();
 
@@ -229,29 +325,32 @@ void usagi::DebugDrawSubsystem::destroyGlyphTexture(dd::GlyphTextureHandle)
     mFontSampler.reset();
 }
 
+void usagi::DebugDrawSubsystem::appendBatch(
+    const FrameData::BatchType type,
+    const dd::DrawVertex *vertices,
+    const int count,
+    const bool depth_enabled,
+    const dd::GlyphTextureHandle glyph_tex)
+{
+    auto &frame = mFrameData.writeBuffer();
+
+    FrameData::Batch batch;
+    batch.type = type;
+    batch.depth_enabled = depth_enabled;
+    batch.glyph_tex = glyph_tex;
+    batch.first = frame.vertices.size();
+    batch.count = count;
+    frame.batches.push_back(batch);
+    frame.vertices.insert(frame.vertices.end(), vertices, vertices + count);
+}
+
 void usagi::DebugDrawSubsystem::drawPointList(
     const dd::DrawVertex *points,
     const int count,
     const bool depth_enabled)
 {
-    mVertexBuffer->allocate(count * sizeof(dd::DrawVertex));
-    {
-        const auto mem = mVertexBuffer->mappedMemory();
-        memcpy(mem, points, mVertexBuffer->size());
-        mVertexBuffer->flush();
-    }
-    mCurrentCmdList->bindPipeline(
-        depth_enabled
-            ? mPointDepthEnabledPipeline
-            : mPointDepthDisabledPipeline
-    );
-    mCurrentCmdList->setConstant(
-        ShaderStage::VERTEX, "u_MvpMatrix",
-        mWorldToNdcFunc().data(), 16 * sizeof(float)
-    );
-    mCurrentCmdList->bindVertexBuffer(0, mVertexBuffer, 0);
-    mCurrentCmdList->drawInstanced(count, 1, 0, 0);
-    mVertexBuffer->release();
+    appendBatch(FrameData::BatchType::POINTS,
+        points, count, depth_enabled, nullptr);
 }
 
 void usagi::DebugDrawSubsystem::drawLineList(
@@ -259,27 +358,8 @@ void usagi::DebugDrawSubsystem::drawLineList(
     const int count,
     const bool depth_enabled)
 {
-    mVertexBuffer->allocate(count * sizeof(dd::DrawVertex));
-    {
-        // todo add a method
-        const auto mem = mVertexBuffer->mappedMemory();
-        memcpy(mem, lines, mVertexBuffer->size());
-        mVertexBuffer->flush();
-    }
-    mCurrentCmdList->bindPipeline(
-        depth_enabled
-        ? mLineDepthEnabledPipeline
-        : mLineDepthDisabledPipeline
-    );
-    // todo add a setting
-    mCurrentCmdList->setLineWidth(1.f);
-    mCurrentCmdList->setConstant(
-        ShaderStage::VERTEX, "u_MvpMatrix",
-        mWorldToNdcFunc().data(), 16 * sizeof(float)
-    );
-    mCurrentCmdList->bindVertexBuffer(0, mVertexBuffer, 0);
-    mCurrentCmdList->drawInstanced(count, 1, 0, 0);
-    mVertexBuffer->release();
+    appendBatch(FrameData::BatchType::LINES,
+        lines, count, depth_enabled, nullptr);
 }
 
 void usagi::DebugDrawSubsystem::drawGlyphList(
@@ -287,22 +367,6 @@ void usagi::DebugDrawSubsystem::drawGlyphList(
     const int count,
     const dd::GlyphTextureHandle glyph_tex)
 {
-    mVertexBuffer->allocate(count * sizeof(dd::DrawVertex));
-    {
-        const auto mem = mVertexBuffer->mappedMemory();
-        memcpy(mem, glyphs, mVertexBuffer->size());
-        mVertexBuffer->flush();
-    }
-    mCurrentCmdList->bindPipeline(mTextPipeline);
-    mCurrentCmdList->setConstant(
-        ShaderStage::VERTEX, "u_screenDimensions",
-        mWindowSizeFunc().data(), 2 * sizeof(float)
-    );
-    mCurrentCmdList->bindResourceSet(0, {
-        mFontSampler,
-        reinterpret_cast<GpuImageView*>(glyph_tex)->shared_from_this()
-    });
-    mCurrentCmdList->bindVertexBuffer(0, mVertexBuffer, 0);
-    mCurrentCmdList->drawInstanced(count, 1, 0, 0);
-    mVertexBuffer->release();
+    appendBatch(FrameData::BatchType::GLYPHS,
+        glyphs, count, false, glyph_tex);
 }
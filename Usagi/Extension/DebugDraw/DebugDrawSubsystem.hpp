@@ -3,6 +3,8 @@
 #include <Usagi/Graphics/Game/ProjectiveRenderingSubsystem.hpp>
 #include <Usagi/Graphics/Game/OverlayRenderingSubsystem.hpp>
 #include <Usagi/Game/CollectionSubsystem.hpp>
+#include <Usagi/Runtime/Graphics/Shader/ShaderConstantHandle.hpp>
+#include <Usagi/Runtime/Memory/TripleBuffer.hpp>
 
 #include "DebugDraw.hpp"
 #include "DebugDrawComponent.hpp"
@@ -32,12 +34,59 @@ class DebugDrawSubsystem
     std::shared_ptr<GraphicsPipeline> mLineDepthEnabledPipeline;
     std::shared_ptr<GraphicsPipeline> mLineDepthDisabledPipeline;
     std::shared_ptr<GraphicsPipeline> mTextPipeline;
+    // the point and line pipelines share the same constant layout
+    ShaderConstantHandle mMvpMatrixConstant;
+    ShaderConstantHandle mScreenDimensionsConstant;
+    ShaderConstantHandle mGlyphTextureConstant;
     std::shared_ptr<GpuImage> mFontTexture;
     std::shared_ptr<GpuSampler> mFontSampler;
+    // select glyph textures with push constants instead of resource sets
+    bool mBindless = false;
     std::shared_ptr<GpuCommandPool> mCommandPool;
-    std::shared_ptr<GpuBuffer> mVertexBuffer;
     mutable std::shared_ptr<GraphicsCommandList> mCurrentCmdList;
 
+    /**
+     * \brief Debug geometry generated in update() and drawn in render(),
+     * which may happen on different threads and at different rates.
+     */
+    struct FrameData
+    {
+        enum class BatchType
+        {
+            POINTS,
+            LINES,
+            GLYPHS,
+        };
+
+        struct Batch
+        {
+            BatchType type;
+            bool depth_enabled = false;
+            dd::GlyphTextureHandle glyph_tex = nullptr;
+            std::size_t first = 0;
+            std::size_t count = 0;
+        };
+
+        Projective3f world_to_ndc = Projective3f::Identity();
+        Vector2f window_size = Vector2f::Zero();
+        std::vector<dd::DrawVertex> vertices;
+        std::vector<Batch> batches;
+
+        void clear()
+        {
+            vertices.clear();
+            batches.clear();
+        }
+    };
+    TripleBuffer<FrameData> mFrameData;
+
+    void appendBatch(
+        FrameData::BatchType type,
+        const dd::DrawVertex *vertices,
+        int count,
+        bool depth_enabled,
+        dd::GlyphTextureHandle glyph_tex);
+
     void createPointLinePipeline();
     void createTextPipeline();
 
@@ -1,9 +1,22 @@
 #version 450 core
+#ifdef BINDLESS
+#extension GL_EXT_nonuniform_qualifier : require
+#endif
 
 layout(location = 0) out vec4 fColor;
 
 layout(set=0, binding=0) uniform sampler samp;
+#ifdef BINDLESS
+layout(set=1, binding=0) uniform texture2D textures[];
+
+// shares the push constant buffer with the vertex shader
+layout(push_constant) uniform uPushConstant {
+    vec4 padding;
+    uint uTextureIndex;
+} pc;
+#else
 layout(set=1, binding=0) uniform texture2D tex;
+#endif
 
 layout(location = 0) in struct{
     vec4 Color;
@@ -12,5 +25,10 @@ layout(location = 0) in struct{
 
 void main()
 {
+#ifdef BINDLESS
+    fColor = In.Color * texture(
+        sampler2D(textures[pc.uTextureIndex], samp), In.UV.xy);
+#else
     fColor = In.Color * texture(sampler2D(tex, samp), In.UV.xy);
+#endif
 }
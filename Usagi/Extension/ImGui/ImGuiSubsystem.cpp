@@ -1,6 +1,7 @@
 ﻿#include "ImGuiSubsystem.hpp"
 
 #include <Usagi/Asset/AssetRoot.hpp>
+#include <Usagi/Asset/Converter/ShaderVariantsAssetConverter.hpp>
 #include <Usagi/Asset/Converter/SpirvAssetConverter.hpp>
 #include <Usagi/Core/Clock.hpp>
 #include <Usagi/Core/Logging.hpp>
@@ -18,6 +19,7 @@
 #include <Usagi/Runtime/Graphics/GpuSampler.hpp>
 #include <Usagi/Runtime/Graphics/GpuSamplerCreateInfo.hpp>
 #include <Usagi/Runtime/Graphics/GraphicsCommandList.hpp>
+#include <Usagi/Runtime/Graphics/GraphicsCommandStream.hpp>
 #include <Usagi/Runtime/Graphics/GraphicsPipelineCompiler.hpp>
 #include <Usagi/Runtime/Input/Keyboard/Keyboard.hpp>
 #include <Usagi/Runtime/Input/Mouse/Mouse.hpp>
@@ -51,9 +53,6 @@ void usagi::ImGuiSubsystem::setup()
 
     // resources
     auto gpu = mGame->runtime()->gpu();
-    mVertexBuffer = gpu->createBuffer(GpuBufferUsage::VERTEX);
-    mIndexBuffer = gpu->createBuffer(GpuBufferUsage::INDEX);
-
     mCommandPool = gpu->createCommandPool();
 
     // fonts
@@ -156,6 +155,7 @@ void usagi::ImGuiSubsystem::createPipelines()
     auto gpu = mGame->runtime()->gpu();
     auto assets = mGame->assets();
     auto compiler = gpu->createPipelineCompiler();
+    mBindless = gpu->bindlessTexturesEnabled();
 
     // Shaders
     {
@@ -164,8 +164,10 @@ void usagi::ImGuiSubsystem::createPipelines()
                 "imgui:shaders/glsl_shader.vert", ShaderStage::VERTEX)
         );
         compiler->setShader(ShaderStage::FRAGMENT,
-            assets->res<SpirvAssetConverter>(
-                "imgui:shaders/glsl_shader.frag", ShaderStage::FRAGMENT)
+            assets->res<ShaderVariantsAssetConverter>(
+                "imgui:shaders/glsl_shader.frag", ShaderStage::FRAGMENT
+            )->variant(mBindless ? ShaderDefines { { "BINDLESS", "1" } }
+                : ShaderDefines { })
         );
     }
     // Vertex Inputs
@@ -204,6 +206,14 @@ void usagi::ImGuiSubsystem::createPipelines()
     compiler->setRenderPass(mRenderTarget->renderPass());
 
     mPipeline = compiler->compile();
+    mScaleConstant = mPipeline->constantHandle(ShaderStage::VERTEX, "uScale");
+    mTranslateConstant =
+        mPipeline->constantHandle(ShaderStage::VERTEX, "uTranslate");
+    if(mBindless)
+    {
+        mTextureIndexConstant =
+            mPipeline->constantHandle(ShaderStage::FRAGMENT, "uTextureIndex");
+    }
 }
 
 void usagi::ImGuiSubsystem::setupInput()
@@ -335,13 +345,15 @@ std::shared_ptr<usagi::GraphicsCommandList> usagi::ImGuiSubsystem::render(
         return { };
 
     // Upload Vertex and index Data
+    GpuBufferSlice vertices, indices;
     {
         const auto vertex_size = draw_data->TotalVtxCount * sizeof(ImDrawVert);
         const auto index_size = draw_data->TotalIdxCount * sizeof(ImDrawIdx);
-        mVertexBuffer->allocate(vertex_size);
-        mIndexBuffer->allocate(index_size);
-        auto vtx_dst = mVertexBuffer->mappedMemory<ImDrawVert>();
-        auto idx_dst = mIndexBuffer->mappedMemory<ImDrawIdx>();
+        auto gpu = mGame->runtime()->gpu();
+        vertices = gpu->allocateTransient(vertex_size);
+        indices = gpu->allocateTransient(index_size);
+        auto vtx_dst = vertices.mappedMemory<ImDrawVert>();
+        auto idx_dst = indices.mappedMemory<ImDrawIdx>();
         for(auto n = 0; n < draw_data->CmdListsCount; n++)
         {
             const ImDrawList *im_draw_list = draw_data->CmdLists[n];
@@ -352,33 +364,25 @@ std::shared_ptr<usagi::GraphicsCommandList> usagi::ImGuiSubsystem::render(
             vtx_dst += im_draw_list->VtxBuffer.Size;
             idx_dst += im_draw_list->IdxBuffer.Size;
         }
-        mVertexBuffer->flush();
-        mIndexBuffer->flush();
     }
 
-    // Render Command List
-    auto cmd_list = mCommandPool->allocateGraphicsCommandList();
-    cmd_list->beginRecording();
-    cmd_list->beginRendering(
-        mRenderTarget->renderPass(),
-        mRenderTarget->createFramebuffer()
-    );
-    cmd_list->bindPipeline(mPipeline);
-    cmd_list->bindResourceSet(0, { mSampler });
+    // Record the draws into a stream which is translated at once
+    auto &stream = mCommandStream;
+    stream.bindPipeline(stream.addPipeline(mPipeline));
+    stream.bindResourceSet(0, stream.addResourceSet({ mSampler }));
 
     // Bind Vertex And Index Buffer
     {
-        cmd_list->bindVertexBuffer(0, mVertexBuffer, 0);
-        cmd_list->bindIndexBuffer(mIndexBuffer, 0,
-            GraphicsIndexType::UINT16
+        stream.bindVertexBuffer(0, stream.addBuffer(vertices.buffer),
+            vertices.offset);
+        stream.bindIndexBuffer(stream.addBuffer(indices.buffer),
+            indices.offset, GraphicsIndexType::UINT16
         );
-        mVertexBuffer->release();
-        mIndexBuffer->release();
     }
 
     // Setup viewport
     {
-        cmd_list->setViewport(
+        stream.setViewport(
             0,
             { 0, 0 },
             { draw_data->DisplaySize.x, draw_data->DisplaySize.y }
@@ -393,10 +397,8 @@ std::shared_ptr<usagi::GraphicsCommandList> usagi::ImGuiSubsystem::render(
         float translate[2];
         translate[0] = -1.0f - draw_data->DisplayPos.x * scale[0];
         translate[1] = -1.0f - draw_data->DisplayPos.y * scale[1];
-        cmd_list->setConstant(ShaderStage::VERTEX,
-            "uScale", scale, sizeof(scale));
-        cmd_list->setConstant(ShaderStage::VERTEX,
-            "uTranslate", translate, sizeof(translate));
+        stream.setConstant(mScaleConstant, scale);
+        stream.setConstant(mTranslateConstant, translate);
     }
 
     // Render the command lists
@@ -424,15 +426,27 @@ std::shared_ptr<usagi::GraphicsCommandList> usagi::ImGuiSubsystem::render(
                     pcmd->ClipRect.z - pcmd->ClipRect.x,
                     pcmd->ClipRect.w - pcmd->ClipRect.y
                 };
-                cmd_list->setScissor(0, origin, size);
-
-                cmd_list->bindResourceSet(1, {
-                    pcmd->TextureId
-                        ? pcmd->TextureId->shared_from_this()
-                        : mFontTextureView
-                });
-
-                cmd_list->drawIndexedInstanced(
+                stream.setScissor(0, origin, size);
+
+                const auto texture = pcmd->TextureId
+                    ? pcmd->TextureId
+                    : mFontTextureView.get();
+                if(mBindless)
+                {
+                    // the texture is not bound, so it must be retained
+                    // separately until the draws are finished
+                    stream.addResource(texture->shared_from_this());
+                    const auto index = texture->bindlessIndex();
+                    stream.setConstant(mTextureIndexConstant, &index);
+                }
+                else
+                {
+                    stream.bindResourceSet(1, stream.addResourceSet({
+                        texture->shared_from_this()
+                    }));
+                }
+
+                stream.drawIndexedInstanced(
                     pcmd->ElemCount, // index count
                     1,               // instance count
                     idx_offset,      // first index
@@ -445,8 +459,18 @@ std::shared_ptr<usagi::GraphicsCommandList> usagi::ImGuiSubsystem::render(
         vtx_offset += im_cmd_list->VtxBuffer.Size;
     }
 
+    // Render Command List
+    auto cmd_list = mCommandPool->allocateGraphicsCommandList();
+    cmd_list->beginRecording();
+    cmd_list->beginRendering(
+        mRenderTarget->renderPass(),
+        mRenderTarget->createFramebuffer()
+    );
+    cmd_list->executeCommandStream(stream);
     cmd_list->endRendering();
     cmd_list->endRecording();
+    // the resources are retained by the command list
+    stream.reset();
 
     return std::move(cmd_list);
 }
@@ -7,6 +7,8 @@
 #include <Usagi/Runtime/Input/Mouse/MouseEventListener.hpp>
 #include <Usagi/Runtime/Window/WindowEventListener.hpp>
 #include <Usagi/Game/CollectionSubsystem.hpp>
+#include <Usagi/Runtime/Graphics/GraphicsCommandStream.hpp>
+#include <Usagi/Runtime/Graphics/Shader/ShaderConstantHandle.hpp>
 
 #include "ImGuiComponent.hpp"
 
@@ -49,13 +51,18 @@ class ImGuiSubsystem
     void updateMouse();
 
 	std::shared_ptr<GraphicsPipeline> mPipeline;
+    ShaderConstantHandle mScaleConstant;
+    ShaderConstantHandle mTranslateConstant;
+    ShaderConstantHandle mTextureIndexConstant;
 	std::shared_ptr<GpuCommandPool> mCommandPool;
+    // reused for recording the draws of each frame
+    GraphicsCommandStream mCommandStream;
     std::shared_ptr<RenderPass> mRenderPass;
-    std::shared_ptr<GpuBuffer> mVertexBuffer;
-	std::shared_ptr<GpuBuffer> mIndexBuffer;
     std::shared_ptr<GpuImage> mFontTexture;
     std::shared_ptr<GpuImageView> mFontTextureView;
     std::shared_ptr<GpuSampler> mSampler;
+    // select textures with push constants instead of resource sets
+    bool mBindless = false;
 
     void setup();
 
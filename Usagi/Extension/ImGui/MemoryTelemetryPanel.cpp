@@ -0,0 +1,85 @@
+﻿#include "MemoryTelemetryPanel.hpp"
+
+#include <Usagi/Runtime/Memory/FrameArena.hpp>
+#include <Usagi/Runtime/Memory/MemoryTracker.hpp>
+
+#include "ImGui.hpp"
+
+namespace
+{
+void formatBytes(char *buf, const std::size_t buf_size, const double bytes)
+{
+    if(bytes >= 1024 * 1024)
+        snprintf(buf, buf_size, "%.2f MiB", bytes / (1024 * 1024));
+    else if(bytes >= 1024)
+        snprintf(buf, buf_size, "%.2f KiB", bytes / 1024);
+    else
+        snprintf(buf, buf_size, "%.0f B", bytes);
+}
+}
+
+void usagi::MemoryTelemetryPanel::draw(const Clock &clock)
+{
+    if(!ImGui::Begin("Memory Telemetry"))
+    {
+        ImGui::End();
+        return;
+    }
+
+    bool enabled = MemoryTracker::enabled();
+    if(ImGui::Checkbox("Enable tracking", &enabled))
+        MemoryTracker::setEnabled(enabled);
+
+    char buf[64];
+    {
+        const auto arena = FrameArena::lastFrameStatistics();
+        formatBytes(buf, sizeof(buf), double(arena.used_bytes));
+        ImGui::Text("Frame arena: %zu allocations, %s, %zu heap allocations",
+            arena.num_allocations, buf, arena.num_heap_allocations);
+    }
+    ImGui::Separator();
+
+    ImGui::Columns(7, "memory_tags");
+    ImGui::Text("Tag"); ImGui::NextColumn();
+    ImGui::Text("Category"); ImGui::NextColumn();
+    ImGui::Text("Current"); ImGui::NextColumn();
+    ImGui::Text("Peak"); ImGui::NextColumn();
+    ImGui::Text("Allocations"); ImGui::NextColumn();
+    ImGui::Text("Managed"); ImGui::NextColumn();
+    ImGui::Text("Fragmentation"); ImGui::NextColumn();
+    ImGui::Separator();
+
+    for(auto &&s : MemoryTracker::snapshot())
+    {
+        ImGui::Text("%s", s.name.c_str()); ImGui::NextColumn();
+        ImGui::Text("%s", to_string(s.category)); ImGui::NextColumn();
+        formatBytes(buf, sizeof(buf), double(s.current_bytes));
+        ImGui::Text("%s", buf); ImGui::NextColumn();
+        formatBytes(buf, sizeof(buf), double(s.peak_bytes));
+        ImGui::Text("%s", buf); ImGui::NextColumn();
+        ImGui::Text("%lld / %lld",
+            static_cast<long long>(s.current_allocations),
+            static_cast<long long>(s.total_allocations));
+        ImGui::NextColumn();
+        if(s.has_region_usage)
+        {
+            formatBytes(buf, sizeof(buf),
+                double(s.region_usage.managed_bytes));
+            ImGui::Text("%s", buf); ImGui::NextColumn();
+            ImGui::Text("%.1f%%", s.fragmentation * 100); ImGui::NextColumn();
+        }
+        else
+        {
+            ImGui::Text("-"); ImGui::NextColumn();
+            ImGui::Text("-"); ImGui::NextColumn();
+        }
+    }
+    ImGui::Columns(1);
+
+    if(ImGui::Button("Dump JSON"))
+        ImGui::SetClipboardText(MemoryTracker::toJson().c_str());
+    ImGui::SameLine();
+    ImGui::TextDisabled("(copied to clipboard)");
+
+    ImGui::End();
+}
@@ -0,0 +1,14 @@
+﻿#pragma once
+
+#include "ImGuiComponent.hpp"
+
+namespace usagi
+{
+/**
+ * \brief Displays the statistics of MemoryTracker and FrameArena.
+ */
+struct MemoryTelemetryPanel : ImGuiComponent
+{
+    void draw(const Clock &clock) override;
+};
+}
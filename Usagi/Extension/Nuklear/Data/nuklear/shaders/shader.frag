@@ -1,14 +1,32 @@
 #version 450 core
+#ifdef BINDLESS
+#extension GL_EXT_nonuniform_qualifier : require
+#endif
 
 layout(location = 0) in vec2 Frag_UV;
 layout(location = 1) in vec4 Frag_Color;
 
 layout(set=0, binding=0) uniform sampler s;
+#ifdef BINDLESS
+layout(set=1, binding=0) uniform texture2D textures[];
+
+// shares the push constant buffer with the vertex shader
+layout(push_constant) uniform PushConstant {
+    vec4 padding;
+    uint texture_index;
+} pc;
+#else
 layout(set=1, binding=0) uniform texture2D t;
+#endif
 
 layout(location = 0) out vec4 Out_Color;
 
 void main()
 {
+#ifdef BINDLESS
+    Out_Color = Frag_Color * texture(
+        sampler2D(textures[pc.texture_index], s), Frag_UV);
+#else
     Out_Color = Frag_Color * texture(sampler2D(t, s), Frag_UV);
+#endif
 }
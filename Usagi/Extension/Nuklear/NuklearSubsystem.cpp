@@ -1,6 +1,7 @@
 ﻿#include "NuklearSubsystem.hpp"
 
 #include <Usagi/Asset/AssetRoot.hpp>
+#include <Usagi/Asset/Converter/ShaderVariantsAssetConverter.hpp>
 #include <Usagi/Asset/Converter/SpirvAssetConverter.hpp>
 #include <Usagi/Core/Clock.hpp>
 #include <Usagi/Core/Logging.hpp>
@@ -22,6 +23,7 @@
 #include <Usagi/Runtime/Graphics/GraphicsPipelineCompiler.hpp>
 #include <Usagi/Runtime/Input/Keyboard/Keyboard.hpp>
 #include <Usagi/Runtime/Input/Mouse/Mouse.hpp>
+#include <Usagi/Runtime/Memory/FrameArena.hpp>
 #include <Usagi/Runtime/Runtime.hpp>
 #include <Usagi/Runtime/Window/Window.hpp>
 
@@ -49,9 +51,6 @@ void usagi::NuklearSubsystem::setup()
 
     // resources
     auto gpu = mGame->runtime()->gpu();
-    mVertexBuffer = gpu->createBuffer(GpuBufferUsage::VERTEX);
-    mIndexBuffer = gpu->createBuffer(GpuBufferUsage::INDEX);
-
     mCommandPool = gpu->createCommandPool();
 
     // fonts
@@ -151,6 +150,7 @@ void usagi::NuklearSubsystem::createPipelines()
     auto gpu = mGame->runtime()->gpu();
     auto assets = mGame->assets();
     auto compiler = gpu->createPipelineCompiler();
+    mBindless = gpu->bindlessTexturesEnabled();
 
     // Shaders
     {
@@ -159,8 +159,10 @@ void usagi::NuklearSubsystem::createPipelines()
                 "nuklear:shaders/shader.vert", ShaderStage::VERTEX)
         );
         compiler->setShader(ShaderStage::FRAGMENT,
-            assets->res<SpirvAssetConverter>(
-                "nuklear:shaders/shader.frag", ShaderStage::FRAGMENT)
+            assets->res<ShaderVariantsAssetConverter>(
+                "nuklear:shaders/shader.frag", ShaderStage::FRAGMENT
+            )->variant(mBindless ? ShaderDefines { { "BINDLESS", "1" } }
+                : ShaderDefines { })
         );
     }
     // Input Assembly
@@ -204,6 +206,14 @@ void usagi::NuklearSubsystem::createPipelines()
     }
     compiler->setRenderPass(mRenderTarget->renderPass());
     mPipeline = compiler->compile();
+    mScaleConstant = mPipeline->constantHandle(ShaderStage::VERTEX, "scale");
+    mTranslateConstant =
+        mPipeline->constantHandle(ShaderStage::VERTEX, "translate");
+    if(mBindless)
+    {
+        mTextureIndexConstant =
+            mPipeline->constantHandle(ShaderStage::FRAGMENT, "texture_index");
+    }
 }
 
 void usagi::NuklearSubsystem::clipboardPaste(
@@ -247,13 +257,14 @@ std::shared_ptr<usagi::GraphicsCommandList> usagi::NuklearSubsystem::render(
     const Clock &clock)
 {
     /* fill converting configuration */
+    GpuBufferSlice vertices, indices;
     {
         static constexpr std::size_t MAX_VERTEX_BUFFER = 512 * 1024;
         static constexpr std::size_t MAX_INDEX_BUFFER = 128 * 1024;
-        mVertexBuffer->allocate(MAX_VERTEX_BUFFER);
-        mIndexBuffer->allocate(MAX_INDEX_BUFFER);
-        auto vtx_dst = mVertexBuffer->mappedMemory();
-        auto idx_dst = mIndexBuffer->mappedMemory();
+        // nuklear requires the size of the buffers before conversion.
+        // convert into scratch memory and upload only the used part.
+        auto vtx_dst = FrameArena::allocate(MAX_VERTEX_BUFFER);
+        auto idx_dst = FrameArena::allocate(MAX_INDEX_BUFFER);
 
         static const nk_draw_vertex_layout_element vertex_layout[] = {
             { NK_VERTEX_POSITION, NK_FORMAT_FLOAT,
@@ -282,6 +293,12 @@ std::shared_ptr<usagi::GraphicsCommandList> usagi::NuklearSubsystem::render(
             nk_buffer_init_fixed(&vbuf, vtx_dst, MAX_VERTEX_BUFFER);
             nk_buffer_init_fixed(&ibuf, idx_dst, MAX_INDEX_BUFFER);
             nk_convert(&mContext, &mCommandList, &vbuf, &ibuf, &config);
+
+            auto gpu = mGame->runtime()->gpu();
+            vertices = gpu->allocateTransient(vbuf.allocated);
+            indices = gpu->allocateTransient(ibuf.allocated);
+            memcpy(vertices.mapped, vtx_dst, vbuf.allocated);
+            memcpy(indices.mapped, idx_dst, ibuf.allocated);
         }
     }
 
@@ -297,12 +314,10 @@ std::shared_ptr<usagi::GraphicsCommandList> usagi::NuklearSubsystem::render(
 
     // Bind Vertex And Index Buffer
     {
-        cmd_list->bindVertexBuffer(0, mVertexBuffer, 0);
-        cmd_list->bindIndexBuffer(mIndexBuffer, 0,
+        cmd_list->bindVertexBuffer(0, vertices.buffer, vertices.offset);
+        cmd_list->bindIndexBuffer(indices.buffer, indices.offset,
             GraphicsIndexType::UINT16
         );
-        mVertexBuffer->release();
-        mIndexBuffer->release();
     }
 
     const auto fs = mFrameBufferSizeFunc();
@@ -317,10 +332,10 @@ std::shared_ptr<usagi::GraphicsCommandList> usagi::NuklearSubsystem::render(
         Vector2f scale { 2, 2 };
         scale = scale.cwiseQuotient(fs);
         Vector2f translate = { -1, -1 };
-        cmd_list->setConstant(ShaderStage::VERTEX,
-            "scale", scale.data(), sizeof(scale));
-        cmd_list->setConstant(ShaderStage::VERTEX,
-            "translate", translate.data(), sizeof(translate));
+        cmd_list->setConstants({
+            { mScaleConstant, scale.data() },
+            { mTranslateConstant, translate.data() },
+        });
     }
 
     /* iterate over and execute each draw command */
@@ -343,9 +358,18 @@ std::shared_ptr<usagi::GraphicsCommandList> usagi::NuklearSubsystem::render(
             }
         );
 
-        cmd_list->bindResourceSet(1, {
-            texture_view->shared_from_this()
-        });
+        if(mBindless)
+        {
+            const auto index = texture_view->bindlessIndex();
+            cmd_list->retainResource(texture_view->shared_from_this());
+            cmd_list->setConstant(mTextureIndexConstant, &index);
+        }
+        else
+        {
+            cmd_list->bindResourceSet(1, {
+                texture_view->shared_from_this()
+            });
+        }
 
         cmd_list->drawIndexedInstanced(
             cmd->elem_count, // index count
@@ -7,6 +7,7 @@
 #include <Usagi/Runtime/Input/Mouse/MouseEventListener.hpp>
 #include <Usagi/Runtime/Window/WindowEventListener.hpp>
 #include <Usagi/Game/CollectionSubsystem.hpp>
+#include <Usagi/Runtime/Graphics/Shader/ShaderConstantHandle.hpp>
 
 #include "Nuklear.hpp"
 #include "NuklearComponent.hpp"
@@ -50,12 +51,15 @@ class NuklearSubsystem
     void processElements(const Clock &clock);
 
 	std::shared_ptr<GraphicsPipeline> mPipeline;
+    ShaderConstantHandle mScaleConstant;
+    ShaderConstantHandle mTranslateConstant;
+    ShaderConstantHandle mTextureIndexConstant;
 	std::shared_ptr<GpuCommandPool> mCommandPool;
-    std::shared_ptr<GpuBuffer> mVertexBuffer;
-	std::shared_ptr<GpuBuffer> mIndexBuffer;
     std::shared_ptr<GpuImage> mFontTexture;
     std::shared_ptr<GpuImageView> mFontTextureView;
     std::shared_ptr<GpuSampler> mSampler;
+    // select textures with push constants instead of resource sets
+    bool mBindless = false;
 
     void setup();
 
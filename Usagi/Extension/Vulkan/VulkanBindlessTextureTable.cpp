@@ -0,0 +1,105 @@
+﻿#include "VulkanBindlessTextureTable.hpp"
+
+#include <Usagi/Core/Logging.hpp>
+
+usagi::VulkanBindlessTextureTable::VulkanBindlessTextureTable(
+    vk::Device device,
+    const std::uint32_t capacity)
+    : mDevice(device)
+    , mCapacity(capacity)
+    , mSlots(capacity)
+{
+    LOG(info, "Creating bindless texture table with {} slots", mCapacity);
+
+    vk::DescriptorSetLayoutBinding binding;
+    binding.setBinding(0);
+    binding.setDescriptorType(vk::DescriptorType::eSampledImage);
+    binding.setDescriptorCount(mCapacity);
+    binding.setStageFlags(vk::ShaderStageFlagBits::eAll);
+
+    // unused slots may hold destroyed views, and slots may be written while
+    // the set is in use by pending jobs.
+    const vk::DescriptorBindingFlagsEXT binding_flags =
+        vk::DescriptorBindingFlagBitsEXT::ePartiallyBound |
+        vk::DescriptorBindingFlagBitsEXT::eUpdateAfterBind |
+        vk::DescriptorBindingFlagBitsEXT::eUpdateUnusedWhilePending;
+    vk::DescriptorSetLayoutBindingFlagsCreateInfoEXT binding_flags_info;
+    binding_flags_info.setBindingCount(1);
+    binding_flags_info.setPBindingFlags(&binding_flags);
+
+    vk::DescriptorSetLayoutCreateInfo layout_info;
+    layout_info.setFlags(
+        vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPoolEXT);
+    layout_info.setBindingCount(1);
+    layout_info.setPBindings(&binding);
+    layout_info.setPNext(&binding_flags_info);
+    mLayout = mDevice.createDescriptorSetLayoutUnique(layout_info);
+
+    const vk::DescriptorPoolSize pool_size {
+        vk::DescriptorType::eSampledImage, mCapacity
+    };
+    vk::DescriptorPoolCreateInfo pool_info;
+    pool_info.setFlags(
+        vk::DescriptorPoolCreateFlagBits::eUpdateAfterBindEXT);
+    pool_info.setMaxSets(1);
+    pool_info.setPoolSizeCount(1);
+    pool_info.setPPoolSizes(&pool_size);
+    mPool = mDevice.createDescriptorPoolUnique(pool_info);
+
+    vk::DescriptorSetAllocateInfo set_info;
+    set_info.setDescriptorPool(mPool.get());
+    set_info.setDescriptorSetCount(1);
+    const auto vk_layout = mLayout.get();
+    set_info.setPSetLayouts(&vk_layout);
+    mSet = mDevice.allocateDescriptorSets(set_info).front();
+}
+
+std::uint32_t usagi::VulkanBindlessTextureTable::allocate(
+    vk::ImageView view,
+    const vk::ImageLayout layout)
+{
+    std::uint32_t index;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        index = mSlots.allocate();
+    }
+
+    vk::DescriptorImageInfo image_info;
+    image_info.setImageView(view);
+    image_info.setImageLayout(layout);
+
+    vk::WriteDescriptorSet write;
+    write.setDstSet(mSet);
+    write.setDstBinding(0);
+    write.setDstArrayElement(index);
+    write.setDescriptorCount(1);
+    write.setDescriptorType(vk::DescriptorType::eSampledImage);
+    write.setPImageInfo(&image_info);
+    // different slots of the set may be updated concurrently
+    mDevice.updateDescriptorSets({ write }, { });
+
+    return index;
+}
+
+void usagi::VulkanBindlessTextureTable::release(const std::uint32_t index)
+{
+    std::lock_guard<std::mutex> lock(mLock);
+
+    mSlots.release(index);
+}
+
+std::vector<std::uint32_t>
+    usagi::VulkanBindlessTextureTable::takeReleasedSlots()
+{
+    std::lock_guard<std::mutex> lock(mLock);
+
+    return mSlots.takeReleasedSlots();
+}
+
+void usagi::VulkanBindlessTextureTable::freeSlots(
+    const std::vector<std::uint32_t> &slots)
+{
+    std::lock_guard<std::mutex> lock(mLock);
+
+    mSlots.freeSlots(slots);
+}
@@ -0,0 +1,65 @@
+﻿#pragma once
+
+#include <mutex>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+#include <Usagi/Runtime/Graphics/BindlessSlotAllocator.hpp>
+#include <Usagi/Utility/Noncopyable.hpp>
+
+namespace usagi
+{
+/**
+ * \brief A descriptor set holding a large, partially bound array of sampled
+ * images. Each sampled image view takes a slot in the array when created,
+ * so shaders can select textures by indices passed in push constants or
+ * instance data without binding descriptor sets per draw.
+ *
+ * Requires the update-after-bind, partially-bound and runtime array
+ * features of VK_EXT_descriptor_indexing.
+ */
+class VulkanBindlessTextureTable : Noncopyable
+{
+    vk::Device mDevice;
+    const std::uint32_t mCapacity;
+
+    vk::UniqueDescriptorSetLayout mLayout;
+    vk::UniqueDescriptorPool mPool;
+    vk::DescriptorSet mSet;
+
+    std::mutex mLock;
+    BindlessSlotAllocator mSlots;
+
+public:
+    VulkanBindlessTextureTable(vk::Device device, std::uint32_t capacity);
+
+    /**
+     * \brief Take a slot in the array and write the view into it. Because
+     * the set is updated after bind, this is allowed while jobs using other
+     * slots are pending.
+     * \param view
+     * \param layout The layout of the image when sampled.
+     * \return The index of the slot.
+     */
+    std::uint32_t allocate(vk::ImageView view, vk::ImageLayout layout);
+
+    /**
+     * \brief Release the slot of a destroyed view. It is not reused until
+     * the frame in which it is released is retired.
+     */
+    void release(std::uint32_t index);
+
+    /**
+     * \brief Take the slots released since the last call. The device calls
+     * this when advancing to the next frame and frees them along with the
+     * frame.
+     */
+    std::vector<std::uint32_t> takeReleasedSlots();
+    void freeSlots(const std::vector<std::uint32_t> &slots);
+
+    vk::DescriptorSetLayout layout() const { return mLayout.get(); }
+    vk::DescriptorSet set() const { return mSet; }
+    std::uint32_t capacity() const { return mCapacity; }
+};
+}
@@ -1,20 +1,65 @@
 ﻿#include "VulkanBufferAllocation.hpp"
 
+#include <algorithm>
+
+#include <Usagi/Runtime/Memory/MemoryTracker.hpp>
+
 #include "VulkanMemoryPool.hpp"
+#include "VulkanMemoryBudget.hpp"
+#include "VulkanGpuDevice.hpp"
 
 usagi::VulkanBufferAllocation::VulkanBufferAllocation(
     VulkanBufferMemoryPoolBase *pool,
+    VulkanMemoryBlock *block,
     std::size_t offset,
     std::size_t size,
     void *apped_address)
     : mPool(pool)
+    , mBlock(block)
     , mOffset(offset)
     , mSize(size)
     , mMappedAddress(apped_address)
 {
+    if(MemoryTracker::enabled() && (mScopeTag = MemoryTracker::currentScope()))
+        mScopeTag->recordAllocation(mSize);
 }
 
 usagi::VulkanBufferAllocation::~VulkanBufferAllocation()
 {
-    mPool->deallocate(mOffset);
+    if(mScopeTag) mScopeTag->recordDeallocation(mSize);
+    mPool->deallocate(mBlock, mOffset);
+}
+
+vk::Buffer usagi::VulkanBufferAllocation::buffer() const
+{
+    return mBlock->buffer.get();
+}
+
+vk::DeviceMemory usagi::VulkanBufferAllocation::memory() const
+{
+    return mBlock->memory.get();
+}
+
+void usagi::VulkanBufferAllocation::flush(
+    const std::size_t offset,
+    const std::size_t size) const
+{
+    const auto device = mBlock->device;
+    const auto flags = device->memoryBudget()->properties().memoryTypes[
+        mBlock->memory_type].propertyFlags;
+    if(flags & vk::MemoryPropertyFlagBits::eHostCoherent)
+        return;
+
+    // the range is relative to the memory block and must be aligned to the
+    // atom size unless it ends at the end of the block
+    const auto atom = device->nonCoherentAtomSize();
+    const auto begin = (mOffset + offset) / atom * atom;
+    const auto end = std::min(
+        (mOffset + offset + size + atom - 1) / atom * atom, mBlock->size);
+
+    vk::MappedMemoryRange range;
+    range.setMemory(mBlock->memory.get());
+    range.setOffset(begin);
+    range.setSize(end - begin);
+    device->device().flushMappedMemoryRanges({ range });
 }
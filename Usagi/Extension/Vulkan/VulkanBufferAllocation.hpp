@@ -7,25 +7,44 @@
 namespace usagi
 {
 class VulkanBufferMemoryPoolBase;
+struct VulkanMemoryBlock;
+class MemoryTag;
 
 class VulkanBufferAllocation : public VulkanBatchResource
 {
     VulkanBufferMemoryPoolBase * mPool = nullptr;
+    VulkanMemoryBlock * mBlock = nullptr;
     const std::size_t mOffset, mSize;
     // nullptr if the buffer is not mapped
     void * const mMappedAddress = nullptr;
+    // the memory tag scope in which the allocation is made
+    std::shared_ptr<MemoryTag> mScopeTag;
 
 public:
     VulkanBufferAllocation(
         VulkanBufferMemoryPoolBase *pool,
+        VulkanMemoryBlock *block,
         std::size_t offset,
         std::size_t size,
         void *apped_address);
     ~VulkanBufferAllocation();
 
     VulkanBufferMemoryPoolBase * pool() const { return mPool; }
+    VulkanMemoryBlock * block() const { return mBlock; }
+    vk::Buffer buffer() const;
+    vk::DeviceMemory memory() const;
     std::size_t offset() const { return mOffset; }
     std::size_t size() const { return mSize; }
     void * mappedAddress() const { return mMappedAddress; }
+
+    /**
+     * \brief Make the host writes to the range of the mapped memory visible
+     * to the device. No-op if the memory is host-coherent. The range is
+     * widened to the non-coherent atom size within the memory block.
+     * \param offset Relative to the allocation.
+     * \param size
+     */
+    void flush(std::size_t offset, std::size_t size) const;
+    void flush() const { flush(0, mSize); }
 };
 }
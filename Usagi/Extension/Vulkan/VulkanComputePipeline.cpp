@@ -0,0 +1,13 @@
+﻿#include "VulkanComputePipeline.hpp"
+
+usagi::ShaderConstantHandle usagi::VulkanComputePipeline::constantHandle(
+    const char *name) const
+{
+    const auto field = queryConstantInfo(ShaderStage::COMPUTE, name);
+
+    ShaderConstantHandle handle;
+    handle.stage = ShaderStage::COMPUTE;
+    handle.offset = field.offset;
+    handle.size = field.size;
+    return handle;
+}
@@ -0,0 +1,34 @@
+﻿#pragma once
+
+#include <Usagi/Runtime/Graphics/ComputePipeline.hpp>
+
+#include "VulkanPipeline.hpp"
+
+namespace usagi
+{
+class VulkanComputePipeline
+    : public ComputePipeline
+    , public VulkanPipeline
+{
+public:
+    VulkanComputePipeline(
+        vk::UniquePipeline vk_pipeline,
+        vk::UniquePipelineLayout vk_pipeline_layout,
+        DescriptorSetLayoutBindingMap layout_bindings,
+        DescriptorSetLayoutMap layout,
+        std::optional<std::uint32_t> bindless_set,
+        PushConstantFieldMap constant_field_map)
+        : VulkanPipeline(
+            vk::PipelineBindPoint::eCompute,
+            std::move(vk_pipeline),
+            std::move(vk_pipeline_layout),
+            std::move(layout_bindings),
+            std::move(layout),
+            bindless_set,
+            std::move(constant_field_map))
+    {
+    }
+
+    ShaderConstantHandle constantHandle(const char *name) const override;
+};
+}
@@ -0,0 +1,129 @@
+﻿#include "VulkanComputePipelineCompiler.hpp"
+
+#include <cstring>
+#include <stdexcept>
+
+#include <fmt/format.h>
+
+#include <Usagi/Runtime/Graphics/Shader/SpirvBinary.hpp>
+#include <Usagi/Utility/Hash.hpp>
+#include <Usagi/Core/Logging.hpp>
+
+#include "VulkanGpuDevice.hpp"
+#include "VulkanComputePipeline.hpp"
+#include "VulkanPipelineLayoutBuilder.hpp"
+
+usagi::VulkanComputePipelineCompiler::VulkanComputePipelineCompiler(
+    VulkanGpuDevice *device)
+    : mDevice { device }
+{
+}
+
+void usagi::VulkanComputePipelineCompiler::setShader(
+    std::shared_ptr<SpirvBinary> shader)
+{
+    mShader = std::move(shader);
+}
+
+void usagi::VulkanComputePipelineCompiler::setSpecializationConstant(
+    const std::uint32_t constant_id,
+    const void *data,
+    const std::size_t size)
+{
+    if(size != 4 && size != 8)
+        throw std::logic_error(
+            "Specialization constants must be 32 or 64 bits in size.");
+
+    SpecializationConstant c;
+    std::memcpy(&c.data, data, size);
+    c.size = static_cast<std::uint32_t>(size);
+    mSpecializationConstants[constant_id] = c;
+}
+
+std::string usagi::VulkanComputePipelineCompiler::pipelineKey() const
+{
+    auto &bytecodes = mShader->bytecodes();
+    // the prefix keeps the keys apart from those of graphics pipelines
+    auto key = fmt::format("compute;S{};", sha256({
+        reinterpret_cast<const char*>(bytecodes.data()),
+        bytecodes.size() * sizeof(SpirvBinary::Bytecode)
+    }));
+    for(auto &&c : mSpecializationConstants)
+        key += fmt::format("C{}:{}:{};", c.first, c.second.size, c.second.data);
+    return key;
+}
+
+std::shared_ptr<usagi::ComputePipeline>
+    usagi::VulkanComputePipelineCompiler::compile()
+{
+    LOG(info, "Compiling compute pipeline...");
+
+    if(!mShader)
+        throw std::logic_error("Compute shader is not set.");
+
+    auto key = pipelineKey();
+    const auto registry = mDevice->pipelineCache();
+    if(auto existing =
+        std::dynamic_pointer_cast<VulkanComputePipeline>(registry->find(key)))
+    {
+        LOG(info, "Reusing an identical pipeline.");
+        return std::move(existing);
+    }
+
+    const auto vk_device = mDevice->device();
+
+    auto &bytecodes = mShader->bytecodes();
+    vk::ShaderModuleCreateInfo module_info;
+    module_info.setCodeSize(bytecodes.size() * sizeof(SpirvBinary::Bytecode));
+    module_info.setPCode(bytecodes.data());
+    // only needed during the creation of the pipeline
+    const auto module = vk_device.createShaderModuleUnique(module_info);
+
+    std::vector<vk::SpecializationMapEntry> entries;
+    std::vector<std::uint8_t> data;
+    for(auto &&c : mSpecializationConstants)
+    {
+        entries.emplace_back(c.first,
+            static_cast<uint32_t>(data.size()), c.second.size);
+        const auto offset = data.size();
+        data.resize(offset + c.second.size);
+        std::memcpy(data.data() + offset, &c.second.data, c.second.size);
+    }
+    vk::SpecializationInfo spec;
+    spec.setMapEntryCount(static_cast<uint32_t>(entries.size()));
+    spec.setPMapEntries(entries.data());
+    spec.setDataSize(data.size());
+    spec.setPData(data.data());
+
+    vk::PipelineShaderStageCreateInfo stage_info;
+    stage_info.setStage(vk::ShaderStageFlagBits::eCompute);
+    stage_info.setModule(module.get());
+    stage_info.setPName("main");
+    if(!entries.empty())
+        stage_info.setPSpecializationInfo(&spec);
+
+    LOG(info, "Generating pipeline layout...");
+
+    VulkanPipelineLayoutBuilder ctx { mDevice };
+    ctx.reflect(ShaderStage::COMPUTE, mShader->reflection());
+    auto pipeline_layout = ctx.createPipelineLayout();
+
+    vk::ComputePipelineCreateInfo pipeline_info;
+    pipeline_info.setStage(stage_info);
+    pipeline_info.setLayout(pipeline_layout.get());
+
+    auto pipeline = vk_device.createComputePipelineUnique(
+        registry->cache(), pipeline_info);
+    auto wrapped_pipeline = std::make_shared<VulkanComputePipeline>(
+        std::move(pipeline),
+        std::move(pipeline_layout),
+        std::move(ctx.desc_set_layout_bindings),
+        std::move(ctx.desc_set_layouts),
+        ctx.bindless_set,
+        std::move(ctx.push_constant_field_map)
+    );
+
+    registry->add(std::move(key), wrapped_pipeline);
+
+    return std::move(wrapped_pipeline);
+}
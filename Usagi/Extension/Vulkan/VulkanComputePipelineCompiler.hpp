@@ -0,0 +1,41 @@
+﻿#pragma once
+
+#include <map>
+
+#include <vulkan/vulkan.hpp>
+
+#include <Usagi/Runtime/Graphics/ComputePipelineCompiler.hpp>
+
+namespace usagi
+{
+class VulkanGpuDevice;
+
+class VulkanComputePipelineCompiler final : public ComputePipelineCompiler
+{
+    VulkanGpuDevice *mDevice = nullptr;
+
+    std::shared_ptr<SpirvBinary> mShader;
+
+    struct SpecializationConstant
+    {
+        std::uint64_t data = 0;
+        std::uint32_t size = 0;
+    };
+    std::map<std::uint32_t, SpecializationConstant> mSpecializationConstants;
+
+    std::string pipelineKey() const;
+
+public:
+    explicit VulkanComputePipelineCompiler(VulkanGpuDevice *device);
+
+    void setShader(std::shared_ptr<SpirvBinary> shader) override;
+
+    using ComputePipelineCompiler::setSpecializationConstant;
+    void setSpecializationConstant(
+        std::uint32_t constant_id,
+        const void *data,
+        std::size_t size) override;
+
+    std::shared_ptr<ComputePipeline> compile() override;
+};
+}
@@ -0,0 +1,164 @@
+﻿#include "VulkanDescriptorCache.hpp"
+
+#include <cstring>
+
+#include <Usagi/Core/Logging.hpp>
+#include <Usagi/Runtime/Graphics/ShaderResource.hpp>
+#include <Usagi/Utility/TypeCast.hpp>
+
+#include "VulkanBatchResource.hpp"
+
+namespace
+{
+// FNV-1a
+std::size_t hashBytes(const void *data, const std::size_t size,
+    std::size_t hash = 14695981039346656037ull)
+{
+    const auto bytes = static_cast<const unsigned char *>(data);
+    for(std::size_t i = 0; i < size; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+}
+
+usagi::VulkanDescriptorData usagi::makeDescriptorData(
+    const VulkanResourceInfo &info)
+{
+    VulkanDescriptorData data;
+    std::memset(&data, 0, sizeof(data));
+    if(const auto image = std::get_if<vk::DescriptorImageInfo>(&info))
+        data.image = *image;
+    else
+        data.buffer = std::get<vk::DescriptorBufferInfo>(info);
+    return data;
+}
+
+usagi::VulkanDescriptorCache::VulkanDescriptorCache(vk::Device device)
+    : mDevice(device)
+{
+}
+
+void usagi::VulkanDescriptorCache::createPool()
+{
+    // sized for the sets used by a frame of UI, debug drawing and a few
+    // compute passes
+    constexpr std::uint32_t MAX_SETS = 256;
+
+    vk::DescriptorPoolCreateInfo info;
+    info.setMaxSets(MAX_SETS);
+    std::initializer_list<vk::DescriptorPoolSize> sizes {
+        { vk::DescriptorType::eSampler, MAX_SETS },
+        { vk::DescriptorType::eSampledImage, MAX_SETS },
+        { vk::DescriptorType::eCombinedImageSampler, MAX_SETS },
+        { vk::DescriptorType::eUniformBuffer, MAX_SETS },
+        { vk::DescriptorType::eStorageBuffer, MAX_SETS },
+        { vk::DescriptorType::eStorageImage, MAX_SETS },
+    };
+    info.setPoolSizeCount(static_cast<uint32_t>(sizes.size()));
+    info.setPPoolSizes(sizes.begin());
+    mPools.push_back(mDevice.createDescriptorPoolUnique(info));
+}
+
+vk::DescriptorSet usagi::VulkanDescriptorCache::allocateSet(
+    vk::DescriptorSetLayout layout)
+{
+    while(true)
+    {
+        if(mCurrentPool == mPools.size())
+        {
+            createPool();
+            LOG(info, "Descriptor cache grows to {} pools", mPools.size());
+        }
+
+        vk::DescriptorSetAllocateInfo info;
+        info.setDescriptorPool(mPools[mCurrentPool].get());
+        info.setDescriptorSetCount(1);
+        info.setPSetLayouts(&layout);
+
+        vk::DescriptorSet set;
+        const auto result = mDevice.allocateDescriptorSets(&info, &set);
+        switch(result)
+        {
+            case vk::Result::eSuccess:
+                return set;
+            case vk::Result::eErrorFragmentedPool:
+            case vk::Result::eErrorOutOfPoolMemory:
+                // try the next pool
+                ++mCurrentPool;
+                break;
+            default:
+                vk::throwResultException(result,
+                    "vk::Device::allocateDescriptorSets");
+        }
+    }
+}
+
+void usagi::VulkanDescriptorCache::retain(
+    Entry &entry,
+    const std::shared_ptr<ShaderResource> *resources,
+    const std::size_t resource_count)
+{
+    for(std::size_t i = 0; i < resource_count; ++i)
+    {
+        auto batch_res =
+            dynamic_pointer_cast_throw<VulkanBatchResource>(resources[i]);
+        batch_res->appendAdditionalResources(mResources);
+        mResources.push_back(std::move(batch_res));
+    }
+    entry.retained = true;
+}
+
+vk::DescriptorSet usagi::VulkanDescriptorCache::acquire(
+    vk::DescriptorSetLayout layout,
+    vk::DescriptorUpdateTemplate update_template,
+    const VulkanDescriptorData *data,
+    const std::size_t count,
+    const std::shared_ptr<ShaderResource> *resources,
+    const std::size_t resource_count)
+{
+    const auto data_size = count * sizeof(VulkanDescriptorData);
+    const VkDescriptorSetLayout vk_layout = layout;
+    const auto hash = hashBytes(data, data_size,
+        hashBytes(&vk_layout, sizeof(vk_layout)));
+
+    std::lock_guard<std::mutex> lock(mLock);
+
+    const auto range = mSets.equal_range(hash);
+    for(auto i = range.first; i != range.second; ++i)
+    {
+        auto &entry = i->second;
+        if(entry.layout == layout && entry.data.size() == count &&
+            std::memcmp(entry.data.data(), data, data_size) == 0)
+        {
+            if(!entry.retained && resources)
+                retain(entry, resources, resource_count);
+            return entry.set;
+        }
+    }
+
+    Entry entry;
+    entry.layout = layout;
+    entry.data.assign(data, data + count);
+    entry.set = allocateSet(layout);
+    mDevice.updateDescriptorSetWithTemplate(
+        entry.set, update_template, entry.data.data());
+    if(resources)
+        retain(entry, resources, resource_count);
+    const auto set = entry.set;
+    mSets.emplace(hash, std::move(entry));
+    return set;
+}
+
+void usagi::VulkanDescriptorCache::reset()
+{
+    std::lock_guard<std::mutex> lock(mLock);
+
+    for(std::size_t i = 0; i < mPools.size() && i <= mCurrentPool; ++i)
+        mDevice.resetDescriptorPool(mPools[i].get());
+    mCurrentPool = 0;
+    mSets.clear();
+    mResources.clear();
+}
@@ -0,0 +1,102 @@
+﻿#pragma once
+
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+#include <Usagi/Utility/Noncopyable.hpp>
+
+#include "VulkanResourceInfo.hpp"
+
+namespace usagi
+{
+class ShaderResource;
+class VulkanBatchResource;
+
+/**
+ * \brief An entry of the data passed to descriptor update templates. The
+ * entries are indexed by binding numbers.
+ */
+union VulkanDescriptorData
+{
+    VkDescriptorImageInfo image;
+    VkDescriptorBufferInfo buffer;
+};
+
+/**
+ * \brief Convert the descriptor filled by a shader resource. The unused
+ * bytes are zeroed so the data can be hashed and compared bytewise.
+ */
+VulkanDescriptorData makeDescriptorData(const VulkanResourceInfo &info);
+
+/**
+ * \brief Caches the descriptor sets used in a frame by their layouts and
+ * contents. Binding the same resources again returns the same set without
+ * touching the driver. The sets are allocated from pools which are reset
+ * in bulk when the frame is retired, along with the resources referenced
+ * by the sets.
+ */
+class VulkanDescriptorCache : Noncopyable
+{
+    vk::Device mDevice;
+
+    std::vector<vk::UniqueDescriptorPool> mPools;
+    // pools before this one are full
+    std::size_t mCurrentPool = 0;
+
+    struct Entry
+    {
+        vk::DescriptorSetLayout layout;
+        std::vector<VulkanDescriptorData> data;
+        vk::DescriptorSet set;
+        // whether the resources are retained by the cache
+        bool retained = false;
+    };
+    std::unordered_multimap<std::size_t, Entry> mSets;
+    // keeps the resources referenced by the sets alive
+    std::vector<std::shared_ptr<VulkanBatchResource>> mResources;
+
+    std::mutex mLock;
+
+    void createPool();
+    vk::DescriptorSet allocateSet(vk::DescriptorSetLayout layout);
+    void retain(
+        Entry &entry,
+        const std::shared_ptr<ShaderResource> *resources,
+        std::size_t resource_count);
+
+public:
+    explicit VulkanDescriptorCache(vk::Device device);
+
+    /**
+     * \brief Get a descriptor set holding the given descriptors. On a cache
+     * miss, a new set is allocated and written using the update template.
+     * \param layout
+     * \param update_template Must be created for layout with the entries
+     * indexed by binding numbers.
+     * \param data
+     * \param count
+     * \param resources The resources which data is filled from. They are
+     * retained until the cache is reset. Can be nullptr if the caller keeps
+     * them alive while it uses the set, in which case they are retained
+     * when another caller passes them for the same set.
+     * \param resource_count
+     * \return
+     */
+    vk::DescriptorSet acquire(
+        vk::DescriptorSetLayout layout,
+        vk::DescriptorUpdateTemplate update_template,
+        const VulkanDescriptorData *data,
+        std::size_t count,
+        const std::shared_ptr<ShaderResource> *resources,
+        std::size_t resource_count);
+
+    /**
+     * \brief Free all the sets. The jobs using them must have finished.
+     */
+    void reset();
+};
+}
@@ -24,6 +24,8 @@ vk::ShaderStageFlagBits translate(ShaderStage stage)
             return vk::ShaderStageFlagBits::eVertex;
         case ShaderStage::FRAGMENT:
             return vk::ShaderStageFlagBits::eFragment;
+        case ShaderStage::COMPUTE:
+            return vk::ShaderStageFlagBits::eCompute;
         default:
             throw std::runtime_error("Invalid shader stage");
     }
@@ -223,6 +225,8 @@ vk::PipelineStageFlagBits translate(GraphicsPipelineStage stage)
     {
         case GraphicsPipelineStage::TOP_OF_PIPE:
             return vk::PipelineStageFlagBits::eTopOfPipe;
+        case GraphicsPipelineStage::DRAW_INDIRECT:
+            return vk::PipelineStageFlagBits::eDrawIndirect;
         case GraphicsPipelineStage::VERTEX_INPUT:
             return vk::PipelineStageFlagBits::eVertexInput;
         case GraphicsPipelineStage::VERTEX_SHADER:
@@ -237,6 +241,8 @@ vk::PipelineStageFlagBits translate(GraphicsPipelineStage stage)
             return vk::PipelineStageFlagBits::eLateFragmentTests;
         case GraphicsPipelineStage::COLOR_ATTACHMENT_OUTPUT:
             return vk::PipelineStageFlagBits::eColorAttachmentOutput;
+        case GraphicsPipelineStage::COMPUTE_SHADER:
+            return vk::PipelineStageFlagBits::eComputeShader;
         case GraphicsPipelineStage::TRANSFER:
             return vk::PipelineStageFlagBits::eTransfer;
         case GraphicsPipelineStage::BOTTOM_OF_PIPE:
@@ -257,6 +263,10 @@ vk::BufferUsageFlagBits translate(const GpuBufferUsage usage)
             return vk::BufferUsageFlagBits::eIndexBuffer;
         case GpuBufferUsage::UNIFORM:
             return vk::BufferUsageFlagBits::eUniformBuffer;
+        case GpuBufferUsage::STORAGE:
+            return vk::BufferUsageFlagBits::eStorageBuffer;
+        case GpuBufferUsage::INDIRECT:
+            return vk::BufferUsageFlagBits::eIndirectBuffer;
         default: throw std::runtime_error("Invalid GpuBufferUsage.");
     }
 }
@@ -345,17 +355,19 @@ USAGI_ENUM_TRANSLATION_NS(usagi::vulkan, GpuBufferFormat, vk::Format, 14,
     )
 )
 
-USAGI_ENUM_TRANSLATION_NS(usagi::vulkan, GpuImageUsage, vk::ImageUsageFlagBits, 4,
+USAGI_ENUM_TRANSLATION_NS(usagi::vulkan, GpuImageUsage, vk::ImageUsageFlagBits, 5,
 (
     GpuImageUsage::SAMPLED,
     GpuImageUsage::COLOR_ATTACHMENT,
     GpuImageUsage::DEPTH_STENCIL_ATTACHMENT,
     GpuImageUsage::INPUT_ATTACHMENT,
+    GpuImageUsage::STORAGE,
 ), (
     vk::ImageUsageFlagBits::eSampled,
     vk::ImageUsageFlagBits::eColorAttachment,
     vk::ImageUsageFlagBits::eDepthStencilAttachment,
     vk::ImageUsageFlagBits::eInputAttachment,
+    vk::ImageUsageFlagBits::eStorage,
 ))
 
 USAGI_ENUM_TRANSLATION_NS(usagi::vulkan, CompareOp, vk::CompareOp, 8,
@@ -379,7 +391,7 @@ USAGI_ENUM_TRANSLATION_NS(usagi::vulkan, CompareOp, vk::CompareOp, 8,
     vk::CompareOp::eAlways,
 ))
 
-USAGI_ENUM_TRANSLATION_NS(usagi::vulkan, GpuImageLayout, vk::ImageLayout, 8,
+USAGI_ENUM_TRANSLATION_NS(usagi::vulkan, GpuImageLayout, vk::ImageLayout, 9,
 (
     GpuImageLayout::UNDEFINED,
     GpuImageLayout::PRESENT,
@@ -389,6 +401,7 @@ USAGI_ENUM_TRANSLATION_NS(usagi::vulkan, GpuImageLayout, vk::ImageLayout, 8,
     GpuImageLayout::DEPTH_STENCIL_ATTACHMENT,
     GpuImageLayout::SHADER_READ_ONLY,
     GpuImageLayout::PREINITIALIZED,
+    GpuImageLayout::GENERAL,
 ), (
     vk::ImageLayout::eUndefined,
     vk::ImageLayout::ePresentSrcKHR,
@@ -398,4 +411,5 @@ USAGI_ENUM_TRANSLATION_NS(usagi::vulkan, GpuImageLayout, vk::ImageLayout, 8,
     vk::ImageLayout::eDepthStencilAttachmentOptimal,
     vk::ImageLayout::eShaderReadOnlyOptimal,
     vk::ImageLayout::ePreinitialized,
+    vk::ImageLayout::eGeneral,
 ))
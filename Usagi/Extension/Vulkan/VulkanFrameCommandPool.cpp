@@ -0,0 +1,60 @@
+﻿#include "VulkanFrameCommandPool.hpp"
+
+usagi::VulkanFrameCommandPool::VulkanFrameCommandPool(
+    vk::Device device,
+    const std::uint32_t queue_family)
+    : mDevice(device)
+    , mQueueFamily(queue_family)
+{
+}
+
+usagi::VulkanFrameCommandPool::ThreadPool &
+    usagi::VulkanFrameCommandPool::threadPool()
+{
+    std::lock_guard<std::mutex> lock(mLock);
+
+    auto &pool = mPools[std::this_thread::get_id()];
+    if(!pool.pool)
+    {
+        vk::CommandPoolCreateInfo info;
+        info.setQueueFamilyIndex(mQueueFamily);
+        // the command buffers are only used in one frame
+        info.setFlags(vk::CommandPoolCreateFlagBits::eTransient);
+        pool.pool = mDevice.createCommandPoolUnique(info);
+    }
+    // the elements of the map are not moved by insertions
+    return pool;
+}
+
+vk::CommandBuffer usagi::VulkanFrameCommandPool::allocate(
+    const vk::CommandBufferLevel level)
+{
+    auto &pool = threadPool();
+    const auto primary = level == vk::CommandBufferLevel::ePrimary;
+    auto &buffers = primary ? pool.primary : pool.secondary;
+    auto &used = primary ? pool.used_primary : pool.used_secondary;
+
+    if(used == buffers.size())
+    {
+        vk::CommandBufferAllocateInfo info;
+        info.setCommandPool(pool.pool.get());
+        info.setLevel(level);
+        info.setCommandBufferCount(1);
+        buffers.push_back(mDevice.allocateCommandBuffers(info).front());
+    }
+    return buffers[used++];
+}
+
+void usagi::VulkanFrameCommandPool::reset()
+{
+    std::lock_guard<std::mutex> lock(mLock);
+
+    for(auto &&p : mPools)
+    {
+        auto &pool = p.second;
+        if(pool.used_primary == 0 && pool.used_secondary == 0) continue;
+        mDevice.resetCommandPool(pool.pool.get(), { });
+        pool.used_primary = 0;
+        pool.used_secondary = 0;
+    }
+}
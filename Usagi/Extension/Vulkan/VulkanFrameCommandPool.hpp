@@ -0,0 +1,57 @@
+﻿#pragma once
+
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+#include <Usagi/Utility/Noncopyable.hpp>
+
+namespace usagi
+{
+/**
+ * \brief The command pools of a frame slot, one for each thread recording
+ * command lists, so that threads never share a pool. The command buffers
+ * are not freed individually but recycled by resetting the pools when the
+ * frame is retired.
+ */
+class VulkanFrameCommandPool : Noncopyable
+{
+    vk::Device mDevice;
+    std::uint32_t mQueueFamily;
+
+    struct ThreadPool
+    {
+        vk::UniqueCommandPool pool;
+        std::vector<vk::CommandBuffer> primary;
+        std::size_t used_primary = 0;
+        std::vector<vk::CommandBuffer> secondary;
+        std::size_t used_secondary = 0;
+    };
+
+    // only guards the map. each pool is only used by its own thread.
+    std::mutex mLock;
+    std::unordered_map<std::thread::id, ThreadPool> mPools;
+
+    ThreadPool & threadPool();
+
+public:
+    VulkanFrameCommandPool(vk::Device device, std::uint32_t queue_family);
+
+    /**
+     * \brief Get a command buffer from the pool of the calling thread,
+     * which must also be the thread recording it.
+     * \param level
+     * \return
+     */
+    vk::CommandBuffer allocate(vk::CommandBufferLevel level);
+
+    /**
+     * \brief Recycle all command buffers. No thread may be recording with
+     * the pools.
+     */
+    void reset();
+};
+}
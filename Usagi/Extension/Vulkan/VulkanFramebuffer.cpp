@@ -7,33 +7,27 @@
 
 usagi::VulkanFramebuffer::VulkanFramebuffer(
     VulkanGpuDevice *device,
+    std::shared_ptr<VulkanRenderPass> render_pass,
     Vector2u32 size,
     std::vector<std::shared_ptr<VulkanGpuImageView>> views)
     : mDevice(device)
+    , mRenderPass(std::move(render_pass))
     , mSize(std::move(size))
     , mViews(std::move(views))
 {
-}
-
-void usagi::VulkanFramebuffer::create(
-    std::shared_ptr<VulkanRenderPass> render_pass)
-{
-    assert(!mFramebuffer);
-
-    auto vk_views = vulkan::transformObjects(mViews,
+    const auto vk_views = vulkan::transformObjectsFrame(mViews,
         [&](auto &&v) {
             return v->view();
         }
     );
 
     vk::FramebufferCreateInfo fb_info;
-    fb_info.setRenderPass(render_pass->renderPass());
+    fb_info.setRenderPass(mRenderPass->renderPass());
     fb_info.setAttachmentCount(static_cast<uint32_t>(vk_views.size()));
     fb_info.setPAttachments(vk_views.data());
     fb_info.setWidth(mSize.x());
     fb_info.setHeight(mSize.y());
     fb_info.setLayers(1);
 
-    mRenderPass = std::move(render_pass);
     mFramebuffer = mDevice->device().createFramebufferUnique(fb_info);
 }
@@ -19,23 +19,27 @@ class VulkanFramebuffer
     , public VulkanBatchResource
 {
     VulkanGpuDevice *mDevice = nullptr;
+    std::shared_ptr<VulkanRenderPass> mRenderPass;
     Vector2u32 mSize;
     std::vector<std::shared_ptr<VulkanGpuImageView>> mViews;
     vk::UniqueFramebuffer mFramebuffer;
-    std::shared_ptr<VulkanRenderPass> mRenderPass;
 
 public:
     VulkanFramebuffer(
         VulkanGpuDevice *device,
+        std::shared_ptr<VulkanRenderPass> render_pass,
         Vector2u32 size,
         std::vector<std::shared_ptr<VulkanGpuImageView>> views);
 
     Vector2u32 size() const override { return mSize; }
 
-    void create(std::shared_ptr<VulkanRenderPass> render_pass);
-
     vk::Framebuffer framebuffer() const { return mFramebuffer.get(); }
 
+    const std::shared_ptr<VulkanRenderPass> & renderPass() const
+    {
+        return mRenderPass;
+    }
+
     const std::vector<std::shared_ptr<VulkanGpuImageView>> & views() const
     {
         return mViews;
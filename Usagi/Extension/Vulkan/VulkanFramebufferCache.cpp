@@ -0,0 +1,76 @@
+﻿#include "VulkanFramebufferCache.hpp"
+
+#include <algorithm>
+
+#include <Usagi/Utility/TypeCast.hpp>
+
+#include "VulkanFramebuffer.hpp"
+#include "VulkanGpuImageView.hpp"
+#include "VulkanHelper.hpp"
+
+usagi::VulkanFramebufferCache::VulkanFramebufferCache(VulkanGpuDevice *device)
+    : mDevice(device)
+{
+}
+
+std::shared_ptr<usagi::VulkanFramebuffer>
+    usagi::VulkanFramebufferCache::acquire(
+    const std::shared_ptr<VulkanRenderPass> &render_pass,
+    const Vector2u32 &size,
+    const std::vector<std::shared_ptr<GpuImageView>> &views)
+{
+    const auto matches = [&](const VulkanFramebuffer &fb) {
+        if(fb.renderPass() != render_pass || fb.size() != size)
+            return false;
+        auto &fb_views = fb.views();
+        return std::equal(
+            fb_views.begin(), fb_views.end(),
+            views.begin(), views.end(),
+            [](auto &&a, auto &&b) {
+                return static_cast<GpuImageView*>(a.get()) == b.get();
+            }
+        );
+    };
+
+    std::lock_guard<std::mutex> lock(mLock);
+
+    for(auto &&e : mEntries)
+    {
+        if(matches(*e.framebuffer))
+        {
+            e.last_used_frame = mFrameIndex;
+            return e.framebuffer;
+        }
+    }
+
+    auto vk_views = vulkan::transformObjects(views,
+        [&](auto &&v) {
+            return dynamic_pointer_cast_throw<VulkanGpuImageView>(v);
+        }
+    );
+    Entry entry;
+    entry.framebuffer = std::make_shared<VulkanFramebuffer>(
+        mDevice, render_pass, size, std::move(vk_views));
+    entry.last_used_frame = mFrameIndex;
+    mEntries.push_back(entry);
+    return entry.framebuffer;
+}
+
+void usagi::VulkanFramebufferCache::nextFrame()
+{
+    std::lock_guard<std::mutex> lock(mLock);
+
+    ++mFrameIndex;
+    // the jobs still using the framebuffers hold their own references
+    mEntries.erase(std::remove_if(mEntries.begin(), mEntries.end(),
+        [&](auto &&e) {
+            return mFrameIndex - e.last_used_frame > MAX_UNUSED_FRAMES;
+        }), mEntries.end());
+}
+
+void usagi::VulkanFramebufferCache::clear()
+{
+    std::lock_guard<std::mutex> lock(mLock);
+
+    mEntries.clear();
+}
@@ -0,0 +1,54 @@
+﻿#pragma once
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <Usagi/Core/Math.hpp>
+#include <Usagi/Utility/Noncopyable.hpp>
+
+namespace usagi
+{
+class GpuImageView;
+class VulkanFramebuffer;
+class VulkanGpuDevice;
+class VulkanRenderPass;
+
+/**
+ * \brief Keeps the framebuffers used in recent frames so that rendering to
+ * the same attachments does not create new framebuffers every frame.
+ * Framebuffers not used for a number of frames are released.
+ */
+class VulkanFramebufferCache : Noncopyable
+{
+    VulkanGpuDevice *mDevice = nullptr;
+
+    struct Entry
+    {
+        std::shared_ptr<VulkanFramebuffer> framebuffer;
+        std::uint64_t last_used_frame = 0;
+    };
+
+    std::mutex mLock;
+    // only a few framebuffers are alive at a time so a linear search
+    // is sufficient
+    std::vector<Entry> mEntries;
+    std::uint64_t mFrameIndex = 0;
+
+public:
+    static constexpr std::uint64_t MAX_UNUSED_FRAMES = 8;
+
+    explicit VulkanFramebufferCache(VulkanGpuDevice *device);
+
+    std::shared_ptr<VulkanFramebuffer> acquire(
+        const std::shared_ptr<VulkanRenderPass> &render_pass,
+        const Vector2u32 &size,
+        const std::vector<std::shared_ptr<GpuImageView>> &views);
+
+    /**
+     * \brief Release the framebuffers not used recently.
+     */
+    void nextFrame();
+    void clear();
+};
+}
@@ -3,6 +3,7 @@
 #include "VulkanGpuDevice.hpp"
 #include "VulkanBufferAllocation.hpp"
 #include "VulkanMemoryPool.hpp"
+#include "VulkanGpuBufferRange.hpp"
 
 usagi::VulkanGpuBuffer::VulkanGpuBuffer(
     VulkanBufferMemoryPoolBase *pool,
@@ -12,28 +13,51 @@ usagi::VulkanGpuBuffer::VulkanGpuBuffer(
 {
 }
 
+usagi::VulkanGpuBuffer::VulkanGpuBuffer(
+    std::shared_ptr<VulkanBufferAllocation> allocation)
+    : mPool(allocation->pool())
+    // the memory of the pool supports all usages
+    , mUsage(GpuBufferUsage::VERTEX)
+    , mAllocation(std::move(allocation))
+{
+}
+
 void usagi::VulkanGpuBuffer::allocate(std::size_t size)
 {
+    mStagingAllocation.reset();
     mAllocation = mPool->allocate(size);
 }
 
 void * usagi::VulkanGpuBuffer::mappedMemory()
 {
-    return mAllocation->mappedAddress();
+    if(const auto mapped = mAllocation->mappedAddress())
+        return mapped;
+    // device-local memory is written through a staging buffer
+    if(!mStagingAllocation)
+    {
+        mStagingAllocation = mPool->device()->allocateStageBuffer(
+            mAllocation->size());
+    }
+    return mStagingAllocation->mappedAddress();
 }
 
 void usagi::VulkanGpuBuffer::flush()
 {
-    vk::MappedMemoryRange range;
-    range.setMemory(mPool->memory());
-    range.setOffset(mAllocation->offset());
-    range.setSize(mAllocation->size());
+    if(mStagingAllocation)
+    {
+        mStagingAllocation->flush();
+        // the staging buffer is released when the copy is finished
+        mPool->device()->copyBuffer(
+            std::move(mStagingAllocation), mAllocation);
+        return;
+    }
 
-    mPool->device()->device().flushMappedMemoryRanges({ range });
+    mAllocation->flush();
 }
 
 void usagi::VulkanGpuBuffer::release()
 {
+    mStagingAllocation.reset();
     mAllocation.reset();
 }
 
@@ -47,8 +71,21 @@ void usagi::VulkanGpuBuffer::fillShaderResourceInfo(
     VulkanResourceInfo &info)
 {
     auto &buffer_info = std::get<vk::DescriptorBufferInfo>(info);
-    buffer_info.setBuffer(mAllocation->pool()->buffer());
+    buffer_info.setBuffer(mAllocation->buffer());
     buffer_info.setOffset(mAllocation->offset());
     buffer_info.setRange(mAllocation->size());
     write.setPBufferInfo(&buffer_info);
 }
+
+void usagi::VulkanGpuBuffer::appendAdditionalResources(
+    std::vector<std::shared_ptr<VulkanBatchResource>> &resources)
+{
+    resources.push_back(mAllocation);
+}
+
+std::shared_ptr<usagi::ShaderResource> usagi::VulkanGpuBuffer::createRange(
+    const std::size_t offset,
+    const std::size_t size)
+{
+    return std::make_shared<VulkanGpuBufferRange>(mAllocation, offset, size);
+}
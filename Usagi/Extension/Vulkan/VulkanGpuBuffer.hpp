@@ -6,6 +6,7 @@
 #include <Usagi/Runtime/Graphics/Enum/GpuBufferUsage.hpp>
 
 #include "VulkanShaderResource.hpp"
+#include "VulkanBatchResource.hpp"
 
 namespace usagi
 {
@@ -13,18 +14,28 @@ class VulkanBufferMemoryPoolBase;
 class VulkanGpuDevice;
 class VulkanBufferAllocation;
 
-// note that VulkanBufferAllocation is inherited from VulkanBatchResource,
-// but not this class, which is only a wrapper of the real resource.
+// note that VulkanBufferAllocation is the real resource tracked by the
+// batches. this class is only a wrapper of it and appends its current
+// allocation when being retained.
 class VulkanGpuBuffer
     : public GpuBuffer
     , public VulkanShaderResource
+    , public VulkanBatchResource
 {
     VulkanBufferMemoryPoolBase * mPool = nullptr;
     GpuBufferUsage mUsage;
     std::shared_ptr<VulkanBufferAllocation> mAllocation;
+    // only used when the allocation is not host-visible
+    std::shared_ptr<VulkanBufferAllocation> mStagingAllocation;
 
 public:
     VulkanGpuBuffer(VulkanBufferMemoryPoolBase *pool, GpuBufferUsage usage);
+    /**
+     * \brief Wrap an existing allocation, such as the memory of a
+     * transient ring.
+     */
+    explicit VulkanGpuBuffer(
+        std::shared_ptr<VulkanBufferAllocation> allocation);
 
     void allocate(std::size_t size) override;
     void release() override;
@@ -33,10 +44,16 @@ public:
     void * mappedMemory() override;
     void flush() override;
 
-    // only used by uniform buffers
+    // used by uniform and storage buffers
     void fillShaderResourceInfo(
         vk::WriteDescriptorSet &write,
         VulkanResourceInfo &info) override;
+    void appendAdditionalResources(
+        std::vector<std::shared_ptr<VulkanBatchResource>> &resources) override;
+
+    std::shared_ptr<ShaderResource> createRange(
+        std::size_t offset,
+        std::size_t size) override;
 
     std::shared_ptr<VulkanBufferAllocation> allocation() const
     {
@@ -0,0 +1,36 @@
+﻿#include "VulkanGpuBufferRange.hpp"
+
+#include <stdexcept>
+
+#include "VulkanBufferAllocation.hpp"
+
+usagi::VulkanGpuBufferRange::VulkanGpuBufferRange(
+    std::shared_ptr<VulkanBufferAllocation> allocation,
+    const std::size_t offset,
+    const std::size_t size)
+    : mAllocation(std::move(allocation))
+    , mOffset(offset)
+    , mSize(size)
+{
+    if(!mAllocation)
+        throw std::logic_error("The buffer is not allocated.");
+    if(offset > mAllocation->size() || size > mAllocation->size() - offset)
+        throw std::out_of_range("The range exceeds the buffer.");
+}
+
+void usagi::VulkanGpuBufferRange::fillShaderResourceInfo(
+    vk::WriteDescriptorSet &write,
+    VulkanResourceInfo &info)
+{
+    auto &buffer_info = std::get<vk::DescriptorBufferInfo>(info);
+    buffer_info.setBuffer(mAllocation->buffer());
+    buffer_info.setOffset(mAllocation->offset() + mOffset);
+    buffer_info.setRange(mSize);
+    write.setPBufferInfo(&buffer_info);
+}
+
+void usagi::VulkanGpuBufferRange::appendAdditionalResources(
+    std::vector<std::shared_ptr<VulkanBatchResource>> &resources)
+{
+    resources.push_back(mAllocation);
+}
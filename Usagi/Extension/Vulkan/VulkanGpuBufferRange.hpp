@@ -0,0 +1,39 @@
+﻿#pragma once
+
+#include <memory>
+
+#include <Usagi/Runtime/Graphics/ShaderResource.hpp>
+
+#include "VulkanShaderResource.hpp"
+#include "VulkanBatchResource.hpp"
+
+namespace usagi
+{
+class VulkanBufferAllocation;
+
+/**
+ * \brief A range of a buffer allocation bound as a uniform or storage
+ * buffer. Created by VulkanGpuBuffer::createRange().
+ */
+class VulkanGpuBufferRange
+    : public ShaderResource
+    , public VulkanShaderResource
+    , public VulkanBatchResource
+{
+    std::shared_ptr<VulkanBufferAllocation> mAllocation;
+    // relative to the allocation
+    const std::size_t mOffset, mSize;
+
+public:
+    VulkanGpuBufferRange(
+        std::shared_ptr<VulkanBufferAllocation> allocation,
+        std::size_t offset,
+        std::size_t size);
+
+    void fillShaderResourceInfo(
+        vk::WriteDescriptorSet &write,
+        VulkanResourceInfo &info) override;
+    void appendAdditionalResources(
+        std::vector<std::shared_ptr<VulkanBatchResource>> &resources) override;
+};
+}
@@ -6,26 +6,38 @@
 usagi::VulkanGpuCommandPool::VulkanGpuCommandPool(VulkanGpuDevice *device)
     : mDevice { device }
 {
-    vk::CommandPoolCreateInfo info;
-
-    info.setQueueFamilyIndex(mDevice->graphicsQueueFamily());
-    // our command lists are freed immediately after each frame.
-    info.setFlags(vk::CommandPoolCreateFlagBits::eTransient);
+}
 
-    mPool = mDevice->device().createCommandPoolUnique(info);
+std::shared_ptr<usagi::GraphicsCommandList> usagi::VulkanGpuCommandPool::
+    allocate(
+    VulkanFrameCommandPool *pools,
+    const vk::CommandBufferLevel level)
+{
+    // the buffer is recycled when the frame is retired
+    return std::make_shared<VulkanGraphicsCommandList>(
+        shared_from_this(),
+        pools->allocate(level),
+        level == vk::CommandBufferLevel::eSecondary
+    );
 }
 
 std::shared_ptr<usagi::GraphicsCommandList> usagi::VulkanGpuCommandPool::
     allocateGraphicsCommandList()
 {
-    vk::CommandBufferAllocateInfo info;
+    return allocate(mDevice->commandPools(), vk::CommandBufferLevel::ePrimary);
+}
 
-    info.setCommandBufferCount(1);
-    info.setCommandPool(mPool.get());
-    info.setLevel(vk::CommandBufferLevel::ePrimary);
+std::shared_ptr<usagi::GraphicsCommandList> usagi::VulkanGpuCommandPool::
+    allocateSecondaryGraphicsCommandList()
+{
+    return allocate(mDevice->commandPools(),
+        vk::CommandBufferLevel::eSecondary);
+}
 
-    return std::make_shared<VulkanGraphicsCommandList>(
-        shared_from_this(),
-        std::move(mDevice->device().allocateCommandBuffersUnique(info).front())
-    );
+std::shared_ptr<usagi::GraphicsCommandList> usagi::VulkanGpuCommandPool::
+    allocateComputeCommandList()
+{
+    // the pools of the async compute queue family if there is one
+    return allocate(mDevice->computeCommandPools(),
+        vk::CommandBufferLevel::ePrimary);
 }
@@ -7,18 +7,29 @@
 namespace usagi
 {
 class VulkanGpuDevice;
+class VulkanFrameCommandPool;
 
+/**
+ * \brief Allocates the command buffers from the per-thread pools of the
+ * current frame held by the device.
+ */
 class VulkanGpuCommandPool
     : public GpuCommandPool
     , public std::enable_shared_from_this<VulkanGpuCommandPool>
 {
     VulkanGpuDevice *mDevice;
-    vk::UniqueCommandPool mPool;
+
+    std::shared_ptr<GraphicsCommandList> allocate(
+        VulkanFrameCommandPool *pools,
+        vk::CommandBufferLevel level);
 
 public:
     explicit VulkanGpuCommandPool(VulkanGpuDevice *device);
 
     std::shared_ptr<GraphicsCommandList> allocateGraphicsCommandList() override;
+    std::shared_ptr<GraphicsCommandList>
+        allocateSecondaryGraphicsCommandList() override;
+    std::shared_ptr<GraphicsCommandList> allocateComputeCommandList() override;
 
     VulkanGpuDevice * device() const { return mDevice; }
 };
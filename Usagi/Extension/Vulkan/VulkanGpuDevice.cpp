@@ -1,12 +1,15 @@
-#include "VulkanGpuDevice.hpp"
+﻿#include "VulkanGpuDevice.hpp"
 
 #include <algorithm>
+#include <cstring>
 
 #include <Usagi/Core/Logging.hpp>
 #include <Usagi/Runtime/Graphics/GpuImageView.hpp>
 #include <Usagi/Runtime/Graphics/GpuSamplerCreateInfo.hpp>
-#include <Usagi/Runtime/Memory/BitmapMemoryAllocator.hpp>
+#include <Usagi/Runtime/Graphics/RenderPassCreateInfo.hpp>
+#include <Usagi/Runtime/Memory/TlsfMemoryAllocator.hpp>
 #include <Usagi/Utility/Flag.hpp>
+#include <Usagi/Utility/Rounding.hpp>
 #include <Usagi/Utility/TypeCast.hpp>
 
 #include "VulkanFramebuffer.hpp"
@@ -20,6 +23,7 @@
 #include "VulkanSemaphore.hpp"
 #include "VulkanEnumTranslation.hpp"
 #include "VulkanGraphicsPipelineCompiler.hpp"
+#include "VulkanComputePipelineCompiler.hpp"
 #include "VulkanHelper.hpp"
 #include "VulkanRenderPass.hpp"
 
@@ -114,6 +118,37 @@ uint32_t usagi::VulkanGpuDevice::selectQueue(
         "Could not find a queue family with required flags.");
 }
 
+uint32_t usagi::VulkanGpuDevice::selectTransferQueue(
+    std::vector<vk::QueueFamilyProperties> &queue_family,
+    const uint32_t graphics_queue_family)
+{
+    for(auto iter = queue_family.begin(); iter != queue_family.end(); ++iter)
+    {
+        if((iter->queueFlags & vk::QueueFlagBits::eTransfer) &&
+            !(iter->queueFlags & (vk::QueueFlagBits::eGraphics |
+                vk::QueueFlagBits::eCompute)))
+        {
+            return static_cast<uint32_t>(iter - queue_family.begin());
+        }
+    }
+    return graphics_queue_family;
+}
+
+uint32_t usagi::VulkanGpuDevice::selectComputeQueue(
+    std::vector<vk::QueueFamilyProperties> &queue_family,
+    const uint32_t graphics_queue_family)
+{
+    for(auto iter = queue_family.begin(); iter != queue_family.end(); ++iter)
+    {
+        if((iter->queueFlags & vk::QueueFlagBits::eCompute) &&
+            !(iter->queueFlags & vk::QueueFlagBits::eGraphics))
+        {
+            return static_cast<uint32_t>(iter - queue_family.begin());
+        }
+    }
+    return graphics_queue_family;
+}
+
 void usagi::VulkanGpuDevice::createInstance()
 {
     LOG(info, "Creating Vulkan intance");
@@ -124,7 +159,7 @@ void usagi::VulkanGpuDevice::createInstance()
     application_info.setApplicationVersion(VK_MAKE_VERSION(1, 0, 0));
     application_info.setPEngineName("Usagi");
     application_info.setEngineVersion(VK_MAKE_VERSION(1, 0, 0));
-    application_info.setApiVersion(VK_API_VERSION_1_0);
+    application_info.setApiVersion(VK_API_VERSION_1_1);
 
     // Extensions
     {
@@ -211,6 +246,12 @@ void usagi::VulkanGpuDevice::selectPhysicalDevice()
             LOG(info, "Driver Version: {}", prop.vendorID);
             LOG(info, "Vendor ID     : {}", prop.vendorID);
             LOG(info, "--------------------------------");
+            // descriptor update templates are core in 1.1
+            if(prop.apiVersion < VK_API_VERSION_1_1)
+            {
+                LOG(info, "Skipped: Vulkan 1.1 is not supported");
+                continue;
+            }
             // todo: select device based on features and score them / let the
             // user choose
             if(!mPhysicalDevice)
@@ -244,6 +285,18 @@ void usagi::VulkanGpuDevice::createDeviceAndQueues()
     LOG(info, "Getting a queue from queue family {}.",
         graphics_queue_index);
 
+    const auto transfer_queue_index = selectTransferQueue(queue_families,
+        graphics_queue_index);
+    if(transfer_queue_index != graphics_queue_index)
+        LOG(info, "Using queue family {} for uploads.",
+            transfer_queue_index);
+
+    const auto compute_queue_index = selectComputeQueue(queue_families,
+        graphics_queue_index);
+    if(compute_queue_index != graphics_queue_index)
+        LOG(info, "Using queue family {} for async compute.",
+            compute_queue_index);
+
     vk::DeviceCreateInfo device_create_info;
 
     vk::PhysicalDeviceFeatures features;
@@ -251,71 +304,264 @@ void usagi::VulkanGpuDevice::createDeviceAndQueues()
     features.setFillModeNonSolid(true);
     features.setLargePoints(true);
     features.setWideLines(true);
+    // indirect draws fall back to one draw per command without these
+    const auto supported_features = mPhysicalDevice.getFeatures();
+    features.setMultiDrawIndirect(supported_features.multiDrawIndirect);
+    features.setDrawIndirectFirstInstance(
+        supported_features.drawIndirectFirstInstance);
+    // storage buffers accessed by vertex and fragment shaders which are
+    // not declared readonly require these
+    features.setVertexPipelineStoresAndAtomics(
+        supported_features.vertexPipelineStoresAndAtomics);
+    features.setFragmentStoresAndAtomics(
+        supported_features.fragmentStoresAndAtomics);
 
-    vk::DeviceQueueCreateInfo queue_create_info[1];
+    // one queue from each distinct family
+    std::vector<std::uint32_t> queue_family_indices {
+        graphics_queue_index
+    };
+    for(auto &&i : { transfer_queue_index, compute_queue_index })
+    {
+        if(std::find(queue_family_indices.begin(), queue_family_indices.end(),
+            i) == queue_family_indices.end())
+            queue_family_indices.push_back(i);
+    }
+    std::vector<vk::DeviceQueueCreateInfo> queue_create_info;
     float queue_priority = 1;
-    queue_create_info[0].setQueueFamilyIndex(graphics_queue_index);
-    queue_create_info[0].setQueueCount(1);
-    queue_create_info[0].setPQueuePriorities(&queue_priority);
-    device_create_info.setQueueCreateInfoCount(1);
-    device_create_info.setPQueueCreateInfos(queue_create_info);
+    for(auto &&i : queue_family_indices)
+    {
+        vk::DeviceQueueCreateInfo info;
+        info.setQueueFamilyIndex(i);
+        info.setQueueCount(1);
+        info.setPQueuePriorities(&queue_priority);
+        queue_create_info.push_back(info);
+    }
+    device_create_info.setQueueCreateInfoCount(
+        static_cast<uint32_t>(queue_create_info.size()));
+    device_create_info.setPQueueCreateInfos(queue_create_info.data());
 
     // todo: check device capacity
-    const std::vector<const char *> device_extensions
+    std::vector<const char *> device_extensions
     {
         VK_KHR_SWAPCHAIN_EXTENSION_NAME,
     };
+
+    // bindless textures are optional
+    std::uint32_t bindless_capacity = 0;
+    const auto bindless = checkBindlessTextureSupport(bindless_capacity);
+    vk::PhysicalDeviceDescriptorIndexingFeaturesEXT indexing_features;
+    if(bindless)
+    {
+        device_extensions.push_back(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+        indexing_features.setDescriptorBindingPartiallyBound(true);
+        indexing_features.setDescriptorBindingSampledImageUpdateAfterBind(
+            true);
+        indexing_features.setDescriptorBindingUpdateUnusedWhilePending(true);
+        indexing_features.setRuntimeDescriptorArray(true);
+        device_create_info.setPNext(&indexing_features);
+    }
+
+    const auto indirect_count = checkDeviceExtension(
+        VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+    if(indirect_count)
+        device_extensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+
     device_create_info.setEnabledExtensionCount(static_cast<uint32_t>(
         device_extensions.size()));
     device_create_info.setPpEnabledExtensionNames(device_extensions.data());
 
     mDevice = mPhysicalDevice.createDeviceUnique(device_create_info);
 
+    if(bindless)
+    {
+        mBindlessTextures = std::make_unique<VulkanBindlessTextureTable>(
+            mDevice.get(), bindless_capacity);
+    }
+
+    mMultiDrawIndirect = supported_features.multiDrawIndirect;
+    if(indirect_count)
+    {
+        mCmdDrawIndirectCount =
+            reinterpret_cast<PFN_vkCmdDrawIndirectCountKHR>(
+                mDevice->getProcAddr("vkCmdDrawIndirectCountKHR"));
+        mCmdDrawIndexedIndirectCount =
+            reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(
+                mDevice->getProcAddr("vkCmdDrawIndexedIndirectCountKHR"));
+    }
+    LOG(info, "Multi-draw indirect: {}, indirect count: {}.",
+        mMultiDrawIndirect, indirectCountEnabled());
+
     mGraphicsQueue = mDevice->getQueue(graphics_queue_index, 0);
     mGraphicsQueueFamilyIndex = graphics_queue_index;
+    mTransferQueue = mDevice->getQueue(transfer_queue_index, 0);
+    mTransferQueueFamilyIndex = transfer_queue_index;
+    mComputeQueue = mDevice->getQueue(compute_queue_index, 0);
+    mComputeQueueFamilyIndex = compute_queue_index;
+
+    // buffers are written by the transfer queue and may be accessed by
+    // the async compute queue without transferring their ownership
+    if(compute_queue_index != graphics_queue_index)
+        mSharingQueueFamilies = std::move(queue_family_indices);
+}
+
+bool usagi::VulkanGpuDevice::checkDeviceExtension(const char *name) const
+{
+    const auto extensions =
+        mPhysicalDevice.enumerateDeviceExtensionProperties();
+    return std::any_of(
+        extensions.begin(), extensions.end(), [=](auto &&e) {
+            return std::strcmp(e.extensionName, name) == 0;
+        }
+    );
+}
+
+bool usagi::VulkanGpuDevice::checkBindlessTextureSupport(
+    std::uint32_t &capacity) const
+{
+    if(!checkDeviceExtension(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME))
+    {
+        LOG(info, "Bindless textures disabled: {} is not supported.",
+            VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+        return false;
+    }
+
+    const auto features = mPhysicalDevice.getFeatures2<
+        vk::PhysicalDeviceFeatures2,
+        vk::PhysicalDeviceDescriptorIndexingFeaturesEXT
+    >();
+    const auto &indexing =
+        features.get<vk::PhysicalDeviceDescriptorIndexingFeaturesEXT>();
+    if(!indexing.descriptorBindingPartiallyBound ||
+        !indexing.descriptorBindingSampledImageUpdateAfterBind ||
+        !indexing.descriptorBindingUpdateUnusedWhilePending ||
+        !indexing.runtimeDescriptorArray)
+    {
+        LOG(info, "Bindless textures disabled: required descriptor indexing "
+            "features are not supported.");
+        return false;
+    }
+
+    const auto properties = mPhysicalDevice.getProperties2<
+        vk::PhysicalDeviceProperties2,
+        vk::PhysicalDeviceDescriptorIndexingPropertiesEXT
+    >();
+    const auto &limits =
+        properties.get<vk::PhysicalDeviceDescriptorIndexingPropertiesEXT>();
+    capacity = std::min({
+        MAX_BINDLESS_TEXTURES,
+        limits.maxDescriptorSetUpdateAfterBindSampledImages,
+        limits.maxPerStageDescriptorUpdateAfterBindSampledImages
+    });
+    return capacity > 0;
 }
 
 void usagi::VulkanGpuDevice::createMemoryPools()
 {
-    mDynamicBufferPool = std::make_unique<BitmapBufferPool>(
+    // Pools allocate device memory in blocks of these sizes when they run
+    // out of space. Allocations larger than half a block get their own
+    // memory.
+    constexpr std::size_t DYNAMIC_BUFFER_BLOCK_SIZE = 32 * 1024 * 1024;
+    constexpr std::size_t STATIC_BUFFER_BLOCK_SIZE = 32 * 1024 * 1024;
+    constexpr std::size_t DEVICE_IMAGE_BLOCK_SIZE = 64 * 1024 * 1024;
+    // enough for a few frames of UI and debug geometry
+    constexpr std::size_t TRANSIENT_RING_SIZE = 8 * 1024 * 1024;
+
+    mMemoryBudget = std::make_unique<VulkanMemoryBudget>(mPhysicalDevice);
+
+    // sub-allocations must satisfy the offset requirements of all usages
+    // of the buffer, as well as the granularity of flushing mapped ranges.
+    const auto limits = mPhysicalDevice.getProperties().limits;
+    mNonCoherentAtomSize = static_cast<std::size_t>(
+        limits.nonCoherentAtomSize);
+    const auto buffer_granularity = static_cast<std::size_t>(std::max({
+        limits.minUniformBufferOffsetAlignment,
+        limits.minStorageBufferOffsetAlignment,
+        limits.nonCoherentAtomSize,
+        vk::DeviceSize { 16 }
+    }));
+
+    mDynamicBufferPool = std::make_unique<DynamicBufferPool>(
         this,
-        1024 * 1024 * 512, // 512MiB  todo from config
-        vk::MemoryPropertyFlagBits::eHostVisible |
-        vk::MemoryPropertyFlagBits::eHostCoherent,
+        "Dynamic Buffer Pool",
+        DYNAMIC_BUFFER_BLOCK_SIZE,
+        // cached memory is preferred for the faster host access. it is
+        // often not coherent, in which case the writes are flushed by
+        // VulkanBufferAllocation::flush().
+        vk::MemoryPropertyFlagBits::eHostVisible,
+        vk::MemoryPropertyFlagBits::eHostCached,
         vk::BufferUsageFlagBits::eTransferSrc |
         vk::BufferUsageFlagBits::eVertexBuffer |
         vk::BufferUsageFlagBits::eIndexBuffer |
-        vk::BufferUsageFlagBits::eUniformBuffer,
-        [](const vk::MemoryRequirements &req) {
-            return std::make_unique<BitmapMemoryAllocator>(
+        vk::BufferUsageFlagBits::eUniformBuffer |
+        vk::BufferUsageFlagBits::eStorageBuffer |
+        vk::BufferUsageFlagBits::eIndirectBuffer,
+        [=](const std::size_t size) {
+            return std::make_unique<TlsfMemoryAllocator>(
                 nullptr,
-                req.size,
-                32 * 1024 /* 32 KiB */ // todo config
+                size,
+                buffer_granularity
             );
         }
     );
 
-    mDeviceImagePool = std::make_unique<BitmapImagePool>(
+    mStaticBufferPool = std::make_unique<StaticBufferPool>(
         this,
-        1024 * 1024 * 512, // 512MiB  todo from config
+        "Static Buffer Pool",
+        STATIC_BUFFER_BLOCK_SIZE,
+        // host-visible device-local memory on integrated GPUs is written
+        // directly.
+        { },
         vk::MemoryPropertyFlagBits::eDeviceLocal,
-        vk::ImageUsageFlagBits::eTransferDst |
-        vk::ImageUsageFlagBits::eSampled,
-        [](const vk::MemoryRequirements &req) {
-            return std::make_unique<BitmapMemoryAllocator>(
+        vk::BufferUsageFlagBits::eTransferDst |
+        vk::BufferUsageFlagBits::eVertexBuffer |
+        vk::BufferUsageFlagBits::eIndexBuffer |
+        vk::BufferUsageFlagBits::eUniformBuffer |
+        vk::BufferUsageFlagBits::eStorageBuffer |
+        vk::BufferUsageFlagBits::eIndirectBuffer,
+        [=](const std::size_t size) {
+            return std::make_unique<TlsfMemoryAllocator>(
+                nullptr,
+                size,
+                buffer_granularity
+            );
+        }
+    );
+
+    mDeviceImagePool = std::make_unique<DeviceImagePool>(
+        this,
+        "Device Image Pool",
+        DEVICE_IMAGE_BLOCK_SIZE,
+        // fall back to system memory when the video memory is exhausted
+        { },
+        vk::MemoryPropertyFlagBits::eDeviceLocal,
+        [](const std::size_t size) {
+            // image alignments are passed on each allocation
+            return std::make_unique<TlsfMemoryAllocator>(
                 nullptr,
-                req.size,
-                32 * 1024 /* 32 KiB */ // todo config
+                size,
+                256
             );
         }
     );
 
+    mUploadQueue = std::make_unique<VulkanUploadQueue>(
+        mDevice.get(),
+        mGraphicsQueueFamilyIndex, mGraphicsQueue,
+        mTransferQueueFamilyIndex, mTransferQueue,
+        !mSharingQueueFamilies.empty(),
+        asyncComputeEnabled(),
+        &mQueueLock
+    );
+
     {
-        vk::CommandPoolCreateInfo info;
-        // todo use DMA queue
-        info.setQueueFamilyIndex(mGraphicsQueueFamilyIndex);
-        info.setFlags(vk::CommandPoolCreateFlagBits::eTransient);
-        mTransferCommandPool = mDevice->createCommandPoolUnique(info);
+        auto allocation = mDynamicBufferPool->allocate(
+            utility::roundUpUnsigned(TRANSIENT_RING_SIZE, buffer_granularity));
+        const auto coherent = static_cast<bool>(
+            mMemoryBudget->properties().memoryTypes[
+                allocation->block()->memory_type].propertyFlags &
+            vk::MemoryPropertyFlagBits::eHostCoherent);
+        mTransientRing = std::make_unique<VulkanTransientRing>(
+            this, std::move(allocation), buffer_granularity, coherent);
     }
 }
 
@@ -328,14 +574,21 @@ void usagi::VulkanGpuDevice::createFallbackTexture()
     mFallbackTexture = createImage(info);
 }
 
-usagi::VulkanGpuDevice::VulkanGpuDevice()
+usagi::VulkanGpuDevice::VulkanGpuDevice(
+    const std::filesystem::path &cache_folder)
 {
     createInstance();
     createDebugReport();
     selectPhysicalDevice();
     createDeviceAndQueues();
+    mPipelineCache = std::make_unique<VulkanPipelineCache>(
+        mPhysicalDevice, mDevice.get(), cache_folder);
     createMemoryPools();
     createFallbackTexture();
+    mFramebuffers = std::make_unique<VulkanFramebufferCache>(this);
+
+    mFrames.resize(DEFAULT_FRAMES_IN_FLIGHT);
+    prepareFrames();
 }
 
 usagi::VulkanGpuDevice::~VulkanGpuDevice()
@@ -343,6 +596,8 @@ usagi::VulkanGpuDevice::~VulkanGpuDevice()
     // Wait till all operations are completed so it is safe to release the
     // resources.
     mDevice->waitIdle();
+
+    mPipelineCache->save();
 }
 
 std::unique_ptr<usagi::GraphicsPipelineCompiler> usagi::VulkanGpuDevice::
@@ -351,6 +606,12 @@ std::unique_ptr<usagi::GraphicsPipelineCompiler> usagi::VulkanGpuDevice::
     return std::make_unique<VulkanGraphicsPipelineCompiler>(this);
 }
 
+std::unique_ptr<usagi::ComputePipelineCompiler> usagi::VulkanGpuDevice::
+    createComputePipelineCompiler()
+{
+    return std::make_unique<VulkanComputePipelineCompiler>(this);
+}
+
 std::shared_ptr<usagi::GpuCommandPool>
     usagi::VulkanGpuDevice::createCommandPool()
 {
@@ -360,33 +621,91 @@ std::shared_ptr<usagi::GpuCommandPool>
 std::shared_ptr<usagi::RenderPass> usagi::VulkanGpuDevice::createRenderPass(
     const RenderPassCreateInfo &info)
 {
-    return std::make_shared<VulkanRenderPass>(this, info);
+    std::string key;
+    for(auto &&u : info.attachment_usages)
+    {
+        key += fmt::format("{}:{}:{}:{}:{}:{}:{}:{},{},{},{};",
+            static_cast<int>(u.format.format), u.format.sample_count,
+            static_cast<int>(u.initial_layout), static_cast<int>(u.layout),
+            static_cast<int>(u.final_layout),
+            static_cast<int>(u.op.load_op), static_cast<int>(u.op.store_op),
+            u.op.clear_color.x(), u.op.clear_color.y(),
+            u.op.clear_color.z(), u.op.clear_color.w());
+    }
+    return mRenderPasses.acquire(key, [&]() {
+        return std::make_shared<VulkanRenderPass>(this, info);
+    });
 }
 
 std::shared_ptr<usagi::Framebuffer> usagi::VulkanGpuDevice::createFramebuffer(
+    std::shared_ptr<RenderPass> render_pass,
     const Vector2u32 &size,
-    std::vector<std::shared_ptr<GpuImageView>> views)
+    const std::vector<std::shared_ptr<GpuImageView>> &views)
 {
-    auto vk_views = transformObjects(views,
-        [&](auto &&v) {
-            return dynamic_pointer_cast_throw<VulkanGpuImageView>(v);
-        }
-    );
+    return mFramebuffers->acquire(
+        dynamic_pointer_cast_throw<VulkanRenderPass>(render_pass),
+        size, views);
+}
 
-    return std::make_shared<VulkanFramebuffer>(this, size, std::move(vk_views));
+void usagi::VulkanGpuDevice::invalidateFramebuffers()
+{
+    mFramebuffers->clear();
 }
 
-// todo sem pool
 std::shared_ptr<usagi::GpuSemaphore> usagi::VulkanGpuDevice::createSemaphore()
 {
     auto sem = mDevice->createSemaphoreUnique(vk::SemaphoreCreateInfo { });
     return std::make_unique<VulkanSemaphore>(std::move(sem));
 }
 
+std::shared_ptr<usagi::GpuSemaphore> usagi::VulkanGpuDevice::frameSemaphore()
+{
+    auto &frame = mFrames[mCurrentFrame];
+    if(frame.used_semaphores == frame.semaphores.size())
+    {
+        frame.semaphores.push_back(std::make_shared<VulkanSemaphore>(
+            mDevice->createSemaphoreUnique(vk::SemaphoreCreateInfo { })));
+    }
+    return frame.semaphores[frame.used_semaphores++];
+}
+
 std::shared_ptr<usagi::GpuBuffer> usagi::VulkanGpuDevice::createBuffer(
-    GpuBufferUsage usage)
+    GpuBufferUsage usage,
+    GpuBufferStorage storage)
 {
-    return std::make_shared<VulkanGpuBuffer>(mDynamicBufferPool.get(), usage);
+    switch(storage)
+    {
+        case GpuBufferStorage::DYNAMIC:
+            return std::make_shared<VulkanGpuBuffer>(
+                mDynamicBufferPool.get(), usage);
+        case GpuBufferStorage::STATIC:
+            return std::make_shared<VulkanGpuBuffer>(
+                mStaticBufferPool.get(), usage);
+        default:
+            throw std::runtime_error("Invalid buffer storage");
+    }
+}
+
+usagi::GpuBufferSlice usagi::VulkanGpuDevice::allocateTransient(
+    const std::size_t size)
+{
+    GpuBufferSlice slice;
+    if(mTransientRing->tryAllocate(size, slice))
+        return slice;
+
+    // the ring is exhausted by the frames in flight. fall back to a
+    // separate allocation, which is freed along with the jobs using it.
+    LOG(warn, "Transient ring of {} bytes is full, allocating {} bytes "
+        "from the dynamic buffer pool", mTransientRing->capacity(), size);
+    auto allocation = mDynamicBufferPool->allocate(size);
+    // flushed along with the ring when the jobs are submitted
+    mTransientRing->addOverflow(allocation);
+    auto buffer = std::make_shared<VulkanGpuBuffer>(std::move(allocation));
+    slice.mapped = buffer->mappedMemory();
+    slice.buffer = std::move(buffer);
+    slice.offset = 0;
+    slice.size = size;
+    return slice;
 }
 
 std::shared_ptr<usagi::GpuImage> usagi::VulkanGpuDevice::createImage(
@@ -399,16 +718,23 @@ std::shared_ptr<usagi::GpuImage> usagi::VulkanGpuDevice::createImage(
 std::shared_ptr<usagi::GpuSampler> usagi::VulkanGpuDevice::createSampler(
     const GpuSamplerCreateInfo &info)
 {
-    vk::SamplerCreateInfo vk_info;
-    vk_info.setMagFilter(translate(info.mag_filter));
-    vk_info.setMinFilter(translate(info.min_filter));
-    vk_info.setMipmapMode(vk::SamplerMipmapMode::eLinear);
-    vk_info.setAddressModeU(translate(info.addressing_mode_u));
-    vk_info.setAddressModeV(translate(info.addressing_mode_v));
-    // todo sampler setBorderColor
-    // vk_info.setBorderColor({ });
-    return std::make_shared<VulkanSampler>(
-        mDevice->createSamplerUnique(vk_info));
+    // the border color is not used yet
+    const auto key = fmt::format("{}:{}:{}:{}",
+        static_cast<int>(info.mag_filter), static_cast<int>(info.min_filter),
+        static_cast<int>(info.addressing_mode_u),
+        static_cast<int>(info.addressing_mode_v));
+    return mSamplers.acquire(key, [&]() {
+        vk::SamplerCreateInfo vk_info;
+        vk_info.setMagFilter(translate(info.mag_filter));
+        vk_info.setMinFilter(translate(info.min_filter));
+        vk_info.setMipmapMode(vk::SamplerMipmapMode::eLinear);
+        vk_info.setAddressModeU(translate(info.addressing_mode_u));
+        vk_info.setAddressModeV(translate(info.addressing_mode_v));
+        // todo sampler setBorderColor
+        // vk_info.setBorderColor({ });
+        return std::make_shared<VulkanSampler>(
+            mDevice->createSamplerUnique(vk_info));
+    });
 }
 
 std::shared_ptr<usagi::GpuImage>
@@ -423,28 +749,74 @@ void usagi::VulkanGpuDevice::submitGraphicsJobs(
     std::initializer_list<GraphicsPipelineStage> wait_stages,
     std::initializer_list<std::shared_ptr<GpuSemaphore>> signal_semaphores)
 {
-    const auto vk_jobs = transformObjects(jobs, [&](auto &&j) {
+    submitJobs(mGraphicsQueue,
+        jobs, wait_semaphores, wait_stages, signal_semaphores);
+}
+
+void usagi::VulkanGpuDevice::submitComputeJobs(
+    const std::vector<std::shared_ptr<GraphicsCommandList>> &jobs,
+    std::initializer_list<std::shared_ptr<GpuSemaphore>> wait_semaphores,
+    std::initializer_list<GraphicsPipelineStage> wait_stages,
+    std::initializer_list<std::shared_ptr<GpuSemaphore>> signal_semaphores)
+{
+    // the compute queue is the graphics queue if there is no dedicated one
+    submitJobs(mComputeQueue,
+        jobs, wait_semaphores, wait_stages, signal_semaphores);
+}
+
+bool usagi::VulkanGpuDevice::asyncComputeEnabled() const
+{
+    return mComputeQueueFamilyIndex != mGraphicsQueueFamilyIndex;
+}
+
+bool usagi::VulkanGpuDevice::indirectCountEnabled() const
+{
+    return mCmdDrawIndirectCount && mCmdDrawIndexedIndirectCount;
+}
+
+void usagi::VulkanGpuDevice::submitJobs(
+    const vk::Queue queue,
+    const std::vector<std::shared_ptr<GraphicsCommandList>> &jobs,
+    std::initializer_list<std::shared_ptr<GpuSemaphore>> wait_semaphores,
+    std::initializer_list<GraphicsPipelineStage> wait_stages,
+    std::initializer_list<std::shared_ptr<GpuSemaphore>> signal_semaphores)
+{
+    // make pending uploads visible to the jobs
+    mUploadQueue->flush();
+    // the uploads are only ordered before the jobs on the graphics queue
+    std::shared_ptr<VulkanSemaphore> upload_sem;
+    if(queue == mComputeQueue && asyncComputeEnabled())
+        upload_sem = mUploadQueue->takeComputeWait();
+
+    const auto vk_jobs = transformObjectsFrame(jobs, [&](auto &&j) {
         return dynamic_cast_ref<VulkanGraphicsCommandList>(j).commandBuffer();
     });
-    const auto vk_wait_sems = transformObjects(wait_semaphores,
+    auto vk_wait_sems = transformObjectsFrame(wait_semaphores,
         [&](auto &&s) {
             return dynamic_cast_ref<VulkanSemaphore>(s).semaphore();
         }
     );
-    const auto vk_wait_stages = transformObjects(wait_stages,
+    auto vk_wait_stages = transformObjectsFrame(wait_stages,
         [&](auto &&s) {
             // todo wait on multiple stages
             return vk::PipelineStageFlags(translate(s));
         }
     );
-    const auto vk_signal_sems = transformObjects(signal_semaphores,
+    if(upload_sem)
+    {
+        vk_wait_sems.push_back(upload_sem->semaphore());
+        vk_wait_stages.push_back(
+            vk::PipelineStageFlagBits::eDrawIndirect |
+            vk::PipelineStageFlagBits::eComputeShader);
+    }
+    const auto vk_signal_sems = transformObjectsFrame(signal_semaphores,
         [&](auto &&s) {
             return dynamic_cast_ref<VulkanSemaphore>(s).semaphore();
         }
     );
 
-    BatchResourceList batch_resources;
-    batch_resources.fence = mDevice->createFenceUnique(vk::FenceCreateInfo { });
+    auto &frame = mFrames[mCurrentFrame];
+    const auto fence = acquireFrameFence();
 
     vk::SubmitInfo info;
     info.setCommandBufferCount(static_cast<uint32_t>(vk_jobs.size()));
@@ -458,7 +830,7 @@ void usagi::VulkanGpuDevice::submitGraphicsJobs(
     const auto cast_append = [&](auto &&container) {
         std::transform(
             container.begin(), container.end(),
-            std::back_inserter(batch_resources.resources),
+            std::back_inserter(frame.resources),
             [&](auto &&j) {
                 return dynamic_pointer_cast_throw<VulkanBatchResource>(j);
             }
@@ -467,25 +839,182 @@ void usagi::VulkanGpuDevice::submitGraphicsJobs(
     cast_append(jobs);
     cast_append(wait_semaphores);
     cast_append(signal_semaphores);
+    if(upload_sem)
+        frame.resources.push_back(std::move(upload_sem));
+
+    frame.transient_mark = mTransientRing->flush();
+    std::lock_guard<std::mutex> lock(mQueueLock);
+    queue.submit({ info }, fence);
+}
+
+vk::Fence usagi::VulkanGpuDevice::acquireFrameFence()
+{
+    auto &frame = mFrames[mCurrentFrame];
+    if(frame.used_fences == frame.fences.size())
+    {
+        frame.fences.push_back(
+            mDevice->createFenceUnique(vk::FenceCreateInfo { }));
+    }
+    return frame.fences[frame.used_fences++].get();
+}
+
+void usagi::VulkanGpuDevice::waitFrame(FrameSlot &frame)
+{
+    if(frame.used_fences == 0) return;
+
+    std::vector<vk::Fence> fences;
+    fences.reserve(frame.used_fences);
+    for(std::size_t i = 0; i < frame.used_fences; ++i)
+        fences.push_back(frame.fences[i].get());
+    mDevice->waitForFences(fences, true, UINT64_MAX);
+}
+
+void usagi::VulkanGpuDevice::retireFrame(FrameSlot &frame)
+{
+    // the fences must have been signaled
+    if(frame.used_fences > 0)
+    {
+        std::vector<vk::Fence> fences;
+        fences.reserve(frame.used_fences);
+        for(std::size_t i = 0; i < frame.used_fences; ++i)
+            fences.push_back(frame.fences[i].get());
+        mDevice->resetFences(fences);
+        mTransientRing->release(frame.transient_mark);
+    }
+    frame.descriptors->reset();
+    frame.command_pools->reset();
+    if(frame.compute_command_pools)
+        frame.compute_command_pools->reset();
+    if(mBindlessTextures)
+        mBindlessTextures->freeSlots(frame.bindless_slots);
+    frame.bindless_slots.clear();
+    frame.used_fences = 0;
+    frame.used_semaphores = 0;
+    frame.resources.clear();
+    frame.transient_mark = 0;
+}
+
+void usagi::VulkanGpuDevice::beginFrame()
+{
+    // the slots released in the last frame may still be used by its jobs
+    if(mBindlessTextures)
+    {
+        auto released = mBindlessTextures->takeReleasedSlots();
+        auto &slots = mFrames[mCurrentFrame].bindless_slots;
+        slots.insert(slots.end(), released.begin(), released.end());
+    }
+
+    mCurrentFrame = (mCurrentFrame + 1) % mFrames.size();
 
-    mGraphicsQueue.submit({ info }, batch_resources.fence.get());
+    mFramebuffers->nextFrame();
+    mSamplers.purge();
+    mRenderPasses.purge();
+    mDescriptorSetLayouts.purge();
 
-    mBatchResourceLists.push_back(std::move(batch_resources));
+    // block until the jobs submitted when the slot was last used are done.
+    // this bounds the number of frames queued up on the gpu.
+    auto &frame = mFrames[mCurrentFrame];
+    waitFrame(frame);
+    retireFrame(frame);
+}
+
+void usagi::VulkanGpuDevice::waitFramesInFlight()
+{
+    for(std::size_t i = 0; i < mFrames.size(); ++i)
+    {
+        auto &frame = mFrames[i];
+        waitFrame(frame);
+        // the current frame may still use its resources
+        if(i != mCurrentFrame)
+            retireFrame(frame);
+    }
+}
+
+std::size_t usagi::VulkanGpuDevice::framesInFlight() const
+{
+    return mFrames.size();
+}
+
+void usagi::VulkanGpuDevice::setFramesInFlight(const std::size_t num_frames)
+{
+    if(num_frames == 0)
+        throw std::runtime_error("At least one frame must be in flight.");
+
+    waitFramesInFlight();
+    // move the current frame to the front so it survives shrinking.
+    std::rotate(mFrames.begin(), mFrames.begin() + mCurrentFrame,
+        mFrames.end());
+    mCurrentFrame = 0;
+    mFrames.resize(num_frames);
+    prepareFrames();
+}
+
+bool usagi::VulkanGpuDevice::bindlessTexturesEnabled() const
+{
+    return mBindlessTextures != nullptr;
+}
+
+usagi::VulkanDescriptorCache * usagi::VulkanGpuDevice::descriptorCache()
+{
+    return mFrames[mCurrentFrame].descriptors.get();
+}
+
+usagi::VulkanFrameCommandPool * usagi::VulkanGpuDevice::commandPools()
+{
+    return mFrames[mCurrentFrame].command_pools.get();
+}
+
+usagi::VulkanFrameCommandPool * usagi::VulkanGpuDevice::computeCommandPools()
+{
+    auto &frame = mFrames[mCurrentFrame];
+    return frame.compute_command_pools
+        ? frame.compute_command_pools.get()
+        : frame.command_pools.get();
+}
+
+void usagi::VulkanGpuDevice::prepareFrames()
+{
+    for(auto &&frame : mFrames)
+    {
+        if(!frame.descriptors)
+        {
+            frame.descriptors =
+                std::make_unique<VulkanDescriptorCache>(mDevice.get());
+        }
+        if(!frame.command_pools)
+        {
+            frame.command_pools = std::make_unique<VulkanFrameCommandPool>(
+                mDevice.get(), mGraphicsQueueFamilyIndex);
+        }
+        if(!frame.compute_command_pools && asyncComputeEnabled())
+        {
+            frame.compute_command_pools =
+                std::make_unique<VulkanFrameCommandPool>(
+                    mDevice.get(), mComputeQueueFamilyIndex);
+        }
+    }
 }
 
 void usagi::VulkanGpuDevice::reclaimResources()
 {
-    for(auto i = mBatchResourceLists.begin(); i != mBatchResourceLists.end();)
+    mUploadQueue->reclaim();
+
+    // retire the previous frames which have finished without blocking
+    for(std::size_t i = 0; i < mFrames.size(); ++i)
     {
-        if(mDevice->getFenceStatus(i->fence.get()) == vk::Result::eSuccess)
-            i = mBatchResourceLists.erase(i);
-        else
-            ++i;
+        if(i == mCurrentFrame) continue;
+        auto &frame = mFrames[i];
+        if(frame.used_fences == 0) continue;
+        // jobs complete in submission order
+        const auto last = frame.fences[frame.used_fences - 1].get();
+        if(mDevice->getFenceStatus(last) == vk::Result::eSuccess)
+            retireFrame(frame);
     }
 }
 
 void usagi::VulkanGpuDevice::waitIdle()
 {
+    std::lock_guard<std::mutex> lock(mQueueLock);
     mDevice->waitIdle();
 }
 
@@ -515,81 +1044,17 @@ usagi::VulkanGpuDevice::allocateStageBuffer(std::size_t size)
     return mDynamicBufferPool->allocate(size);
 }
 
-void usagi::VulkanGpuDevice::copyBufferToImage(
-    const std::shared_ptr<VulkanBufferAllocation> &buffer,
+std::shared_ptr<usagi::GpuUploadHandle>
+usagi::VulkanGpuDevice::copyBufferToImage(
+    std::shared_ptr<VulkanBufferAllocation> buffer,
     VulkanGpuImage *image)
 {
-    vk::UniqueCommandBuffer cmd;
-    {
-        vk::CommandBufferAllocateInfo info;
-        info.setCommandBufferCount(1);
-        info.setCommandPool(mTransferCommandPool.get());
-        info.setLevel(vk::CommandBufferLevel::ePrimary);
+    return mUploadQueue->copyBufferToImage(std::move(buffer), image);
+}
 
-        cmd = std::move(mDevice->allocateCommandBuffersUnique(info).front());
-    }
-    {
-        vk::CommandBufferBeginInfo info;
-        info.setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
-        cmd->begin(info);
-    }
-    vk::ImageSubresourceRange range;
-    range.setAspectMask(vk::ImageAspectFlagBits::eColor);
-    range.setBaseArrayLayer(0);
-    range.setLayerCount(1);
-    range.setBaseMipLevel(0);
-    range.setLevelCount(1);
-    {
-        vk::ImageMemoryBarrier barrier;
-        barrier.setImage(image->image());
-        barrier.setOldLayout(vk::ImageLayout::eUndefined);
-        barrier.setNewLayout(vk::ImageLayout::eTransferDstOptimal);
-        barrier.setSrcQueueFamilyIndex(mGraphicsQueueFamilyIndex);
-        barrier.setDstQueueFamilyIndex(mGraphicsQueueFamilyIndex);
-        barrier.setSrcAccessMask(vk::AccessFlagBits::eTransferRead);
-        barrier.setDstAccessMask(vk::AccessFlagBits::eTransferWrite);
-        barrier.setSubresourceRange(range);
-        cmd->pipelineBarrier(
-            vk::PipelineStageFlagBits::eTransfer,
-            vk::PipelineStageFlagBits::eTransfer,
-            { }, { }, { }, { barrier });
-    }
-    {
-        vk::BufferImageCopy copy;
-        const auto size = image->size();
-        copy.setImageExtent({ size.x(), size.y(), 1 });
-        copy.setBufferOffset(buffer->offset());
-        copy.imageSubresource.setAspectMask(vk::ImageAspectFlagBits::eColor);
-        copy.imageSubresource.setLayerCount(1);
-        copy.imageSubresource.setBaseArrayLayer(0);
-        copy.imageSubresource.setMipLevel(0);
-        cmd->copyBufferToImage(
-            buffer->pool()->buffer(), image->image(),
-            vk::ImageLayout::eTransferDstOptimal, { copy });
-    }
-    {
-        vk::ImageMemoryBarrier barrier;
-        barrier.setImage(image->image());
-        barrier.setOldLayout(vk::ImageLayout::eTransferDstOptimal);
-        barrier.setNewLayout(vk::ImageLayout::eShaderReadOnlyOptimal);
-        barrier.setSrcQueueFamilyIndex(mGraphicsQueueFamilyIndex);
-        barrier.setDstQueueFamilyIndex(mGraphicsQueueFamilyIndex);
-        barrier.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite);
-        barrier.setDstAccessMask(vk::AccessFlagBits::eShaderRead);
-        barrier.setSubresourceRange(range);
-        cmd->pipelineBarrier(
-            vk::PipelineStageFlagBits::eTransfer,
-            vk::PipelineStageFlagBits::eFragmentShader,
-            { }, { }, { }, { barrier });
-    }
-    cmd->end();
-    {
-        vk::SubmitInfo info;
-        const auto cmd_handle = cmd.get();
-        info.setCommandBufferCount(1);
-        info.setPCommandBuffers(&cmd_handle);
-        mGraphicsQueue.submit({ info }, { });
-    }
-    // todo batch uploads & manage dependencies
-    mDevice->waitIdle();
+std::shared_ptr<usagi::GpuUploadHandle> usagi::VulkanGpuDevice::copyBuffer(
+    std::shared_ptr<VulkanBufferAllocation> src,
+    std::shared_ptr<VulkanBufferAllocation> dst)
+{
+    return mUploadQueue->copyBuffer(std::move(src), std::move(dst));
 }
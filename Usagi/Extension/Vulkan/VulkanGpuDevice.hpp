@@ -1,18 +1,31 @@
 ﻿#pragma once
 
-#include <deque>
+#include <mutex>
 
 #include <vulkan/vulkan.hpp>
 
 #include <Usagi/Runtime/Graphics/GpuDevice.hpp>
 
+#include "VulkanBindlessTextureTable.hpp"
+#include "VulkanDescriptorCache.hpp"
+#include "VulkanFrameCommandPool.hpp"
+#include "VulkanFramebufferCache.hpp"
+#include "VulkanMemoryBudget.hpp"
 #include "VulkanMemoryPool.hpp"
+#include "VulkanObjectCache.hpp"
+#include "VulkanPipelineCache.hpp"
+#include "VulkanTransientRing.hpp"
+#include "VulkanUploadQueue.hpp"
 
 namespace usagi
 {
-class BitmapMemoryAllocator;
+class TlsfMemoryAllocator;
 class VulkanMemoryPool;
 class VulkanBatchResource;
+class VulkanSemaphore;
+class VulkanSampler;
+class VulkanRenderPass;
+struct VulkanDescriptorSetLayout;
 
 class VulkanGpuDevice : public GpuDevice
 {
@@ -26,10 +39,42 @@ class VulkanGpuDevice : public GpuDevice
 
     vk::Queue mGraphicsQueue;
     std::uint32_t mGraphicsQueueFamilyIndex = -1;
+    vk::Queue mTransferQueue;
+    std::uint32_t mTransferQueueFamilyIndex = -1;
+    vk::Queue mComputeQueue;
+    std::uint32_t mComputeQueueFamilyIndex = -1;
+    /**
+     * \brief Serializes the submissions to all the queues, which may be
+     * made by the upload queue on the simulation thread while the render
+     * thread submits the frames.
+     */
+    std::mutex mQueueLock;
+    /**
+     * \brief The queue families accessing the buffers and the sampled and
+     * storage images concurrently. Empty if the resources are only used by
+     * the graphics queue family, which owns them exclusively.
+     */
+    std::vector<std::uint32_t> mSharingQueueFamilies;
 
     static uint32_t selectQueue(
         std::vector<vk::QueueFamilyProperties> &queue_family,
         const vk::QueueFlags &queue_flags);
+    /**
+     * \brief Find a queue family only supporting transfer operations, which
+     * usually corresponds to the DMA engines. Returns the graphics queue
+     * family if there is none.
+     */
+    static uint32_t selectTransferQueue(
+        std::vector<vk::QueueFamilyProperties> &queue_family,
+        uint32_t graphics_queue_family);
+    /**
+     * \brief Find a queue family supporting compute but not graphics
+     * operations, which runs concurrently with the graphics queue on most
+     * discrete GPUs. Returns the graphics queue family if there is none.
+     */
+    static uint32_t selectComputeQueue(
+        std::vector<vk::QueueFamilyProperties> &queue_family,
+        uint32_t graphics_queue_family);
     void checkQueuePresentationCapacity(uint32_t queue_family_index) const;
 
     static VKAPI_ATTR VkBool32 VKAPI_CALL debugMessengerCallbackDispatcher(
@@ -47,53 +92,161 @@ class VulkanGpuDevice : public GpuDevice
     void createDebugReport();
     void selectPhysicalDevice();
     void createDeviceAndQueues();
+    bool checkDeviceExtension(const char *name) const;
+
+    // Bindless Textures
+
+    static constexpr std::uint32_t MAX_BINDLESS_TEXTURES = 4096;
+    /**
+     * \brief Check whether the features required by the bindless texture
+     * table are available and determine its capacity.
+     */
+    bool checkBindlessTextureSupport(std::uint32_t &capacity) const;
+    /**
+     * \brief Null if bindless textures are not supported. Must outlive all
+     * image views, which release their slots to it.
+     */
+    std::unique_ptr<VulkanBindlessTextureTable> mBindlessTextures;
+
+    // Indirect Draws
+
+    bool mMultiDrawIndirect = false;
+    // loaded from VK_KHR_draw_indirect_count. null if not supported.
+    PFN_vkCmdDrawIndirectCountKHR mCmdDrawIndirectCount = nullptr;
+    PFN_vkCmdDrawIndexedIndirectCountKHR mCmdDrawIndexedIndirectCount =
+        nullptr;
+
+    // Pipeline Cache
+
+    std::unique_ptr<VulkanPipelineCache> mPipelineCache;
+
+    // Object Caches
+
+    VulkanObjectCache<VulkanSampler> mSamplers;
+    VulkanObjectCache<VulkanRenderPass> mRenderPasses;
+    VulkanObjectCache<VulkanDescriptorSetLayout> mDescriptorSetLayouts;
 
     // Memory Management
 
-    using BitmapBufferPool = VulkanBufferMemoryPool<BitmapMemoryAllocator>;
+    /**
+     * \brief Must outlive the pools, which return their blocks to it.
+     */
+    std::unique_ptr<VulkanMemoryBudget> mMemoryBudget;
+
+    using DynamicBufferPool = VulkanBufferMemoryPool<TlsfMemoryAllocator>;
     /**
      * \brief Used for per-frame updated buffers and resource staging.
      */
-    std::unique_ptr<BitmapBufferPool> mDynamicBufferPool;
+    std::unique_ptr<DynamicBufferPool> mDynamicBufferPool;
 
-    using BitmapImagePool = VulkanImageMemoryPool<BitmapMemoryAllocator>;
+    using StaticBufferPool = VulkanBufferMemoryPool<TlsfMemoryAllocator>;
     /**
-     * \brief Used for device-local textures.
+     * \brief Used for immutable or rarely updated buffers, which are
+     * filled using staging buffers if the memory is not host-visible.
      */
-    std::unique_ptr<BitmapImagePool> mDeviceImagePool;
+    std::unique_ptr<StaticBufferPool> mStaticBufferPool;
 
-    vk::UniqueCommandPool mTransferCommandPool;
+    using DeviceImagePool = VulkanImageMemoryPool<TlsfMemoryAllocator>;
+    /**
+     * \brief Used for device-local textures.
+     */
+    std::unique_ptr<DeviceImagePool> mDeviceImagePool;
 
     void createMemoryPools();
+    std::size_t mNonCoherentAtomSize = 1;
+
+    /**
+     * \brief Batches image uploads. Must be destroyed before the pools
+     * since it holds staging buffers.
+     */
+    std::unique_ptr<VulkanUploadQueue> mUploadQueue;
+
+    /**
+     * \brief Per-frame vertex, index and uniform data.
+     */
+    std::unique_ptr<VulkanTransientRing> mTransientRing;
 
     std::shared_ptr<GpuImage> mFallbackTexture;
     void createFallbackTexture();
 
-    // Resource Tracking
+    /**
+     * \brief Holds image views so must be destroyed before the pools.
+     */
+    std::unique_ptr<VulkanFramebufferCache> mFramebuffers;
+
+    // Frames in Flight
 
-    struct BatchResourceList
+    /**
+     * \brief The fences, semaphores, descriptor sets and command buffers
+     * used in a frame, which are recycled along with the resources of the
+     * jobs when the frame is retired.
+     */
+    struct FrameSlot
     {
-        vk::UniqueFence fence;
+        std::vector<vk::UniqueFence> fences;
+        std::size_t used_fences = 0;
+        std::vector<std::shared_ptr<VulkanSemaphore>> semaphores;
+        std::size_t used_semaphores = 0;
+        std::unique_ptr<VulkanDescriptorCache> descriptors;
+        std::unique_ptr<VulkanFrameCommandPool> command_pools;
+        // null if async compute is disabled
+        std::unique_ptr<VulkanFrameCommandPool> compute_command_pools;
+        // bindless texture slots released during the frame
+        std::vector<std::uint32_t> bindless_slots;
         std::vector<std::shared_ptr<VulkanBatchResource>> resources;
+        // transient memory allocated before the last submission
+        std::uint64_t transient_mark = 0;
     };
+    static constexpr std::size_t DEFAULT_FRAMES_IN_FLIGHT = 2;
     // must be the first to be destructed in dtor since it may refer to other
     // members.
-    std::deque<BatchResourceList> mBatchResourceLists;
+    std::vector<FrameSlot> mFrames;
+    std::size_t mCurrentFrame = 0;
+
+    /**
+     * \brief Create the objects of new frame slots. They are not created
+     * lazily since command lists are recorded on multiple threads.
+     */
+    void prepareFrames();
+    vk::Fence acquireFrameFence();
+    void submitJobs(
+        vk::Queue queue,
+        const std::vector<std::shared_ptr<GraphicsCommandList>> &jobs,
+        std::initializer_list<std::shared_ptr<GpuSemaphore>> wait_semaphores,
+        std::initializer_list<GraphicsPipelineStage> wait_stages,
+        std::initializer_list<std::shared_ptr<GpuSemaphore>> signal_semaphores
+    );
+    void waitFrame(FrameSlot &frame);
+    void retireFrame(FrameSlot &frame);
 
 public:
-    VulkanGpuDevice();
+    /**
+     * \brief
+     * \param cache_folder Where the pipeline cache is persisted. If empty,
+     * the cache is only kept in memory.
+     */
+    explicit VulkanGpuDevice(
+        const std::filesystem::path &cache_folder = "cache");
     ~VulkanGpuDevice();
 
     std::unique_ptr<GraphicsPipelineCompiler> createPipelineCompiler() override;
+    std::unique_ptr<ComputePipelineCompiler> createComputePipelineCompiler()
+        override;
     std::shared_ptr<Swapchain> createSwapchain(Window *window) override;
     std::shared_ptr<GpuCommandPool> createCommandPool() override;
     std::shared_ptr<RenderPass> createRenderPass(
         const RenderPassCreateInfo &info) override;
     std::shared_ptr<Framebuffer> createFramebuffer(
+        std::shared_ptr<RenderPass> render_pass,
         const Vector2u32 &size,
-        std::vector<std::shared_ptr<GpuImageView>> views) override;
+        const std::vector<std::shared_ptr<GpuImageView>> &views) override;
+    void invalidateFramebuffers() override;
     std::shared_ptr<GpuSemaphore> createSemaphore() override;
-    std::shared_ptr<GpuBuffer> createBuffer(GpuBufferUsage usage) override;
+    std::shared_ptr<GpuSemaphore> frameSemaphore() override;
+    std::shared_ptr<GpuBuffer> createBuffer(
+        GpuBufferUsage usage,
+        GpuBufferStorage storage) override;
+    GpuBufferSlice allocateTransient(std::size_t size) override;
     std::shared_ptr<GpuImage> createImage(const GpuImageCreateInfo &info)
         override;
     std::shared_ptr<GpuSampler> createSampler(const GpuSamplerCreateInfo &info)
@@ -106,6 +259,62 @@ public:
         std::initializer_list<GraphicsPipelineStage> wait_stages,
         std::initializer_list<std::shared_ptr<GpuSemaphore>> signal_semaphores
     ) override;
+    void submitComputeJobs(
+        const std::vector<std::shared_ptr<GraphicsCommandList>> &jobs,
+        std::initializer_list<std::shared_ptr<GpuSemaphore>> wait_semaphores,
+        std::initializer_list<GraphicsPipelineStage> wait_stages,
+        std::initializer_list<std::shared_ptr<GpuSemaphore>> signal_semaphores
+    ) override;
+    bool asyncComputeEnabled() const override;
+    bool indirectCountEnabled() const override;
+
+    void beginFrame() override;
+    void waitFramesInFlight() override;
+    std::size_t framesInFlight() const override;
+    void setFramesInFlight(std::size_t num_frames) override;
+
+    /**
+     * \brief The descriptor sets of the current frame.
+     */
+    VulkanDescriptorCache * descriptorCache();
+    /**
+     * \brief The command pools of the current frame.
+     */
+    VulkanFrameCommandPool * commandPools();
+    /**
+     * \brief The command pools of the current frame for compute jobs. Same
+     * as commandPools() if async compute is disabled.
+     */
+    VulkanFrameCommandPool * computeCommandPools();
+
+    VulkanPipelineCache * pipelineCache() const
+    {
+        return mPipelineCache.get();
+    }
+
+    VulkanObjectCache<VulkanDescriptorSetLayout> & descriptorSetLayouts()
+    {
+        return mDescriptorSetLayouts;
+    }
+
+    bool bindlessTexturesEnabled() const override;
+    VulkanBindlessTextureTable * bindlessTextures() const
+    {
+        return mBindlessTextures.get();
+    }
+
+    /**
+     * \brief Whether an indirect draw command may issue more than one draw.
+     */
+    bool multiDrawIndirectEnabled() const { return mMultiDrawIndirect; }
+    PFN_vkCmdDrawIndirectCountKHR cmdDrawIndirectCount() const
+    {
+        return mCmdDrawIndirectCount;
+    }
+    PFN_vkCmdDrawIndexedIndirectCountKHR cmdDrawIndexedIndirectCount() const
+    {
+        return mCmdDrawIndexedIndirectCount;
+    }
 
     void reclaimResources() override;
     void waitIdle() override;
@@ -113,13 +322,29 @@ public:
     vk::Device device() const;
     vk::PhysicalDevice physicalDevice() const;
     uint32_t graphicsQueueFamily() const;
+    const std::vector<std::uint32_t> & sharingQueueFamilies() const
+    {
+        return mSharingQueueFamilies;
+    }
 
     vk::Queue presentQueue() const;
+    /**
+     * \brief Must be held when submitting to or presenting on any queue.
+     */
+    std::mutex & queueLock() { return mQueueLock; }
+    VulkanMemoryBudget * memoryBudget() const { return mMemoryBudget.get(); }
+    /**
+     * \brief The granularity of flushing non-coherent mapped memory.
+     */
+    std::size_t nonCoherentAtomSize() const { return mNonCoherentAtomSize; }
 
     std::shared_ptr<VulkanBufferAllocation> allocateStageBuffer(
         std::size_t size);
-    void copyBufferToImage(
-        const std::shared_ptr<VulkanBufferAllocation> &buffer,
+    std::shared_ptr<GpuUploadHandle> copyBufferToImage(
+        std::shared_ptr<VulkanBufferAllocation> buffer,
         VulkanGpuImage *image);
+    std::shared_ptr<GpuUploadHandle> copyBuffer(
+        std::shared_ptr<VulkanBufferAllocation> src,
+        std::shared_ptr<VulkanBufferAllocation> dst);
 };
 }
@@ -44,7 +44,7 @@ void usagi::VulkanGpuImage::createBaseView()
     info.setSubresourceRange(subresource_range);
 
     mBaseView = std::make_shared<VulkanGpuImageView>(
-        this, mDevice.createImageViewUnique(info));
+        this, mDevice.createImageViewUnique(info), mBindlessTable);
 }
 
 usagi::VulkanGpuImage::VulkanGpuImage(
@@ -81,5 +81,5 @@ std::shared_ptr<usagi::GpuImageView> usagi::VulkanGpuImage::createView(
     vk_info.setSubresourceRange(subresource_range);
 
     return std::make_shared<VulkanGpuImageView>(
-        this, mDevice.createImageViewUnique(vk_info));
+        this, mDevice.createImageViewUnique(vk_info), mBindlessTable);
 }
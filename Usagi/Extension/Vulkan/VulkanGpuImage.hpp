@@ -9,6 +9,7 @@
 namespace usagi
 {
 class VulkanGpuImageView;
+class VulkanBindlessTextureTable;
 
 class VulkanGpuImage
     : public GpuImage
@@ -18,6 +19,11 @@ class VulkanGpuImage
 protected:
     vk::Device mDevice;
     std::shared_ptr<VulkanGpuImageView> mBaseView;
+    // set for sampled images if bindless textures are enabled
+    VulkanBindlessTextureTable *mBindlessTable = nullptr;
+    // created with concurrent sharing among the queue families, so its
+    // ownership is never transferred
+    bool mConcurrentSharing = false;
 
     vk::ImageAspectFlags getAspectsFromFormat() const;
     virtual void createBaseView();
@@ -33,5 +39,11 @@ public:
         const GpuImageViewCreateInfo &info) override;
 
     virtual vk::Image image() const = 0;
+
+    bool concurrentSharing() const { return mConcurrentSharing; }
+    void setConcurrentSharing(const bool concurrent)
+    {
+        mConcurrentSharing = concurrent;
+    }
 };
 }
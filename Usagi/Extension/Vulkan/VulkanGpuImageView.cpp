@@ -1,13 +1,27 @@
 ﻿#include "VulkanGpuImageView.hpp"
 
+#include "VulkanBindlessTextureTable.hpp"
 #include "VulkanGpuImage.hpp"
 
 usagi::VulkanGpuImageView::VulkanGpuImageView(
     VulkanGpuImage *image,
-    vk::UniqueImageView vk_image_view)
+    vk::UniqueImageView vk_image_view,
+    VulkanBindlessTextureTable *bindless_table)
     : mImage(image)
     , mImageView(std::move(vk_image_view))
+    , mBindlessTable(bindless_table)
 {
+    if(mBindlessTable)
+    {
+        mBindlessIndex = mBindlessTable->allocate(
+            mImageView.get(), vk::ImageLayout::eShaderReadOnlyOptimal);
+    }
+}
+
+usagi::VulkanGpuImageView::~VulkanGpuImageView()
+{
+    if(mBindlessTable)
+        mBindlessTable->release(mBindlessIndex);
 }
 
 void usagi::VulkanGpuImageView::fillShaderResourceInfo(
@@ -20,6 +34,10 @@ void usagi::VulkanGpuImageView::fillShaderResourceInfo(
         case vk::DescriptorType::eSampledImage:
             image_info.setImageLayout(vk::ImageLayout::eShaderReadOnlyOptimal);
             break;
+        // storage images must be transitioned to the general layout
+        case vk::DescriptorType::eStorageImage:
+            image_info.setImageLayout(vk::ImageLayout::eGeneral);
+            break;
         default:
             throw std::runtime_error("Unsupported image usage.");
     }
@@ -10,6 +10,7 @@
 namespace usagi
 {
 class VulkanGpuImage;
+class VulkanBindlessTextureTable;
 
 class VulkanGpuImageView
     : public GpuImageView
@@ -18,11 +19,24 @@ class VulkanGpuImageView
 {
     VulkanGpuImage *mImage;
     vk::UniqueImageView mImageView;
+    VulkanBindlessTextureTable *mBindlessTable = nullptr;
+    std::uint32_t mBindlessIndex = NO_BINDLESS_INDEX;
 
 public:
+    /**
+     * \brief
+     * \param image
+     * \param vk_image_view
+     * \param bindless_table If not null, the view takes a slot in the
+     * bindless texture array.
+     */
     VulkanGpuImageView(
         VulkanGpuImage *image,
-        vk::UniqueImageView vk_image_view);
+        vk::UniqueImageView vk_image_view,
+        VulkanBindlessTextureTable *bindless_table = nullptr);
+    ~VulkanGpuImageView();
+
+    std::uint32_t bindlessIndex() const override { return mBindlessIndex; }
 
     void fillShaderResourceInfo(
         vk::WriteDescriptorSet &write,
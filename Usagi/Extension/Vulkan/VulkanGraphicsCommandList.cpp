@@ -1,5 +1,10 @@
 ﻿#include "VulkanGraphicsCommandList.hpp"
 
+#include <algorithm>
+#include <cstring>
+#include <tuple>
+
+#include <Usagi/Runtime/Memory/ArenaAllocator.hpp>
 #include <Usagi/Utility/TypeCast.hpp>
 
 #include "VulkanGpuDevice.hpp"
@@ -13,16 +18,135 @@
 #include "VulkanBufferAllocation.hpp"
 #include "VulkanMemoryPool.hpp"
 #include "VulkanGraphicsPipeline.hpp"
+#include "VulkanComputePipeline.hpp"
 #include "VulkanGpuImageView.hpp"
 #include "VulkanShaderResource.hpp"
+#include "VulkanDescriptorCache.hpp"
+
+#include <Usagi/Runtime/Graphics/GraphicsCommandStream.hpp>
 
 using namespace usagi::vulkan;
 
+namespace
+{
+using vk::AccessFlagBits;
+
+const vk::AccessFlags WRITE_ACCESS =
+    AccessFlagBits::eHostWrite |
+    AccessFlagBits::eColorAttachmentWrite |
+    AccessFlagBits::eDepthStencilAttachmentWrite |
+    AccessFlagBits::eTransferWrite |
+    AccessFlagBits::eShaderWrite;
+
+/**
+ * \brief The accesses which may happen to an image in the layout.
+ */
+vk::AccessFlags layoutAccess(const vk::ImageLayout layout)
+{
+    switch(layout)
+    {
+        case vk::ImageLayout::ePreinitialized:
+            return AccessFlagBits::eHostWrite;
+        case vk::ImageLayout::eColorAttachmentOptimal:
+            return AccessFlagBits::eColorAttachmentRead |
+                AccessFlagBits::eColorAttachmentWrite;
+        case vk::ImageLayout::eDepthStencilAttachmentOptimal:
+            return AccessFlagBits::eDepthStencilAttachmentRead |
+                AccessFlagBits::eDepthStencilAttachmentWrite;
+        case vk::ImageLayout::eDepthStencilReadOnlyOptimal:
+            return AccessFlagBits::eDepthStencilAttachmentRead |
+                AccessFlagBits::eShaderRead;
+        case vk::ImageLayout::eTransferSrcOptimal:
+            return AccessFlagBits::eTransferRead;
+        case vk::ImageLayout::eTransferDstOptimal:
+            return AccessFlagBits::eTransferWrite;
+        case vk::ImageLayout::eShaderReadOnlyOptimal:
+            return AccessFlagBits::eShaderRead;
+        case vk::ImageLayout::eGeneral:
+            return AccessFlagBits::eShaderRead | AccessFlagBits::eShaderWrite |
+                AccessFlagBits::eTransferRead | AccessFlagBits::eTransferWrite;
+        // presentation is synchronized with semaphores
+        case vk::ImageLayout::ePresentSrcKHR:
+        case vk::ImageLayout::eUndefined:
+        default:
+            return { };
+    }
+}
+
+/**
+ * \brief The accesses which may be made by the commands in the stage.
+ */
+vk::AccessFlags stageAccess(const vk::PipelineStageFlagBits stage)
+{
+    using Stage = vk::PipelineStageFlagBits;
+    switch(stage)
+    {
+        case Stage::eDrawIndirect:
+            return AccessFlagBits::eIndirectCommandRead;
+        case Stage::eVertexInput:
+            return AccessFlagBits::eVertexAttributeRead |
+                AccessFlagBits::eIndexRead;
+        case Stage::eVertexShader:
+        case Stage::eGeometryShader:
+        case Stage::eFragmentShader:
+        case Stage::eComputeShader:
+            return AccessFlagBits::eUniformRead |
+                AccessFlagBits::eShaderRead | AccessFlagBits::eShaderWrite;
+        case Stage::eEarlyFragmentTests:
+        case Stage::eLateFragmentTests:
+            return AccessFlagBits::eDepthStencilAttachmentRead |
+                AccessFlagBits::eDepthStencilAttachmentWrite;
+        case Stage::eColorAttachmentOutput:
+            return AccessFlagBits::eColorAttachmentRead |
+                AccessFlagBits::eColorAttachmentWrite;
+        case Stage::eTransfer:
+            return AccessFlagBits::eTransferRead |
+                AccessFlagBits::eTransferWrite;
+        case Stage::eHost:
+            return AccessFlagBits::eHostRead | AccessFlagBits::eHostWrite;
+        // execution dependencies only
+        case Stage::eTopOfPipe:
+        case Stage::eBottomOfPipe:
+        default:
+            return { };
+    }
+}
+
+/**
+ * \brief The layout of the data read by fillShaderResourceInfo() is
+ * selected by the variant alternative.
+ */
+usagi::VulkanResourceInfo makeResourceInfo(const vk::DescriptorType type)
+{
+    switch(type)
+    {
+        case vk::DescriptorType::eUniformBuffer:
+        case vk::DescriptorType::eStorageBuffer:
+            return vk::DescriptorBufferInfo { };
+        default:
+            return vk::DescriptorImageInfo { };
+    }
+}
+
+void checkCompatibility(
+    const std::shared_ptr<usagi::VulkanFramebuffer> &framebuffer,
+    const std::shared_ptr<usagi::VulkanRenderPass> &render_pass)
+{
+    if(framebuffer->renderPass() != render_pass &&
+        framebuffer->renderPass()->compatibilityKey() !=
+        render_pass->compatibilityKey())
+        throw std::runtime_error(
+            "The framebuffer is incompatible with the render pass.");
+}
+}
+
 usagi::VulkanGraphicsCommandList::VulkanGraphicsCommandList(
     std::shared_ptr<VulkanGpuCommandPool> pool,
-    vk::UniqueCommandBuffer vk_command_buffer)
+    vk::CommandBuffer vk_command_buffer,
+    const bool secondary)
     : mCommandPool(std::move(pool))
-    , mCommandBuffer(std::move(vk_command_buffer))
+    , mCommandBuffer(vk_command_buffer)
+    , mSecondary(secondary)
 {
 }
 
@@ -32,12 +156,42 @@ void usagi::VulkanGraphicsCommandList::beginRecording()
     command_buffer_begin_info.setFlags(
         vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
 
-    mCommandBuffer->begin(command_buffer_begin_info);
+    mCommandBuffer.begin(command_buffer_begin_info);
+}
+
+void usagi::VulkanGraphicsCommandList::beginRecording(
+    std::shared_ptr<RenderPass> render_pass,
+    std::shared_ptr<Framebuffer> framebuffer)
+{
+    if(!mSecondary)
+        throw std::logic_error(
+            "Only secondary command lists can continue a render pass.");
+
+    auto vk_framebuffer =
+        dynamic_pointer_cast_throw<VulkanFramebuffer>(framebuffer);
+    const auto vk_renderpass =
+        dynamic_pointer_cast_throw<VulkanRenderPass>(render_pass);
+    checkCompatibility(vk_framebuffer, vk_renderpass);
+
+    vk::CommandBufferInheritanceInfo inheritance_info;
+    inheritance_info.setRenderPass(vk_renderpass->renderPass());
+    inheritance_info.setSubpass(0);
+    inheritance_info.setFramebuffer(vk_framebuffer->framebuffer());
+
+    vk::CommandBufferBeginInfo command_buffer_begin_info;
+    command_buffer_begin_info.setFlags(
+        vk::CommandBufferUsageFlagBits::eOneTimeSubmit |
+        vk::CommandBufferUsageFlagBits::eRenderPassContinue);
+    command_buffer_begin_info.setPInheritanceInfo(&inheritance_info);
+
+    mCommandBuffer.begin(command_buffer_begin_info);
+
+    mResources.push_back(std::move(vk_framebuffer));
 }
 
 void usagi::VulkanGraphicsCommandList::endRecording()
 {
-    mCommandBuffer->end();
+    mCommandBuffer.end();
 }
 
 void usagi::VulkanGraphicsCommandList::imageTransition(
@@ -58,72 +212,41 @@ void usagi::VulkanGraphicsCommandList::imageTransition(
     barrier.setSrcQueueFamilyIndex(queue_family_index);
     barrier.setDstQueueFamilyIndex(queue_family_index);
 
-    // modified from
-    // https://harrylovescode.gitbooks.io/vulkan-api/content/chap07/chap07.html
-    // todo: not reliable
-    using vk::AccessFlagBits;
-    switch(barrier.oldLayout)
-    {
-        case vk::ImageLayout::ePreinitialized:
-            barrier.srcAccessMask =
-                AccessFlagBits::eHostWrite;
-            break;
-        case vk::ImageLayout::eColorAttachmentOptimal:
-            barrier.srcAccessMask =
-                AccessFlagBits::eColorAttachmentWrite;
-            break;
-        case vk::ImageLayout::eDepthStencilAttachmentOptimal:
-            barrier.srcAccessMask =
-                AccessFlagBits::eDepthStencilAttachmentWrite;
-            break;
-        case vk::ImageLayout::eTransferSrcOptimal:
-            barrier.srcAccessMask = AccessFlagBits::eTransferRead;
-            break;
-        case vk::ImageLayout::eShaderReadOnlyOptimal:
-            barrier.srcAccessMask = AccessFlagBits::eShaderRead;
-            break;
-        //case vk::ImageLayout::ePresentSrcKHR:
-        //    barrier.srcAccessMask = AccessFlagBits::eMemoryRead;
-        //    break;
-        default: ;
-    }
-    switch(barrier.newLayout)
-    {
-        case vk::ImageLayout::eTransferDstOptimal:
-            barrier.dstAccessMask = AccessFlagBits::eTransferWrite;
-            break;
-        case vk::ImageLayout::eTransferSrcOptimal:
-            barrier.srcAccessMask |= AccessFlagBits::eTransferRead;
-            barrier.dstAccessMask = AccessFlagBits::eTransferRead;
-            break;
-        case vk::ImageLayout::eColorAttachmentOptimal:
-            barrier.dstAccessMask = AccessFlagBits::eColorAttachmentWrite;
-            barrier.srcAccessMask = AccessFlagBits::eTransferRead;
-            break;
-        case vk::ImageLayout::eDepthAttachmentStencilReadOnlyOptimal:
-            barrier.dstAccessMask |=
-                AccessFlagBits::eDepthStencilAttachmentWrite;
-            break;
-        case vk::ImageLayout::eShaderReadOnlyOptimal:
-            barrier.dstAccessMask = AccessFlagBits::eShaderRead;
-            break;
-        //case vk::ImageLayout::ePresentSrcKHR:
-        //    barrier.dstAccessMask = AccessFlagBits::eMemoryRead;
-        //    break;
-        default:;
-    }
+    // all writes possibly made in the old layout must be made available
+    // and all kinds of accesses in the new layout must see them
+    barrier.setSrcAccessMask(layoutAccess(barrier.oldLayout) & WRITE_ACCESS);
+    barrier.setDstAccessMask(layoutAccess(barrier.newLayout));
     barrier.subresourceRange.setAspectMask(vk::ImageAspectFlagBits::eColor);
     barrier.subresourceRange.setBaseArrayLayer(0);
     barrier.subresourceRange.setLayerCount(1);
     barrier.subresourceRange.setBaseMipLevel(0);
     barrier.subresourceRange.setLevelCount(1);
 
-    mCommandBuffer->pipelineBarrier(
+    mCommandBuffer.pipelineBarrier(
         translate(src_stage), translate(dest_stage),
         { }, { }, { }, { barrier }
     );
 }
 
+void usagi::VulkanGraphicsCommandList::memoryBarrier(
+    const GraphicsPipelineStage src_stage,
+    const GraphicsPipelineStage dest_stage)
+{
+    const auto vk_src_stage = translate(src_stage);
+    const auto vk_dest_stage = translate(dest_stage);
+
+    // a global barrier covers all buffers and images, which is usually
+    // cheaper than barriers on individual resources
+    vk::MemoryBarrier barrier;
+    barrier.setSrcAccessMask(stageAccess(vk_src_stage) & WRITE_ACCESS);
+    barrier.setDstAccessMask(stageAccess(vk_dest_stage));
+
+    mCommandBuffer.pipelineBarrier(
+        vk_src_stage, vk_dest_stage,
+        { }, { barrier }, { }, { }
+    );
+}
+
 // note: bad performance on tile-based GPUs
 // https://developer.samsung.com/game/usage#clearingattachments
 void usagi::VulkanGraphicsCommandList::clearColorImage(
@@ -142,7 +265,7 @@ void usagi::VulkanGraphicsCommandList::clearColorImage(
     subresource_range.setLayerCount(1);
     subresource_range.setBaseMipLevel(0);
     subresource_range.setLevelCount(1);
-    mCommandBuffer->clearColorImage(
+    mCommandBuffer.clearColorImage(
         vk_image.image(), translate(layout),
         color_value, { subresource_range }
     );
@@ -150,16 +273,14 @@ void usagi::VulkanGraphicsCommandList::clearColorImage(
 
 void usagi::VulkanGraphicsCommandList::beginRendering(
     std::shared_ptr<RenderPass> render_pass,
-    std::shared_ptr<Framebuffer> framebuffer)
+    std::shared_ptr<Framebuffer> framebuffer,
+    const RenderingContents contents)
 {
     auto vk_framebuffer =
         dynamic_pointer_cast_throw<VulkanFramebuffer>(framebuffer);
     const auto vk_renderpass =
         dynamic_pointer_cast_throw<VulkanRenderPass>(render_pass);
-
-    // todo reuse framebuffers?
-    // todo unmatched view amount?
-    vk_framebuffer->create(vk_renderpass);
+    checkCompatibility(vk_framebuffer, vk_renderpass);
 
     vk::RenderPassBeginInfo begin_info;
     // todo support clear values
@@ -172,7 +293,11 @@ void usagi::VulkanGraphicsCommandList::beginRendering(
     begin_info.setClearValueCount(static_cast<uint32_t>(clear_values.size()));
     begin_info.setPClearValues(clear_values.data());
     // assuming that only one render pass is used
-    mCommandBuffer->beginRenderPass(begin_info, vk::SubpassContents::eInline);
+    mExecutesSecondary =
+        contents == RenderingContents::SECONDARY_COMMAND_LISTS;
+    mCommandBuffer.beginRenderPass(begin_info, mExecutesSecondary
+        ? vk::SubpassContents::eSecondaryCommandBuffers
+        : vk::SubpassContents::eInline);
 
     for(auto &&view : vk_framebuffer->views())
     {
@@ -185,8 +310,32 @@ void usagi::VulkanGraphicsCommandList::beginRendering(
 
 void usagi::VulkanGraphicsCommandList::endRendering()
 {
-    mCurrentPipeline.reset();
-    mCommandBuffer->endRenderPass();
+    mGraphicsState.pipeline = nullptr;
+    mExecutesSecondary = false;
+    mCommandBuffer.endRenderPass();
+}
+
+void usagi::VulkanGraphicsCommandList::executeCommandLists(
+    const std::vector<std::shared_ptr<GraphicsCommandList>> &command_lists)
+{
+    if(!mExecutesSecondary)
+        throw std::logic_error(
+            "The render pass was not begun for secondary command lists.");
+
+    FrameVector<vk::CommandBuffer> buffers;
+    buffers.reserve(command_lists.size());
+    for(auto &&c : command_lists)
+    {
+        auto vk_list = dynamic_pointer_cast_throw<VulkanGraphicsCommandList>(c);
+        if(!vk_list->mSecondary)
+            throw std::logic_error(
+                "Only secondary command lists can be executed.");
+        buffers.push_back(vk_list->commandBuffer());
+        // the resources used by the list are kept alive along with it
+        mResources.push_back(std::move(vk_list));
+    }
+    mCommandBuffer.executeCommands(
+        static_cast<std::uint32_t>(buffers.size()), buffers.data());
 }
 
 void usagi::VulkanGraphicsCommandList::bindPipeline(
@@ -195,107 +344,135 @@ void usagi::VulkanGraphicsCommandList::bindPipeline(
     auto vk_pipeline =
         dynamic_pointer_cast_throw<VulkanGraphicsPipeline>(pipeline);
 
-    if(mCurrentPipeline == vk_pipeline) return;
-
-    mCommandBuffer->bindPipeline(vk::PipelineBindPoint::eGraphics,
-        vk_pipeline->pipeline());
-    mCurrentPipeline = vk_pipeline;
-    mResources.push_back(std::move(vk_pipeline));
+    const auto bound = mGraphicsState.pipeline == vk_pipeline.get();
+    bindVulkanPipeline(vk_pipeline.get());
+    if(!bound) mResources.push_back(std::move(vk_pipeline));
 }
 
-void usagi::VulkanGraphicsCommandList::createDescriptorPool()
+void usagi::VulkanGraphicsCommandList::bindPipeline(
+    std::shared_ptr<ComputePipeline> pipeline)
 {
-    // todo: precise control over allocation size
-    vk::DescriptorPoolCreateInfo info;
-    info.setMaxSets(16);
-    std::initializer_list<vk::DescriptorPoolSize> sizes {
-        { vk::DescriptorType::eSampler, 16 },
-    { vk::DescriptorType::eSampledImage, 16 },
-    { vk::DescriptorType::eUniformBuffer, 16 },
-    };
-    info.setPoolSizeCount(static_cast<uint32_t>(sizes.size()));
-    info.setPPoolSizes(sizes.begin());
-    mDescriptorPools.push_back(
-        mCommandPool->device()->device().createDescriptorPoolUnique(info));
+    auto vk_pipeline =
+        dynamic_pointer_cast_throw<VulkanComputePipeline>(pipeline);
+
+    const auto bound = mComputeState.pipeline == vk_pipeline.get();
+    bindVulkanPipeline(vk_pipeline.get());
+    if(!bound) mResources.push_back(std::move(vk_pipeline));
 }
 
-vk::DescriptorSet usagi::VulkanGraphicsCommandList::
-    allocateDescriptorSet(const std::uint32_t set_id)
+usagi::VulkanPipeline * usagi::VulkanGraphicsCommandList::currentPipeline()
+    const
 {
-    assert(mCurrentPipeline);
-
-    auto allow_new_pool = true;
-
-    if(mDescriptorPools.empty())
-    {
-        createDescriptorPool();
-        allow_new_pool = false;
-    }
+    if(mCurrentState->pipeline == nullptr)
+        throw std::runtime_error(
+            "No active pipeline is bound, unable to retrieve pipeline layout.");
+    return mCurrentState->pipeline;
+}
 
-    while(true) try
-    {
-        vk::DescriptorSetAllocateInfo info;
-        info.setDescriptorPool(mDescriptorPools.back().get());
-        info.setDescriptorSetCount(1);
-        const auto layout = { mCurrentPipeline->descriptorSetLayout(set_id) };
-        info.setPSetLayouts(layout.begin());
-
-        mDescriptorSets.push_back(mCommandPool->device()->device()
-            .allocateDescriptorSets(info).front());
-        return mDescriptorSets.back();
-    }
-    catch(const vk::SystemError &e)
+void usagi::VulkanGraphicsCommandList::bindVulkanPipeline(
+    VulkanPipeline *vk_pipeline)
+{
+    const auto bind_point = vk_pipeline->bindPoint();
+    auto &state = bind_point == vk::PipelineBindPoint::eCompute
+        ? mComputeState : mGraphicsState;
+    // switching back to the other bind point does not rebind its pipeline
+    mCurrentState = &state;
+    if(state.pipeline == vk_pipeline) return;
+
+    mCommandBuffer.bindPipeline(bind_point, vk_pipeline->pipeline());
+    // conservatively assume that the layouts are incompatible
+    auto &sets = state.descriptor_sets;
+    if(!state.pipeline || state.pipeline->layout() != vk_pipeline->layout())
+        sets.clear();
+    if(const auto bindless_set = vk_pipeline->bindlessSet())
     {
-        switch(static_cast<vk::Result>(e.code().value()))
+        const auto table_set =
+            mCommandPool->device()->bindlessTextures()->set();
+        if(*bindless_set >= sets.size() || sets[*bindless_set] != table_set)
         {
-            case vk::Result::eErrorFragmentedPool:
-            case vk::Result::eErrorOutOfPoolMemory:
-                if(!allow_new_pool) throw;
-                createDescriptorPool();
-                allow_new_pool = false;
-            default: break;
+            mCommandBuffer.bindDescriptorSets(
+                bind_point,
+                vk_pipeline->layout(),
+                *bindless_set, { table_set }, { }
+            );
+            if(*bindless_set >= sets.size())
+                sets.resize(*bindless_set + 1);
+            sets[*bindless_set] = table_set;
         }
     }
+    state.pipeline = vk_pipeline;
 }
 
-// todo performance
 void usagi::VulkanGraphicsCommandList::bindResourceSet(
     const std::uint32_t set_id,
     std::initializer_list<std::shared_ptr<ShaderResource>> resources)
 {
-    auto vk_resources = vulkan::transformObjects(resources, [](auto &&r) {
-        return dynamic_pointer_cast_throw<VulkanShaderResource>(r);
-    });
+    FrameVector<VulkanShaderResource *> vk_resources;
+    vk_resources.reserve(resources.size());
+    for(auto &&r : resources)
+        vk_resources.push_back(&dynamic_cast_ref<VulkanShaderResource>(r));
+    bindResources(set_id, vk_resources.data(), vk_resources.size(),
+        resources.begin());
+}
 
-    const auto desc_set = allocateDescriptorSet(set_id);
-    std::vector<vk::WriteDescriptorSet> writes {
-        vk_resources.size(), vk::WriteDescriptorSet {}
-    };
-    std::vector<VulkanResourceInfo> res_infos {
-        vk_resources.size(), VulkanResourceInfo { }
-    };
-    for(std::size_t i = 0; i < writes.size(); ++i)
+void usagi::VulkanGraphicsCommandList::retainResource(
+    std::shared_ptr<ShaderResource> resource)
+{
+    auto batch_res =
+        dynamic_pointer_cast_throw<VulkanBatchResource>(resource);
+    batch_res->appendAdditionalResources(mResources);
+    mResources.push_back(std::move(batch_res));
+}
+
+void usagi::VulkanGraphicsCommandList::bindResources(
+    const std::uint32_t set_id,
+    VulkanShaderResource * const *resources,
+    const std::size_t count,
+    const std::shared_ptr<ShaderResource> *retained)
+{
+    if(mCurrentState->pipeline == nullptr)
+        throw std::runtime_error(
+            "No active pipeline is bound, unable to retrieve set layout.");
+    const auto pipeline = mCurrentState->pipeline;
+
+    const auto &update_template = pipeline->descriptorUpdateTemplate(set_id);
+    if(count < update_template.data_count)
+        throw std::runtime_error("Insufficient resources for the set.");
+
+    // the descriptors also identify the set in the cache
+    FrameVector<VulkanDescriptorData> data;
+    data.reserve(count);
+    for(std::size_t i = 0; i < count; ++i)
     {
-        auto &res = vk_resources[i];
-        auto batch_res = dynamic_pointer_cast_throw<VulkanBatchResource>(res);
-        auto &write = writes[i];
-        write.setDescriptorType(mCurrentPipeline->descriptorType(
-            set_id, static_cast<uint32_t>(i)));
-        write.setDstSet(desc_set);
-        write.setDstBinding(static_cast<uint32_t>(i));
-        write.setDstArrayElement(0);
-        write.setDescriptorCount(1);
-        res->fillShaderResourceInfo(write, res_infos[i]);
-        batch_res->appendAdditionalResources(mResources);
-        mResources.push_back(std::move(batch_res));
+        // the resources fill the descriptors according to the types
+        // declared by the shaders
+        vk::WriteDescriptorSet write;
+        write.setDescriptorType(pipeline->descriptorType(
+            set_id, static_cast<std::uint32_t>(i)));
+        auto info = makeResourceInfo(write.descriptorType);
+        resources[i]->fillShaderResourceInfo(write, info);
+        data.push_back(makeDescriptorData(info));
     }
 
-    mCommandPool->device()->device().updateDescriptorSets(writes, { });
-    mCommandBuffer->bindDescriptorSets(
-        vk::PipelineBindPoint::eGraphics,
-        mCurrentPipeline->layout(),
+    const auto desc_set = mCommandPool->device()->descriptorCache()->acquire(
+        pipeline->descriptorSetLayout(set_id),
+        update_template.update_template.get(),
+        data.data(), data.size(),
+        retained, count
+    );
+
+    auto &sets = mCurrentState->descriptor_sets;
+    if(set_id < sets.size() && sets[set_id] == desc_set)
+        return;
+
+    mCommandBuffer.bindDescriptorSets(
+        pipeline->bindPoint(),
+        pipeline->layout(),
         set_id, { desc_set }, { }
     );
+    if(set_id >= sets.size())
+        sets.resize(set_id + 1);
+    sets[set_id] = desc_set;
 }
 
 void usagi::VulkanGraphicsCommandList::setViewport(
@@ -305,7 +482,7 @@ void usagi::VulkanGraphicsCommandList::setViewport(
     vk::Viewport viewports[] = {
         { origin.x(), origin.y(), size.x(), size.y(), 0.f, 1.f }
     };
-    mCommandBuffer->setViewport(index, 1, viewports);
+    mCommandBuffer.setViewport(index, 1, viewports);
 }
 
 void usagi::VulkanGraphicsCommandList::setScissor(
@@ -317,12 +494,12 @@ void usagi::VulkanGraphicsCommandList::setScissor(
         { origin.x(), origin.y() },
         { size.x(), size.y() }
     };
-    mCommandBuffer->setScissor(viewport_index, 1, &scissor);
+    mCommandBuffer.setScissor(viewport_index, 1, &scissor);
 }
 
 void usagi::VulkanGraphicsCommandList::setLineWidth(float width)
 {
-    mCommandBuffer->setLineWidth(width);
+    mCommandBuffer.setLineWidth(width);
 }
 
 void usagi::VulkanGraphicsCommandList::setConstant(
@@ -331,22 +508,77 @@ void usagi::VulkanGraphicsCommandList::setConstant(
     const void *data,
     const std::size_t size)
 {
-    if(mCurrentPipeline == nullptr)
-        throw std::runtime_error(
-            "No active pipeline is bound, unable to retrieve pipeline layout.");
+    const auto pipeline = currentPipeline();
 
-    const auto constant_info = mCurrentPipeline->queryConstantInfo(stage, name);
+    const auto constant_info = pipeline->queryConstantInfo(stage, name);
     if(size != constant_info.size)
 	    throw std::runtime_error("Unmatched constant size.");
 
-    mCommandBuffer->pushConstants(
-        mCurrentPipeline->layout(),
+    mCommandBuffer.pushConstants(
+        pipeline->layout(),
         translate(stage),
         constant_info.offset, constant_info.size,
         data
     );
 }
 
+void usagi::VulkanGraphicsCommandList::setConstant(
+    const ShaderConstantHandle &handle,
+    const void *data)
+{
+    mCommandBuffer.pushConstants(
+        currentPipeline()->layout(),
+        translate(handle.stage),
+        handle.offset, handle.size,
+        data
+    );
+}
+
+void usagi::VulkanGraphicsCommandList::setConstants(
+    std::initializer_list<ShaderConstantWrite> writes)
+{
+    const auto layout = currentPipeline()->layout();
+
+    FrameVector<ShaderConstantWrite> sorted { writes.begin(), writes.end() };
+    std::sort(sorted.begin(), sorted.end(), [](auto &&a, auto &&b) {
+        return std::tie(a.handle.stage, a.handle.offset) <
+            std::tie(b.handle.stage, b.handle.offset);
+    });
+
+    // Vulkan guarantees at least 128 bytes of push constants
+    constexpr std::size_t MAX_RUN_SIZE = 256;
+    alignas(16) std::uint8_t run[MAX_RUN_SIZE];
+    std::uint32_t run_begin = 0, run_end = 0;
+    ShaderStage run_stage = ShaderStage::VERTEX;
+
+    const auto flush = [&]() {
+        if(run_end == run_begin) return;
+        mCommandBuffer.pushConstants(
+            layout,
+            translate(run_stage),
+            run_begin, run_end - run_begin,
+            run
+        );
+        run_begin = run_end;
+    };
+
+    // merge adjacent fields into runs
+    for(auto &&w : sorted)
+    {
+        const auto &h = w.handle;
+        if(h.stage != run_stage || h.offset != run_end ||
+            h.offset + h.size - run_begin > MAX_RUN_SIZE)
+        {
+            flush();
+            run_stage = h.stage;
+            run_begin = run_end = h.offset;
+        }
+        memcpy(run + (h.offset - run_begin), w.data, h.size);
+        run_end = h.offset + h.size;
+    }
+    flush();
+}
+
 void usagi::VulkanGraphicsCommandList::bindIndexBuffer(
     const std::shared_ptr<GpuBuffer> &buffer,
 	const std::size_t offset,
@@ -355,8 +587,8 @@ void usagi::VulkanGraphicsCommandList::bindIndexBuffer(
 	auto &vk_buffer = dynamic_cast_ref<VulkanGpuBuffer>(buffer.get());
     auto allocation = vk_buffer.allocation();
 
-    mCommandBuffer->bindIndexBuffer(
-        allocation->pool()->buffer(), allocation->offset() + offset,
+    mCommandBuffer.bindIndexBuffer(
+        allocation->buffer(), allocation->offset() + offset,
         translate(type)
 	);
 
@@ -371,10 +603,10 @@ void usagi::VulkanGraphicsCommandList::bindVertexBuffer(
 	auto &vk_buffer = dynamic_cast_ref<VulkanGpuBuffer>(buffer.get());
     auto allocation = vk_buffer.allocation();
 
-	vk::Buffer buffers[] = { allocation->pool()->buffer() };
+	vk::Buffer buffers[] = { allocation->buffer() };
     vk::DeviceSize sizes[] = { allocation->offset() + offset };
 
-    mCommandBuffer->bindVertexBuffers(binding_index, 1, buffers, sizes);
+    mCommandBuffer.bindVertexBuffers(binding_index, 1, buffers, sizes);
 
     mResources.push_back(std::move(allocation));
 }
@@ -385,7 +617,7 @@ void usagi::VulkanGraphicsCommandList::drawInstanced(
     const std::uint32_t first_vertex,
     const std::uint32_t first_instance)
 {
-    mCommandBuffer->draw(vertex_count, instance_count, first_vertex,
+    mCommandBuffer.draw(vertex_count, instance_count, first_vertex,
         first_instance);
 }
 
@@ -396,6 +628,255 @@ void usagi::VulkanGraphicsCommandList::drawIndexedInstanced(
     const std::int32_t vertex_offset,
     const std::uint32_t first_instance)
 {
-    mCommandBuffer->drawIndexed(index_count, instance_count, first_index,
+    mCommandBuffer.drawIndexed(index_count, instance_count, first_index,
         vertex_offset, first_instance);
 }
+
+std::pair<vk::Buffer, vk::DeviceSize>
+    usagi::VulkanGraphicsCommandList::retainBuffer(
+        const std::shared_ptr<GpuBuffer> &buffer)
+{
+    auto allocation =
+        dynamic_cast_ref<VulkanGpuBuffer>(buffer.get()).allocation();
+    std::pair<vk::Buffer, vk::DeviceSize> result {
+        allocation->buffer(), allocation->offset()
+    };
+    mResources.push_back(std::move(allocation));
+    return result;
+}
+
+void usagi::VulkanGraphicsCommandList::drawIndirect(
+    const vk::Buffer buffer,
+    const vk::DeviceSize offset,
+    const std::uint32_t draw_count,
+    const std::uint32_t stride,
+    const bool indexed)
+{
+    if(mCommandPool->device()->multiDrawIndirectEnabled())
+    {
+        if(indexed)
+            mCommandBuffer.drawIndexedIndirect(
+                buffer, offset, draw_count, stride);
+        else
+            mCommandBuffer.drawIndirect(buffer, offset, draw_count, stride);
+        return;
+    }
+    for(std::uint32_t i = 0; i < draw_count; ++i)
+    {
+        const auto draw_offset = offset + vk::DeviceSize { stride } * i;
+        if(indexed)
+            mCommandBuffer.drawIndexedIndirect(buffer, draw_offset, 1, stride);
+        else
+            mCommandBuffer.drawIndirect(buffer, draw_offset, 1, stride);
+    }
+}
+
+void usagi::VulkanGraphicsCommandList::drawIndirect(
+    const std::shared_ptr<GpuBuffer> &buffer,
+    const std::size_t offset,
+    const std::uint32_t draw_count,
+    const std::uint32_t stride)
+{
+    const auto vk_buffer = retainBuffer(buffer);
+    drawIndirect(vk_buffer.first, vk_buffer.second + offset,
+        draw_count, stride, false);
+}
+
+void usagi::VulkanGraphicsCommandList::drawIndexedIndirect(
+    const std::shared_ptr<GpuBuffer> &buffer,
+    const std::size_t offset,
+    const std::uint32_t draw_count,
+    const std::uint32_t stride)
+{
+    const auto vk_buffer = retainBuffer(buffer);
+    drawIndirect(vk_buffer.first, vk_buffer.second + offset,
+        draw_count, stride, true);
+}
+
+void usagi::VulkanGraphicsCommandList::drawIndirectCount(
+    const std::shared_ptr<GpuBuffer> &buffer,
+    const std::size_t offset,
+    const std::shared_ptr<GpuBuffer> &count_buffer,
+    const std::size_t count_offset,
+    const std::uint32_t max_draw_count,
+    const std::uint32_t stride)
+{
+    const auto func = mCommandPool->device()->cmdDrawIndirectCount();
+    if(!func)
+        throw std::runtime_error("Indirect count is not supported.");
+
+    const auto vk_buffer = retainBuffer(buffer);
+    const auto vk_count_buffer = retainBuffer(count_buffer);
+    func(static_cast<VkCommandBuffer>(mCommandBuffer),
+        static_cast<VkBuffer>(vk_buffer.first), vk_buffer.second + offset,
+        static_cast<VkBuffer>(vk_count_buffer.first),
+        vk_count_buffer.second + count_offset,
+        max_draw_count, stride);
+}
+
+void usagi::VulkanGraphicsCommandList::drawIndexedIndirectCount(
+    const std::shared_ptr<GpuBuffer> &buffer,
+    const std::size_t offset,
+    const std::shared_ptr<GpuBuffer> &count_buffer,
+    const std::size_t count_offset,
+    const std::uint32_t max_draw_count,
+    const std::uint32_t stride)
+{
+    const auto func = mCommandPool->device()->cmdDrawIndexedIndirectCount();
+    if(!func)
+        throw std::runtime_error("Indirect count is not supported.");
+
+    const auto vk_buffer = retainBuffer(buffer);
+    const auto vk_count_buffer = retainBuffer(count_buffer);
+    func(static_cast<VkCommandBuffer>(mCommandBuffer),
+        static_cast<VkBuffer>(vk_buffer.first), vk_buffer.second + offset,
+        static_cast<VkBuffer>(vk_count_buffer.first),
+        vk_count_buffer.second + count_offset,
+        max_draw_count, stride);
+}
+
+void usagi::VulkanGraphicsCommandList::executeCommandStream(
+    const GraphicsCommandStream &stream)
+{
+    using Stream = GraphicsCommandStream;
+
+    // resolve the handles and retain the resources once for the stream
+    FrameVector<VulkanGraphicsPipeline *> pipelines;
+    pipelines.reserve(stream.pipelines().size());
+    for(auto &&p : stream.pipelines())
+    {
+        auto vk_pipeline =
+            dynamic_pointer_cast_throw<VulkanGraphicsPipeline>(p);
+        pipelines.push_back(vk_pipeline.get());
+        mResources.push_back(std::move(vk_pipeline));
+    }
+    FrameVector<std::pair<vk::Buffer, vk::DeviceSize>> buffers;
+    buffers.reserve(stream.buffers().size());
+    for(auto &&b : stream.buffers())
+        buffers.push_back(retainBuffer(b));
+    for(auto &&r : stream.resources())
+        retainResource(r);
+    // the command list keeps the set resources alive, so the descriptor
+    // cache does not need to retain them on each miss
+    FrameVector<VulkanShaderResource *> set_resources;
+    set_resources.reserve(stream.setResources().size());
+    for(auto &&r : stream.setResources())
+    {
+        set_resources.push_back(&dynamic_cast_ref<VulkanShaderResource>(r));
+        retainResource(r);
+    }
+
+    struct Translator
+    {
+        VulkanGraphicsCommandList &list;
+        const Stream &stream;
+        const FrameVector<VulkanGraphicsPipeline *> &pipelines;
+        const FrameVector<std::pair<vk::Buffer, vk::DeviceSize>> &buffers;
+        const FrameVector<VulkanShaderResource *> &set_resources;
+
+        void operator()(const Stream::BindPipeline &c)
+        {
+            list.bindVulkanPipeline(pipelines[c.pipeline]);
+        }
+
+        void operator()(const Stream::BindResourceSet &c)
+        {
+            const auto set = stream.resourceSet(c.resource_set);
+            list.bindResources(c.set_id, set_resources.data() + set.first,
+                set.count, nullptr);
+        }
+
+        void operator()(const Stream::BindIndexBuffer &c)
+        {
+            const auto &buffer = buffers[c.buffer];
+            list.mCommandBuffer.bindIndexBuffer(
+                buffer.first, buffer.second + c.offset, translate(c.type));
+        }
+
+        void operator()(const Stream::BindVertexBuffer &c)
+        {
+            const auto &buffer = buffers[c.buffer];
+            const vk::DeviceSize offset = buffer.second + c.offset;
+            list.mCommandBuffer.bindVertexBuffers(
+                c.binding_index, 1, &buffer.first, &offset);
+        }
+
+        void operator()(const Stream::SetViewport &c)
+        {
+            const vk::Viewport viewport {
+                c.origin[0], c.origin[1], c.size[0], c.size[1], 0.f, 1.f
+            };
+            list.mCommandBuffer.setViewport(c.index, 1, &viewport);
+        }
+
+        void operator()(const Stream::SetScissor &c)
+        {
+            const vk::Rect2D scissor {
+                { c.origin[0], c.origin[1] },
+                { c.size[0], c.size[1] }
+            };
+            list.mCommandBuffer.setScissor(c.viewport_index, 1, &scissor);
+        }
+
+        void operator()(const Stream::SetLineWidth &c)
+        {
+            list.mCommandBuffer.setLineWidth(c.width);
+        }
+
+        void operator()(const ShaderConstantWrite &c)
+        {
+            list.mCommandBuffer.pushConstants(
+                list.currentPipeline()->layout(),
+                translate(c.handle.stage),
+                c.handle.offset, c.handle.size,
+                c.data
+            );
+        }
+
+        void operator()(const Stream::DrawInstanced &c)
+        {
+            list.mCommandBuffer.draw(c.vertex_count, c.instance_count,
+                c.first_vertex, c.first_instance);
+        }
+
+        void operator()(const Stream::DrawIndexedInstanced &c)
+        {
+            list.mCommandBuffer.drawIndexed(c.index_count, c.instance_count,
+                c.first_index, c.vertex_offset, c.first_instance);
+        }
+
+        void operator()(const Stream::DrawIndirect &c)
+        {
+            const auto &buffer = buffers[c.buffer];
+            list.drawIndirect(buffer.first, buffer.second + c.offset,
+                c.draw_count, c.stride, false);
+        }
+
+        void operator()(const Stream::DrawIndexedIndirect &c)
+        {
+            const auto &buffer = buffers[c.buffer];
+            list.drawIndirect(buffer.first, buffer.second + c.offset,
+                c.draw_count, c.stride, true);
+        }
+    };
+
+    stream.visit(Translator {
+        *this, stream, pipelines, buffers, set_resources
+    });
+}
+
+void usagi::VulkanGraphicsCommandList::dispatch(
+    const std::uint32_t group_count_x,
+    const std::uint32_t group_count_y,
+    const std::uint32_t group_count_z)
+{
+    mCommandBuffer.dispatch(group_count_x, group_count_y, group_count_z);
+}
+
+void usagi::VulkanGraphicsCommandList::dispatchIndirect(
+    const std::shared_ptr<GpuBuffer> &buffer,
+    const std::size_t offset)
+{
+    const auto vk_buffer = retainBuffer(buffer);
+    mCommandBuffer.dispatchIndirect(vk_buffer.first, vk_buffer.second + offset);
+}
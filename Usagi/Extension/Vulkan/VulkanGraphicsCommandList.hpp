@@ -1,5 +1,7 @@
 ﻿#pragma once
 
+#include <utility>
+
 #include <vulkan/vulkan.hpp>
 
 #include <Usagi/Runtime/Graphics/GraphicsCommandList.hpp>
@@ -9,7 +11,8 @@
 namespace usagi
 {
 class VulkanGpuCommandPool;
-class VulkanGraphicsPipeline;
+class VulkanPipeline;
+class VulkanShaderResource;
 
 class VulkanGraphicsCommandList
     : public GraphicsCommandList
@@ -18,22 +21,60 @@ class VulkanGraphicsCommandList
     // this shared_ptr is used to ensure that the pool won't be freed before
     // command lists.
     std::shared_ptr<VulkanGpuCommandPool> mCommandPool;
-    vk::UniqueCommandBuffer mCommandBuffer;
-    std::shared_ptr<VulkanGraphicsPipeline> mCurrentPipeline;
-    std::vector<vk::UniqueDescriptorPool> mDescriptorPools;
-    // whole pool is discarded after use, so unique handles are not used.
-    std::vector<vk::DescriptorSet> mDescriptorSets;
+    // owned by the command pools of the frame
+    vk::CommandBuffer mCommandBuffer;
+    bool mSecondary = false;
+    // the render pass is continued from secondary command lists
+    bool mExecutesSecondary = false;
+
+    // graphics and compute pipelines have separate binding states
+    struct BindPointState
+    {
+        // retained by mResources
+        VulkanPipeline *pipeline = nullptr;
+        // the sets bound with the layout of the pipeline, indexed by set
+        // ids. used for skipping redundant bindings.
+        std::vector<vk::DescriptorSet> descriptor_sets;
+    };
+    BindPointState mGraphicsState;
+    BindPointState mComputeState;
+    // the bind point of the pipeline bound most recently, which resource
+    // sets and constants are applied to
+    BindPointState *mCurrentState = &mGraphicsState;
     std::vector<std::shared_ptr<VulkanBatchResource>> mResources;
 
-    void createDescriptorPool();
-    vk::DescriptorSet allocateDescriptorSet(std::uint32_t set_id);
+    VulkanPipeline * currentPipeline() const;
+    // the pipeline must be retained by the caller
+    void bindVulkanPipeline(VulkanPipeline *pipeline);
+    // retained may be nullptr if the resources are already retained by the
+    // command list
+    void bindResources(
+        std::uint32_t set_id,
+        VulkanShaderResource * const *resources,
+        std::size_t count,
+        const std::shared_ptr<ShaderResource> *retained);
+    // issues the draws one by one if multi-draw is not supported
+    void drawIndirect(
+        vk::Buffer buffer,
+        vk::DeviceSize offset,
+        std::uint32_t draw_count,
+        std::uint32_t stride,
+        bool indexed);
+    // returns the buffer and the offset of the allocation, which is
+    // retained by the command list
+    std::pair<vk::Buffer, vk::DeviceSize> retainBuffer(
+        const std::shared_ptr<GpuBuffer> &buffer);
 
 public:
     VulkanGraphicsCommandList(
         std::shared_ptr<VulkanGpuCommandPool> pool,
-        vk::UniqueCommandBuffer vk_command_buffer);
+        vk::CommandBuffer vk_command_buffer,
+        bool secondary);
 
     void beginRecording() override;
+    void beginRecording(
+        std::shared_ptr<RenderPass> render_pass,
+        std::shared_ptr<Framebuffer> framebuffer) override;
     void endRecording() override;
 
     void imageTransition(
@@ -42,6 +83,9 @@ public:
         GpuImageLayout new_layout,
         GraphicsPipelineStage src_stage,
         GraphicsPipelineStage dest_stage) override;
+    void memoryBarrier(
+        GraphicsPipelineStage src_stage,
+        GraphicsPipelineStage dest_stage) override;
     void clearColorImage(
         GpuImage *image,
         GpuImageLayout layout,
@@ -49,16 +93,25 @@ public:
 
     void beginRendering(
         std::shared_ptr<RenderPass> render_pass,
-        std::shared_ptr<Framebuffer> framebuffer) override;
+        std::shared_ptr<Framebuffer> framebuffer,
+        RenderingContents contents) override;
     void endRendering() override;
+    void executeCommandLists(
+        const std::vector<std::shared_ptr<GraphicsCommandList>> &command_lists
+    ) override;
 
     void bindPipeline(std::shared_ptr<GraphicsPipeline> pipeline) override;
+    void bindPipeline(std::shared_ptr<ComputePipeline> pipeline) override;
 
-    // todo optimize out binding the same set of resources
+    /**
+     * \brief The descriptor sets are cached by the device for the current
+     * frame, so the command list must be submitted in the same frame.
+     */
     void bindResourceSet(
         std::uint32_t set_id,
         std::initializer_list<std::shared_ptr<ShaderResource>> resources
     ) override;
+    void retainResource(std::shared_ptr<ShaderResource> resource) override;
 
     void setViewport(
         std::uint32_t index,
@@ -75,6 +128,11 @@ public:
         const char *name,
         const void *data,
         std::size_t size) override;
+    void setConstant(
+        const ShaderConstantHandle &handle,
+        const void *data) override;
+    void setConstants(
+        std::initializer_list<ShaderConstantWrite> writes) override;
     void bindIndexBuffer(
         const std::shared_ptr<GpuBuffer> &buffer,
         std::size_t offset,
@@ -95,7 +153,41 @@ public:
         std::uint32_t first_index,
         std::int32_t vertex_offset,
         std::uint32_t first_instance) override;
+    void drawIndirect(
+        const std::shared_ptr<GpuBuffer> &buffer,
+        std::size_t offset,
+        std::uint32_t draw_count,
+        std::uint32_t stride) override;
+    void drawIndexedIndirect(
+        const std::shared_ptr<GpuBuffer> &buffer,
+        std::size_t offset,
+        std::uint32_t draw_count,
+        std::uint32_t stride) override;
+    void drawIndirectCount(
+        const std::shared_ptr<GpuBuffer> &buffer,
+        std::size_t offset,
+        const std::shared_ptr<GpuBuffer> &count_buffer,
+        std::size_t count_offset,
+        std::uint32_t max_draw_count,
+        std::uint32_t stride) override;
+    void drawIndexedIndirectCount(
+        const std::shared_ptr<GpuBuffer> &buffer,
+        std::size_t offset,
+        const std::shared_ptr<GpuBuffer> &count_buffer,
+        std::size_t count_offset,
+        std::uint32_t max_draw_count,
+        std::uint32_t stride) override;
+
+    void executeCommandStream(const GraphicsCommandStream &stream) override;
+
+    void dispatch(
+        std::uint32_t group_count_x,
+        std::uint32_t group_count_y,
+        std::uint32_t group_count_z) override;
+    void dispatchIndirect(
+        const std::shared_ptr<GpuBuffer> &buffer,
+        std::size_t offset) override;
 
-    vk::CommandBuffer commandBuffer() const { return mCommandBuffer.get(); }
+    vk::CommandBuffer commandBuffer() const { return mCommandBuffer; }
 };
 }
@@ -1,8 +1,14 @@
 ﻿#include "VulkanGraphicsPipelineCompiler.hpp"
 
+#include <algorithm>
 #include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#include <fmt/format.h>
 
 #include <Usagi/Runtime/Graphics/Shader/SpirvBinary.hpp>
+#include <Usagi/Utility/Hash.hpp>
 #include <Usagi/Utility/TypeCast.hpp>
 #include <Usagi/Core/Logging.hpp>
 
@@ -10,8 +16,8 @@
 #include "VulkanEnumTranslation.hpp"
 #include "VulkanRenderPass.hpp"
 #include "VulkanGraphicsPipeline.hpp"
+#include "VulkanPipelineLayoutBuilder.hpp"
 
-using namespace spirv_cross;
 using namespace usagi::vulkan;
 
 vk::UniqueShaderModule usagi::VulkanGraphicsPipelineCompiler::
@@ -50,6 +56,31 @@ void usagi::VulkanGraphicsPipelineCompiler::setupShaderStages()
         info.setModule(shader.second.module.get());
         info.setPName(shader.second.entry_point.c_str());
 
+        auto &entries = shader.second.specialization_entries;
+        auto &data = shader.second.specialization_data;
+        entries.clear();
+        data.clear();
+        const auto constants = mSpecializationConstants.find(shader.first);
+        if(constants != mSpecializationConstants.end() &&
+            !constants->second.empty())
+        {
+            for(auto &&c : constants->second)
+            {
+                entries.emplace_back(c.first,
+                    static_cast<uint32_t>(data.size()), c.second.size);
+                const auto offset = data.size();
+                data.resize(offset + c.second.size);
+                std::memcpy(data.data() + offset, &c.second.data,
+                    c.second.size);
+            }
+            auto &spec = shader.second.specialization_info;
+            spec.setMapEntryCount(static_cast<uint32_t>(entries.size()));
+            spec.setPMapEntries(entries.data());
+            spec.setDataSize(data.size());
+            spec.setPData(data.data());
+            info.setPSpecializationInfo(&spec);
+        }
+
         mShaderStageCreateInfos.push_back(info);
     }
     mPipelineCreateInfo.setStageCount(
@@ -85,6 +116,77 @@ void usagi::VulkanGraphicsPipelineCompiler::setupDynamicStates()
 	mPipelineCreateInfo.pDynamicState = &mDynamicStateCreateInfo;
 }
 
+std::string usagi::VulkanGraphicsPipelineCompiler::pipelineKey() const
+{
+    // derivative flags are left out since they don't affect the behavior
+    // of the pipeline
+    std::string key;
+
+    for(auto &&shader : mShaders)
+    {
+        auto &bytecodes = shader.second.binary->bytecodes();
+        key += fmt::format("S{}:{}:{};",
+            static_cast<int>(shader.first), shader.second.entry_point,
+            sha256({
+                reinterpret_cast<const char*>(bytecodes.data()),
+                bytecodes.size() * sizeof(SpirvBinary::Bytecode)
+            }));
+    }
+
+    for(auto &&stage : mSpecializationConstants)
+        for(auto &&c : stage.second)
+            key += fmt::format("C{}:{}:{}:{};",
+                static_cast<int>(stage.first), c.first,
+                c.second.size, c.second.data);
+
+    for(auto &&b : mVertexInputBindings)
+        key += fmt::format("B{}:{}:{};",
+            b.binding, b.stride, static_cast<int>(b.inputRate));
+    for(auto &&a : mVertexAttributeNameMap)
+        key += fmt::format("A{}:{}:{}:{};", a.first, a.second.binding,
+            a.second.offset, static_cast<int>(a.second.format));
+    for(auto &&a : mVertexAttributeLocationArray)
+        key += fmt::format("L{}:{}:{}:{};", a.location, a.binding,
+            a.offset, static_cast<int>(a.format));
+
+    auto &ia = mInputAssemblyStateCreateInfo;
+    key += fmt::format("I{}:{};",
+        static_cast<int>(ia.topology), ia.primitiveRestartEnable);
+
+    auto &rs = mRasterizationStateCreateInfo;
+    key += fmt::format("R{}:{}:{}:{}:{};",
+        static_cast<int>(rs.polygonMode),
+        static_cast<VkCullModeFlags>(rs.cullMode),
+        static_cast<int>(rs.frontFace),
+        rs.depthBiasEnable, rs.lineWidth);
+
+    auto &ms = mMultisampleStateCreateInfo;
+    key += fmt::format("M{}:{}:{};",
+        static_cast<int>(ms.rasterizationSamples),
+        ms.sampleShadingEnable, ms.minSampleShading);
+
+    auto &ds = mDepthStencilStateCreateInfo;
+    key += fmt::format("D{}:{}:{};", ds.depthTestEnable,
+        ds.depthWriteEnable, static_cast<int>(ds.depthCompareOp));
+
+    auto &cb = mColorBlendAttachmentState;
+    key += fmt::format("C{}:{}:{}:{}:{}:{}:{}:{};", cb.blendEnable,
+        static_cast<int>(cb.colorBlendOp),
+        static_cast<int>(cb.alphaBlendOp),
+        static_cast<int>(cb.srcColorBlendFactor),
+        static_cast<int>(cb.dstColorBlendFactor),
+        static_cast<int>(cb.srcAlphaBlendFactor),
+        static_cast<int>(cb.dstAlphaBlendFactor),
+        static_cast<VkColorComponentFlags>(cb.colorWriteMask));
+
+    for(auto &&s : mDynamicStates)
+        key += fmt::format("Y{};", static_cast<int>(s));
+
+    key += fmt::format("P{}", mRenderPass->compatibilityKey());
+
+    return key;
+}
+
 void usagi::VulkanGraphicsPipelineCompiler::setRenderPass(
     const std::shared_ptr<RenderPass> render_pass)
 {
@@ -92,274 +194,90 @@ void usagi::VulkanGraphicsPipelineCompiler::setRenderPass(
     mPipelineCreateInfo.setRenderPass(mRenderPass->renderPass());
 }
 
-struct usagi::VulkanGraphicsPipelineCompiler::Context
-{
-    // Descriptor Set Layouts
-    VulkanGraphicsPipeline::DescriptorSetLayoutBindingMap
-        desc_set_layout_bindings;
-    VulkanGraphicsPipeline::DescriptorSetLayoutMap desc_set_layouts;
-    std::vector<vk::DescriptorSetLayout> desc_set_layout_array;
-
-    // Push Constants
-    std::vector<vk::PushConstantRange> push_constants;
-    VulkanGraphicsPipeline::PushConstantFieldMap push_constant_field_map;
-    // Allocate enough space for push constant buffer
-    // all shader stages have the same binding of the constant buffer
-    // (see the same memory). they must pad the buffer correctly to get
-    // the desired data.
-    // todo if multiple push constant buffer are supported in the future
-    // a separate max size should be calculated for each buffer
-    std::size_t max_push_constant_size = 0;
-};
-
-struct usagi::VulkanGraphicsPipelineCompiler::ReflectionHelper
+void usagi::VulkanGraphicsPipelineCompiler::reflectVertexInputAttributes(
+    const ShaderReflection &reflection)
 {
-    Context &ctx;
-    VulkanGraphicsPipelineCompiler *p = nullptr;
-    const ShaderMap::value_type &shader;
-    const Compiler & compiler;
-    ShaderResources resources;
-    std::size_t push_constant_offset = 0;
-    std::size_t push_constant_size = 0;
-    VulkanGraphicsPipeline::PushConstantFieldMap::value_type::second_type &
-        push_constant_fields;
-
-    ReflectionHelper(
-        Context &ctx,
-        VulkanGraphicsPipelineCompiler *pipeline_compiler,
-        const ShaderMap::value_type &shader)
-        : ctx { ctx }
-        , p { pipeline_compiler }
-        , shader { shader }
-        , compiler { shader.second.binary->reflectionCompiler() }
-        , resources { compiler.get_shader_resources() }
-        , push_constant_fields { ctx.push_constant_field_map[shader.first] }
-    {
-    }
-
-    void reflectPushConstantField(
-        const Resource &resource, const SPIRType &type, unsigned i)
-    {
-        const auto &member_name =
-            compiler.get_member_name(type.self, i);
-        const auto member_offset =
-            compiler.type_struct_member_offset(type, i);
-        const auto member_size =
-            compiler.get_declared_struct_member_size(type, i);
-
-        // if first member is named padding, it is considered as offset hint
-        // and is ignored.
-        if(i == 0 && member_name == "padding")
-        {
-            push_constant_offset = member_size;
-            return;
-        }
-
-        LOG(info, "{}: offset={}, size={}",
-            member_name, member_offset, member_size);
-
-        VulkanPushConstantField field;
-        field.size = static_cast<uint32_t>(member_size);
-        field.offset = static_cast<uint32_t>(member_offset);
-
-        // add to reflection record
-        // todo: if multiple constant buffers are allowed in the
-        // future, member name may not uniquely identify the fields.
-        // use struct_name.field_name instead?
-        push_constant_fields[member_name] = field;
-    }
-
-    std::size_t reflectPushConstantBuffer(
-        const Resource &resource)
+    // vertex pulling: the shader reads the vertices from storage buffers
+    // using gl_VertexIndex and gl_InstanceIndex
+    if(reflection.stage_inputs.empty())
     {
-        const auto &type = compiler.get_type(resource.base_type_id);
-        const auto size = compiler.get_declared_struct_size(type);
-
-        const auto member_count = type.member_types.size();
-        for(unsigned i = 0; i < member_count; i++)
-            reflectPushConstantField(resource, type, i);
-
-        return size;
+        LOG(info, "No vertex input attribute, the vertices are pulled "
+            "by the shader.");
+        return;
     }
 
-    void reflectPushConstantRanges()
-    {
-        for(const auto &resource : resources.push_constant_buffers)
-            push_constant_size += reflectPushConstantBuffer(resource);
-
-        if(push_constant_size == 0) return;
-
-        vk::PushConstantRange range;
-        // todo allow multiple stages in one shader source
-        range.setOffset(static_cast<uint32_t>(push_constant_offset));
-        range.setSize(static_cast<uint32_t>(
-            push_constant_size - push_constant_offset));
-        range.setStageFlags(translate(shader.first));
-        ctx.push_constants.push_back(range);
-
-        ctx.max_push_constant_size = std::max(
-            ctx.max_push_constant_size,
-            push_constant_size
-        );
-    }
+    LOG(info, "Vertex input attribtues:");
 
-    void reflectVertexInputAttributes()
+    for(auto &&input : reflection.stage_inputs)
     {
-        LOG(info, "Vertex input attribtues:");
+        LOG(info, "{}: location={}", input.name, input.location);
 
-        for(auto &&resource : resources.stage_inputs)
+        // normalize to location-based indexing
+        const auto it = mVertexAttributeNameMap.find(input.name);
+        if(it != mVertexAttributeNameMap.end())
         {
-            const auto location = compiler.get_decoration(
-                resource.id, spv::DecorationLocation);
-
-            LOG(info, "{}: location={}", resource.name, location);
-
-            // normalize to location-based indexing
-            const auto it = p->mVertexAttributeNameMap.find(resource.name);
-            if(it != p->mVertexAttributeNameMap.end())
-            {
-                it->second.location = location;
-                p->mVertexAttributeLocationArray.push_back(it->second);
-                p->mVertexAttributeNameMap.erase(it);
-            }
+            it->second.location = input.location;
+            mVertexAttributeLocationArray.push_back(it->second);
+            mVertexAttributeNameMap.erase(it);
+            continue;
         }
+        const auto located = std::any_of(
+            mVertexAttributeLocationArray.begin(),
+            mVertexAttributeLocationArray.end(),
+            [&](auto &&a) { return a.location == input.location; });
+        if(!located)
+            LOG(warn, "Vertex input {} is not bound to any attribute.",
+                input.name);
     }
-
-    void addResource(std::vector<Resource>::value_type &resource,
-        const vk::DescriptorType resource_type) const
-    {
-        // todo: ensure different stages uses different set indices
-        const auto set = compiler.get_decoration(
-            resource.id, spv::DecorationDescriptorSet);
-        const auto binding = compiler.get_decoration(
-            resource.id, spv::DecorationBinding);
-        const auto &type = compiler.get_type(resource.type_id);
-
-        vk::DescriptorSetLayoutBinding layout_binding;
-        layout_binding.setStageFlags(translate(shader.first));
-        layout_binding.setBinding(binding);
-        layout_binding.setDescriptorCount(type.vecsize);
-        layout_binding.setDescriptorType(resource_type);
-
-        ctx.desc_set_layout_bindings[set].push_back(layout_binding);
-    }
-
-    void ignoreResource(std::vector<Resource>::value_type &resource,
-        const vk::DescriptorType resource_type) const
-    {
-        const auto set = compiler.get_decoration(
-            resource.id, spv::DecorationDescriptorSet);
-        const auto binding = compiler.get_decoration(
-            resource.id, spv::DecorationBinding);
-
-        LOG(warn, "{type} {name} (set={},binding={}) is ignored.",
-            to_string(resource_type), resource.name, set, binding);
-    }
-
-    void reflectDescriptorSets()
-    {
-        LOG(info, "Descriptor set layouts:");
-
-        // todo: deal with others resource types
-
-        for(auto &&resource : resources.storage_buffers)
-            ignoreResource(resource, vk::DescriptorType::eStorageBuffer);
-
-        // sampler2D is not supported in HLSL so not included here.
-        // don't use them in shaders.
-        for(auto &&resource : resources.sampled_images)
-            ignoreResource(resource, vk::DescriptorType::eSampledImage);
-
-        for(auto &&resource : resources.separate_images)
-            addResource(resource, vk::DescriptorType::eSampledImage);
-
-        for(auto &&resource : resources.separate_samplers)
-            addResource(resource, vk::DescriptorType::eSampler);
-
-        for(auto &&resource : resources.uniform_buffers)
-            addResource(resource, vk::DescriptorType::eUniformBuffer);
-
-        // note that only one subpass is used to maintain compatibility
-        // for shader cross-compiling
-        for(auto &&resource : resources.subpass_inputs)
-            addResource(resource, vk::DescriptorType::eInputAttachment);
-    }
-
-    // todo auto get render targets?
-    //void reflectRenderTargets()
-    //{
-    //    for(const auto &resource : resources.stage_outputs)
-    //    {
-    //        const auto attachment_index = compiler.get_decoration(
-    //            resource.id, spv::DecorationInputAttachmentIndex);
-    //    }
-    //}
-};
+}
 
 std::shared_ptr<usagi::GraphicsPipeline>
     usagi::VulkanGraphicsPipelineCompiler::compile()
 {
 	LOG(info, "Compiling graphics pipeline...");
 
+    setupDynamicStates();
+
+    auto key = pipelineKey();
+    const auto registry = mDevice->pipelineCache();
+    if(auto existing =
+        std::dynamic_pointer_cast<VulkanGraphicsPipeline>(registry->find(key)))
+    {
+        LOG(info, "Reusing an identical pipeline.");
+        return std::move(existing);
+    }
+
 	setupShaderStages();
-	setupDynamicStates();
 
 	LOG(info, "Generating pipeline layout...");
 
-    Context ctx;
+    VulkanPipelineLayoutBuilder ctx { mDevice };
 
 	for(auto &&shader : mShaders)
 	{
         LOG(info, "Reflecting {} shader", to_string(shader.first));
 
-        ReflectionHelper helper { ctx, this, shader };
+        const auto &reflection = shader.second.binary->reflection();
         if(shader.first == ShaderStage::VERTEX)
-            helper.reflectVertexInputAttributes();
-        // todo
-		//if(shader.first == ShaderStage::FRAGMENT)
-        //    helper.reflectRenderTargets();
-        helper.reflectPushConstantRanges();
-        helper.reflectDescriptorSets();
+            reflectVertexInputAttributes(reflection);
+        // todo auto get render targets from the fragment shader?
+        ctx.reflect(shader.first, reflection);
 	}
 
-    vk::UniquePipelineLayout compatible_pipeline_layout;
-	{
-		vk::PipelineLayoutCreateInfo info;
-
-        for(auto &&layout : ctx.desc_set_layout_bindings)
-        {
-            vk::DescriptorSetLayoutCreateInfo layout_info;
-            layout_info.setBindingCount(
-                static_cast<uint32_t>(layout.second.size()));
-            layout_info.setPBindings(layout.second.data());
-            auto l = mDevice->device().createDescriptorSetLayoutUnique(
-				layout_info);
-            ctx.desc_set_layout_array.push_back(l.get());
-            ctx.desc_set_layouts[layout.first] = std::move(l);
-        }
-        info.setSetLayoutCount(
-            static_cast<uint32_t>(ctx.desc_set_layout_array.size()));
-        info.setPSetLayouts(ctx.desc_set_layout_array.data());
-
-        info.setPushConstantRangeCount(
-            static_cast<uint32_t>(ctx.push_constants.size()));
-        info.setPPushConstantRanges(ctx.push_constants.data());
-
-		compatible_pipeline_layout =
-			mDevice->device().createPipelineLayoutUnique(info);
-		mPipelineCreateInfo.setLayout(compatible_pipeline_layout.get());
-	}
+    auto compatible_pipeline_layout = ctx.createPipelineLayout();
+    mPipelineCreateInfo.setLayout(compatible_pipeline_layout.get());
 
     setupVertexInput();
 
 	auto pipeline = mDevice->device().createGraphicsPipelineUnique(
-		{ }, mPipelineCreateInfo);
+		registry->cache(), mPipelineCreateInfo);
     auto wrapped_pipeline = std::make_shared<VulkanGraphicsPipeline>(
         std::move(pipeline),
         std::move(compatible_pipeline_layout),
         mRenderPass,
         std::move(ctx.desc_set_layout_bindings),
         std::move(ctx.desc_set_layouts),
+        ctx.bindless_set,
         std::move(ctx.push_constant_field_map)
     );
 
@@ -373,9 +291,58 @@ std::shared_ptr<usagi::GraphicsPipeline>
         mPipelineCreateInfo.setBasePipelineIndex(-1);
     }
 
+    registry->add(std::move(key), wrapped_pipeline);
+
     return std::move(wrapped_pipeline);
 }
 
+std::unique_ptr<usagi::VulkanGraphicsPipelineCompiler>
+    usagi::VulkanGraphicsPipelineCompiler::snapshot() const
+{
+    auto s = std::make_unique<VulkanGraphicsPipelineCompiler>(mDevice);
+
+    for(auto &&shader : mShaders)
+    {
+        ShaderInfo info;
+        info.entry_point = shader.second.entry_point;
+        info.binary = shader.second.binary;
+        s->mShaders[shader.first] = std::move(info);
+    }
+    s->mSpecializationConstants = mSpecializationConstants;
+    if(mRenderPass)
+        s->setRenderPass(mRenderPass);
+
+    s->mVertexInputBindings = mVertexInputBindings;
+    s->mVertexAttributeNameMap = mVertexAttributeNameMap;
+    s->mVertexAttributeLocationArray = mVertexAttributeLocationArray;
+
+    // these states do not contain pointers
+    s->mInputAssemblyStateCreateInfo = mInputAssemblyStateCreateInfo;
+    s->mRasterizationStateCreateInfo = mRasterizationStateCreateInfo;
+    s->mMultisampleStateCreateInfo = mMultisampleStateCreateInfo;
+    s->mDepthStencilStateCreateInfo = mDepthStencilStateCreateInfo;
+    s->mColorBlendAttachmentState = mColorBlendAttachmentState;
+
+    s->mParentPipeline = mParentPipeline;
+    s->mPipelineCreateInfo.setFlags(mPipelineCreateInfo.flags);
+    s->mPipelineCreateInfo.setBasePipelineHandle(
+        mPipelineCreateInfo.basePipelineHandle);
+    s->mPipelineCreateInfo.setBasePipelineIndex(
+        mPipelineCreateInfo.basePipelineIndex);
+
+    return s;
+}
+
+std::future<std::shared_ptr<usagi::GraphicsPipeline>>
+    usagi::VulkanGraphicsPipelineCompiler::compileAsync()
+{
+    // the pipeline cache and the pipeline registry of the device are
+    // thread-safe, so the snapshots may be compiled concurrently.
+    return std::async(std::launch::async, [s = snapshot()]() {
+        return s->compile();
+    });
+}
+
 usagi::VulkanGraphicsPipelineCompiler::VulkanGraphicsPipelineCompiler(
     VulkanGpuDevice *device)
     : mDevice { device }
@@ -426,6 +393,22 @@ void usagi::VulkanGraphicsPipelineCompiler::setShader(
     mShaders[stage] = std::move(info);
 }
 
+void usagi::VulkanGraphicsPipelineCompiler::setSpecializationConstant(
+    const ShaderStage stage,
+    const std::uint32_t constant_id,
+    const void *data,
+    const std::size_t size)
+{
+    if(size != 4 && size != 8)
+        throw std::logic_error(
+            "Specialization constants must be 32 or 64 bits in size.");
+
+    SpecializationConstant c;
+    std::memcpy(&c.data, data, size);
+    c.size = static_cast<std::uint32_t>(size);
+    mSpecializationConstants[stage][constant_id] = c;
+}
+
 void usagi::VulkanGraphicsPipelineCompiler::setVertexBufferBinding(
     const std::uint32_t binding_index,
     const std::uint32_t stride,
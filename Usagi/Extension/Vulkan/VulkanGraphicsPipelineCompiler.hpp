@@ -8,6 +8,7 @@
 
 namespace usagi
 {
+struct ShaderReflection;
 class VulkanGraphicsPipeline;
 class VulkanRenderPass;
 class VulkanGpuDevice;
@@ -21,10 +22,23 @@ class VulkanGraphicsPipelineCompiler final : public GraphicsPipelineCompiler
         std::string entry_point = "main";
         std::shared_ptr<SpirvBinary> binary = nullptr;
         vk::UniqueShaderModule module;
+        // filled by setupShaderStages()
+        std::vector<vk::SpecializationMapEntry> specialization_entries;
+        std::vector<std::uint8_t> specialization_data;
+        vk::SpecializationInfo specialization_info;
     };
     using ShaderMap = std::map<ShaderStage, ShaderInfo>;
     ShaderMap mShaders;
 
+    struct SpecializationConstant
+    {
+        std::uint64_t data = 0;
+        std::uint32_t size = 0;
+    };
+    using SpecializationConstantMap = std::map<ShaderStage,
+        std::map<std::uint32_t, SpecializationConstant>>;
+    SpecializationConstantMap mSpecializationConstants;
+
 	vk::UniqueShaderModule createShaderModule(const SpirvBinary *binary) const;
 
     std::vector<vk::PipelineShaderStageCreateInfo> mShaderStageCreateInfos;
@@ -42,9 +56,6 @@ class VulkanGraphicsPipelineCompiler final : public GraphicsPipelineCompiler
 
     vk::GraphicsPipelineCreateInfo mPipelineCreateInfo;
 
-    struct Context;
-    struct ReflectionHelper;
-
     using VertexInputBindingArray = std::vector<
         vk::VertexInputBindingDescription>;
     VertexInputBindingArray mVertexInputBindings;
@@ -62,9 +73,28 @@ class VulkanGraphicsPipelineCompiler final : public GraphicsPipelineCompiler
     void setupVertexInput();
     void setupDynamicStates();
 
+    /**
+     * \brief Resolve the locations of the vertex attributes specified by
+     * names.
+     */
+    void reflectVertexInputAttributes(const ShaderReflection &reflection);
+
+    /**
+     * \brief Describe the complete pipeline state as a string so identical
+     * requests can be served by the same pipeline. Must be called before
+     * the vertex attributes are resolved by reflection.
+     */
+    std::string pipelineKey() const;
+
     // Pipeline derivatives support
     std::shared_ptr<VulkanGraphicsPipeline> mParentPipeline;
 
+    /**
+     * \brief Copy the pipeline states into a new compiler. Shader modules
+     * are not shared and will be created by the new compiler.
+     */
+    std::unique_ptr<VulkanGraphicsPipelineCompiler> snapshot() const;
+
 public:
     explicit VulkanGraphicsPipelineCompiler(VulkanGpuDevice *device);
 
@@ -74,6 +104,13 @@ public:
         ShaderStage stage,
         std::shared_ptr<SpirvBinary> shader) override;
 
+    using GraphicsPipelineCompiler::setSpecializationConstant;
+    void setSpecializationConstant(
+        ShaderStage stage,
+        std::uint32_t constant_id,
+        const void *data,
+        std::size_t size) override;
+
     void setVertexBufferBinding(
         std::uint32_t binding_index,
         std::uint32_t stride,
@@ -104,5 +141,6 @@ public:
     void setColorBlendState(const ColorBlendState &state) override;
 
     std::shared_ptr<GraphicsPipeline> compile() override;
+    std::future<std::shared_ptr<GraphicsPipeline>> compileAsync() override;
 };
 }
@@ -4,6 +4,8 @@
 #include <algorithm>
 #include <type_traits>
 
+#include <Usagi/Runtime/Memory/ArenaAllocator.hpp>
+
 namespace usagi::vulkan
 {
 template <
@@ -19,4 +21,22 @@ auto transformObjects(SrcContainer &src, TransFunc func)
     std::transform(src.begin(), src.end(), std::back_inserter(dest), func);
     return dest;
 }
+
+/**
+ * \brief Same as transformObjects() but the result is allocated from the
+ * frame arena. Use it for temporary arrays passed to Vulkan commands.
+ */
+template <
+    typename SrcContainer,
+    typename TransFunc,
+    typename DestT =
+        std::invoke_result_t<TransFunc, typename SrcContainer::value_type>
+>
+auto transformObjectsFrame(SrcContainer &src, TransFunc func)
+{
+    FrameVector<DestT> dest;
+    dest.reserve(src.size());
+    std::transform(src.begin(), src.end(), std::back_inserter(dest), func);
+    return dest;
+}
 }
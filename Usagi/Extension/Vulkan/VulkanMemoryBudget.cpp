@@ -0,0 +1,86 @@
+﻿#include "VulkanMemoryBudget.hpp"
+
+#include <cassert>
+
+#include <fmt/format.h>
+
+#include <Usagi/Runtime/Memory/MemoryTracker.hpp>
+
+usagi::VulkanMemoryBudget::VulkanMemoryBudget(
+    vk::PhysicalDevice physical_device,
+    const double budget_fraction)
+    : mProperties(physical_device.getMemoryProperties())
+{
+    for(std::uint32_t i = 0; i < mProperties.memoryHeapCount; ++i)
+    {
+        auto heap = std::make_unique<Heap>();
+        heap->size = mProperties.memoryHeaps[i].size;
+        heap->budget = static_cast<vk::DeviceSize>(
+            static_cast<double>(heap->size) * budget_fraction);
+        heap->memory_tag = MemoryTracker::registerTag(
+            fmt::format("Vulkan Heap {}", i), MemoryTagCategory::GPU_POOL);
+        const auto h = heap.get();
+        heap->memory_tag->setRegionUsageQuery([=]() {
+            MemoryRegionUsage usage;
+            const auto used = h->used.load(std::memory_order_relaxed);
+            usage.managed_bytes = h->budget;
+            usage.free_bytes = h->budget > used ? h->budget - used : 0;
+            usage.largest_free_block = usage.free_bytes;
+            return usage;
+        });
+        mHeaps.push_back(std::move(heap));
+    }
+}
+
+usagi::VulkanMemoryBudget::~VulkanMemoryBudget()
+{
+    for(auto &&heap : mHeaps)
+    {
+        // all memory blocks should be returned by now
+        assert(heap->used == 0);
+        heap->memory_tag->setRegionUsageQuery(nullptr);
+    }
+}
+
+bool usagi::VulkanMemoryBudget::tryReserve(
+    const std::uint32_t heap,
+    const vk::DeviceSize size)
+{
+    auto &h = *mHeaps.at(heap);
+    auto used = h.used.load(std::memory_order_relaxed);
+    do
+    {
+        if(used + size > h.budget)
+            return false;
+    }
+    while(!h.used.compare_exchange_weak(used, used + size,
+        std::memory_order_relaxed));
+    h.memory_tag->recordAllocation(size);
+    return true;
+}
+
+void usagi::VulkanMemoryBudget::release(
+    const std::uint32_t heap,
+    const vk::DeviceSize size)
+{
+    auto &h = *mHeaps.at(heap);
+    h.used.fetch_sub(size, std::memory_order_relaxed);
+    h.memory_tag->recordDeallocation(size);
+}
+
+vk::DeviceSize usagi::VulkanMemoryBudget::heapSize(
+    const std::uint32_t heap) const
+{
+    return mHeaps.at(heap)->size;
+}
+
+vk::DeviceSize usagi::VulkanMemoryBudget::budget(
+    const std::uint32_t heap) const
+{
+    return mHeaps.at(heap)->budget;
+}
+
+vk::DeviceSize usagi::VulkanMemoryBudget::used(const std::uint32_t heap) const
+{
+    return mHeaps.at(heap)->used.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,66 @@
+﻿#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+#include <Usagi/Utility/Noncopyable.hpp>
+
+namespace usagi
+{
+class MemoryTag;
+
+/**
+ * \brief Tracks the device memory allocated from each memory heap and
+ * limits it to a fraction of the heap size, so that the pools can fall back
+ * to other memory types before the driver starts failing allocations or
+ * paging memory out.
+ */
+class VulkanMemoryBudget : Noncopyable
+{
+    struct Heap
+    {
+        vk::DeviceSize size = 0;
+        vk::DeviceSize budget = 0;
+        std::atomic<vk::DeviceSize> used { 0 };
+        std::shared_ptr<MemoryTag> memory_tag;
+    };
+
+    vk::PhysicalDeviceMemoryProperties mProperties;
+    std::vector<std::unique_ptr<Heap>> mHeaps;
+
+public:
+    /**
+     * \param budget_fraction The fraction of each heap which may be
+     * allocated by the pools.
+     */
+    VulkanMemoryBudget(
+        vk::PhysicalDevice physical_device,
+        double budget_fraction = 0.8);
+    ~VulkanMemoryBudget();
+
+    const vk::PhysicalDeviceMemoryProperties & properties() const
+    {
+        return mProperties;
+    }
+
+    std::uint32_t heapIndex(std::uint32_t memory_type) const
+    {
+        return mProperties.memoryTypes[memory_type].heapIndex;
+    }
+
+    /**
+     * \brief Account the allocation against the heap if it is within the
+     * budget.
+     * \return false if the allocation would exceed the budget.
+     */
+    bool tryReserve(std::uint32_t heap, vk::DeviceSize size);
+    void release(std::uint32_t heap, vk::DeviceSize size);
+
+    vk::DeviceSize heapSize(std::uint32_t heap) const;
+    vk::DeviceSize budget(std::uint32_t heap) const;
+    vk::DeviceSize used(std::uint32_t heap) const;
+};
+}
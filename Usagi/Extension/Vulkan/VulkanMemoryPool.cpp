@@ -2,66 +2,133 @@
 
 #include <Usagi/Core/Logging.hpp>
 #include <Usagi/Runtime/Graphics/GpuImageCreateInfo.hpp>
-#include <Usagi/Utility/Rounding.hpp>
 
 #include "VulkanGpuDevice.hpp"
 #include "VulkanEnumTranslation.hpp"
+#include "VulkanMemoryBudget.hpp"
 
 using namespace usagi::vulkan;
 
-void usagi::VulkanMemoryPool::mapMemory()
+usagi::VulkanMemoryBlock::~VulkanMemoryBlock()
 {
-    mMappedMemory = static_cast<char*>(mDevice->device().mapMemory(
-        mMemory.get(), 0, VK_WHOLE_SIZE));
+    buffer.reset();
+    if(!memory) return;
+    if(mapped)
+        device->device().unmapMemory(memory.get());
+    memory.reset();
+    device->memoryBudget()->release(heap, size);
 }
 
-void usagi::VulkanMemoryPool::unmapMemory()
+namespace
 {
-    if(mMappedMemory != nullptr)
-    {
-        mDevice->device().unmapMemory(mMemory.get());
-        mMappedMemory = nullptr;
-    }
+unsigned countFlags(const vk::MemoryPropertyFlags &flags)
+{
+    auto bits = static_cast<VkMemoryPropertyFlags>(flags);
+    unsigned count = 0;
+    for(; bits; bits &= bits - 1) ++count;
+    return count;
+}
 }
 
-void usagi::VulkanMemoryPool::allocateDeviceMemory(
-    const vk::MemoryPropertyFlags &mem_properties)
+std::vector<std::uint32_t> usagi::VulkanMemoryPool::rankMemoryTypes(
+    const std::uint32_t type_bits) const
 {
-    const auto memory_properties =
-        mDevice->physicalDevice().getMemoryProperties();
+    const auto &memory_properties = mDevice->memoryBudget()->properties();
 
-    // find first heap supporting our needs and has enough space
-    for(uint32_t i = 0; i < memory_properties.memoryTypeCount; ++i)
+    std::vector<std::pair<unsigned, std::uint32_t>> candidates;
+    for(std::uint32_t i = 0; i < memory_properties.memoryTypeCount; ++i)
     {
         // the i-th bit is set only when that memory type is supported.
         // https://www.khronos.org/registry/vulkan/specs/1.0/man/html/VkMemoryRequirements.html
-        if((mMemoryRequirements.memoryTypeBits & 1 << i) &&
-            (memory_properties.memoryTypes[i].propertyFlags & mem_properties))
+        if(!(type_bits & 1u << i))
+            continue;
+        const auto flags = memory_properties.memoryTypes[i].propertyFlags;
+        if((flags & mRequiredFlags) != mRequiredFlags)
+            continue;
+        const auto missing = countFlags(mPreferredFlags & ~flags);
+        const auto extra = countFlags(
+            flags & ~(mRequiredFlags | mPreferredFlags));
+        // there are fewer than 32 memory property flags
+        candidates.emplace_back(missing * 32 + extra, i);
+    }
+    // keep the driver's order among equally ranked types
+    std::stable_sort(candidates.begin(), candidates.end(),
+        [](auto &&l, auto &&r) { return l.first < r.first; });
+
+    std::vector<std::uint32_t> types;
+    types.reserve(candidates.size());
+    for(auto &&c : candidates)
+        types.push_back(c.second);
+    return types;
+}
+
+void usagi::VulkanMemoryPool::allocateBlockMemory(
+    VulkanMemoryBlock &block,
+    const std::size_t size,
+    const std::uint32_t type_bits)
+{
+    const auto budget = mDevice->memoryBudget();
+    const auto &memory_properties = budget->properties();
+
+    for(auto i : rankMemoryTypes(type_bits))
+    {
+        const auto heap = memory_properties.memoryTypes[i].heapIndex;
+        if(!budget->tryReserve(heap, size))
         {
-            vk::MemoryAllocateInfo info;
-            info.setAllocationSize(mMemoryRequirements.size);
-            info.setMemoryTypeIndex(i);
-            try
-            {
-                mMemory = mDevice->device().allocateMemoryUnique(info);
-                if(mem_properties & vk::MemoryPropertyFlagBits::eHostVisible)
-                    mapMemory();
-                return;
-            }
-            catch(const vk::OutOfHostMemoryError &e)
-            {
-                LOG(warn, "Host memory is exhausted: {}", e.what());
-            }
-            catch(const vk::OutOfDeviceMemoryError &e)
+            LOG(warn, "{}: GPU memory heap {} is over budget ({}/{} bytes "
+                "used), trying other memory types",
+                mMemoryTag->name(), heap,
+                budget->used(heap), budget->budget(heap));
+            continue;
+        }
+        vk::MemoryAllocateInfo info;
+        info.setAllocationSize(size);
+        info.setMemoryTypeIndex(i);
+        try
+        {
+            block.memory = mDevice->device().allocateMemoryUnique(info);
+            block.size = size;
+            block.memory_type = i;
+            block.heap = heap;
+            if(memory_properties.memoryTypes[i].propertyFlags &
+                vk::MemoryPropertyFlagBits::eHostVisible)
             {
-                LOG(warn, "GPU memory heap {} is exhausted: {}",
-                    memory_properties.memoryTypes[i].heapIndex, e.what());
+                block.mapped = static_cast<char*>(mDevice->device().mapMemory(
+                    block.memory.get(), 0, VK_WHOLE_SIZE));
             }
+            return;
+        }
+        catch(const vk::OutOfHostMemoryError &e)
+        {
+            LOG(warn, "Host memory is exhausted: {}", e.what());
         }
+        catch(const vk::OutOfDeviceMemoryError &e)
+        {
+            LOG(warn, "GPU memory heap {} is exhausted: {}", heap, e.what());
+        }
+        // the allocation or the mapping failed
+        block.memory.reset();
+        budget->release(heap, size);
     }
     throw std::bad_alloc();
 }
 
+void usagi::VulkanMemoryPool::createBlockMemory(
+    VulkanMemoryBlock &block,
+    const std::size_t size,
+    const std::uint32_t type_bits)
+{
+    allocateBlockMemory(block, size, type_bits);
+}
+
+bool usagi::VulkanMemoryPool::concurrentSharing(
+    const GpuImageCreateInfo &info) const
+{
+    return (info.usage == GpuImageUsage::SAMPLED ||
+        info.usage == GpuImageUsage::STORAGE) &&
+        !mDevice->sharingQueueFamilies().empty();
+}
+
 vk::UniqueImage usagi::VulkanMemoryPool::createImage(
     const GpuImageCreateInfo &info) const
 {
@@ -79,7 +146,18 @@ vk::UniqueImage usagi::VulkanMemoryPool::createImage(
     vk_info.setUsage(
         translate(info.usage) |
         vk::ImageUsageFlagBits::eTransferDst);
-    vk_info.setSharingMode(vk::SharingMode::eExclusive);
+    if(concurrentSharing(info))
+    {
+        const auto &families = mDevice->sharingQueueFamilies();
+        vk_info.setSharingMode(vk::SharingMode::eConcurrent);
+        vk_info.setQueueFamilyIndexCount(
+            static_cast<uint32_t>(families.size()));
+        vk_info.setPQueueFamilyIndices(families.data());
+    }
+    else
+    {
+        vk_info.setSharingMode(vk::SharingMode::eExclusive);
+    }
     vk_info.setInitialLayout(vk::ImageLayout::eUndefined);
 
     return mDevice->device().createImageUnique(vk_info);
@@ -94,71 +172,76 @@ vk::MemoryRequirements usagi::VulkanMemoryPool::getImageRequirements(
 void usagi::VulkanMemoryPool::bindImageMemory(
     VulkanPooledImage *image)
 {
-    mDevice->device().bindImageMemory(image->image(), mMemory.get(),
-        image->offset());
+    mDevice->device().bindImageMemory(image->image(),
+        image->block()->memory.get(), image->offset());
 }
 
-void usagi::VulkanMemoryPool::createImageBaseView(VulkanPooledImage *image)
+void usagi::VulkanMemoryPool::createImageBaseView(
+    VulkanPooledImage *image,
+    const bool sampled)
 {
+    if(sampled)
+        image->mBindlessTable = mDevice->bindlessTextures();
     image->createBaseView();
 }
 
-void usagi::VulkanMemoryPool::allocateDeviceMemoryForBuffer(
+usagi::VulkanMemoryPool::VulkanMemoryPool(
+    VulkanGpuDevice *device,
+    std::string name,
+    const std::size_t block_size,
+    const vk::MemoryPropertyFlags &required_flags,
+    const vk::MemoryPropertyFlags &preferred_flags)
+    : mDevice(device)
+    , mBlockSize(block_size)
+    , mDedicatedThreshold(block_size / 2)
+    , mRequiredFlags(required_flags)
+    , mPreferredFlags(preferred_flags)
+    , mMemoryTag(MemoryTracker::registerTag(
+        std::move(name), MemoryTagCategory::GPU_POOL))
+{
+}
+
+void usagi::VulkanBufferMemoryPoolBase::createBlockMemory(
+    VulkanMemoryBlock &block,
     const std::size_t size,
-    const vk::MemoryPropertyFlags &mem_properties,
-    const vk::BufferUsageFlags &usages,
-    vk::UniqueBuffer &buffer)
+    const std::uint32_t type_bits)
 {
     vk::BufferCreateInfo buffer_create_info;
 
     buffer_create_info.setSize(size);
-    buffer_create_info.setUsage(usages);
-    buffer_create_info.setSharingMode(vk::SharingMode::eExclusive);
-
-    auto vk_device = mDevice->device();
-    buffer = vk_device.createBufferUnique(buffer_create_info);
-
-    mMemoryRequirements = vk_device.getBufferMemoryRequirements(buffer.get());
-    allocateDeviceMemory(mem_properties);
-    vk_device.bindBufferMemory(buffer.get(), mMemory.get(), 0);
-}
-
-void usagi::VulkanMemoryPool::allocateDeviceMemoryForImage(
-    std::size_t total_size,
-    const vk::MemoryPropertyFlags &mem_properties,
-    const vk::ImageUsageFlags &usages)
-{
-    vk::ImageCreateInfo vk_info;
-    vk_info.setImageType(vk::ImageType::e2D);
-    vk_info.setFormat(vk::Format::eR32G32B32A32Sfloat);
-    vk_info.extent.width = 2048;
-    vk_info.extent.height = 2048;
-    vk_info.extent.depth = 1;
-    vk_info.setMipLevels(1);
-    vk_info.setArrayLayers(1);
-    vk_info.setSamples(vk::SampleCountFlagBits::e1);
-    vk_info.setTiling(vk::ImageTiling::eOptimal);
-    vk_info.setUsage(usages);
-    vk_info.setSharingMode(vk::SharingMode::eExclusive);
-    vk_info.setInitialLayout(vk::ImageLayout::eUndefined);
+    buffer_create_info.setUsage(mUsages);
+    // the blocks are shared by buffers of all usages, so they are accessible
+    // from the async compute queue if there is one
+    const auto &families = mDevice->sharingQueueFamilies();
+    if(families.empty())
+    {
+        buffer_create_info.setSharingMode(vk::SharingMode::eExclusive);
+    }
+    else
+    {
+        buffer_create_info.setSharingMode(vk::SharingMode::eConcurrent);
+        buffer_create_info.setQueueFamilyIndexCount(
+            static_cast<uint32_t>(families.size()));
+        buffer_create_info.setPQueueFamilyIndices(families.data());
+    }
 
     auto vk_device = mDevice->device();
-    auto dummy_image = vk_device.createImageUnique(vk_info);
+    block.buffer = vk_device.createBufferUnique(buffer_create_info);
 
-    mMemoryRequirements =
-        vk_device.getImageMemoryRequirements(dummy_image.get());
-    mMemoryRequirements.size =
-        utility::roundUpUnsigned(total_size, mMemoryRequirements.alignment);
-
-    allocateDeviceMemory(mem_properties);
-}
-
-usagi::VulkanMemoryPool::VulkanMemoryPool(VulkanGpuDevice *device)
-    : mDevice(device)
-{
+    const auto req = vk_device.getBufferMemoryRequirements(block.buffer.get());
+    allocateBlockMemory(block, req.size, req.memoryTypeBits & type_bits);
+    vk_device.bindBufferMemory(block.buffer.get(), block.memory.get(), 0);
 }
 
-usagi::VulkanMemoryPool::~VulkanMemoryPool()
+usagi::VulkanBufferMemoryPoolBase::VulkanBufferMemoryPoolBase(
+    VulkanGpuDevice *device,
+    std::string name,
+    const std::size_t block_size,
+    const vk::MemoryPropertyFlags &required_flags,
+    const vk::MemoryPropertyFlags &preferred_flags,
+    const vk::BufferUsageFlags &usages)
+    : VulkanMemoryPool(device, std::move(name), block_size,
+        required_flags, preferred_flags)
+    , mUsages(usages)
 {
-    unmapMemory();
 }
@@ -1,9 +1,16 @@
 ﻿#pragma once
 
+#include <algorithm>
+#include <cassert>
+#include <functional>
+#include <mutex>
+#include <vector>
+
 #include <vulkan/vulkan.hpp>
 
 #include <Usagi/Utility/Noncopyable.hpp>
 #include <Usagi/Runtime/Graphics/GpuImageCreateInfo.hpp>
+#include <Usagi/Runtime/Memory/MemoryTracker.hpp>
 
 #include "VulkanBufferAllocation.hpp"
 #include "VulkanPooledImage.hpp"
@@ -15,163 +22,385 @@ struct GpuImageCreateInfo;
 class VulkanGpuDevice;
 class VulkanBufferAllocation;
 
+/**
+ * \brief A piece of device memory owned by a memory pool, from which the
+ * resources are sub-allocated. Blocks of buffer pools also contain a buffer
+ * spanning the whole block. The memory is returned to the heap budget of
+ * the device when the block is destroyed.
+ */
+struct VulkanMemoryBlock : Noncopyable
+{
+    VulkanGpuDevice *device = nullptr;
+    vk::UniqueDeviceMemory memory;
+    vk::UniqueBuffer buffer;
+    std::size_t size = 0;
+    std::uint32_t memory_type = 0;
+    std::uint32_t heap = 0;
+    // the memory will be automatically mapped if has eHostVisible flag
+    char *mapped = nullptr;
+    // the block only holds a single resource and is freed along with it
+    bool dedicated = false;
+    std::size_t num_allocations = 0;
+
+    ~VulkanMemoryBlock();
+};
+
 class VulkanMemoryPool : Noncopyable
 {
 protected:
     VulkanGpuDevice *mDevice = nullptr;
-    vk::UniqueDeviceMemory mMemory;
-    vk::MemoryRequirements mMemoryRequirements { };
-    // the memory will be automatically mapped if has eHostVisible flag
-    char *mMappedMemory = nullptr;
+    const std::size_t mBlockSize;
+    // allocations not smaller than this get their own blocks
+    const std::size_t mDedicatedThreshold;
+    const vk::MemoryPropertyFlags mRequiredFlags;
+    const vk::MemoryPropertyFlags mPreferredFlags;
+    std::shared_ptr<MemoryTag> mMemoryTag;
+    std::mutex mMutex;
 
-    void mapMemory();
-    void unmapMemory();
+    /**
+     * \brief Get the memory types allowed by type_bits and having all the
+     * required flags, ordered by the number of missing preferred flags and
+     * then the number of unrequested flags, so exact matches come first.
+     */
+    std::vector<std::uint32_t> rankMemoryTypes(std::uint32_t type_bits) const;
 
-    void allocateDeviceMemory(const vk::MemoryPropertyFlags &mem_properties);
+    /**
+     * \brief Allocate the memory of the block from the best ranked memory
+     * type whose heap has enough budget left. Memory of host-visible types
+     * is mapped.
+     * \throw std::bad_alloc if none of the memory types could satisfy the
+     * allocation.
+     */
+    void allocateBlockMemory(
+        VulkanMemoryBlock &block,
+        std::size_t size,
+        std::uint32_t type_bits);
 
+    /**
+     * \brief Allocate the memory of a new block. type_bits is the set of
+     * memory types acceptable by the resource requesting the block.
+     */
+    virtual void createBlockMemory(
+        VulkanMemoryBlock &block,
+        std::size_t size,
+        std::uint32_t type_bits);
+
+    /**
+     * \brief Sampled and storage images may be accessed by the async
+     * compute queue and are shared concurrently. Attachments are only used
+     * by the graphics queue.
+     */
+    bool concurrentSharing(const GpuImageCreateInfo &info) const;
     vk::UniqueImage createImage(const GpuImageCreateInfo &info) const;
     vk::MemoryRequirements getImageRequirements(vk::Image image) const;
     void bindImageMemory(VulkanPooledImage *image);
-    static void createImageBaseView(VulkanPooledImage *image);
+    /**
+     * \brief Create the base view of the image. If the image is sampled,
+     * its views are put into the bindless texture table if it is enabled.
+     */
+    void createImageBaseView(VulkanPooledImage *image, bool sampled);
 
-    void allocateDeviceMemoryForBuffer(
-        std::size_t size,
-        const vk::MemoryPropertyFlags &mem_properties,
-        const vk::BufferUsageFlags &usages,
-        vk::UniqueBuffer &buffer);
+public:
+    VulkanMemoryPool(
+        VulkanGpuDevice *device,
+        std::string name,
+        std::size_t block_size,
+        const vk::MemoryPropertyFlags &required_flags,
+        const vk::MemoryPropertyFlags &preferred_flags);
+    virtual ~VulkanMemoryPool() = default;
 
-    void allocateDeviceMemoryForImage(
-        std::size_t total_size,
-        const vk::MemoryPropertyFlags &mem_properties,
-        const vk::ImageUsageFlags &usages);
+    virtual void deallocate(VulkanMemoryBlock *block, std::size_t offset) = 0;
+
+    VulkanGpuDevice * device() const { return mDevice; }
+    MemoryTag * memoryTag() const { return mMemoryTag.get(); }
+    std::size_t blockSize() const { return mBlockSize; }
+};
 
+/**
+ * \brief Manages a list of memory blocks, each sub-allocated by its own
+ * allocator. A new block is allocated when the existing ones are full, and
+ * a dedicated block of just the requested size is used when a full block
+ * cannot be allocated. Empty blocks are freed except for one, which is kept
+ * so that usage oscillating around a block boundary does not reallocate
+ * device memory every frame.
+ */
+template <typename Base, typename Allocator>
+class VulkanBlockPool : public Base
+{
 public:
-    VulkanMemoryPool(VulkanGpuDevice *device);
-    virtual ~VulkanMemoryPool();
+    using AllocatorFactory =
+        std::function<std::unique_ptr<Allocator>(std::size_t size)>;
 
-    virtual void deallocate(std::size_t offset) = 0;
+protected:
+    struct Block : VulkanMemoryBlock
+    {
+        // null for dedicated blocks
+        std::unique_ptr<Allocator> allocator;
+    };
 
-    VulkanGpuDevice * device() const { return mDevice; }
-    vk::DeviceMemory memory() const { return mMemory.get(); }
+    std::vector<std::unique_ptr<Block>> mBlocks;
+    AllocatorFactory mAllocatorFactory;
+
+    Block * createBlock(
+        const std::size_t size,
+        const std::uint32_t type_bits,
+        const bool dedicated)
+    {
+        auto block = std::make_unique<Block>();
+        block->device = this->mDevice;
+        block->dedicated = dedicated;
+        this->createBlockMemory(*block, size, type_bits);
+        if(dedicated)
+        {
+            this->mMemoryTag->recordAllocation(block->size);
+        }
+        else
+        {
+            block->allocator = mAllocatorFactory(size);
+            block->allocator->setMemoryTag(this->mMemoryTag);
+        }
+        mBlocks.push_back(std::move(block));
+        return mBlocks.back().get();
+    }
+
+    void destroyBlock(Block *block)
+    {
+        const auto iter = std::find_if(mBlocks.begin(), mBlocks.end(),
+            [=](auto &&b) { return b.get() == block; });
+        assert(iter != mBlocks.end());
+        mBlocks.erase(iter);
+    }
+
+    static bool trySubAllocate(
+        Block *block,
+        const std::size_t size,
+        const std::size_t alignment,
+        std::size_t &offset)
+    {
+        try
+        {
+            offset = reinterpret_cast<std::size_t>(
+                block->allocator->allocate(size, alignment));
+        }
+        catch(const std::bad_alloc &)
+        {
+            return false;
+        }
+        ++block->num_allocations;
+        return true;
+    }
+
+    /**
+     * \brief Find space for the allocation in the blocks whose memory
+     * types are in type_bits, growing the pool if necessary.
+     * \throw std::bad_alloc if no memory could be allocated from the device.
+     */
+    std::pair<Block*, std::size_t> allocateFromBlocks(
+        const std::size_t size,
+        const std::size_t alignment,
+        const std::uint32_t type_bits)
+    {
+        std::lock_guard<std::mutex> lock(this->mMutex);
+
+        std::size_t offset = 0;
+        if(size < this->mDedicatedThreshold)
+        {
+            for(auto &&block : mBlocks)
+            {
+                if(block->dedicated ||
+                    !(type_bits & 1u << block->memory_type))
+                    continue;
+                if(trySubAllocate(block.get(), size, alignment, offset))
+                    return { block.get(), offset };
+            }
+            try
+            {
+                const auto block = createBlock(
+                    this->mBlockSize, type_bits, false);
+                if(trySubAllocate(block, size, alignment, offset))
+                    return { block, offset };
+                destroyBlock(block);
+            }
+            catch(const std::bad_alloc &)
+            {
+                // try a smaller allocation below
+            }
+        }
+        const auto block = createBlock(size, type_bits, true);
+        block->num_allocations = 1;
+        return { block, 0 };
+    }
+
+public:
+    template <typename... BaseArgs>
+    explicit VulkanBlockPool(
+        AllocatorFactory allocator_factory,
+        BaseArgs &&... base_args)
+        : Base(std::forward<BaseArgs>(base_args)...)
+        , mAllocatorFactory(std::move(allocator_factory))
+    {
+        this->mMemoryTag->setRegionUsageQuery([this]() {
+            std::lock_guard<std::mutex> lock(this->mMutex);
+            MemoryRegionUsage usage;
+            for(auto &&block : mBlocks)
+            {
+                usage.managed_bytes += block->size;
+                if(block->dedicated) continue;
+                usage.free_bytes += block->allocator->usableSize();
+                usage.largest_free_block = std::max(
+                    usage.largest_free_block,
+                    block->allocator->largestFreeBlockSize());
+            }
+            return usage;
+        });
+    }
+
+    ~VulkanBlockPool()
+    {
+        this->mMemoryTag->setRegionUsageQuery(nullptr);
+        // all memory all freed
+        assert(std::all_of(mBlocks.begin(), mBlocks.end(),
+            [](auto &&b) { return b->num_allocations == 0; }));
+    }
+
+    void deallocate(
+        VulkanMemoryBlock *memory_block,
+        const std::size_t offset) override
+    {
+        std::lock_guard<std::mutex> lock(this->mMutex);
+
+        const auto block = static_cast<Block*>(memory_block);
+        if(block->dedicated)
+            this->mMemoryTag->recordDeallocation(block->size);
+        else
+            block->allocator->deallocate(reinterpret_cast<void*>(offset));
+
+        if(--block->num_allocations > 0)
+            return;
+        const auto keep = !block->dedicated && std::none_of(
+            mBlocks.begin(), mBlocks.end(), [=](auto &&b) {
+                return b.get() != block && !b->dedicated &&
+                    b->num_allocations == 0;
+            });
+        if(!keep)
+            destroyBlock(block);
+    }
+
+    std::size_t blockCount() const { return mBlocks.size(); }
 };
 
 class VulkanBufferMemoryPoolBase : public VulkanMemoryPool
 {
 protected:
-    vk::UniqueBuffer mBuffer;
+    const vk::BufferUsageFlags mUsages;
+
+    void createBlockMemory(
+        VulkanMemoryBlock &block,
+        std::size_t size,
+        std::uint32_t type_bits) override;
 
 public:
-    using VulkanMemoryPool::VulkanMemoryPool;
+    VulkanBufferMemoryPoolBase(
+        VulkanGpuDevice *device,
+        std::string name,
+        std::size_t block_size,
+        const vk::MemoryPropertyFlags &required_flags,
+        const vk::MemoryPropertyFlags &preferred_flags,
+        const vk::BufferUsageFlags &usages);
 
     virtual std::shared_ptr<VulkanBufferAllocation> allocate(
         std::size_t size) = 0;
-
-    vk::Buffer buffer() const { return mBuffer.get(); }
 };
 
 template <typename Allocator>
-class VulkanBufferMemoryPool : public VulkanBufferMemoryPoolBase
+class VulkanBufferMemoryPool
+    : public VulkanBlockPool<VulkanBufferMemoryPoolBase, Allocator>
 {
-    std::unique_ptr<Allocator> mAllocator;
+    using BaseT = VulkanBlockPool<VulkanBufferMemoryPoolBase, Allocator>;
 
 public:
-    template <typename AllocCreateFunc>
     VulkanBufferMemoryPool(
         VulkanGpuDevice *device,
-        const std::size_t size,
-        const vk::MemoryPropertyFlags &mem_properties,
+        std::string name,
+        const std::size_t block_size,
+        const vk::MemoryPropertyFlags &required_flags,
+        const vk::MemoryPropertyFlags &preferred_flags,
         const vk::BufferUsageFlags &usages,
-        AllocCreateFunc alloc_create_func)
-        : VulkanBufferMemoryPoolBase(device)
+        typename BaseT::AllocatorFactory allocator_factory)
+        : BaseT(
+            std::move(allocator_factory),
+            device, std::move(name), block_size,
+            required_flags, preferred_flags, usages)
     {
-        allocateDeviceMemoryForBuffer(size, mem_properties, usages, mBuffer);
-        mAllocator = alloc_create_func(mMemoryRequirements);
-    }
-
-    ~VulkanBufferMemoryPool()
-    {
-        // all memory all freed
-        assert(mAllocator || mAllocator->usedSize() == 0);
     }
 
     std::shared_ptr<VulkanBufferAllocation> allocate(std::size_t size) override
     {
-        auto offset = reinterpret_cast<std::size_t>(mAllocator->allocate(size));
+        const auto [block, offset] = this->allocateFromBlocks(size, 0, ~0u);
         try
         {
-            auto alloc = std::make_shared<VulkanBufferAllocation>(
-                this,
+            return std::make_shared<VulkanBufferAllocation>(
+                this, block,
                 offset, size,
-                mMappedMemory ? mMappedMemory + offset : nullptr
+                block->mapped ? block->mapped + offset : nullptr
             );
-            return std::move(alloc);
         }
         catch(...)
         {
-            deallocate(offset);
+            this->deallocate(block, offset);
             throw;
         }
     }
-
-    void deallocate(const std::size_t offset) override
-    {
-        mAllocator->deallocate(reinterpret_cast<void*>(offset));
-    }
 };
 
 template <typename Allocator>
-class VulkanImageMemoryPool : public VulkanMemoryPool
+class VulkanImageMemoryPool
+    : public VulkanBlockPool<VulkanMemoryPool, Allocator>
 {
-    std::unique_ptr<Allocator> mAllocator;
+    using BaseT = VulkanBlockPool<VulkanMemoryPool, Allocator>;
 
 public:
-    template <typename AllocCreateFunc>
     VulkanImageMemoryPool(
         VulkanGpuDevice *device,
-        std::size_t size,
-        const vk::MemoryPropertyFlags &mem_properties,
-        const vk::ImageUsageFlags &usages,
-        AllocCreateFunc alloc_create_func)
-        : VulkanMemoryPool(device)
-    {
-        allocateDeviceMemoryForImage(size, mem_properties, usages);
-        mAllocator = alloc_create_func(mMemoryRequirements);
-    }
-
-    ~VulkanImageMemoryPool()
+        std::string name,
+        const std::size_t block_size,
+        const vk::MemoryPropertyFlags &required_flags,
+        const vk::MemoryPropertyFlags &preferred_flags,
+        typename BaseT::AllocatorFactory allocator_factory)
+        : BaseT(
+            std::move(allocator_factory),
+            device, std::move(name), block_size,
+            required_flags, preferred_flags)
     {
-        // all memory all freed
-        assert(mAllocator || mAllocator->usedSize() == 0);
     }
 
     std::shared_ptr<VulkanPooledImage> createPooledImage(
         const GpuImageCreateInfo &info)
     {
-        auto image = createImage(info);
-        const auto req = getImageRequirements(image.get());
-        auto offset = reinterpret_cast<std::size_t>(mAllocator->allocate(
-            req.size, req.alignment));
+        auto image = this->createImage(info);
+        const auto req = this->getImageRequirements(image.get());
+        const auto [block, offset] = this->allocateFromBlocks(
+            req.size, req.alignment, req.memoryTypeBits);
+        std::shared_ptr<VulkanPooledImage> wrapper;
         try
         {
-            auto wrapper = std::make_shared<VulkanPooledImage>(
+            wrapper = std::make_shared<VulkanPooledImage>(
                 std::move(image),
                 GpuImageFormat { info.format, info.sample_count }, info.size,
-                this, offset, req.size
+                this, block, offset, req.size
             );
-            bindImageMemory(wrapper.get());
-            createImageBaseView(wrapper.get());
-            return std::move(wrapper);
         }
         catch(...)
         {
-            deallocate(offset);
+            this->deallocate(block, offset);
             throw;
         }
-    }
-
-    void deallocate(const std::size_t offset) override
-    {
-        mAllocator->deallocate(reinterpret_cast<void*>(offset));
+        wrapper->setConcurrentSharing(this->concurrentSharing(info));
+        // the memory is returned by the image from now on
+        this->bindImageMemory(wrapper.get());
+        this->createImageBaseView(wrapper.get(),
+            info.usage == GpuImageUsage::SAMPLED);
+        return std::move(wrapper);
     }
 };
 }
@@ -0,0 +1,62 @@
+﻿#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include <Usagi/Utility/Noncopyable.hpp>
+
+namespace usagi
+{
+/**
+ * \brief Shares device objects created from identical descriptions. The
+ * cache only keeps weak references so the objects are released as soon as
+ * no one uses them.
+ * \tparam T
+ */
+template <typename T>
+class VulkanObjectCache : Noncopyable
+{
+    std::mutex mLock;
+    std::unordered_map<std::string, std::weak_ptr<T>> mObjects;
+
+public:
+    /**
+     * \brief Get the object described by the key, or create it if there is
+     * no living one.
+     * \tparam Create std::shared_ptr<T>()
+     * \param key
+     * \param create
+     * \return
+     */
+    template <typename Create>
+    std::shared_ptr<T> acquire(const std::string &key, Create &&create)
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+
+        auto &entry = mObjects[key];
+        if(auto object = entry.lock())
+            return object;
+        std::shared_ptr<T> object = create();
+        entry = object;
+        return object;
+    }
+
+    /**
+     * \brief Remove the entries whose objects were released.
+     */
+    void purge()
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+
+        for(auto i = mObjects.begin(); i != mObjects.end();)
+        {
+            if(i->second.expired())
+                i = mObjects.erase(i);
+            else
+                ++i;
+        }
+    }
+};
+}
@@ -0,0 +1,75 @@
+﻿#include "VulkanPipeline.hpp"
+
+#include <algorithm>
+
+#include <Usagi/Core/Logging.hpp>
+
+vk::DescriptorSetLayout usagi::VulkanPipeline::descriptorSetLayout(
+    const std::uint32_t set_id) const
+{
+    const auto i = mLayouts.find(set_id);
+    if(i == mLayouts.end())
+    {
+        LOG(error, "Nonexisting descriptor set id = {}", set_id);
+        throw std::logic_error("Referenced invalid resource.");
+    }
+    return i->second->layout.get();
+}
+
+const usagi::VulkanDescriptorUpdateTemplate &
+usagi::VulkanPipeline::descriptorUpdateTemplate(
+    const std::uint32_t set_id) const
+{
+    const auto i = mLayouts.find(set_id);
+    if(i == mLayouts.end())
+    {
+        LOG(error, "Nonexisting descriptor set id = {}", set_id);
+        throw std::logic_error("Referenced invalid resource.");
+    }
+    return i->second->update_template;
+}
+
+vk::DescriptorType usagi::VulkanPipeline::descriptorType(
+    const std::uint32_t set_id,
+    const std::uint32_t binding) const
+{
+    const auto set = mLayoutBindings.find(set_id);
+    if(set == mLayoutBindings.end())
+    {
+        LOG(error, "Nonexisting descriptor set id = {}", set_id);
+        throw std::logic_error("Referenced invalid resource.");
+    }
+    auto &bindings = set->second;
+    // access by index if no binding is skipped
+    if(binding < bindings.size())
+    {
+        auto &vk_binding = bindings[binding];
+        if(vk_binding.binding == binding)
+            return vk_binding.descriptorType;
+    }
+    // fallback to linear search
+    const auto iter = std::find_if(bindings.begin(), bindings.end(),
+        [&](auto &&b) { return b.binding == binding; });
+    if(iter == bindings.end())
+    {
+        LOG(error, "Nonexisting binding {} in descriptor set {}",
+            binding, set_id);
+        throw std::logic_error("Referenced invalid resource.");
+    }
+    return iter->descriptorType;
+}
+
+usagi::VulkanPushConstantField usagi::VulkanPipeline::queryConstantInfo(
+    ShaderStage stage,
+    const std::string &name) const
+{
+    const auto fields = mConstantFieldMap.find(stage);
+    if(fields != mConstantFieldMap.end())
+    {
+        const auto field = fields->second.find(name);
+        if(field != fields->second.end())
+            return field->second;
+    }
+    LOG(error, "Nonexisting constant {} in {} shader", name, to_string(stage));
+    throw std::logic_error("Referenced invalid constant.");
+}
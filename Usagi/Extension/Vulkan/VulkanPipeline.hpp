@@ -0,0 +1,98 @@
+﻿#pragma once
+
+#include <map>
+#include <optional>
+
+#include <vulkan/vulkan.hpp>
+
+#include <Usagi/Runtime/Graphics/Shader/ShaderStage.hpp>
+
+#include "VulkanBatchResource.hpp"
+
+namespace usagi
+{
+struct VulkanPushConstantField
+{
+	std::uint32_t offset = 0, size = 0;
+};
+
+struct VulkanDescriptorUpdateTemplate
+{
+    vk::UniqueDescriptorUpdateTemplate update_template;
+    // number of VulkanDescriptorData entries read by the template
+    std::uint32_t data_count = 0;
+};
+
+/**
+ * \brief Shared by the pipelines declaring identical bindings, so that
+ * their descriptor sets are also shared in the descriptor cache.
+ */
+struct VulkanDescriptorSetLayout
+{
+    vk::UniqueDescriptorSetLayout layout;
+    VulkanDescriptorUpdateTemplate update_template;
+};
+
+/**
+ * \brief The pipeline object and the layout generated by reflecting its
+ * shaders, which are common to graphics and compute pipelines.
+ */
+class VulkanPipeline : public VulkanBatchResource
+{
+public:
+    using DescriptorSetLayoutBindingMap =
+        std::map<std::uint32_t, std::vector<vk::DescriptorSetLayoutBinding>>;
+	using DescriptorSetLayoutMap = std::map<std::uint32_t,
+        std::shared_ptr<VulkanDescriptorSetLayout>>;
+	using PushConstantFieldMap =
+		std::map<ShaderStage, std::map<std::string, VulkanPushConstantField>>;
+
+private:
+    const vk::PipelineBindPoint mBindPoint;
+    vk::UniquePipeline mPipeline;
+    vk::UniquePipelineLayout mPipelineLayout;
+
+    const DescriptorSetLayoutBindingMap mLayoutBindings;
+    const DescriptorSetLayoutMap mLayouts;
+    const std::optional<std::uint32_t> mBindlessSet;
+	const PushConstantFieldMap mConstantFieldMap;
+
+public:
+    VulkanPipeline(
+        vk::PipelineBindPoint bind_point,
+        vk::UniquePipeline vk_pipeline,
+        vk::UniquePipelineLayout vk_pipeline_layout,
+        DescriptorSetLayoutBindingMap layout_bindings,
+        DescriptorSetLayoutMap layout,
+        std::optional<std::uint32_t> bindless_set,
+        PushConstantFieldMap constant_field_map)
+        : mBindPoint { bind_point }
+        , mPipeline { std::move(vk_pipeline) }
+        , mPipelineLayout { std::move(vk_pipeline_layout) }
+        , mLayoutBindings(std::move(layout_bindings))
+        , mLayouts { std::move(layout) }
+        , mBindlessSet { bindless_set }
+        , mConstantFieldMap { std::move(constant_field_map) }
+    {
+    }
+
+    vk::PipelineBindPoint bindPoint() const { return mBindPoint; }
+    vk::Pipeline pipeline() const { return mPipeline.get(); }
+    vk::PipelineLayout layout() const { return mPipelineLayout.get(); }
+
+    vk::DescriptorSetLayout descriptorSetLayout(std::uint32_t set_id) const;
+    /**
+     * \brief The set id which the bindless texture table is bound to.
+     */
+    std::optional<std::uint32_t> bindlessSet() const { return mBindlessSet; }
+    const VulkanDescriptorUpdateTemplate & descriptorUpdateTemplate(
+        std::uint32_t set_id) const;
+    vk::DescriptorType descriptorType(
+        std::uint32_t set_id,
+        std::uint32_t binding) const;
+
+    VulkanPushConstantField queryConstantInfo(
+        ShaderStage stage,
+        const std::string &name) const;
+};
+}
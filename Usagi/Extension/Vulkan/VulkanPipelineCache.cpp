@@ -0,0 +1,132 @@
+﻿#include "VulkanPipelineCache.hpp"
+
+#include <cstring>
+
+#include <fmt/format.h>
+
+#include <Usagi/Core/Logging.hpp>
+#include <Usagi/Utility/File.hpp>
+
+namespace fs = std::filesystem;
+
+bool usagi::VulkanPipelineCache::validateHeader(
+    const std::string &data,
+    const vk::PhysicalDeviceProperties &properties)
+{
+    // VkPipelineCacheHeaderVersionOne
+    struct Header
+    {
+        std::uint32_t length;
+        std::uint32_t version;
+        std::uint32_t vendor_id;
+        std::uint32_t device_id;
+        std::uint8_t uuid[VK_UUID_SIZE];
+    } header;
+    static_assert(sizeof(Header) == 16 + VK_UUID_SIZE);
+
+    if(data.size() < sizeof(Header))
+        return false;
+    std::memcpy(&header, data.data(), sizeof(Header));
+
+    return header.length >= sizeof(Header) &&
+        header.version == static_cast<std::uint32_t>(
+            vk::PipelineCacheHeaderVersion::eOne) &&
+        header.vendor_id == properties.vendorID &&
+        header.device_id == properties.deviceID &&
+        std::memcmp(header.uuid, properties.pipelineCacheUUID,
+            VK_UUID_SIZE) == 0;
+}
+
+usagi::VulkanPipelineCache::VulkanPipelineCache(
+    vk::PhysicalDevice physical_device,
+    vk::Device device,
+    const fs::path &cache_folder)
+    : mDevice(device)
+{
+    const auto properties = physical_device.getProperties();
+
+    std::string data;
+    if(!cache_folder.empty())
+    {
+        std::string uuid;
+        for(auto &&b : properties.pipelineCacheUUID)
+            uuid += fmt::format("{:02x}", b);
+        mFilePath = cache_folder / fmt::format("pipelines_{}.bin", uuid);
+
+        if(exists(mFilePath))
+        {
+            try
+            {
+                data = readFileAsString(mFilePath);
+                if(validateHeader(data, properties))
+                {
+                    LOG(info, "Loaded {} bytes of pipeline cache from {}",
+                        data.size(), mFilePath.u8string());
+                }
+                else
+                {
+                    LOG(warn, "Discarded incompatible pipeline cache {}",
+                        mFilePath.u8string());
+                    data.clear();
+                }
+            }
+            catch(const std::exception &e)
+            {
+                LOG(warn, "Could not load pipeline cache {}: {}",
+                    mFilePath.u8string(), e.what());
+                data.clear();
+            }
+        }
+    }
+
+    vk::PipelineCacheCreateInfo info;
+    info.setInitialDataSize(data.size());
+    info.setPInitialData(data.data());
+    mCache = mDevice.createPipelineCacheUnique(info);
+}
+
+void usagi::VulkanPipelineCache::save()
+{
+    if(mFilePath.empty()) return;
+
+    auto data = mDevice.getPipelineCacheData(mCache.get());
+    if(data.empty()) return;
+
+    // write to a temporary file first so an interrupted write does not
+    // leave a truncated cache behind
+    std::error_code ec;
+    create_directories(mFilePath.parent_path(), ec);
+    auto temp_path = mFilePath;
+    temp_path += ".tmp";
+    dumpBinary(temp_path, data.data(), data.size());
+    fs::rename(temp_path, mFilePath, ec);
+    if(ec)
+    {
+        LOG(error, "Could not save pipeline cache to {}: {}",
+            mFilePath.u8string(), ec.message());
+        return;
+    }
+    LOG(info, "Saved {} bytes of pipeline cache to {}",
+        data.size(), mFilePath.u8string());
+}
+
+std::shared_ptr<usagi::VulkanPipeline>
+    usagi::VulkanPipelineCache::find(const std::string &key)
+{
+    std::lock_guard<std::mutex> lock(mLock);
+
+    const auto i = mPipelines.find(key);
+    if(i == mPipelines.end()) return nullptr;
+    auto pipeline = i->second.lock();
+    if(!pipeline) mPipelines.erase(i);
+    return pipeline;
+}
+
+void usagi::VulkanPipelineCache::add(
+    std::string key,
+    const std::shared_ptr<VulkanPipeline> &pipeline)
+{
+    std::lock_guard<std::mutex> lock(mLock);
+
+    mPipelines[std::move(key)] = pipeline;
+}
@@ -0,0 +1,69 @@
+﻿#pragma once
+
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include <vulkan/vulkan.hpp>
+
+#include <Usagi/Utility/Noncopyable.hpp>
+
+namespace usagi
+{
+class VulkanPipeline;
+
+/**
+ * \brief Device-wide pipeline cache persisted across launches, and a
+ * registry of the created pipelines keyed by their full state descriptions
+ * so identical requests share the same pipeline object.
+ *
+ * The cache file is named after the pipeline cache UUID of the device so
+ * different GPUs or drivers do not overwrite each other's data. Its header
+ * is validated against the device before passing it to the driver.
+ */
+class VulkanPipelineCache : Noncopyable
+{
+    vk::Device mDevice;
+    std::filesystem::path mFilePath;
+    vk::UniquePipelineCache mCache;
+
+    std::mutex mLock;
+    std::unordered_map<std::string, std::weak_ptr<VulkanPipeline>>
+        mPipelines;
+
+    static bool validateHeader(
+        const std::string &data,
+        const vk::PhysicalDeviceProperties &properties);
+
+public:
+    /**
+     * \brief
+     * \param physical_device
+     * \param device
+     * \param cache_folder If empty, the cache is not persisted.
+     */
+    VulkanPipelineCache(
+        vk::PhysicalDevice physical_device,
+        vk::Device device,
+        const std::filesystem::path &cache_folder);
+
+    vk::PipelineCache cache() const { return mCache.get(); }
+
+    /**
+     * \brief Write the cache data to disk.
+     */
+    void save();
+
+    /**
+     * \brief Find a live pipeline created with the same description.
+     * \param key
+     * \return nullptr if not found.
+     */
+    std::shared_ptr<VulkanPipeline> find(const std::string &key);
+    void add(
+        std::string key,
+        const std::shared_ptr<VulkanPipeline> &pipeline);
+};
+}
@@ -0,0 +1,293 @@
+﻿#include "VulkanPipelineLayoutBuilder.hpp"
+
+#include <algorithm>
+
+#include <fmt/format.h>
+
+#include <Usagi/Core/Logging.hpp>
+
+#include "VulkanGpuDevice.hpp"
+#include "VulkanEnumTranslation.hpp"
+#include "VulkanDescriptorCache.hpp"
+
+using namespace usagi::vulkan;
+
+struct usagi::VulkanPipelineLayoutBuilder::ReflectionHelper
+{
+    VulkanPipelineLayoutBuilder &ctx;
+    const ShaderStage stage;
+    const ShaderReflection &reflection;
+    std::size_t push_constant_offset = 0;
+    std::size_t push_constant_size = 0;
+    VulkanPipeline::PushConstantFieldMap::mapped_type &push_constant_fields;
+
+    ReflectionHelper(
+        VulkanPipelineLayoutBuilder &ctx,
+        const ShaderStage stage,
+        const ShaderReflection &reflection)
+        : ctx { ctx }
+        , stage { stage }
+        , reflection { reflection }
+        , push_constant_fields { ctx.push_constant_field_map[stage] }
+    {
+    }
+
+    void reflectPushConstantField(
+        const ShaderReflection::PushConstantField &member, unsigned i)
+    {
+        // if first member is named padding, it is considered as offset hint
+        // and is ignored.
+        if(i == 0 && member.name == "padding")
+        {
+            push_constant_offset = member.size;
+            return;
+        }
+
+        LOG(info, "{}: offset={}, size={}",
+            member.name, member.offset, member.size);
+
+        VulkanPushConstantField field;
+        field.size = member.size;
+        field.offset = member.offset;
+
+        // add to reflection record
+        // todo: if multiple constant buffers are allowed in the
+        // future, member name may not uniquely identify the fields.
+        // use struct_name.field_name instead?
+        push_constant_fields[member.name] = field;
+    }
+
+    std::size_t reflectPushConstantBuffer(
+        const ShaderReflection::PushConstantBuffer &buffer)
+    {
+        const auto member_count = buffer.fields.size();
+        for(unsigned i = 0; i < member_count; i++)
+            reflectPushConstantField(buffer.fields[i], i);
+
+        return buffer.size;
+    }
+
+    void reflectPushConstantRanges()
+    {
+        for(const auto &buffer : reflection.push_constant_buffers)
+            push_constant_size += reflectPushConstantBuffer(buffer);
+
+        if(push_constant_size == 0) return;
+
+        vk::PushConstantRange range;
+        // todo allow multiple stages in one shader source
+        range.setOffset(static_cast<uint32_t>(push_constant_offset));
+        range.setSize(static_cast<uint32_t>(
+            push_constant_size - push_constant_offset));
+        range.setStageFlags(translate(stage));
+        ctx.push_constants.push_back(range);
+
+        ctx.max_push_constant_size = std::max(
+            ctx.max_push_constant_size,
+            push_constant_size
+        );
+    }
+
+    void addResource(const ShaderReflection::Resource &resource,
+        const vk::DescriptorType resource_type) const
+    {
+        auto &bindings = ctx.desc_set_layout_bindings[resource.set];
+
+        // a resource declared by multiple stages, such as the instance data
+        // pulled by both the vertex and fragment shaders, shares a binding
+        const auto iter = std::find_if(bindings.begin(), bindings.end(),
+            [&](auto &&b) { return b.binding == resource.binding; });
+        if(iter != bindings.end())
+        {
+            if(iter->descriptorType != resource_type ||
+                iter->descriptorCount != resource.descriptor_count)
+            {
+                LOG(error, "{} (set={},binding={}) is declared differently "
+                    "by multiple stages.", resource.name, resource.set,
+                    resource.binding);
+                throw std::runtime_error(
+                    "Conflicting declarations of a shader resource.");
+            }
+            iter->stageFlags |= translate(stage);
+            return;
+        }
+
+        vk::DescriptorSetLayoutBinding layout_binding;
+        layout_binding.setStageFlags(translate(stage));
+        layout_binding.setBinding(resource.binding);
+        layout_binding.setDescriptorCount(resource.descriptor_count);
+        layout_binding.setDescriptorType(resource_type);
+
+        bindings.push_back(layout_binding);
+    }
+
+    void addImageResource(const ShaderReflection::Resource &resource) const
+    {
+        if(!resource.runtime_array)
+        {
+            addResource(resource, vk::DescriptorType::eSampledImage);
+            return;
+        }
+
+        const auto set = resource.set;
+        if(ctx.device->bindlessTextures() == nullptr)
+        {
+            LOG(error, "{} (set={}) requires bindless textures.",
+                resource.name, set);
+            throw std::runtime_error(
+                "Bindless textures are not supported by the device.");
+        }
+        LOG(info, "{} (set={}) uses the bindless texture table.",
+            resource.name, set);
+        ctx.bindless_set = set;
+        // reserve the set index
+        ctx.desc_set_layout_bindings[set];
+    }
+
+    void ignoreResource(const ShaderReflection::Resource &resource,
+        const vk::DescriptorType resource_type) const
+    {
+        LOG(warn, "{} {} (set={},binding={}) is ignored.",
+            to_string(resource_type), resource.name,
+            resource.set, resource.binding);
+    }
+
+    void reflectDescriptorSets()
+    {
+        LOG(info, "Descriptor set layouts:");
+
+        using Type = ShaderReflection::ResourceType;
+
+        // todo: deal with others resource types
+        for(auto &&resource : reflection.resources)
+        {
+            switch(resource.type)
+            {
+                case Type::STORAGE_BUFFER:
+                    addResource(resource,
+                        vk::DescriptorType::eStorageBuffer);
+                    break;
+                // sampler2D is not supported in HLSL so not included here.
+                // don't use them in shaders.
+                case Type::COMBINED_IMAGE_SAMPLER:
+                    ignoreResource(resource,
+                        vk::DescriptorType::eSampledImage);
+                    break;
+                case Type::SEPARATE_IMAGE:
+                    addImageResource(resource);
+                    break;
+                case Type::SEPARATE_SAMPLER:
+                    addResource(resource, vk::DescriptorType::eSampler);
+                    break;
+                case Type::UNIFORM_BUFFER:
+                    addResource(resource,
+                        vk::DescriptorType::eUniformBuffer);
+                    break;
+                // note that only one subpass is used to maintain
+                // compatibility for shader cross-compiling
+                case Type::SUBPASS_INPUT:
+                    addResource(resource,
+                        vk::DescriptorType::eInputAttachment);
+                    break;
+                case Type::STORAGE_IMAGE:
+                    addResource(resource,
+                        vk::DescriptorType::eStorageImage);
+                    break;
+                default: break;
+            }
+        }
+    }
+};
+
+void usagi::VulkanPipelineLayoutBuilder::reflect(
+    const ShaderStage stage,
+    const ShaderReflection &reflection)
+{
+    ReflectionHelper helper { *this, stage, reflection };
+    helper.reflectPushConstantRanges();
+    helper.reflectDescriptorSets();
+}
+
+vk::UniquePipelineLayout
+    usagi::VulkanPipelineLayoutBuilder::createPipelineLayout()
+{
+    vk::PipelineLayoutCreateInfo info;
+
+    for(auto &&layout : desc_set_layout_bindings)
+    {
+        if(layout.first == bindless_set)
+        {
+            if(!layout.second.empty())
+                throw std::runtime_error("The bindless texture set "
+                    "must not contain other resources.");
+            desc_set_layout_array.push_back(
+                device->bindlessTextures()->layout());
+            continue;
+        }
+
+        auto l = createDescriptorSetLayout(layout.second);
+        desc_set_layout_array.push_back(l->layout.get());
+        desc_set_layouts[layout.first] = std::move(l);
+    }
+    info.setSetLayoutCount(
+        static_cast<uint32_t>(desc_set_layout_array.size()));
+    info.setPSetLayouts(desc_set_layout_array.data());
+
+    info.setPushConstantRangeCount(
+        static_cast<uint32_t>(push_constants.size()));
+    info.setPPushConstantRanges(push_constants.data());
+
+    return device->device().createPipelineLayoutUnique(info);
+}
+
+std::shared_ptr<usagi::VulkanDescriptorSetLayout>
+    usagi::VulkanPipelineLayoutBuilder::createDescriptorSetLayout(
+    const std::vector<vk::DescriptorSetLayoutBinding> &bindings) const
+{
+    std::string key;
+    for(auto &&b : bindings)
+    {
+        key += fmt::format("{}:{}:{}:{};", b.binding,
+            static_cast<int>(b.descriptorType), b.descriptorCount,
+            static_cast<VkShaderStageFlags>(b.stageFlags));
+    }
+
+    return device->descriptorSetLayouts().acquire(key, [&]() {
+        auto l = std::make_shared<VulkanDescriptorSetLayout>();
+
+        vk::DescriptorSetLayoutCreateInfo layout_info;
+        layout_info.setBindingCount(static_cast<uint32_t>(bindings.size()));
+        layout_info.setPBindings(bindings.data());
+        l->layout = device->device().createDescriptorSetLayoutUnique(
+            layout_info);
+
+        // descriptors are written from arrays of VulkanDescriptorData
+        // indexed by binding numbers
+        std::vector<vk::DescriptorUpdateTemplateEntry> entries;
+        auto &update_template = l->update_template;
+        for(auto &&binding : bindings)
+        {
+            vk::DescriptorUpdateTemplateEntry entry;
+            entry.setDstBinding(binding.binding);
+            entry.setDstArrayElement(0);
+            entry.setDescriptorCount(1);
+            entry.setDescriptorType(binding.descriptorType);
+            entry.setOffset(binding.binding * sizeof(VulkanDescriptorData));
+            entry.setStride(sizeof(VulkanDescriptorData));
+            entries.push_back(entry);
+            update_template.data_count = std::max(
+                update_template.data_count, binding.binding + 1);
+        }
+        vk::DescriptorUpdateTemplateCreateInfo template_info;
+        template_info.setDescriptorUpdateEntryCount(
+            static_cast<uint32_t>(entries.size()));
+        template_info.setPDescriptorUpdateEntries(entries.data());
+        template_info.setTemplateType(
+            vk::DescriptorUpdateTemplateType::eDescriptorSet);
+        template_info.setDescriptorSetLayout(l->layout.get());
+        update_template.update_template = device->device()
+            .createDescriptorUpdateTemplateUnique(template_info);
+
+        return l;
+    });
+}
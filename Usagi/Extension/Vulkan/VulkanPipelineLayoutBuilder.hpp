@@ -0,0 +1,67 @@
+﻿#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <Usagi/Runtime/Graphics/Shader/ShaderReflection.hpp>
+#include <Usagi/Utility/Noncopyable.hpp>
+
+#include "VulkanPipeline.hpp"
+
+namespace usagi
+{
+class VulkanGpuDevice;
+
+/**
+ * \brief Generates the descriptor set layouts, push constant ranges and
+ * the pipeline layout from the reflection of the shaders of a pipeline.
+ * Shared by the graphics and compute pipeline compilers.
+ */
+struct VulkanPipelineLayoutBuilder : Noncopyable
+{
+    VulkanGpuDevice *device = nullptr;
+
+    // Descriptor Set Layouts
+    VulkanPipeline::DescriptorSetLayoutBindingMap desc_set_layout_bindings;
+    VulkanPipeline::DescriptorSetLayoutMap desc_set_layouts;
+    // the set declaring an unsized texture array uses the layout of the
+    // bindless texture table
+    std::optional<std::uint32_t> bindless_set;
+    std::vector<vk::DescriptorSetLayout> desc_set_layout_array;
+
+    // Push Constants
+    std::vector<vk::PushConstantRange> push_constants;
+    VulkanPipeline::PushConstantFieldMap push_constant_field_map;
+    // Allocate enough space for push constant buffer
+    // all shader stages have the same binding of the constant buffer
+    // (see the same memory). they must pad the buffer correctly to get
+    // the desired data.
+    // todo if multiple push constant buffer are supported in the future
+    // a separate max size should be calculated for each buffer
+    std::size_t max_push_constant_size = 0;
+
+    explicit VulkanPipelineLayoutBuilder(VulkanGpuDevice *device)
+        : device { device }
+    {
+    }
+
+    /**
+     * \brief Collect the push constants and the resources of a shader.
+     */
+    void reflect(ShaderStage stage, const ShaderReflection &reflection);
+
+    /**
+     * \brief Create the descriptor set layouts and the pipeline layout
+     * from the collected resources.
+     */
+    vk::UniquePipelineLayout createPipelineLayout();
+
+private:
+    struct ReflectionHelper;
+
+    /**
+     * \brief Get a shared layout along with its update template.
+     */
+    std::shared_ptr<VulkanDescriptorSetLayout> createDescriptorSetLayout(
+        const std::vector<vk::DescriptorSetLayoutBinding> &bindings) const;
+};
+}
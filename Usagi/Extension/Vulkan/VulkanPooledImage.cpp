@@ -1,5 +1,7 @@
 ﻿#include "VulkanPooledImage.hpp"
 
+#include <Usagi/Runtime/Memory/MemoryTracker.hpp>
+
 #include "VulkanGpuDevice.hpp"
 #include "VulkanMemoryPool.hpp"
 
@@ -8,27 +10,35 @@ usagi::VulkanPooledImage::VulkanPooledImage(
     GpuImageFormat format,
     const Vector2u32 &size,
     VulkanMemoryPool *pool,
+    VulkanMemoryBlock *block,
     const std::size_t buffer_offset,
     const std::size_t buffer_size)
     : VulkanGpuImage(format, size, vk_image.getOwner())
     , mImage(std::move(vk_image))
     , mPool(pool)
+    , mBlock(block)
     , mBufferOffset(buffer_offset)
     , mBufferSize(buffer_size)
 {
+    if(MemoryTracker::enabled() && (mScopeTag = MemoryTracker::currentScope()))
+        mScopeTag->recordAllocation(mBufferSize);
 }
 
 usagi::VulkanPooledImage::~VulkanPooledImage()
 {
-    mPool->deallocate(mBufferOffset);
+    if(mScopeTag) mScopeTag->recordDeallocation(mBufferSize);
+    mPool->deallocate(mBlock, mBufferOffset);
 }
 
-void usagi::VulkanPooledImage::upload(const void *data, const std::size_t size)
+std::shared_ptr<usagi::GpuUploadHandle> usagi::VulkanPooledImage::upload(
+    const void *data,
+    const std::size_t size)
 {
     assert(size <= mBufferSize);
 
     auto device = mPool->device();
     const auto buffer = device->allocateStageBuffer(size);
     memcpy(buffer->mappedAddress(), data, size);
-    device->copyBufferToImage(buffer, this);
+    buffer->flush();
+    return device->copyBufferToImage(buffer, this);
 }
@@ -5,13 +5,18 @@
 namespace usagi
 {
 class VulkanMemoryPool;
+struct VulkanMemoryBlock;
+class MemoryTag;
 
 class VulkanPooledImage : public VulkanGpuImage
 {
     vk::UniqueImage mImage;
     VulkanMemoryPool *mPool = nullptr;
+    VulkanMemoryBlock *mBlock = nullptr;
     std::size_t mBufferOffset;
     std::size_t mBufferSize;
+    // the memory tag scope in which the image is created
+    std::shared_ptr<MemoryTag> mScopeTag;
 
     friend class VulkanMemoryPool;
 
@@ -21,13 +26,17 @@ public:
         GpuImageFormat format,
         const Vector2u32 &size,
         VulkanMemoryPool *pool,
+        VulkanMemoryBlock *block,
         std::size_t buffer_offset,
         std::size_t buffer_size);
     ~VulkanPooledImage();
 
-    void upload(const void *data, std::size_t size) override;
+    std::shared_ptr<GpuUploadHandle> upload(
+        const void *data,
+        std::size_t size) override;
 
     vk::Image image() const override { return mImage.get(); }
+    VulkanMemoryBlock * block() const { return mBlock; }
     std::size_t offset() const { return mBufferOffset; }
 };
 }
@@ -1,5 +1,7 @@
 ﻿#include "VulkanRenderPass.hpp"
 
+#include <fmt/format.h>
+
 #include <Usagi/Core/Logging.hpp>
 #include <Usagi/Runtime/Graphics/RenderPassCreateInfo.hpp>
 
@@ -28,6 +30,11 @@ usagi::VulkanRenderPass::VulkanRenderPass(
         d.setLoadOp(translate(u.op.load_op));
         d.setStoreOp(translate(u.op.store_op));
         attachment_descriptions.push_back(d);
+        // compatibility only concerns formats, sample counts and how the
+        // attachments are referenced by the subpass
+        mCompatibilityKey += fmt::format("{}:{}:{};",
+            static_cast<int>(d.format), static_cast<int>(d.samples),
+            u.layout == GpuImageLayout::DEPTH_STENCIL_ATTACHMENT);
         mClearValues.emplace_back(std::array<float, 4> {
             u.op.clear_color.x(), u.op.clear_color.y(),
             u.op.clear_color.z(), u.op.clear_color.w()
@@ -68,5 +75,42 @@ usagi::VulkanRenderPass::VulkanRenderPass(
     vk_info.setSubpassCount(1);
     vk_info.setPSubpasses(&subpass);
 
+    // Wait for the earlier accesses to the attachments, including the
+    // presentation engine reading the swapchain images, before the layout
+    // transitions and the accesses of this pass. Only the attachments whose
+    // contents are preserved have writes to be made visible.
+    vk::SubpassDependency dependency;
+    dependency.setSrcSubpass(VK_SUBPASS_EXTERNAL);
+    dependency.setDstSubpass(0);
+    for(auto &&u : info.attachment_usages)
+    {
+        vk::PipelineStageFlags stages;
+        vk::AccessFlags writes, accesses;
+        if(u.layout == GpuImageLayout::DEPTH_STENCIL_ATTACHMENT)
+        {
+            stages = vk::PipelineStageFlagBits::eEarlyFragmentTests |
+                vk::PipelineStageFlagBits::eLateFragmentTests;
+            writes = vk::AccessFlagBits::eDepthStencilAttachmentWrite;
+            accesses = writes |
+                vk::AccessFlagBits::eDepthStencilAttachmentRead;
+        }
+        else
+        {
+            stages = vk::PipelineStageFlagBits::eColorAttachmentOutput;
+            writes = vk::AccessFlagBits::eColorAttachmentWrite;
+            accesses = writes | vk::AccessFlagBits::eColorAttachmentRead;
+        }
+        dependency.srcStageMask |= stages;
+        dependency.dstStageMask |= stages;
+        if(u.initial_layout != GpuImageLayout::UNDEFINED)
+            dependency.srcAccessMask |= writes;
+        dependency.dstAccessMask |= accesses;
+    }
+    if(dependency.srcStageMask)
+    {
+        vk_info.setDependencyCount(1);
+        vk_info.setPDependencies(&dependency);
+    }
+
     mRenderPass = device->device().createRenderPassUnique(vk_info);
 }
@@ -13,6 +13,7 @@ class VulkanRenderPass : public RenderPass
 {
     vk::UniqueRenderPass mRenderPass;
     std::vector<vk::ClearValue> mClearValues;
+    std::string mCompatibilityKey;
 
 public:
     VulkanRenderPass(VulkanGpuDevice *device, const RenderPassCreateInfo &info);
@@ -23,5 +24,14 @@ public:
     {
         return mClearValues;
     }
+
+    /**
+     * \brief Render passes with equal keys are compatible so pipelines
+     * created for one of them can be used with the others.
+     */
+    const std::string & compatibilityKey() const
+    {
+        return mCompatibilityKey;
+    }
 };
 }
@@ -0,0 +1,95 @@
+﻿#include "VulkanTransientRing.hpp"
+
+#include <cassert>
+
+#include <Usagi/Utility/BitHack.hpp>
+#include <Usagi/Utility/Rounding.hpp>
+
+#include "VulkanBufferAllocation.hpp"
+#include "VulkanGpuBuffer.hpp"
+#include "VulkanGpuDevice.hpp"
+
+usagi::VulkanTransientRing::VulkanTransientRing(
+    VulkanGpuDevice *device,
+    std::shared_ptr<VulkanBufferAllocation> allocation,
+    const std::size_t alignment,
+    const bool coherent)
+    : mDevice(device)
+    , mAllocation(std::move(allocation))
+    , mBuffer(std::make_shared<VulkanGpuBuffer>(mAllocation))
+    , mMappedMemory(static_cast<char*>(mAllocation->mappedAddress()))
+    , mCapacity(mAllocation->size())
+    , mAlignment(alignment)
+    , mCoherent(coherent)
+{
+    assert(mMappedMemory);
+    assert(utility::isPowerOfTwo(mAlignment));
+    assert(mCapacity % mAlignment == 0);
+}
+
+bool usagi::VulkanTransientRing::tryAllocate(
+    const std::size_t size,
+    GpuBufferSlice &slice)
+{
+    std::lock_guard<std::mutex> lock(mLock);
+
+    auto pos = utility::roundUpUnsigned(mHead, std::uint64_t { mAlignment });
+    auto offset = static_cast<std::size_t>(pos % mCapacity);
+    // skip the remaining space at the end of the buffer
+    if(offset + size > mCapacity)
+    {
+        pos += mCapacity - offset;
+        offset = 0;
+    }
+    if(pos + size - mTail > mCapacity)
+        return false;
+    mHead = pos + size;
+
+    slice.buffer = mBuffer;
+    slice.offset = offset;
+    slice.size = size;
+    slice.mapped = mMappedMemory + offset;
+    return true;
+}
+
+void usagi::VulkanTransientRing::addOverflow(
+    std::shared_ptr<VulkanBufferAllocation> allocation)
+{
+    std::lock_guard<std::mutex> lock(mLock);
+
+    if(!mCoherent)
+        mOverflow.push_back(std::move(allocation));
+}
+
+std::uint64_t usagi::VulkanTransientRing::flush()
+{
+    std::lock_guard<std::mutex> lock(mLock);
+
+    for(auto &&a : mOverflow)
+        a->flush();
+    mOverflow.clear();
+
+    if(!mCoherent && mHead > mFlushed)
+    {
+        // the range covers the skipped space at the end of the buffer if
+        // the allocations wrapped around, in which case the whole buffer
+        // is flushed. the range is aligned to the non-coherent atom size
+        // by the allocation.
+        const auto begin = static_cast<std::size_t>(mFlushed % mCapacity);
+        const auto size = static_cast<std::size_t>(mHead - mFlushed);
+        if(size >= mCapacity || begin + size > mCapacity)
+            mAllocation->flush();
+        else
+            mAllocation->flush(begin, size);
+    }
+    mFlushed = mHead;
+    return mHead;
+}
+
+void usagi::VulkanTransientRing::release(const std::uint64_t mark)
+{
+    std::lock_guard<std::mutex> lock(mLock);
+
+    assert(mark <= mHead);
+    if(mark > mTail) mTail = mark;
+}
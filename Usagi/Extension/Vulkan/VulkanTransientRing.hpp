@@ -0,0 +1,80 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <Usagi/Runtime/Graphics/GpuBufferSlice.hpp>
+#include <Usagi/Utility/Noncopyable.hpp>
+
+namespace usagi
+{
+class VulkanGpuDevice;
+class VulkanGpuBuffer;
+class VulkanBufferAllocation;
+
+/**
+ * \brief Linear sub-allocator over a persistently mapped buffer used as a
+ * ring. Allocations are made at the head and the tail advances when the
+ * jobs using the memory are finished.
+ *
+ * Positions are monotonically increasing byte counts, whose remainders
+ * divided by the capacity are the offsets in the buffer. An allocation
+ * never wraps around the end of the buffer.
+ */
+class VulkanTransientRing : Noncopyable
+{
+    VulkanGpuDevice *mDevice = nullptr;
+    std::shared_ptr<VulkanBufferAllocation> mAllocation;
+    std::shared_ptr<VulkanGpuBuffer> mBuffer;
+    char *mMappedMemory = nullptr;
+    const std::size_t mCapacity;
+    const std::size_t mAlignment;
+    // only non-coherent memory needs explicit flushes
+    const bool mCoherent;
+
+    std::mutex mLock;
+    std::uint64_t mHead = 0;
+    std::uint64_t mTail = 0;
+    std::uint64_t mFlushed = 0;
+    // allocations made outside of the ring when it is full, which are
+    // flushed along with it
+    std::vector<std::shared_ptr<VulkanBufferAllocation>> mOverflow;
+
+public:
+    /**
+     * \param alignment Must be a power of two dividing the capacity.
+     */
+    VulkanTransientRing(
+        VulkanGpuDevice *device,
+        std::shared_ptr<VulkanBufferAllocation> allocation,
+        std::size_t alignment,
+        bool coherent);
+
+    /**
+     * \return false if the ring does not have enough free space.
+     */
+    bool tryAllocate(std::size_t size, GpuBufferSlice &slice);
+
+    /**
+     * \brief Flush an allocation used in place of the ring memory by the
+     * next flush(). The allocation is not retained after that.
+     */
+    void addOverflow(std::shared_ptr<VulkanBufferAllocation> allocation);
+
+    /**
+     * \brief Flush the memory written since the last call in one range and
+     * return the current head, which is passed to release() when the jobs
+     * submitted with the memory are finished.
+     */
+    std::uint64_t flush();
+
+    /**
+     * \brief Recycle the memory allocated before the mark.
+     */
+    void release(std::uint64_t mark);
+
+    std::size_t capacity() const { return mCapacity; }
+};
+}
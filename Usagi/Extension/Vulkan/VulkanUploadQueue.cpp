@@ -0,0 +1,412 @@
+﻿#include "VulkanUploadQueue.hpp"
+
+#include <cassert>
+#include <limits>
+
+#include "VulkanBufferAllocation.hpp"
+#include "VulkanGpuImage.hpp"
+#include "VulkanSemaphore.hpp"
+
+namespace
+{
+// the uploaded resources may be read by any of these stages, on the
+// graphics queue or by the compute jobs executed on it
+const vk::PipelineStageFlags UPLOAD_DST_STAGES =
+    vk::PipelineStageFlagBits::eDrawIndirect |
+    vk::PipelineStageFlagBits::eVertexInput |
+    vk::PipelineStageFlagBits::eVertexShader |
+    vk::PipelineStageFlagBits::eFragmentShader |
+    vk::PipelineStageFlagBits::eComputeShader;
+
+const vk::AccessFlags BUFFER_DST_ACCESS =
+    vk::AccessFlagBits::eIndirectCommandRead |
+    vk::AccessFlagBits::eVertexAttributeRead |
+    vk::AccessFlagBits::eIndexRead |
+    vk::AccessFlagBits::eUniformRead |
+    vk::AccessFlagBits::eShaderRead;
+}
+
+void usagi::VulkanUploadQueue::Batch::release()
+{
+    // command buffers must be freed before their pools
+    transfer_commands.reset();
+    acquire_commands.reset();
+    acquire_buffer_barriers.clear();
+    acquire_image_barriers.clear();
+    transfer_finished.reset();
+    compute_ready.reset();
+    fence.reset();
+    resources.clear();
+    completed = true;
+}
+
+usagi::VulkanUploadQueue::VulkanUploadQueue(
+    const vk::Device device,
+    const std::uint32_t graphics_queue_family,
+    const vk::Queue graphics_queue,
+    const std::uint32_t transfer_queue_family,
+    const vk::Queue transfer_queue,
+    const bool concurrent_buffers,
+    const bool async_compute,
+    std::mutex *queue_lock)
+    : mDevice(device)
+    , mGraphicsQueueFamily(graphics_queue_family)
+    , mGraphicsQueue(graphics_queue)
+    , mTransferQueueFamily(transfer_queue_family)
+    , mTransferQueue(transfer_queue)
+    , mConcurrentBuffers(concurrent_buffers)
+    , mAsyncCompute(async_compute)
+    , mQueueLock(queue_lock)
+{
+    vk::CommandPoolCreateInfo info;
+    info.setFlags(vk::CommandPoolCreateFlagBits::eTransient);
+    info.setQueueFamilyIndex(mTransferQueueFamily);
+    mTransferCommandPool = mDevice.createCommandPoolUnique(info);
+    if(separateTransferQueue())
+    {
+        info.setQueueFamilyIndex(mGraphicsQueueFamily);
+        mGraphicsCommandPool = mDevice.createCommandPoolUnique(info);
+    }
+}
+
+usagi::VulkanUploadQueue::~VulkanUploadQueue()
+{
+    // the device is idle when the queue is destroyed. mark the batches
+    // completed so remaining handles do not refer to the queue.
+    if(mRecordingBatch) mRecordingBatch->release();
+    for(auto &&b : mSubmittedBatches)
+        b->release();
+}
+
+vk::UniqueCommandBuffer usagi::VulkanUploadQueue::beginCommandBuffer(
+    const vk::CommandPool pool) const
+{
+    vk::CommandBufferAllocateInfo alloc_info;
+    alloc_info.setCommandBufferCount(1);
+    alloc_info.setCommandPool(pool);
+    alloc_info.setLevel(vk::CommandBufferLevel::ePrimary);
+    auto cmd = std::move(
+        mDevice.allocateCommandBuffersUnique(alloc_info).front());
+
+    vk::CommandBufferBeginInfo begin_info;
+    begin_info.setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+    cmd->begin(begin_info);
+
+    return std::move(cmd);
+}
+
+usagi::VulkanUploadQueue::Batch & usagi::VulkanUploadQueue::recordingBatch()
+{
+    if(!mRecordingBatch)
+    {
+        auto batch = std::make_shared<Batch>();
+        batch->transfer_commands =
+            beginCommandBuffer(mTransferCommandPool.get());
+        mRecordingBatch = std::move(batch);
+    }
+    return *mRecordingBatch;
+}
+
+std::shared_ptr<usagi::GpuUploadHandle>
+usagi::VulkanUploadQueue::copyBufferToImage(
+    std::shared_ptr<VulkanBufferAllocation> buffer,
+    VulkanGpuImage *image)
+{
+    std::lock_guard<std::mutex> lock(mLock);
+
+    auto &batch = recordingBatch();
+    auto &cmd = batch.transfer_commands;
+
+    vk::ImageSubresourceRange range;
+    range.setAspectMask(vk::ImageAspectFlagBits::eColor);
+    range.setBaseArrayLayer(0);
+    range.setLayerCount(1);
+    range.setBaseMipLevel(0);
+    range.setLevelCount(1);
+    {
+        // the whole image is overwritten so the previous content is
+        // discarded.
+        vk::ImageMemoryBarrier barrier;
+        barrier.setImage(image->image());
+        barrier.setOldLayout(vk::ImageLayout::eUndefined);
+        barrier.setNewLayout(vk::ImageLayout::eTransferDstOptimal);
+        barrier.setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED);
+        barrier.setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED);
+        barrier.setDstAccessMask(vk::AccessFlagBits::eTransferWrite);
+        barrier.setSubresourceRange(range);
+        cmd->pipelineBarrier(
+            vk::PipelineStageFlagBits::eTopOfPipe,
+            vk::PipelineStageFlagBits::eTransfer,
+            { }, { }, { }, { barrier });
+    }
+    {
+        vk::BufferImageCopy copy;
+        const auto size = image->size();
+        copy.setImageExtent({ size.x(), size.y(), 1 });
+        copy.setBufferOffset(buffer->offset());
+        copy.imageSubresource.setAspectMask(vk::ImageAspectFlagBits::eColor);
+        copy.imageSubresource.setLayerCount(1);
+        copy.imageSubresource.setBaseArrayLayer(0);
+        copy.imageSubresource.setMipLevel(0);
+        cmd->copyBufferToImage(
+            buffer->buffer(), image->image(),
+            vk::ImageLayout::eTransferDstOptimal, { copy });
+    }
+    {
+        vk::ImageMemoryBarrier barrier;
+        barrier.setImage(image->image());
+        barrier.setOldLayout(vk::ImageLayout::eTransferDstOptimal);
+        barrier.setNewLayout(vk::ImageLayout::eShaderReadOnlyOptimal);
+        barrier.setSubresourceRange(range);
+        barrier.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite);
+        barrier.setDstAccessMask(vk::AccessFlagBits::eShaderRead);
+        barrier.setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED);
+        barrier.setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED);
+        if(!separateTransferQueue())
+        {
+            cmd->pipelineBarrier(
+                vk::PipelineStageFlagBits::eTransfer, UPLOAD_DST_STAGES,
+                { }, { }, { }, { barrier });
+        }
+        else if(image->concurrentSharing())
+        {
+            // the writes are made available by the semaphore signaled
+            // after the copies. the layout is transitioned on the graphics
+            // queue without transferring the ownership.
+            batch.acquire_image_barriers.push_back(barrier);
+        }
+        else
+        {
+            // release the ownership to the graphics queue family. the
+            // same barrier must be recorded on the graphics queue to
+            // acquire the ownership.
+            barrier.setSrcQueueFamilyIndex(mTransferQueueFamily);
+            barrier.setDstQueueFamilyIndex(mGraphicsQueueFamily);
+            barrier.setDstAccessMask({ });
+            cmd->pipelineBarrier(
+                vk::PipelineStageFlagBits::eTransfer,
+                vk::PipelineStageFlagBits::eBottomOfPipe,
+                { }, { }, { }, { barrier });
+            barrier.setSrcAccessMask({ });
+            barrier.setDstAccessMask(vk::AccessFlagBits::eShaderRead);
+            batch.acquire_image_barriers.push_back(barrier);
+        }
+    }
+
+    batch.staging_bytes += buffer->size();
+    batch.resources.push_back(std::move(buffer));
+    batch.resources.push_back(image->shared_from_this());
+
+    auto handle = std::make_shared<VulkanUploadHandle>(this, mRecordingBatch);
+    if(batch.staging_bytes >= FLUSH_THRESHOLD)
+        flushLocked();
+    return std::move(handle);
+}
+
+std::shared_ptr<usagi::GpuUploadHandle> usagi::VulkanUploadQueue::copyBuffer(
+    std::shared_ptr<VulkanBufferAllocation> src,
+    std::shared_ptr<VulkanBufferAllocation> dst)
+{
+    assert(src->size() <= dst->size());
+
+    std::lock_guard<std::mutex> lock(mLock);
+
+    auto &batch = recordingBatch();
+    auto &cmd = batch.transfer_commands;
+
+    {
+        vk::BufferCopy copy;
+        copy.setSrcOffset(src->offset());
+        copy.setDstOffset(dst->offset());
+        copy.setSize(src->size());
+        cmd->copyBuffer(src->buffer(), dst->buffer(), { copy });
+    }
+    {
+        vk::BufferMemoryBarrier barrier;
+        barrier.setBuffer(dst->buffer());
+        barrier.setOffset(dst->offset());
+        barrier.setSize(src->size());
+        barrier.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite);
+        barrier.setDstAccessMask(BUFFER_DST_ACCESS);
+        barrier.setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED);
+        barrier.setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED);
+        if(!separateTransferQueue())
+        {
+            cmd->pipelineBarrier(
+                vk::PipelineStageFlagBits::eTransfer, UPLOAD_DST_STAGES,
+                { }, { }, { barrier }, { });
+        }
+        else if(mConcurrentBuffers)
+        {
+            // the writes are made available by the semaphore signaled
+            // after the copies and made visible on the graphics queue.
+            // concurrent buffers have no owner to transfer.
+            batch.acquire_buffer_barriers.push_back(barrier);
+        }
+        else
+        {
+            // the destination range was not used by the transfer queue
+            // before so only the release and acquire are needed.
+            barrier.setSrcQueueFamilyIndex(mTransferQueueFamily);
+            barrier.setDstQueueFamilyIndex(mGraphicsQueueFamily);
+            barrier.setDstAccessMask({ });
+            cmd->pipelineBarrier(
+                vk::PipelineStageFlagBits::eTransfer,
+                vk::PipelineStageFlagBits::eBottomOfPipe,
+                { }, { }, { barrier }, { });
+            barrier.setSrcAccessMask({ });
+            barrier.setDstAccessMask(BUFFER_DST_ACCESS);
+            batch.acquire_buffer_barriers.push_back(barrier);
+        }
+    }
+
+    batch.staging_bytes += src->size();
+    batch.resources.push_back(std::move(src));
+    batch.resources.push_back(std::move(dst));
+
+    auto handle = std::make_shared<VulkanUploadHandle>(this, mRecordingBatch);
+    if(batch.staging_bytes >= FLUSH_THRESHOLD)
+        flushLocked();
+    return std::move(handle);
+}
+
+void usagi::VulkanUploadQueue::flush()
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    flushLocked();
+}
+
+void usagi::VulkanUploadQueue::flushLocked()
+{
+    if(!mRecordingBatch) return;
+
+    auto batch = std::move(mRecordingBatch);
+    batch->transfer_commands->end();
+    batch->fence = mDevice.createFenceUnique(vk::FenceCreateInfo { });
+
+    // signaled by the last submission of the batch on the graphics queue,
+    // after which the resources are ready for the compute queue
+    vk::Semaphore compute_sem;
+    if(mAsyncCompute)
+    {
+        batch->compute_ready = std::make_shared<VulkanSemaphore>(
+            mDevice.createSemaphoreUnique(vk::SemaphoreCreateInfo { }));
+        compute_sem = batch->compute_ready->semaphore();
+    }
+
+    const auto transfer_cmd = batch->transfer_commands.get();
+    vk::SubmitInfo transfer_info;
+    transfer_info.setCommandBufferCount(1);
+    transfer_info.setPCommandBuffers(&transfer_cmd);
+
+    if(separateTransferQueue())
+    {
+        batch->transfer_finished =
+            mDevice.createSemaphoreUnique(vk::SemaphoreCreateInfo { });
+        const auto sem = batch->transfer_finished.get();
+        transfer_info.setSignalSemaphoreCount(1);
+        transfer_info.setPSignalSemaphores(&sem);
+        {
+            std::lock_guard<std::mutex> queue_lock(*mQueueLock);
+            mTransferQueue.submit({ transfer_info }, { });
+        }
+
+        batch->acquire_commands =
+            beginCommandBuffer(mGraphicsCommandPool.get());
+        // the semaphore wait covers the transfer stage, which the barriers
+        // continue from
+        batch->acquire_commands->pipelineBarrier(
+            vk::PipelineStageFlagBits::eTransfer, UPLOAD_DST_STAGES,
+            { }, { },
+            batch->acquire_buffer_barriers,
+            batch->acquire_image_barriers);
+        batch->acquire_commands->end();
+
+        const auto acquire_cmd = batch->acquire_commands.get();
+        const vk::PipelineStageFlags wait_stage =
+            vk::PipelineStageFlagBits::eTransfer;
+        vk::SubmitInfo acquire_info;
+        acquire_info.setWaitSemaphoreCount(1);
+        acquire_info.setPWaitSemaphores(&sem);
+        acquire_info.setPWaitDstStageMask(&wait_stage);
+        acquire_info.setCommandBufferCount(1);
+        acquire_info.setPCommandBuffers(&acquire_cmd);
+        if(compute_sem)
+        {
+            acquire_info.setSignalSemaphoreCount(1);
+            acquire_info.setPSignalSemaphores(&compute_sem);
+        }
+        std::lock_guard<std::mutex> queue_lock(*mQueueLock);
+        mGraphicsQueue.submit({ acquire_info }, batch->fence.get());
+    }
+    else
+    {
+        if(compute_sem)
+        {
+            transfer_info.setSignalSemaphoreCount(1);
+            transfer_info.setPSignalSemaphores(&compute_sem);
+        }
+        std::lock_guard<std::mutex> queue_lock(*mQueueLock);
+        mTransferQueue.submit({ transfer_info }, batch->fence.get());
+    }
+
+    // the semaphores of earlier batches are signaled before this one, so
+    // they no longer need to be waited
+    if(batch->compute_ready)
+        mComputeWait = batch->compute_ready;
+    batch->submitted = true;
+    mSubmittedBatches.push_back(std::move(batch));
+}
+
+std::shared_ptr<usagi::VulkanSemaphore>
+    usagi::VulkanUploadQueue::takeComputeWait()
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    return std::move(mComputeWait);
+}
+
+void usagi::VulkanUploadQueue::reclaim()
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    reclaimLocked();
+}
+
+void usagi::VulkanUploadQueue::reclaimLocked()
+{
+    // batches complete in submission order
+    while(!mSubmittedBatches.empty() &&
+        isCompletedLocked(*mSubmittedBatches.front()))
+    {
+        mSubmittedBatches.pop_front();
+    }
+}
+
+bool usagi::VulkanUploadQueue::isCompleted(Batch &batch)
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    return isCompletedLocked(batch);
+}
+
+bool usagi::VulkanUploadQueue::isCompletedLocked(Batch &batch)
+{
+    if(batch.completed) return true;
+    if(!batch.submitted) return false;
+    if(mDevice.getFenceStatus(batch.fence.get()) != vk::Result::eSuccess)
+        return false;
+    batch.release();
+    return true;
+}
+
+void usagi::VulkanUploadQueue::wait(Batch &batch)
+{
+    // the lock is held during the wait so that the fence is not released
+    // by another thread
+    std::lock_guard<std::mutex> lock(mLock);
+    if(batch.completed) return;
+    if(!batch.submitted) flushLocked();
+    const auto result = mDevice.waitForFences({ batch.fence.get() }, true,
+        std::numeric_limits<std::uint64_t>::max());
+    assert(result == vk::Result::eSuccess);
+    batch.release();
+    reclaimLocked();
+}
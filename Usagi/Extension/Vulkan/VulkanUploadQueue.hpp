@@ -0,0 +1,185 @@
+﻿#pragma once
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+#include <Usagi/Runtime/Graphics/GpuUploadHandle.hpp>
+#include <Usagi/Utility/Noncopyable.hpp>
+
+namespace usagi
+{
+class VulkanBatchResource;
+class VulkanBufferAllocation;
+class VulkanGpuImage;
+class VulkanSemaphore;
+
+/**
+ * \brief Records resource uploads into batches and submits each batch with
+ * a single queue submission. If the device has a dedicated transfer queue
+ * family, the copies are executed on it and the ownership of the resources
+ * is transferred to the graphics queue family afterwards. Resources shared
+ * concurrently among the queue families have no owner, so they are only
+ * made visible to the graphics queue after the copies.
+ *
+ * If async compute is enabled, each batch also signals a semaphore on the
+ * graphics queue after the copies, which the next compute submission waits
+ * on. Only the last one has to be waited since the batches are finished
+ * on the graphics queue in submission order.
+ *
+ * The uploads may be recorded by the simulation thread while the render
+ * thread submits the frames, so all the functions are serialized by a
+ * lock, and the submissions also hold the queue lock of the device.
+ */
+class VulkanUploadQueue : Noncopyable
+{
+public:
+    struct Batch
+    {
+        vk::UniqueCommandBuffer transfer_commands;
+        // acquires the ownership of the resources on the graphics queue,
+        // or makes the writes to concurrent resources visible to it
+        vk::UniqueCommandBuffer acquire_commands;
+        std::vector<vk::BufferMemoryBarrier> acquire_buffer_barriers;
+        std::vector<vk::ImageMemoryBarrier> acquire_image_barriers;
+        vk::UniqueSemaphore transfer_finished;
+        // waited by the compute queue, which may keep it after the batch
+        // is released
+        std::shared_ptr<VulkanSemaphore> compute_ready;
+        vk::UniqueFence fence;
+        // staging buffers and destination images
+        std::vector<std::shared_ptr<VulkanBatchResource>> resources;
+        std::size_t staging_bytes = 0;
+        bool submitted = false;
+        // read by the upload handles without holding the lock
+        std::atomic<bool> completed { false };
+
+        void release();
+    };
+
+private:
+    vk::Device mDevice;
+    const std::uint32_t mGraphicsQueueFamily;
+    vk::Queue mGraphicsQueue;
+    const std::uint32_t mTransferQueueFamily;
+    vk::Queue mTransferQueue;
+    // the buffers are created with concurrent sharing mode
+    const bool mConcurrentBuffers;
+    // the compute queue is not the graphics queue
+    const bool mAsyncCompute;
+    // owned by the device and shared by all submissions to the queues
+    std::mutex *mQueueLock;
+
+    // guards the batches
+    std::mutex mLock;
+
+    vk::UniqueCommandPool mTransferCommandPool;
+    vk::UniqueCommandPool mGraphicsCommandPool;
+
+    std::shared_ptr<Batch> mRecordingBatch;
+    std::deque<std::shared_ptr<Batch>> mSubmittedBatches;
+    // signaled by the last batch and not waited by the compute queue yet
+    std::shared_ptr<VulkanSemaphore> mComputeWait;
+
+    // submit the current batch when its staging buffers exceed this size
+    static constexpr std::size_t FLUSH_THRESHOLD = 32 * 1024 * 1024;
+
+    bool separateTransferQueue() const
+    {
+        return mTransferQueueFamily != mGraphicsQueueFamily;
+    }
+
+    vk::UniqueCommandBuffer beginCommandBuffer(vk::CommandPool pool) const;
+    Batch & recordingBatch();
+
+    // the following functions require mLock to be held
+    void flushLocked();
+    void reclaimLocked();
+    bool isCompletedLocked(Batch &batch);
+
+public:
+    VulkanUploadQueue(
+        vk::Device device,
+        std::uint32_t graphics_queue_family,
+        vk::Queue graphics_queue,
+        std::uint32_t transfer_queue_family,
+        vk::Queue transfer_queue,
+        bool concurrent_buffers,
+        bool async_compute,
+        std::mutex *queue_lock);
+    ~VulkanUploadQueue();
+
+    /**
+     * \brief Record the copy of the whole image from the buffer. The image
+     * is transitioned to shader read-only optimal layout.
+     */
+    std::shared_ptr<GpuUploadHandle> copyBufferToImage(
+        std::shared_ptr<VulkanBufferAllocation> buffer,
+        VulkanGpuImage *image);
+
+    /**
+     * \brief Record the copy from the staging buffer to the device-local
+     * buffer, after which the data is available to vertex input and
+     * shaders.
+     */
+    std::shared_ptr<GpuUploadHandle> copyBuffer(
+        std::shared_ptr<VulkanBufferAllocation> src,
+        std::shared_ptr<VulkanBufferAllocation> dst);
+
+    /**
+     * \brief Submit the recorded uploads. Called before submitting graphics
+     * jobs so that they are ordered after the uploads on the graphics
+     * queue.
+     */
+    void flush();
+
+    /**
+     * \brief Take the semaphore signaled by the last submitted batch if the
+     * compute queue has not waited on it. The compute submission must wait
+     * on it and keep it alive until the submission is finished. Must not be
+     * called while holding the queue lock.
+     */
+    std::shared_ptr<VulkanSemaphore> takeComputeWait();
+
+    /**
+     * \brief Release the staging buffers of finished batches.
+     */
+    void reclaim();
+
+    bool isCompleted(Batch &batch);
+    /**
+     * \brief Blocks the other threads using the queue until the batch is
+     * finished.
+     */
+    void wait(Batch &batch);
+};
+
+class VulkanUploadHandle : public GpuUploadHandle
+{
+    VulkanUploadQueue *mQueue;
+    std::shared_ptr<VulkanUploadQueue::Batch> mBatch;
+
+public:
+    VulkanUploadHandle(
+        VulkanUploadQueue *queue,
+        std::shared_ptr<VulkanUploadQueue::Batch> batch)
+        : mQueue(queue)
+        , mBatch(std::move(batch))
+    {
+    }
+
+    bool ready() override
+    {
+        return mBatch->completed || mQueue->isCompleted(*mBatch);
+    }
+
+    void wait() override
+    {
+        if(!mBatch->completed) mQueue->wait(*mBatch);
+    }
+};
+}
@@ -26,7 +26,7 @@ std::shared_ptr<usagi::GpuSemaphore> usagi::VulkanSwapchain::acquireNextImage()
         LOG(warn, "Requesting another image from swapchain while "
             "already {} is used.", mImagesInUse);
 
-    auto sem = mDevice->createSemaphore();
+    auto sem = mDevice->frameSemaphore();
     const auto vk_sem = static_cast<VulkanSemaphore&>(*sem).semaphore();
 
     // todo sometimes hangs when debugging with RenderDoc
@@ -67,7 +67,7 @@ usagi::GpuImage * usagi::VulkanSwapchain::currentImage()
 void usagi::VulkanSwapchain::present(
     std::initializer_list<std::shared_ptr<GpuSemaphore>> wait_semaphores)
 {
-    const auto sems = vulkan::transformObjects(wait_semaphores,
+    const auto sems = vulkan::transformObjectsFrame(wait_semaphores,
         [&](auto &&s) {
             return dynamic_cast_ref<VulkanSemaphore>(s).semaphore();
         }
@@ -77,7 +77,7 @@ void usagi::VulkanSwapchain::present(
 }
 
 void usagi::VulkanSwapchain::present(
-    const std::vector<vk::Semaphore> &wait_semaphores)
+    const vk::ArrayProxy<const vk::Semaphore> wait_semaphores)
 {
     vk::PresentInfoKHR info;
 
@@ -96,7 +96,12 @@ void usagi::VulkanSwapchain::present(
 
     // If the swapchain is suboptimal or out-of-date, it will be recreated
     // during next call of acquireNextImage().
-    switch(mDevice->presentQueue().presentKHR(&info))
+    vk::Result result;
+    {
+        std::lock_guard<std::mutex> lock(mDevice->queueLock());
+        result = mDevice->presentQueue().presentKHR(&info);
+    }
+    switch(result)
     {
         case vk::Result::eSuccess: break;
         case vk::Result::eSuboptimalKHR:
@@ -219,8 +224,10 @@ void usagi::VulkanSwapchain::createSwapchain(
 
     // Ensure that no operation involving the swapchain images is outstanding.
     // Since acquireNextImage() and drawing operations aren't parallel,
-    // as long as the device is idle, it won't happen.
-    mDevice->device().waitIdle();
+    // as long as the frames in flight are finished, it won't happen.
+    mDevice->waitFramesInFlight();
+    // drop the framebuffers referring to the old images
+    mDevice->invalidateFramebuffers();
 
     LOG(info, "Creating swapchain");
 
@@ -55,7 +55,7 @@ public:
     void present(std::initializer_list<std::shared_ptr<GpuSemaphore>>
         wait_semaphores) override;
 
-    void present(const std::vector<vk::Semaphore> &wait_semaphores);
+    void present(vk::ArrayProxy<const vk::Semaphore> wait_semaphores);
 };
 }
 
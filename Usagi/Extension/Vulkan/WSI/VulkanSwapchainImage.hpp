@@ -19,7 +19,9 @@ public:
     vk::Image image() const override { return mImage; }
 
     // todo this should be a valid operation, but requires waiting on the image available semaphore
-    void upload(const void *data, std::size_t size) override
+    std::shared_ptr<GpuUploadHandle> upload(
+        const void *data,
+        std::size_t size) override
     {
         throw std::runtime_error("Operation not supported.");
     }
@@ -8,6 +8,7 @@
 #include <Usagi/Extension/Win32/Input/Win32InputManager.hpp>
 #include <Usagi/Extension/Win32/Win32Helper.hpp>
 #include <Usagi/Extension/Win32/Window/Win32WindowManager.hpp>
+#include <Usagi/Runtime/Memory/MemoryTracker.hpp>
 #include <Usagi/Utility/Unicode.hpp>
 
 std::shared_ptr<usagi::Runtime> usagi::Runtime::create()
@@ -70,9 +71,19 @@ void usagi::Win32Runtime::writeMiniDump(
     }
 }
 
+std::size_t usagi::Win32Runtime::captureCallstack(
+    void **frames,
+    const std::size_t max_frames)
+{
+    // skip this function and the tracker
+    return RtlCaptureStackBackTrace(2, static_cast<DWORD>(max_frames),
+        frames, nullptr);
+}
+
 usagi::Win32Runtime::Win32Runtime()
 {
     win32::patchConsole();
+    MemoryTracker::setCallstackCaptureFunc(&captureCallstack);
 }
 
 usagi::Win32Runtime::~Win32Runtime()
@@ -24,6 +24,8 @@ class Win32Runtime
     static LONG WINAPI exceptionHandler(PEXCEPTION_POINTERS p_exception_info);
     void writeMiniDump(PEXCEPTION_POINTERS p_exception_info) const;
 
+    static std::size_t captureCallstack(void **frames, std::size_t max_frames);
+
 public:
     Win32Runtime();
     virtual ~Win32Runtime();
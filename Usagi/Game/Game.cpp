@@ -1,6 +1,8 @@
 ﻿#include "Game.hpp"
 
 #include <Usagi/Asset/AssetRoot.hpp>
+#include <Usagi/Runtime/Memory/FrameArena.hpp>
+#include <Usagi/Runtime/Memory/MemoryTracker.hpp>
 #include <Usagi/Runtime/Runtime.hpp>
 #include <Usagi/Runtime/Window/WindowManager.hpp>
 #include <Usagi/Runtime/Input/InputManager.hpp>
@@ -57,5 +59,9 @@ void usagi::Game::mainLoop()
     while(continueGame())
     {
         frame();
+        // invalidate transient allocations made during the frame
+        FrameArena::nextFrame();
+        MemoryTracker::update();
+        endFrame();
     }
 }
@@ -32,6 +32,11 @@ protected:
     void updateClock();
     void performDeferredActions();
     virtual void frame();
+    /**
+     * \brief Invoked by the main loop after the frame memory of all threads
+     * is invalidated.
+     */
+    virtual void endFrame() { }
 
 public:
     explicit Game(std::shared_ptr<Runtime> runtime);
@@ -46,12 +46,14 @@ void usagi::GameState::setSubsystemEnabled(
 }
 
 usagi::Subsystem * usagi::GameState::addSubsystemPtr(
-    std::string name,
+    std::string subsystem_name,
     std::unique_ptr<Subsystem> subsystem)
 {
     SubsystemInfo info;
-    info.name = std::move(name);
+    info.name = std::move(subsystem_name);
     info.subsystem = std::move(subsystem);
+    info.memory_tag = MemoryTracker::registerTag(
+        name() + "/" + info.name, MemoryTagCategory::SUBSYSTEM);
 
     // check that no existing subsystem is using the same name
     if(findSubsystemByName(info.name) != mSubsystems.end())
@@ -60,6 +62,8 @@ usagi::Subsystem * usagi::GameState::addSubsystemPtr(
     }
     const auto ptr = info.subsystem.get();
     mSubsystems.push_back(std::move(info));
+    // allocations made while setting up the subsystem
+    MemoryTagScope scope { mSubsystems.back().memory_tag };
     subsystemFilter(ptr);
     return ptr;
 }
@@ -79,6 +83,9 @@ void usagi::GameState::update(const Clock &clock)
     for(auto &&s : mSubsystems)
     {
         if(s.enabled)
+        {
+            MemoryTagScope scope { s.memory_tag };
             s.subsystem->update(clock);
+        }
     }
 }
@@ -6,6 +6,7 @@
 
 #include <Usagi/Core/Clock.hpp>
 #include <Usagi/Core/Element.hpp>
+#include <Usagi/Runtime/Memory/MemoryTracker.hpp>
 #include <Usagi/Utility/TypeCast.hpp>
 
 #include "Subsystem.hpp"
@@ -17,6 +18,11 @@ struct SubsystemInfo
     std::string name;
     std::unique_ptr<Subsystem> subsystem;
     bool enabled = true;
+    /**
+     * \brief GPU resources allocated during the update of the subsystem
+     * are accounted to this tag.
+     */
+    std::shared_ptr<MemoryTag> memory_tag;
 };
 
 class GameState : public Element
@@ -40,7 +46,7 @@ protected:
         bool enabled);
 
     Subsystem * addSubsystemPtr(
-        std::string name,
+        std::string subsystem_name,
         std::unique_ptr<Subsystem> subsystem);
 
     virtual void subsystemFilter(Subsystem *subsystem) { }
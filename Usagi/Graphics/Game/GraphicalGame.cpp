@@ -2,6 +2,7 @@
 
 #include <algorithm>
 
+#include <Usagi/Core/Logging.hpp>
 #include <Usagi/Game/GameStateManager.hpp>
 #include <Usagi/Graphics/RenderTarget/RenderTargetDescriptor.hpp>
 #include <Usagi/Graphics/RenderTarget/Source/ImageRenderTargetSource.hpp>
@@ -48,36 +49,21 @@ void usagi::GraphicalGame::setupRenderTargets(const bool depth)
             mRuntime->gpu(), info));
     }
 
-    // clear images & perform transitions
+    // the first pass using the images clears them and the last one
+    // prepares the swapchain image for presentation. the depth contents
+    // are discarded after the last use.
+    mRenderGraph->declareResource(findSource("color").get(),
+        Color4f::Zero(), GpuImageLayout::PRESENT);
+    if(depth)
     {
-        RenderTargetDescriptor desc { this };
-        {
-            GpuAttachmentUsage u;
-            u.initial_layout = GpuImageLayout::UNDEFINED;
-            u.final_layout = GpuImageLayout::COLOR_ATTACHMENT;
-            u.op.load_op = GpuAttachmentLoadOp::CLEAR;
-            desc.sharedColorTarget("swapchain", u);
-        }
-        if(depth)
-        {
-            GpuAttachmentUsage u;
-            u.initial_layout = GpuImageLayout::UNDEFINED;
-            u.final_layout = GpuImageLayout::DEPTH_STENCIL_ATTACHMENT;
-            u.op.load_op = GpuAttachmentLoadOp::CLEAR;
-            u.op.clear_color = { 1, 0, 0, 0 };
-            desc.depthTarget(u);
-        }
-        mPreRender->createRenderTarget(desc);
+        mRenderGraph->declareResource(findSource("depth").get(),
+            { 1, 0, 0, 0 }, GpuImageLayout::UNDEFINED);
     }
+
     {
         RenderTargetDescriptor desc { this };
-        {
-            GpuAttachmentUsage u;
-            u.initial_layout = GpuImageLayout::COLOR_ATTACHMENT;
-            u.final_layout = GpuImageLayout::PRESENT;
-            desc.sharedColorTarget("swapchain", u);
-        }
-        mPostRender->createRenderTarget(desc);
+        desc.sharedColorTarget("swapchain");
+        mPresentTransition->createRenderTarget(desc);
     }
 }
 
@@ -91,12 +77,14 @@ usagi::GraphicalGame::GraphicalGame(std::shared_ptr<Runtime> runtime)
 {
     mRuntime->initGpu();
 
-    mPreRender = std::make_unique<ImageTransitionSubsystem>(mRuntime->gpu());
-    mPostRender = std::make_unique<ImageTransitionSubsystem>(mRuntime->gpu());
+    mRenderGraph = std::make_unique<RenderGraph>(mRuntime->gpu());
+    mPresentTransition =
+        std::make_unique<ImageTransitionSubsystem>(mRuntime->gpu());
 }
 
 usagi::GraphicalGame::~GraphicalGame()
 {
+    stopRenderThread();
     if(mMainWindow.window)
         mMainWindow.window->removeEventListener(this);
 }
@@ -108,49 +96,208 @@ void usagi::GraphicalGame::submitGraphicsJobs(
     jobs.clear();
 }
 
-void usagi::GraphicalGame::frame()
+usagi::GraphicalGame::FramePacket usagi::GraphicalGame::simulate()
 {
+    FramePacket packet;
+    packet.input_time = mTimingClock.now();
+
     processInput();
 
+    // update states & gather render passes
+    mRenderGraph->beginFrame();
+    mStateManager->update(mMasterClock);
+    mRenderGraph->addPass(mPresentTransition->renderTarget(),
+        [this, clock = mMasterClock]() {
+            return mPresentTransition->render(clock);
+        }, true);
+    packet.passes = mRenderGraph->endFrame();
+    packet.jobs = std::move(mPendingJobs);
+    mPendingJobs.clear();
+
+    packet.simulation_time = mTimingClock.now() - packet.input_time;
+    return packet;
+}
+
+void usagi::GraphicalGame::renderFrame(FramePacket &packet)
+{
+    const auto render_begin = mTimingClock.now();
+    const auto gpu_device = mRuntime->gpu();
+    // wait for the oldest frame in flight to release its resources
+    gpu_device->beginFrame();
+
     // switch swapchain image
     const auto wait_semaphores = { mMainWindow.swapchain->acquireNextImage() };
 
-    // update states & gather render jobs
-    mPendingJobs.push_back(mPreRender->render(mMasterClock));
-    mStateManager->update(mMasterClock);
-    mPendingJobs.push_back(mPostRender->render(mMasterClock));
+    // record the passes in parallel
+    auto &jobs = packet.jobs;
+    mRenderGraph->execute(packet.passes, jobs);
     // remove empty lists
-    mPendingJobs.erase(std::remove(
-        mPendingJobs.begin(), mPendingJobs.end(), nullptr), mPendingJobs.end());
+    jobs.erase(std::remove(jobs.begin(), jobs.end(), nullptr), jobs.end());
 
     // submit graphics jobs
     const auto wait_stages = {
         GraphicsPipelineStage::COLOR_ATTACHMENT_OUTPUT
     };
-    const auto gpu_device = mRuntime->gpu();
-    const auto rendering_finished_sem = gpu_device->createSemaphore();
+    const auto rendering_finished_sem = gpu_device->frameSemaphore();
     const auto signal_semaphores = {
         rendering_finished_sem
     };
     gpu_device->submitGraphicsJobs(
-        mPendingJobs,
+        jobs,
         wait_semaphores,
         wait_stages,
         signal_semaphores
     );
-    mPendingJobs.clear();
+    jobs.clear();
 
     // Present image
     mMainWindow.swapchain->present({ rendering_finished_sem });
+    updateStatistics(packet, render_begin, mTimingClock.now());
 
     // collect unused resources from previous frames
     gpu_device->reclaimResources();
+}
 
-    performDeferredActions();
+void usagi::GraphicalGame::frame()
+{
+    auto packet = simulate();
+
+    if(renderThreadEnabled())
+    {
+        // deferred actions may change what the render thread is using.
+        // the render thread is also idle when the frame memory is reset.
+        waitRenderThread();
+        performDeferredActions();
+        mPendingFrame = std::move(packet);
+    }
+    else
+    {
+        renderFrame(packet);
+        performDeferredActions();
+    }
 
     updateClock();
 }
 
+void usagi::GraphicalGame::endFrame()
+{
+    if(!mPendingFrame) return;
+    {
+        std::lock_guard<std::mutex> lock(mRenderLock);
+        mQueuedFrame = std::move(mPendingFrame);
+        mPendingFrame.reset();
+    }
+    mRenderCondition.notify_all();
+}
+
+void usagi::GraphicalGame::mainLoop()
+{
+    Game::mainLoop();
+    // the states used by the render thread are destroyed with the game
+    stopRenderThread();
+}
+
+void usagi::GraphicalGame::renderThreadMain()
+{
+    while(true)
+    {
+        FramePacket packet;
+        {
+            std::unique_lock<std::mutex> lock(mRenderLock);
+            mRenderCondition.wait(lock, [&]() {
+                return mQueuedFrame || mStopRenderThread;
+            });
+            // the queued frame is still drawn when stopping
+            if(!mQueuedFrame) return;
+            packet = std::move(*mQueuedFrame);
+            mQueuedFrame.reset();
+            mRendering = true;
+        }
+        std::exception_ptr error;
+        try
+        {
+            renderFrame(packet);
+        }
+        catch(...)
+        {
+            error = std::current_exception();
+        }
+        {
+            std::lock_guard<std::mutex> lock(mRenderLock);
+            if(error && !mRenderError) mRenderError = error;
+            mRendering = false;
+        }
+        mRenderCondition.notify_all();
+    }
+}
+
+void usagi::GraphicalGame::waitRenderThread()
+{
+    std::unique_lock<std::mutex> lock(mRenderLock);
+    mRenderCondition.wait(lock, [&]() {
+        return !mQueuedFrame && !mRendering;
+    });
+    if(mRenderError)
+    {
+        auto error = mRenderError;
+        mRenderError = nullptr;
+        std::rethrow_exception(error);
+    }
+}
+
+void usagi::GraphicalGame::stopRenderThread()
+{
+    if(!mRenderThread.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(mRenderLock);
+        mStopRenderThread = true;
+    }
+    mRenderCondition.notify_all();
+    mRenderThread.join();
+    mStopRenderThread = false;
+    // the error would be lost otherwise
+    if(mRenderError)
+    {
+        LOG(error, "The render thread stopped with an error.");
+        mRenderError = nullptr;
+    }
+}
+
+void usagi::GraphicalGame::setRenderThreadEnabled(const bool enabled)
+{
+    if(enabled == renderThreadEnabled()) return;
+    if(enabled)
+        mRenderThread = std::thread(&GraphicalGame::renderThreadMain, this);
+    else
+        stopRenderThread();
+}
+
+void usagi::GraphicalGame::updateStatistics(
+    const FramePacket &packet,
+    const TimePoint render_begin,
+    const TimePoint present_time)
+{
+    // exponential moving average
+    constexpr double WEIGHT = 0.05;
+    const auto smooth = [&](TimeDuration &average, const TimeDuration v) {
+        average += (v - average) * WEIGHT;
+    };
+
+    std::lock_guard<std::mutex> lock(mStatisticsLock);
+    smooth(mStatistics.simulation_time, packet.simulation_time);
+    smooth(mStatistics.render_time, present_time - render_begin);
+    smooth(mStatistics.input_latency, present_time - packet.input_time);
+    if(mLastPresentTime >= 0)
+        smooth(mStatistics.frame_interval, present_time - mLastPresentTime);
+    mLastPresentTime = present_time;
+}
+
+usagi::FrameStatistics usagi::GraphicalGame::frameStatistics() const
+{
+    std::lock_guard<std::mutex> lock(mStatisticsLock);
+    return mStatistics;
+}
+
 usagi::GpuDevice * usagi::GraphicalGame::gpu() const
 {
     return mRuntime->gpu();
@@ -159,5 +306,9 @@ usagi::GpuDevice * usagi::GraphicalGame::gpu() const
 void usagi::GraphicalGame::onWindowResizeEnd(const WindowSizeEvent &e)
 {
     if(e.size.x() != 0 && e.size.y() != 0)
+    {
+        // the attachments may still be used by the render thread
+        waitRenderThread();
         resize(e.size);
+    }
 }
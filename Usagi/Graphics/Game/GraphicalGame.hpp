@@ -1,6 +1,13 @@
 ﻿#pragma once
 
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <thread>
+
 #include <Usagi/Game/Game.hpp>
+#include <Usagi/Graphics/RenderGraph/RenderGraph.hpp>
 #include <Usagi/Graphics/RenderTarget/RenderTargetProvider.hpp>
 #include <Usagi/Graphics/RenderWindow.hpp>
 #include <Usagi/Runtime/Window/WindowEventListener.hpp>
@@ -10,6 +17,27 @@
 
 namespace usagi
 {
+/**
+ * \brief Timings of the recent frames, smoothed over about twenty frames.
+ * They are measured the same way with or without the render thread.
+ */
+struct FrameStatistics
+{
+    // processing input and updating the states
+    TimeDuration simulation_time = 0;
+    // recording, submitting and presenting
+    TimeDuration render_time = 0;
+    // between presenting consecutive frames
+    TimeDuration frame_interval = 0;
+    // from processing the input of a frame till presenting it
+    TimeDuration input_latency = 0;
+
+    double framesPerSecond() const
+    {
+        return frame_interval > 0 ? 1 / frame_interval : 0;
+    }
+};
+
 /**
  * \brief Provides the following functionalities:
  *
@@ -24,10 +52,59 @@ class GraphicalGame
 {
 protected:
     RenderWindow mMainWindow;
-    std::unique_ptr<ImageTransitionSubsystem> mPreRender;
-    std::unique_ptr<ImageTransitionSubsystem> mPostRender;
+    std::unique_ptr<RenderGraph> mRenderGraph;
+    /**
+     * \brief Clears the swapchain image and prepares it for presentation if
+     * no other pass renders to it.
+     */
+    std::unique_ptr<ImageTransitionSubsystem> mPresentTransition;
     std::vector<std::shared_ptr<GraphicsCommandList>> mPendingJobs;
 
+    /**
+     * \brief Everything the render thread needs for drawing a frame,
+     * produced by the simulation.
+     */
+    struct FramePacket
+    {
+        RenderGraph::Frame passes;
+        std::vector<std::shared_ptr<GraphicsCommandList>> jobs;
+        TimePoint input_time = 0;
+        TimeDuration simulation_time = 0;
+    };
+
+    FramePacket simulate();
+    void renderFrame(FramePacket &packet);
+
+    std::thread mRenderThread;
+    std::mutex mRenderLock;
+    std::condition_variable mRenderCondition;
+    // a queue of depth one. the simulation thread waits for the render
+    // thread to finish the last frame before queuing the next one.
+    std::optional<FramePacket> mQueuedFrame;
+    // produced by frame() and queued after the frame memory is reset
+    std::optional<FramePacket> mPendingFrame;
+    bool mRendering = false;
+    bool mStopRenderThread = false;
+    std::exception_ptr mRenderError;
+
+    void renderThreadMain();
+    /**
+     * \brief Block until the render thread has no frame to draw. Errors
+     * from the render thread are rethrown.
+     */
+    void waitRenderThread();
+    void stopRenderThread();
+
+    Clock mTimingClock;
+    mutable std::mutex mStatisticsLock;
+    FrameStatistics mStatistics;
+    TimePoint mLastPresentTime = -1;
+
+    void updateStatistics(
+        const FramePacket &packet,
+        TimePoint render_begin,
+        TimePoint present_time);
+
     void createMainWindow(
         const std::string &window_title,
         const Vector2i &window_position,
@@ -37,11 +114,32 @@ protected:
 
     bool continueGame() const override;
     void frame() override;
+    void endFrame() override;
 
 public:
     explicit GraphicalGame(std::shared_ptr<Runtime> runtime);
     ~GraphicalGame();
 
+    void mainLoop() override;
+
+    /**
+     * \brief Record, submit and present the frames on a render thread, one
+     * frame behind the simulation, so the frame time is bounded by the
+     * slower one of them instead of their sum. The render() of renderable
+     * subsystems must only read the data published for rendering in this
+     * mode. Disabled by default.
+     *
+     * The update() of the subsystems may still create GPU resources and
+     * upload data to them, because the upload queue and the queue
+     * submissions of the device are synchronized. Recording and submitting
+     * command lists, and beginning and presenting frames must only be done
+     * by the render thread.
+     * \param enabled
+     */
+    void setRenderThreadEnabled(bool enabled);
+    bool renderThreadEnabled() const { return mRenderThread.joinable(); }
+    FrameStatistics frameStatistics() const;
+
     /**
      * \brief The content of the vector will be removed.
      * \param jobs
@@ -49,6 +147,11 @@ public:
     void submitGraphicsJobs(
         std::vector<std::shared_ptr<GraphicsCommandList>> &jobs);
     GpuDevice * gpu() const override;
+    /**
+     * \brief The passes rendered in the current frame. Game states add the
+     * passes of their subsystems during update.
+     */
+    RenderGraph * renderGraph() const { return mRenderGraph.get(); }
     void onWindowResizeEnd(const WindowSizeEvent &e) override;
 
     RenderWindow * mainWindow() { return &mMainWindow; }
@@ -1,7 +1,5 @@
 ﻿#include "GraphicalGameState.hpp"
 
-#include <execution>
-
 #include <Usagi/Graphics/RenderTarget/RenderTargetDescriptor.hpp>
 
 #include "RenderableSubsystem.hpp"
@@ -16,7 +14,10 @@ void usagi::GraphicalGameState::subsystemFilter(Subsystem *subsystem)
         // in the later process.
         sys->createRenderTarget(desc);
         sys->createPipelines();
-        mRenderableSubsystems.push_back({ mRenderableSubsystems.size(), sys });
+        // the filter is called after the subsystem is registered
+        mRenderableSubsystems.push_back({
+            mRenderableSubsystems.size(), sys, mSubsystems.back().memory_tag
+        });
     }
 }
 
@@ -38,15 +39,16 @@ void usagi::GraphicalGameState::update(const Clock &clock)
 
     // set camera for each subsystem??
 
-    // record command lists in parallel
-    mCommandLists.resize(mRenderableSubsystems.size());
-    std::for_each(
-        std::execution::par,
-        mRenderableSubsystems.begin(),
-        mRenderableSubsystems.end(),
-        [&](const IndexedRenderable &i) {
-            mCommandLists[i.first] = i.second->render(mClock);
-        }
-    );
-    mGame->submitGraphicsJobs(mCommandLists);
+    // the command lists are recorded in parallel after all states are
+    // updated
+    const auto graph = mGame->renderGraph();
+    for(auto &&i : mRenderableSubsystems)
+    {
+        // the clock is copied since the pass may be recorded on the render
+        // thread while the next frame is being updated
+        graph->addPass(i.subsystem->renderTarget(), [i, clock = mClock]() {
+            MemoryTagScope scope { i.memory_tag };
+            return i.subsystem->render(clock);
+        });
+    }
 }
@@ -13,9 +13,13 @@ class GraphicalGameState : public GameState
 protected:
     GraphicalGame *mGame;
 
-    using IndexedRenderable = std::pair<std::size_t, RenderableSubsystem*>;
-    std::vector<IndexedRenderable> mRenderableSubsystems;
-    std::vector<std::shared_ptr<GraphicsCommandList>> mCommandLists;
+    struct RenderableInfo
+    {
+        std::size_t index;
+        RenderableSubsystem *subsystem;
+        std::shared_ptr<MemoryTag> memory_tag;
+    };
+    std::vector<RenderableInfo> mRenderableSubsystems;
 
     void subsystemFilter(Subsystem *subsystem) override;
 
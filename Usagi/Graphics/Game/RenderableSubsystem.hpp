@@ -22,6 +22,12 @@ protected:
 public:
     virtual void createRenderTarget(RenderTargetDescriptor &descriptor) = 0;
 
+    /**
+     * \brief The attachments drawn by render(). May be null if the subsystem
+     * does not render into any attachment.
+     */
+    RenderTarget * renderTarget() const { return mRenderTarget.get(); }
+
     /**
      * \brief Create pipelines. Apart from during initialization, may also be
      * invoked when rendering setting is changed.
@@ -36,6 +42,10 @@ public:
      * to the game states should happen in update().
      * Secondary command lists can be used if the subsystem internally records
      * the command list in parallel.
+     * When the game renders on a render thread, this method runs at the
+     * same time as the update() of the next frame, so it should only read
+     * the data published by update() for rendering, such as through a
+     * TripleBuffer.
      * \param clock
      */
     virtual std::shared_ptr<GraphicsCommandList> render(const Clock &clock) = 0;
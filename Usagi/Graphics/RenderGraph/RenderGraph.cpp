@@ -0,0 +1,276 @@
+﻿#include "RenderGraph.hpp"
+
+#include <algorithm>
+#include <execution>
+#include <optional>
+#include <set>
+
+#include <Usagi/Graphics/RenderTarget/RenderTarget.hpp>
+#include <Usagi/Runtime/Graphics/GpuDevice.hpp>
+#include <Usagi/Runtime/Graphics/RenderPassCreateInfo.hpp>
+
+usagi::RenderGraph::RenderGraph(GpuDevice *gpu)
+    : mGpu(gpu)
+{
+}
+
+void usagi::RenderGraph::declareResource(
+    const RenderTargetSource *source,
+    const Color4f &clear_color,
+    const GpuImageLayout final_layout)
+{
+    auto &r = mResources[source];
+    r.clear_color = clear_color;
+    r.final_layout = final_layout;
+    invalidate();
+}
+
+void usagi::RenderGraph::beginFrame()
+{
+    mPasses.clear();
+}
+
+void usagi::RenderGraph::addPass(
+    RenderTarget *target,
+    RecordFunc record,
+    const bool transition_only)
+{
+    Pass pass;
+    pass.target = target;
+    pass.record = std::move(record);
+    pass.transition_only = transition_only;
+    mPasses.push_back(std::move(pass));
+}
+
+bool usagi::RenderGraph::compiled(const std::vector<Pass> &passes) const
+{
+    return std::equal(
+        passes.begin(), passes.end(),
+        mCompiledPasses.begin(), mCompiledPasses.end(),
+        [](auto &&p, auto &&c) {
+            return p.target == c.target &&
+                p.transition_only == c.transition_only;
+        }
+    );
+}
+
+void usagi::RenderGraph::invalidate()
+{
+    mCompiledPasses.clear();
+}
+
+void usagi::RenderGraph::cullPasses(const std::vector<Pass> &passes)
+{
+    // walk backwards from the resources remaining at the end of the frame
+    // and cull the passes whose results are overwritten or never used.
+    // attachments not declared as resources are assumed to be used
+    // elsewhere.
+    std::set<const RenderTargetSource *> needed;
+    for(auto &&p : passes)
+    {
+        if(!p.target) continue;
+        for(auto &&s : p.target->sources())
+        {
+            const auto r = mResources.find(s.get());
+            if(r == mResources.end() ||
+                r->second.final_layout != GpuImageLayout::UNDEFINED)
+                needed.insert(s.get());
+        }
+    }
+    for(std::size_t i = passes.size(); i-- > 0;)
+    {
+        auto &p = passes[i];
+        auto &c = mCompiledPasses[i];
+        if(!p.target) continue;
+
+        auto &sources = p.target->sources();
+        auto &usages = p.target->usages();
+        c.culled = std::none_of(sources.begin(), sources.end(),
+            [&](auto &&s) { return needed.count(s.get()) != 0; });
+        if(c.culled) continue;
+
+        for(std::size_t j = 0; j < sources.size(); ++j)
+        {
+            if(usages[j].op.load_op == GpuAttachmentLoadOp::LOAD)
+                needed.insert(sources[j].get());
+            else
+                needed.erase(sources[j].get());
+        }
+    }
+
+    // transition-only passes are not needed if the other passes bring the
+    // attachments into the right layouts
+    std::set<const RenderTargetSource *> drawn;
+    for(std::size_t i = 0; i < passes.size(); ++i)
+    {
+        auto &p = passes[i];
+        if(!p.target || p.transition_only || mCompiledPasses[i].culled)
+            continue;
+        for(auto &&s : p.target->sources())
+            drawn.insert(s.get());
+    }
+    for(std::size_t i = 0; i < passes.size(); ++i)
+    {
+        auto &p = passes[i];
+        auto &c = mCompiledPasses[i];
+        if(!p.target || !p.transition_only || c.culled) continue;
+        auto &sources = p.target->sources();
+        c.culled = std::all_of(sources.begin(), sources.end(),
+            [&](auto &&s) { return drawn.count(s.get()) != 0; });
+    }
+}
+
+void usagi::RenderGraph::createRenderPasses(
+    const std::vector<Pass> &passes)
+{
+    struct Use
+    {
+        GpuImageLayout layout;
+        bool loads;
+    };
+
+    // find the next use of each attachment
+    std::vector<std::vector<std::optional<Use>>> next_uses(passes.size());
+    {
+        std::map<const RenderTargetSource *, Use> later;
+        for(std::size_t i = passes.size(); i-- > 0;)
+        {
+            auto &p = passes[i];
+            if(!p.target || mCompiledPasses[i].culled) continue;
+
+            auto &sources = p.target->sources();
+            auto &usages = p.target->usages();
+            auto &next = next_uses[i];
+            next.resize(sources.size());
+            for(std::size_t j = 0; j < sources.size(); ++j)
+            {
+                const auto l = later.find(sources[j].get());
+                if(l != later.end()) next[j] = l->second;
+                later[sources[j].get()] = {
+                    usages[j].layout,
+                    usages[j].op.load_op == GpuAttachmentLoadOp::LOAD
+                };
+            }
+        }
+    }
+
+    std::map<const RenderTargetSource *, GpuImageLayout> current_layouts;
+    for(std::size_t i = 0; i < passes.size(); ++i)
+    {
+        auto &p = passes[i];
+        if(!p.target || mCompiledPasses[i].culled) continue;
+
+        auto &sources = p.target->sources();
+        RenderPassCreateInfo info;
+        info.attachment_usages = p.target->usages();
+        for(std::size_t j = 0; j < sources.size(); ++j)
+        {
+            auto &u = info.attachment_usages[j];
+            const auto source = sources[j].get();
+            const auto r = mResources.find(source);
+            const auto declared = r != mResources.end();
+
+            const auto cur = current_layouts.find(source);
+            if(cur != current_layouts.end())
+            {
+                u.initial_layout = cur->second;
+            }
+            // the contents from the last frame are not used
+            else if(declared)
+            {
+                u.initial_layout = GpuImageLayout::UNDEFINED;
+                if(u.op.load_op == GpuAttachmentLoadOp::LOAD)
+                {
+                    u.op.load_op = GpuAttachmentLoadOp::CLEAR;
+                    u.op.clear_color = r->second.clear_color;
+                }
+            }
+            current_layouts[source] = u.layout;
+
+            if(const auto &next = next_uses[i][j])
+            {
+                u.final_layout = next->layout;
+                u.op.store_op = next->loads
+                    ? GpuAttachmentStoreOp::STORE
+                    : GpuAttachmentStoreOp::UNDEFINED;
+            }
+            else if(declared)
+            {
+                if(r->second.final_layout == GpuImageLayout::UNDEFINED)
+                {
+                    u.final_layout = u.layout;
+                    u.op.store_op = GpuAttachmentStoreOp::UNDEFINED;
+                }
+                else
+                {
+                    u.final_layout = r->second.final_layout;
+                    u.op.store_op = GpuAttachmentStoreOp::STORE;
+                }
+            }
+        }
+        // render passes are cached by the device
+        p.target->setRenderPass(mGpu->createRenderPass(info));
+    }
+}
+
+void usagi::RenderGraph::compile(const std::vector<Pass> &passes)
+{
+    mCompiledPasses.clear();
+    mCompiledPasses.reserve(passes.size());
+    for(auto &&p : passes)
+    {
+        CompiledPass c;
+        c.target = p.target;
+        c.transition_only = p.transition_only;
+        mCompiledPasses.push_back(c);
+    }
+
+    cullPasses(passes);
+    createRenderPasses(passes);
+}
+
+usagi::RenderGraph::Frame usagi::RenderGraph::endFrame()
+{
+    Frame frame;
+    frame.passes = std::move(mPasses);
+    mPasses.clear();
+    return frame;
+}
+
+void usagi::RenderGraph::execute(
+    std::vector<std::shared_ptr<GraphicsCommandList>> &jobs)
+{
+    execute(endFrame(), jobs);
+}
+
+void usagi::RenderGraph::execute(
+    const Frame &frame,
+    std::vector<std::shared_ptr<GraphicsCommandList>> &jobs)
+{
+    const auto &passes = frame.passes;
+    if(!compiled(passes))
+        compile(passes);
+
+    // (pass index, job index)
+    std::vector<std::pair<std::size_t, std::size_t>> records;
+    records.reserve(passes.size());
+    for(std::size_t i = 0; i < passes.size(); ++i)
+    {
+        if(!mCompiledPasses[i].culled)
+            records.emplace_back(i, jobs.size() + records.size());
+    }
+
+    const auto first_job = jobs.size();
+    jobs.resize(first_job + records.size());
+    std::for_each(
+        std::execution::par,
+        records.begin(),
+        records.end(),
+        [&](auto &&r) {
+            jobs[r.second] = passes[r.first].record();
+        }
+    );
+    // remove empty lists
+    jobs.erase(std::remove(
+        jobs.begin() + first_job, jobs.end(), nullptr), jobs.end());
+}
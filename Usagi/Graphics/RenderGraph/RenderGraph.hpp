@@ -0,0 +1,141 @@
+﻿#pragma once
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include <Usagi/Core/Math.hpp>
+#include <Usagi/Runtime/Graphics/Enum/GpuImageLayout.hpp>
+#include <Usagi/Utility/Noncopyable.hpp>
+
+namespace usagi
+{
+class GpuDevice;
+class GraphicsCommandList;
+class RenderPass;
+class RenderTarget;
+class RenderTargetSource;
+
+/**
+ * \brief Collects the passes rendered in a frame in submission order and
+ * adapts the render pass of each one to its neighbours before they are
+ * recorded in parallel.
+ *
+ * The layout transitions between passes are folded into the render passes
+ * and the attachments are synchronized with their previous users. The first
+ * use of a declared resource in the frame clears it and the last use either
+ * leaves it in the final layout or discards the contents. Passes whose
+ * results are not used by later passes or by the resources are culled.
+ *
+ * Each pass is recorded into its own command list with its own render pass.
+ * Passes are never merged into subpasses of a shared render pass, and the
+ * attachments are never aliased.
+ */
+class RenderGraph : Noncopyable
+{
+public:
+    using RecordFunc = std::function<std::shared_ptr<GraphicsCommandList>()>;
+
+private:
+    GpuDevice *mGpu = nullptr;
+
+    struct Resource
+    {
+        Color4f clear_color = Color4f::Zero();
+        GpuImageLayout final_layout = GpuImageLayout::UNDEFINED;
+    };
+    std::map<const RenderTargetSource *, Resource> mResources;
+
+    struct Pass
+    {
+        RenderTarget *target = nullptr;
+        RecordFunc record;
+        bool transition_only = false;
+    };
+    std::vector<Pass> mPasses;
+
+    struct CompiledPass
+    {
+        RenderTarget *target = nullptr;
+        bool transition_only = false;
+        bool culled = false;
+    };
+    // reused as long as the same passes are added in later frames
+    std::vector<CompiledPass> mCompiledPasses;
+
+    bool compiled(const std::vector<Pass> &passes) const;
+    void compile(const std::vector<Pass> &passes);
+    void cullPasses(const std::vector<Pass> &passes);
+    void createRenderPasses(const std::vector<Pass> &passes);
+
+public:
+    /**
+     * \brief The passes added in a frame. They can be executed on another
+     * thread while the passes of the next frame are being added.
+     */
+    class Frame
+    {
+        friend class RenderGraph;
+        std::vector<Pass> passes;
+    };
+
+    explicit RenderGraph(GpuDevice *gpu);
+
+    /**
+     * \brief Declare an attachment whose contents live within the frame.
+     * \param source
+     * \param clear_color Used by the first pass using the attachment.
+     * \param final_layout The layout at the end of the frame. If UNDEFINED,
+     * the attachment is transient and the contents are not stored after the
+     * last use.
+     */
+    void declareResource(
+        const RenderTargetSource *source,
+        const Color4f &clear_color,
+        GpuImageLayout final_layout);
+
+    void beginFrame();
+
+    /**
+     * \brief
+     * \param target The attachments used by the pass. If null, the pass
+     * is always recorded and not considered in the dependencies.
+     * \param record Invoked on a worker thread.
+     * \param transition_only The pass only brings its attachments into the
+     * right layouts, and is culled if other passes use all of them.
+     */
+    void addPass(
+        RenderTarget *target,
+        RecordFunc record,
+        bool transition_only = false);
+
+    /**
+     * \brief Take out the passes added since beginFrame().
+     */
+    Frame endFrame();
+
+    /**
+     * \brief Record the command lists of the passes in parallel and append
+     * them to the jobs in the order of the passes.
+     * \param jobs
+     */
+    void execute(std::vector<std::shared_ptr<GraphicsCommandList>> &jobs);
+
+    /**
+     * \brief Record the passes of a frame taken by endFrame(). Only one
+     * thread may execute frames at a time, but it can be a different one
+     * from the thread adding passes.
+     * \param frame
+     * \param jobs
+     */
+    void execute(
+        const Frame &frame,
+        std::vector<std::shared_ptr<GraphicsCommandList>> &jobs);
+
+    /**
+     * \brief Force the passes to be compiled again in the next frame.
+     */
+    void invalidate();
+};
+}
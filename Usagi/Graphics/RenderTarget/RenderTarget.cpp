@@ -8,10 +8,12 @@
 usagi::RenderTarget::RenderTarget(
     RenderTargetProvider *provider,
     std::shared_ptr<RenderPass> render_pass,
-    std::vector<std::shared_ptr<RenderTargetSource>> render_target_sources)
+    std::vector<std::shared_ptr<RenderTargetSource>> render_target_sources,
+    std::vector<GpuAttachmentUsage> usages)
     : mProvider(provider)
     , mRenderPass(std::move(render_pass))
     , mSources(std::move(render_target_sources))
+    , mUsages(std::move(usages))
 {
 }
 
@@ -23,5 +25,6 @@ std::shared_ptr<usagi::Framebuffer> usagi::RenderTarget::createFramebuffer()
     {
         mImageViews.push_back(s->view());
     }
-    return mProvider->gpu()->createFramebuffer(mProvider->size(), mImageViews);
+    return mProvider->gpu()->createFramebuffer(
+        mRenderPass, mProvider->size(), mImageViews);
 }
@@ -3,6 +3,8 @@
 #include <memory>
 #include <vector>
 
+#include <Usagi/Runtime/Graphics/RenderPassCreateInfo.hpp>
+
 namespace usagi
 {
 class Framebuffer;
@@ -16,15 +18,40 @@ class RenderTarget
     RenderTargetProvider *mProvider = nullptr;
     std::shared_ptr<RenderPass> mRenderPass;
     std::vector<std::shared_ptr<RenderTargetSource>> mSources;
+    std::vector<GpuAttachmentUsage> mUsages;
     std::vector<std::shared_ptr<GpuImageView>> mImageViews;
 
 public:
     RenderTarget(
         RenderTargetProvider *provider,
         std::shared_ptr<RenderPass> render_pass,
-        std::vector<std::shared_ptr<RenderTargetSource>> render_target_sources);
+        std::vector<std::shared_ptr<RenderTargetSource>> render_target_sources,
+        std::vector<GpuAttachmentUsage> usages);
 
     std::shared_ptr<RenderPass> renderPass() const { return mRenderPass; }
+    /**
+     * \brief Used by the render graph to adapt the layouts and operations
+     * of the attachments to the other passes in the frame. The new render
+     * pass must be compatible with the original one.
+     */
+    void setRenderPass(std::shared_ptr<RenderPass> render_pass)
+    {
+        mRenderPass = std::move(render_pass);
+    }
+
+    const std::vector<std::shared_ptr<RenderTargetSource>> & sources() const
+    {
+        return mSources;
+    }
+
+    /**
+     * \brief The attachment usages declared by the subsystem, with the
+     * formats and layouts filled in by the sources.
+     */
+    const std::vector<GpuAttachmentUsage> & usages() const
+    {
+        return mUsages;
+    }
     std::shared_ptr<Framebuffer> createFramebuffer();
 };
 }
@@ -24,7 +24,8 @@ std::unique_ptr<usagi::RenderTarget> usagi::RenderTargetDescriptor::finish()
     return std::make_unique<RenderTarget>(
         mProvider,
         std::move(render_pass),
-        std::move(mSources));
+        std::move(mSources),
+        std::move(render_pass_info.attachment_usages));
 }
 
 void usagi::RenderTargetDescriptor::sharedColorTarget(
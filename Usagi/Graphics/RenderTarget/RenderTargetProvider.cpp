@@ -1,5 +1,7 @@
 ﻿#include "RenderTargetProvider.hpp"
 
+#include <Usagi/Runtime/Graphics/GpuDevice.hpp>
+
 #include "RenderTargetSource.hpp"
 
 std::shared_ptr<usagi::RenderTargetSource>
@@ -14,6 +16,8 @@ usagi::RenderTargetProvider::findSource(const std::string &name) const
 
 void usagi::RenderTargetProvider::resize(const Vector2u32 &size)
 {
+    // the framebuffers hold references to the old attachments
+    gpu()->invalidateFramebuffers();
     for(auto &&s : mSources)
     {
         s.second->resize(size);
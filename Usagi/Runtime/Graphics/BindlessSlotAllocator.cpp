@@ -0,0 +1,42 @@
+﻿#include "BindlessSlotAllocator.hpp"
+
+#include <stdexcept>
+
+usagi::BindlessSlotAllocator::BindlessSlotAllocator(
+    const std::uint32_t capacity)
+    : mCapacity(capacity)
+{
+}
+
+std::uint32_t usagi::BindlessSlotAllocator::allocate()
+{
+    if(!mFreeSlots.empty())
+    {
+        const auto index = mFreeSlots.back();
+        mFreeSlots.pop_back();
+        return index;
+    }
+    if(mNextSlot < mCapacity)
+        return mNextSlot++;
+    throw std::runtime_error("Bindless texture table is full.");
+}
+
+void usagi::BindlessSlotAllocator::release(const std::uint32_t index)
+{
+    if(index >= mNextSlot)
+        throw std::logic_error("The bindless slot was never allocated.");
+    mReleasedSlots.push_back(index);
+}
+
+std::vector<std::uint32_t> usagi::BindlessSlotAllocator::takeReleasedSlots()
+{
+    std::vector<std::uint32_t> slots;
+    slots.swap(mReleasedSlots);
+    return slots;
+}
+
+void usagi::BindlessSlotAllocator::freeSlots(
+    const std::vector<std::uint32_t> &slots)
+{
+    mFreeSlots.insert(mFreeSlots.end(), slots.begin(), slots.end());
+}
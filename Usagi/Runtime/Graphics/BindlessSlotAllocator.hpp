@@ -0,0 +1,47 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace usagi
+{
+/**
+ * \brief Bookkeeping of the slots in a bindless texture array. A released
+ * slot may still be indexed by pending jobs, so it goes through two stages
+ * before being reused: the device takes the slots released during a frame
+ * when the frame ends, and frees them when that frame is retired.
+ *
+ * Not thread-safe. The owner serializes the access.
+ */
+class BindlessSlotAllocator
+{
+    std::uint32_t mCapacity;
+    std::vector<std::uint32_t> mFreeSlots;
+    std::uint32_t mNextSlot = 0;
+    // slots released during the current frame
+    std::vector<std::uint32_t> mReleasedSlots;
+
+public:
+    explicit BindlessSlotAllocator(std::uint32_t capacity);
+
+    /**
+     * \brief Take a freed slot, or one never used before.
+     * \return The index of the slot.
+     * \throw std::runtime_error if all the slots are taken.
+     */
+    std::uint32_t allocate();
+
+    /**
+     * \brief The slot is not reused until it is passed to freeSlots().
+     */
+    void release(std::uint32_t index);
+
+    /**
+     * \brief Take the slots released since the last call.
+     */
+    std::vector<std::uint32_t> takeReleasedSlots();
+    void freeSlots(const std::vector<std::uint32_t> &slots);
+
+    std::uint32_t capacity() const { return mCapacity; }
+};
+}
@@ -0,0 +1,22 @@
+﻿#pragma once
+
+#include <Usagi/Utility/Noncopyable.hpp>
+
+#include "Shader/ShaderConstantHandle.hpp"
+
+namespace usagi
+{
+class ComputePipeline : Noncopyable
+{
+public:
+    virtual ~ComputePipeline() = default;
+
+    /**
+     * \brief Resolve a field of the constant buffer declared in the compute
+     * shader. See GraphicsPipeline::constantHandle().
+     * \param name
+     * \return
+     */
+    virtual ShaderConstantHandle constantHandle(const char *name) const = 0;
+};
+}
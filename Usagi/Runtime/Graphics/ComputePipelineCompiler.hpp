@@ -0,0 +1,66 @@
+﻿#pragma once
+
+#include <memory>
+#include <type_traits>
+
+#include <Usagi/Utility/Noncopyable.hpp>
+
+namespace usagi
+{
+class SpirvBinary;
+class ComputePipeline;
+
+/**
+ * \brief Compiles a compute pipeline from a compute shader. Like graphics
+ * pipelines, the resource bindings and the constant buffer layout are
+ * generated by reflecting the shader. Storage buffers and storage images
+ * are bound using GraphicsCommandList::bindResourceSet() after binding
+ * the pipeline.
+ */
+class ComputePipelineCompiler : Noncopyable
+{
+public:
+    virtual ~ComputePipelineCompiler() = default;
+
+    virtual void setShader(std::shared_ptr<SpirvBinary> shader) = 0;
+
+    /**
+     * \brief See GraphicsPipelineCompiler::setSpecializationConstant().
+     * Commonly used for choosing the workgroup size declared with
+     * layout(local_size_x_id = N).
+     * \param constant_id
+     * \param data
+     * \param size Must be 4 or 8.
+     */
+    virtual void setSpecializationConstant(
+        std::uint32_t constant_id,
+        const void *data,
+        std::size_t size) = 0;
+
+    template <typename T>
+    void setSpecializationConstant(
+        const std::uint32_t constant_id,
+        const T value)
+    {
+        static_assert(std::is_arithmetic_v<T>);
+        // GLSL bool constants are 32-bit
+        if constexpr(std::is_same_v<T, bool>)
+        {
+            const std::uint32_t b = value ? 1 : 0;
+            setSpecializationConstant(constant_id, &b, sizeof(b));
+        }
+        else
+        {
+            static_assert(sizeof(T) == 4 || sizeof(T) == 8);
+            setSpecializationConstant(constant_id, &value, sizeof(T));
+        }
+    }
+
+    /**
+     * \brief Create the pipeline. Pipelines created from identical shaders
+     * and constants are shared.
+     * \return
+     */
+    virtual std::shared_ptr<ComputePipeline> compile() = 0;
+};
+}
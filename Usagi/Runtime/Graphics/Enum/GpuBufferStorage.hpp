@@ -0,0 +1,13 @@
+﻿#pragma once
+
+namespace usagi
+{
+enum class GpuBufferStorage
+{
+    // host-visible memory for data written by the host every frame
+    DYNAMIC,
+    // device-local memory for immutable or rarely updated data, which is
+    // written through staging buffers
+    STATIC,
+};
+}
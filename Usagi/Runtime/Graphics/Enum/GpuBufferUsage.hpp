@@ -7,5 +7,7 @@ enum class GpuBufferUsage
     VERTEX,
     INDEX,
     UNIFORM,
+    STORAGE,
+    INDIRECT,
 };
 }
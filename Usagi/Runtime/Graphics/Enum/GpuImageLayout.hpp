@@ -12,6 +12,8 @@ enum class GpuImageLayout
     DEPTH_STENCIL_ATTACHMENT,
     SHADER_READ_ONLY,
     PREINITIALIZED,
+    // required by storage images
+    GENERAL,
     AUTO,
 };
 }
@@ -8,5 +8,6 @@ enum class GpuImageUsage
     COLOR_ATTACHMENT,
     DEPTH_STENCIL_ATTACHMENT,
     INPUT_ATTACHMENT,
+    STORAGE,
 };
 }
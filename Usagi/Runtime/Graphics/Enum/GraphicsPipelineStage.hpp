@@ -5,6 +5,7 @@ namespace usagi
 enum class GraphicsPipelineStage
 {
     TOP_OF_PIPE,
+    DRAW_INDIRECT,
     VERTEX_INPUT,
     VERTEX_SHADER,
     GEOMETRY_SHADER,
@@ -12,6 +13,7 @@ enum class GraphicsPipelineStage
     EARLY_FRAGMENT_TESTS,
     LATE_FRAGMENT_TESTS,
     COLOR_ATTACHMENT_OUTPUT,
+    COMPUTE_SHADER,
     TRANSFER,
     BOTTOM_OF_PIPE,
     HOST,
@@ -0,0 +1,16 @@
+﻿#pragma once
+
+namespace usagi
+{
+/**
+ * \brief How the commands of a render pass are provided.
+ */
+enum class RenderingContents
+{
+    // recorded directly into the command list beginning the render pass
+    INLINE,
+    // recorded into secondary command lists and executed by the command
+    // list beginning the render pass
+    SECONDARY_COMMAND_LISTS,
+};
+}
@@ -1,6 +1,7 @@
 ﻿#pragma once
 
 #include <cstddef>
+#include <memory>
 
 #include "ShaderResource.hpp"
 
@@ -25,6 +26,11 @@ public:
      */
     virtual void release() = 0;
 
+    /**
+     * \brief For static buffers, this is the memory of a staging buffer
+     * which is only valid until flush(). Reallocate the buffer before
+     * writing new data if it may still be used by the GPU.
+     */
     virtual void * mappedMemory() = 0;
     virtual std::size_t size() const = 0;
 
@@ -35,5 +41,19 @@ public:
     }
 
     virtual void flush() = 0;
+
+    /**
+     * \brief Bind a range of the current allocation as a uniform or storage
+     * buffer, such as a slice of the transient memory or the instances of
+     * one batch in a large buffer. The range keeps the allocation alive,
+     * so reallocating the buffer afterwards does not affect it.
+     * \param offset Must be aligned to the offset alignment of the
+     * descriptor type. Slices returned by GpuDevice::allocateTransient()
+     * always are.
+     * \param size
+     */
+    virtual std::shared_ptr<ShaderResource> createRange(
+        std::size_t offset,
+        std::size_t size) = 0;
 };
 }
@@ -0,0 +1,27 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <memory>
+
+namespace usagi
+{
+class GpuBuffer;
+
+/**
+ * \brief A range of a mapped buffer. Bind it by passing the buffer and the
+ * offset to the command list.
+ */
+struct GpuBufferSlice
+{
+    std::shared_ptr<GpuBuffer> buffer;
+    std::size_t offset = 0;
+    std::size_t size = 0;
+    void *mapped = nullptr;
+
+    template <typename CastType>
+    CastType * mappedMemory() const
+    {
+        return reinterpret_cast<CastType *>(mapped);
+    }
+};
+}
@@ -8,6 +8,12 @@ namespace usagi
 {
 class GraphicsCommandList;
 
+/**
+ * \brief Command lists are allocated from the storage of the calling
+ * thread in the current frame, so any thread may allocate and record
+ * command lists concurrently. A command list must be recorded by the thread
+ * allocating it and submitted in the same frame.
+ */
 class GpuCommandPool : Noncopyable
 {
 public:
@@ -15,5 +21,18 @@ public:
 
     virtual std::shared_ptr<GraphicsCommandList> allocateGraphicsCommandList()
         = 0;
+    /**
+     * \brief Allocate a command list recording a part of a render pass,
+     * which is executed by the primary command list beginning the render
+     * pass with RenderingContents::SECONDARY_COMMAND_LISTS.
+     */
+    virtual std::shared_ptr<GraphicsCommandList>
+        allocateSecondaryGraphicsCommandList() = 0;
+    /**
+     * \brief Allocate a command list for GpuDevice::submitComputeJobs().
+     * Only setup and compute commands may be recorded.
+     */
+    virtual std::shared_ptr<GraphicsCommandList>
+        allocateComputeCommandList() = 0;
 };
 }
@@ -6,7 +6,9 @@
 #include <Usagi/Utility/Noncopyable.hpp>
 #include <Usagi/Core/Math.hpp>
 
+#include "Enum/GpuBufferStorage.hpp"
 #include "Enum/GpuBufferUsage.hpp"
+#include "GpuBufferSlice.hpp"
 
 namespace usagi
 {
@@ -23,6 +25,7 @@ class Window;
 class GpuCommandPool;
 class GraphicsCommandList;
 class GraphicsPipelineCompiler;
+class ComputePipelineCompiler;
 class GpuSemaphore;
 class RenderPass;
 enum class GraphicsPipelineStage;
@@ -36,21 +39,64 @@ public:
     virtual std::shared_ptr<GpuCommandPool> createCommandPool() = 0;
     virtual std::unique_ptr<GraphicsPipelineCompiler>
         createPipelineCompiler() = 0;
+    virtual std::unique_ptr<ComputePipelineCompiler>
+        createComputePipelineCompiler() = 0;
+    /**
+     * \brief Render passes created from identical descriptions are shared.
+     */
     virtual std::shared_ptr<RenderPass> createRenderPass(
         const RenderPassCreateInfo &info) = 0;
+    /**
+     * \brief Get a framebuffer for rendering to the views using the render
+     * pass. The framebuffers are cached and reused in later frames.
+     */
     virtual std::shared_ptr<Framebuffer> createFramebuffer(
+        std::shared_ptr<RenderPass> render_pass,
         const Vector2u32 &size,
-        std::vector<std::shared_ptr<GpuImageView>> views) = 0;
+        const std::vector<std::shared_ptr<GpuImageView>> &views) = 0;
+    /**
+     * \brief Release the cached framebuffers. Call it before the attachments
+     * are recreated, such as on resizing.
+     */
+    virtual void invalidateFramebuffers() = 0;
     virtual std::shared_ptr<GpuSemaphore> createSemaphore() = 0;
+    /**
+     * \brief Get a semaphore from the pool of the current frame, which is
+     * reused after the frame is retired. Use it for synchronizations which
+     * happen within a frame, such as presentation.
+     */
+    virtual std::shared_ptr<GpuSemaphore> frameSemaphore() = 0;
     virtual std::shared_ptr<GpuImage> createImage(
         const GpuImageCreateInfo &info) = 0;
     virtual std::shared_ptr<GpuImage> fallbackTexture() const = 0;
+    /**
+     * \brief Whether sampled image views are placed in a bindless texture
+     * array. If enabled, shaders may declare an unsized texture2D array
+     * and index it with GpuImageView::bindlessIndex() instead of binding
+     * the views in resource sets.
+     */
+    virtual bool bindlessTexturesEnabled() const = 0;
 
     /**
      * \brief Memory is not allocated until GpuBuffer::allocate() is called.
+     * Static buffers are read by the GPU from its own memory. The data
+     * written to their mapped memory is copied to the GPU when
+     * GpuBuffer::flush() is called.
      * \return
      */
-    virtual std::shared_ptr<GpuBuffer> createBuffer(GpuBufferUsage usage) = 0;
+    virtual std::shared_ptr<GpuBuffer> createBuffer(
+        GpuBufferUsage usage,
+        GpuBufferStorage storage) = 0;
+
+    /**
+     * \brief Allocate mapped memory for vertex, index or uniform data used
+     * by the graphics jobs submitted next. The memory is written by the
+     * host and recycled when these jobs are finished, so it must be filled
+     * before the submission and must not be accessed afterwards. The
+     * offset of the slice satisfies the alignment requirements of all
+     * usages.
+     */
+    virtual GpuBufferSlice allocateTransient(std::size_t size) = 0;
     virtual std::shared_ptr<GpuSampler> createSampler(
         const GpuSamplerCreateInfo &info) = 0;
 
@@ -62,7 +108,51 @@ public:
     ) = 0;
 
     /**
-     * \brief Release resources used by previous jobs.
+     * \brief Submit command lists allocated by
+     * GpuCommandPool::allocateComputeCommandList(). If async compute is
+     * enabled, they run on a separate queue concurrently with the graphics
+     * jobs and must be synchronized with them using semaphores. Otherwise
+     * they are executed on the graphics queue in submission order. The
+     * resources of the jobs are released along with the current frame.
+     */
+    virtual void submitComputeJobs(
+        const std::vector<std::shared_ptr<GraphicsCommandList>> &jobs,
+        std::initializer_list<std::shared_ptr<GpuSemaphore>> wait_semaphores,
+        std::initializer_list<GraphicsPipelineStage> wait_stages,
+        std::initializer_list<std::shared_ptr<GpuSemaphore>> signal_semaphores
+    ) = 0;
+    /**
+     * \brief Whether the device exposes a queue dedicated to compute work.
+     */
+    virtual bool asyncComputeEnabled() const = 0;
+    /**
+     * \brief Whether GraphicsCommandList::drawIndirectCount() and
+     * drawIndexedIndirectCount() are supported.
+     */
+    virtual bool indirectCountEnabled() const = 0;
+
+    // Frames in Flight
+
+    /**
+     * \brief Start recording a new frame. Blocks until the GPU finished
+     * the frame submitted framesInFlight() frames ago, whose resources are
+     * then released. This limits how far the CPU can run ahead of the GPU.
+     */
+    virtual void beginFrame() = 0;
+
+    /**
+     * \brief Wait for all submitted graphics jobs to finish, such as before
+     * recreating the swapchain. The resources of the previous frames are
+     * released.
+     */
+    virtual void waitFramesInFlight() = 0;
+
+    virtual std::size_t framesInFlight() const = 0;
+    virtual void setFramesInFlight(std::size_t num_frames) = 0;
+
+    /**
+     * \brief Release resources used by previous jobs which are finished
+     * without blocking.
      */
     virtual void reclaimResources() = 0;
     virtual void waitIdle() = 0;
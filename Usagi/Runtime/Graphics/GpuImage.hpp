@@ -11,6 +11,7 @@ namespace usagi
 {
 struct GpuImageViewCreateInfo;
 class GpuImageView;
+class GpuUploadHandle;
 
 class GpuImage : Noncopyable
 {
@@ -34,10 +35,15 @@ public:
         const GpuImageViewCreateInfo &info) = 0;
 
     /**
-     * \brief Upload image data to GPU memory.
+     * \brief Upload image data to GPU memory. The data is copied into a
+     * staging buffer before returning, and the transfer to the image is
+     * performed asynchronously.
      * \param data
      * \param size
+     * \return A handle for querying the completion of the transfer.
      */
-    virtual void upload(const void *data, std::size_t size) = 0;
+    virtual std::shared_ptr<GpuUploadHandle> upload(
+        const void *data,
+        std::size_t size) = 0;
 };
 }
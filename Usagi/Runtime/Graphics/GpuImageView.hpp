@@ -1,5 +1,6 @@
 ﻿#pragma once
 
+#include <cstdint>
 #include <memory>
 
 #include "ShaderResource.hpp"
@@ -12,6 +13,17 @@ class GpuImageView
     , public std::enable_shared_from_this<GpuImageView>
 {
 public:
+    static constexpr std::uint32_t NO_BINDLESS_INDEX = ~0u;
+
     virtual ~GpuImageView() = default;
+
+    /**
+     * \brief The index of the view in the bindless texture array, or
+     * NO_BINDLESS_INDEX if it is not sampled or bindless textures are not
+     * enabled. Since using the index does not reference the view in
+     * command lists, the view must be kept alive until the jobs using it
+     * are finished.
+     */
+    virtual std::uint32_t bindlessIndex() const = 0;
 };
 }
@@ -0,0 +1,114 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <stdexcept>
+
+#include <Usagi/Utility/Noncopyable.hpp>
+
+#include "GpuBufferSlice.hpp"
+#include "GpuDevice.hpp"
+
+namespace usagi
+{
+/**
+ * \brief The arguments of one draw read by
+ * GraphicsCommandList::drawIndirect(). The layout is consumed by the GPU
+ * and must not be changed.
+ */
+struct GpuDrawIndirectCommand
+{
+    std::uint32_t vertex_count = 0;
+    std::uint32_t instance_count = 0;
+    std::uint32_t first_vertex = 0;
+    std::uint32_t first_instance = 0;
+};
+static_assert(sizeof(GpuDrawIndirectCommand) == 16);
+
+/**
+ * \brief The arguments of one draw read by
+ * GraphicsCommandList::drawIndexedIndirect().
+ */
+struct GpuDrawIndexedIndirectCommand
+{
+    std::uint32_t index_count = 0;
+    std::uint32_t instance_count = 0;
+    std::uint32_t first_index = 0;
+    std::int32_t vertex_offset = 0;
+    std::uint32_t first_instance = 0;
+};
+static_assert(sizeof(GpuDrawIndexedIndirectCommand) == 20);
+
+/**
+ * \brief The workgroup counts read by
+ * GraphicsCommandList::dispatchIndirect().
+ */
+struct GpuDispatchIndirectCommand
+{
+    std::uint32_t group_count_x = 0;
+    std::uint32_t group_count_y = 0;
+    std::uint32_t group_count_z = 0;
+};
+static_assert(sizeof(GpuDispatchIndirectCommand) == 12);
+
+/**
+ * \brief Builds an array of indirect commands in the transient memory of
+ * the device. The commands are written directly into the mapped memory, so
+ * the same lifetime rules as GpuDevice::allocateTransient() apply: the
+ * array must be filled before the command lists using it are submitted
+ * and is invalid afterwards.
+ *
+ * e.g.
+ *  GpuIndirectCommandArray<GpuDrawIndexedIndirectCommand> draws(gpu, n);
+ *  for(...) draws.push({ count, 1, first, 0, i });
+ *  cmd_list->drawIndexedIndirect(draws.buffer(), draws.offset(),
+ *      draws.size());
+ */
+template <typename Command>
+class GpuIndirectCommandArray : Noncopyable
+{
+    GpuBufferSlice mSlice;
+    std::uint32_t mCapacity = 0;
+    std::uint32_t mSize = 0;
+
+public:
+    GpuIndirectCommandArray(GpuDevice *gpu, const std::uint32_t capacity)
+        : mSlice(gpu->allocateTransient(sizeof(Command) * capacity))
+        , mCapacity(capacity)
+    {
+    }
+
+    void push(const Command &command)
+    {
+        if(mSize == mCapacity)
+            throw std::out_of_range("Indirect command array is full.");
+        mSlice.mappedMemory<Command>()[mSize++] = command;
+    }
+
+    /**
+     * \brief Reserve the space of a command and return it for filling.
+     */
+    Command & emplace()
+    {
+        push(Command { });
+        return mSlice.mappedMemory<Command>()[mSize - 1];
+    }
+
+    const std::shared_ptr<GpuBuffer> & buffer() const
+    {
+        return mSlice.buffer;
+    }
+
+    /**
+     * \brief Offset of the first command in buffer().
+     */
+    std::size_t offset() const { return mSlice.offset; }
+    std::uint32_t size() const { return mSize; }
+    std::uint32_t capacity() const { return mCapacity; }
+    bool empty() const { return mSize == 0; }
+
+    static constexpr std::uint32_t stride()
+    {
+        return sizeof(Command);
+    }
+};
+}
@@ -0,0 +1,81 @@
+﻿#pragma once
+
+#include <array>
+#include <cstring>
+#include <memory>
+
+#include <Usagi/Runtime/Memory/TripleBuffer.hpp>
+
+#include "GpuBuffer.hpp"
+#include "GpuDevice.hpp"
+
+namespace usagi
+{
+/**
+ * \brief Triple buffer whose payloads live in GPU-visible memory. The
+ * producer writes into the mapped memory of the back buffer and the consumer
+ * binds the front buffer in its command lists.
+ *
+ * Each write() obtains a fresh allocation for the back buffer, so the
+ * memory previously held by it stays alive until the command lists
+ * referencing it are finished by the GPU and is never overwritten while
+ * in use.
+ */
+class GpuTripleBuffer : Noncopyable
+{
+    std::array<std::shared_ptr<GpuBuffer>, 3> mBuffers;
+    TripleBufferIndex mIndex;
+
+public:
+    GpuTripleBuffer(GpuDevice *gpu, const GpuBufferUsage usage)
+    {
+        for(auto &&b : mBuffers)
+            b = gpu->createBuffer(usage, GpuBufferStorage::DYNAMIC);
+    }
+
+    // ~~ Producer ~~
+
+    /**
+     * \brief Allocate the back buffer with the specified size and return
+     * its mapped memory. Call publish() after filling it.
+     */
+    void * beginWrite(const std::size_t size)
+    {
+        auto &buffer = mBuffers[mIndex.backIndex()];
+        buffer->allocate(size);
+        return buffer->mappedMemory();
+    }
+
+    void publish()
+    {
+        mBuffers[mIndex.backIndex()]->flush();
+        mIndex.publish();
+    }
+
+    void write(const void *data, const std::size_t size)
+    {
+        std::memcpy(beginWrite(size), data, size);
+        publish();
+    }
+
+    // ~~ Consumer ~~
+
+    bool hasNewData() const { return mIndex.hasNewData(); }
+    bool fetch() { return mIndex.fetch(); }
+
+    /**
+     * \brief The front buffer. Its size is zero if nothing was published
+     * yet.
+     */
+    const std::shared_ptr<GpuBuffer> & readBuffer() const
+    {
+        return mBuffers[mIndex.frontIndex()];
+    }
+
+    const std::shared_ptr<GpuBuffer> & read()
+    {
+        fetch();
+        return readBuffer();
+    }
+};
+}
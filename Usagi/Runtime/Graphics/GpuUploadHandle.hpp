@@ -0,0 +1,29 @@
+﻿#pragma once
+
+#include <Usagi/Utility/Noncopyable.hpp>
+
+namespace usagi
+{
+/**
+ * \brief Tracks the completion of an asynchronous upload. Uploads are
+ * batched by the device and submitted no later than the next graphics job
+ * submission, so the uploaded data is always visible to graphics jobs
+ * submitted afterwards.
+ */
+class GpuUploadHandle : Noncopyable
+{
+public:
+    virtual ~GpuUploadHandle() = default;
+
+    /**
+     * \brief Whether the GPU finished the upload.
+     */
+    virtual bool ready() = 0;
+
+    /**
+     * \brief Submit the upload if it has not been submitted and block until
+     * it is finished.
+     */
+    virtual void wait() = 0;
+};
+}
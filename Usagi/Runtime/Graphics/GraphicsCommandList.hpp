@@ -1,21 +1,30 @@
 ﻿#pragma once
 
+#include <memory>
+#include <vector>
+
 #include <Usagi/Core/Math.hpp>
 #include <Usagi/Utility/Noncopyable.hpp>
 
 #include "Enum/GpuImageLayout.hpp"
 #include "Enum/GraphicsIndexType.hpp"
 #include "Enum/GraphicsPipelineStage.hpp"
+#include "Enum/RenderingContents.hpp"
 #include "Shader/ShaderStage.hpp"
 #include "ShaderResource.hpp"
 #include "GraphicsPipeline.hpp"
+#include "ComputePipeline.hpp"
+#include "GpuIndirectCommands.hpp"
 
 namespace usagi
 {
 class GraphicsPipeline;
+class ComputePipeline;
 class GpuImage;
 class GpuBuffer;
 class Framebuffer;
+class RenderPass;
+class GraphicsCommandStream;
 
 /**
  * \brief Device states including resource bindings are reset between
@@ -27,6 +36,17 @@ public:
     virtual ~GraphicsCommandList() = default;
 
     virtual void beginRecording() = 0;
+    /**
+     * \brief Begin recording a secondary command list, which continues
+     * the render pass begun by the primary command list executing it.
+     * Only graphics commands may be recorded.
+     * \param render_pass
+     * \param framebuffer
+     */
+    virtual void beginRecording(
+        std::shared_ptr<RenderPass> render_pass,
+        std::shared_ptr<Framebuffer> framebuffer
+    ) = 0;
     virtual void endRecording() = 0;
 
     // Setup commands
@@ -46,20 +66,57 @@ public:
         Color4f color
     ) = 0;
 
+    /**
+     * \brief Make the memory written by the commands in src_stage before
+     * the barrier visible to the commands in dest_stage after it, such as
+     * storage buffers written by a compute shader and then read as vertex
+     * buffers or indirect arguments. Image layouts are not changed.
+     * \param src_stage
+     * \param dest_stage
+     */
+    virtual void memoryBarrier(
+        GraphicsPipelineStage src_stage,
+        GraphicsPipelineStage dest_stage
+    ) = 0;
+
     // Graphics commands
 
+    /**
+     * \brief
+     * \param render_pass
+     * \param framebuffer
+     * \param contents If SECONDARY_COMMAND_LISTS, the only command allowed
+     * before endRendering() is executeCommandLists().
+     */
     virtual void beginRendering(
         std::shared_ptr<RenderPass> render_pass,
-        std::shared_ptr<Framebuffer> framebuffer
+        std::shared_ptr<Framebuffer> framebuffer,
+        RenderingContents contents = RenderingContents::INLINE
     ) = 0;
     virtual void endRendering() = 0;
 
+    /**
+     * \brief Execute secondary command lists in the order given, so the
+     * results are deterministic no matter which threads recorded them.
+     * \param command_lists Must have finished recording.
+     */
+    virtual void executeCommandLists(
+        const std::vector<std::shared_ptr<GraphicsCommandList>> &command_lists
+    ) = 0;
+
     /**
      * \brief Binding the same pipeline as the current one should be optimized
      * as a no-op.
      * \param pipeline
      */
     virtual void bindPipeline(std::shared_ptr<GraphicsPipeline> pipeline) = 0;
+    /**
+     * \brief Compute pipelines are bound independently of the graphics
+     * pipeline. Resource sets and constants are applied to the pipeline
+     * bound most recently.
+     * \param pipeline
+     */
+    virtual void bindPipeline(std::shared_ptr<ComputePipeline> pipeline) = 0;
 
     // Dynamic States
 
@@ -107,6 +164,26 @@ public:
         std::size_t size
 	) = 0;
 
+    /**
+     * \brief Set the value of a field resolved by
+     * GraphicsPipeline::constantHandle(). The handle must be obtained from
+     * the active pipeline or one with the same constant buffer layout.
+     * \param handle
+     * \param data The source buffer containing handle.size bytes.
+     */
+    virtual void setConstant(
+        const ShaderConstantHandle &handle,
+        const void *data
+    ) = 0;
+
+    /**
+     * \brief Set multiple fields at once. Adjacent fields of the same stage
+     * are written with a single update.
+     */
+    virtual void setConstants(
+        std::initializer_list<ShaderConstantWrite> writes
+    ) = 0;
+
     virtual void bindIndexBuffer(
         const std::shared_ptr<GpuBuffer> &buffer,
         std::size_t offset,
@@ -139,6 +216,12 @@ public:
         std::initializer_list<std::shared_ptr<ShaderResource>> resources
     ) = 0;
 
+    /**
+     * \brief Keep a resource alive until the commands are finished without
+     * binding it, such as a texture selected by its bindless index.
+     */
+    virtual void retainResource(std::shared_ptr<ShaderResource> resource) = 0;
+
     // Draw
 
     virtual void drawInstanced(
@@ -164,5 +247,105 @@ public:
         std::int32_t vertex_offset,
         std::uint32_t first_instance
 	) = 0;
+
+    /**
+     * \brief Issue draw_count draws whose arguments are read from the
+     * buffer as GpuDrawIndirectCommand. The arguments may be written by
+     * the host using GpuIndirectCommandArray or by a compute shader, whose
+     * writes must be made visible with a memoryBarrier() to DRAW_INDIRECT.
+     * If the device does not support multiple draws in one command, the
+     * draws are issued one by one.
+     * \param buffer Created with GpuBufferUsage::INDIRECT or allocated from
+     * the transient memory.
+     * \param offset Must be a multiple of 4.
+     * \param draw_count
+     * \param stride Byte distance between the commands. Must be a multiple
+     * of 4 and not less than the command size.
+     */
+    virtual void drawIndirect(
+        const std::shared_ptr<GpuBuffer> &buffer,
+        std::size_t offset,
+        std::uint32_t draw_count,
+        std::uint32_t stride = sizeof(GpuDrawIndirectCommand)
+    ) = 0;
+
+    /**
+     * \brief Same as drawIndirect() but reads GpuDrawIndexedIndirectCommand
+     * and uses the bound index buffer.
+     */
+    virtual void drawIndexedIndirect(
+        const std::shared_ptr<GpuBuffer> &buffer,
+        std::size_t offset,
+        std::uint32_t draw_count,
+        std::uint32_t stride = sizeof(GpuDrawIndexedIndirectCommand)
+    ) = 0;
+
+    /**
+     * \brief Read the number of draws from an uint32 in count_buffer, so
+     * the GPU decides how many draws are issued, such as after culling the
+     * objects in a compute shader. Only available if
+     * GpuDevice::indirectCountEnabled().
+     * \param buffer
+     * \param offset
+     * \param count_buffer
+     * \param count_offset Must be a multiple of 4.
+     * \param max_draw_count The draw count is clamped to this value.
+     * \param stride
+     */
+    virtual void drawIndirectCount(
+        const std::shared_ptr<GpuBuffer> &buffer,
+        std::size_t offset,
+        const std::shared_ptr<GpuBuffer> &count_buffer,
+        std::size_t count_offset,
+        std::uint32_t max_draw_count,
+        std::uint32_t stride = sizeof(GpuDrawIndirectCommand)
+    ) = 0;
+
+    virtual void drawIndexedIndirectCount(
+        const std::shared_ptr<GpuBuffer> &buffer,
+        std::size_t offset,
+        const std::shared_ptr<GpuBuffer> &count_buffer,
+        std::size_t count_offset,
+        std::uint32_t max_draw_count,
+        std::uint32_t stride = sizeof(GpuDrawIndexedIndirectCommand)
+    ) = 0;
+
+    /**
+     * \brief Translate the commands recorded in the stream. The stream
+     * continues from the current states of the command list and must be
+     * executed within a render pass. The resources referenced by the stream
+     * are retained by the command list, so the stream can be reset right
+     * afterwards.
+     * \param stream
+     */
+    virtual void executeCommandStream(const GraphicsCommandStream &stream)
+        = 0;
+
+    // Compute
+    // Cannot be used between beginRendering() and endRendering().
+
+    /**
+     * \brief Run the bound compute pipeline.
+     * \param group_count_x Number of workgroups, not invocations.
+     * \param group_count_y
+     * \param group_count_z
+     */
+    virtual void dispatch(
+        std::uint32_t group_count_x,
+        std::uint32_t group_count_y,
+        std::uint32_t group_count_z
+    ) = 0;
+
+    /**
+     * \brief Read the workgroup counts from three uint32 in the buffer,
+     * which is usually written by another compute shader. The writes must
+     * be made visible with a memoryBarrier() to DRAW_INDIRECT.
+     * \param buffer Created with GpuBufferUsage::INDIRECT.
+     * \param offset Must be a multiple of 4.
+     */
+    virtual void dispatchIndirect(
+        const std::shared_ptr<GpuBuffer> &buffer,
+        std::size_t offset
+    ) = 0;
 };
 }
@@ -0,0 +1,167 @@
+﻿#include "GraphicsCommandStream.hpp"
+
+#include "GraphicsPipeline.hpp"
+#include "GpuBuffer.hpp"
+
+template <typename T>
+usagi::GraphicsCommandStream::Handle usagi::GraphicsCommandStream::addObject(
+    std::vector<std::shared_ptr<T>> &objects,
+    std::unordered_map<const void *, Handle> &handles,
+    const std::shared_ptr<T> &object)
+{
+    const auto handle = static_cast<Handle>(objects.size());
+    const auto result = handles.try_emplace(object.get(), handle);
+    if(result.second)
+        objects.push_back(object);
+    return result.first->second;
+}
+
+usagi::GraphicsCommandStream::Handle usagi::GraphicsCommandStream::
+    addPipeline(const std::shared_ptr<GraphicsPipeline> &pipeline)
+{
+    return addObject(mPipelines, mHandles, pipeline);
+}
+
+usagi::GraphicsCommandStream::Handle usagi::GraphicsCommandStream::
+    addBuffer(const std::shared_ptr<GpuBuffer> &buffer)
+{
+    return addObject(mBuffers, mHandles, buffer);
+}
+
+usagi::GraphicsCommandStream::Handle usagi::GraphicsCommandStream::
+    addResourceSet(
+        std::initializer_list<std::shared_ptr<ShaderResource>> resources)
+{
+    const auto handle = static_cast<Handle>(mResourceSets.size());
+    mResourceSets.emplace_back(mSetResources.size(), resources.size());
+    mSetResources.insert(mSetResources.end(), resources);
+    return handle;
+}
+
+usagi::GraphicsCommandStream::Handle usagi::GraphicsCommandStream::
+    addResource(const std::shared_ptr<ShaderResource> &resource)
+{
+    return addObject(mResources, mResourceHandles, resource);
+}
+
+void usagi::GraphicsCommandStream::bindPipeline(const Handle pipeline)
+{
+    encode(Op::BIND_PIPELINE, BindPipeline { pipeline });
+}
+
+void usagi::GraphicsCommandStream::bindResourceSet(
+    const std::uint32_t set_id,
+    const Handle resource_set)
+{
+    encode(Op::BIND_RESOURCE_SET, BindResourceSet { set_id, resource_set });
+}
+
+void usagi::GraphicsCommandStream::bindIndexBuffer(
+    const Handle buffer,
+    const std::size_t offset,
+    const GraphicsIndexType type)
+{
+    encode(Op::BIND_INDEX_BUFFER, BindIndexBuffer { offset, buffer, type });
+}
+
+void usagi::GraphicsCommandStream::bindVertexBuffer(
+    const std::uint32_t binding_index,
+    const Handle buffer,
+    const std::size_t offset)
+{
+    encode(Op::BIND_VERTEX_BUFFER,
+        BindVertexBuffer { offset, binding_index, buffer });
+}
+
+void usagi::GraphicsCommandStream::setViewport(
+    const std::uint32_t index,
+    const Vector2f &origin,
+    const Vector2f &size)
+{
+    encode(Op::SET_VIEWPORT, SetViewport {
+        index, { origin.x(), origin.y() }, { size.x(), size.y() }
+    });
+}
+
+void usagi::GraphicsCommandStream::setScissor(
+    const std::uint32_t viewport_index,
+    const Vector2i32 &origin,
+    const Vector2u32 &size)
+{
+    encode(Op::SET_SCISSOR, SetScissor {
+        viewport_index, { origin.x(), origin.y() }, { size.x(), size.y() }
+    });
+}
+
+void usagi::GraphicsCommandStream::setLineWidth(const float width)
+{
+    encode(Op::SET_LINE_WIDTH, SetLineWidth { width });
+}
+
+void usagi::GraphicsCommandStream::setConstant(
+    const ShaderConstantHandle &handle,
+    const void *data)
+{
+    encode(Op::SET_CONSTANT, SetConstant { handle });
+    const auto pos = mBytes.size();
+    mBytes.resize(pos + handle.size);
+    std::memcpy(mBytes.data() + pos, data, handle.size);
+}
+
+void usagi::GraphicsCommandStream::drawInstanced(
+    const std::uint32_t vertex_count,
+    const std::uint32_t instance_count,
+    const std::uint32_t first_vertex,
+    const std::uint32_t first_instance)
+{
+    encode(Op::DRAW_INSTANCED, DrawInstanced {
+        vertex_count, instance_count, first_vertex, first_instance
+    });
+}
+
+void usagi::GraphicsCommandStream::drawIndexedInstanced(
+    const std::uint32_t index_count,
+    const std::uint32_t instance_count,
+    const std::uint32_t first_index,
+    const std::int32_t vertex_offset,
+    const std::uint32_t first_instance)
+{
+    encode(Op::DRAW_INDEXED_INSTANCED, DrawIndexedInstanced {
+        index_count, instance_count, first_index, vertex_offset,
+        first_instance
+    });
+}
+
+void usagi::GraphicsCommandStream::drawIndirect(
+    const Handle buffer,
+    const std::size_t offset,
+    const std::uint32_t draw_count,
+    const std::uint32_t stride)
+{
+    encode(Op::DRAW_INDIRECT, DrawIndirect {
+        offset, buffer, draw_count, stride
+    });
+}
+
+void usagi::GraphicsCommandStream::drawIndexedIndirect(
+    const Handle buffer,
+    const std::size_t offset,
+    const std::uint32_t draw_count,
+    const std::uint32_t stride)
+{
+    encode(Op::DRAW_INDEXED_INDIRECT, DrawIndexedIndirect {
+        offset, buffer, draw_count, stride
+    });
+}
+
+void usagi::GraphicsCommandStream::reset()
+{
+    mBytes.clear();
+    mPipelines.clear();
+    mBuffers.clear();
+    mSetResources.clear();
+    mResourceSets.clear();
+    mResources.clear();
+    mHandles.clear();
+    mResourceHandles.clear();
+}
@@ -0,0 +1,369 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <memory>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <Usagi/Core/Math.hpp>
+#include <Usagi/Utility/Noncopyable.hpp>
+
+#include "Enum/GraphicsIndexType.hpp"
+#include "Shader/ShaderConstantHandle.hpp"
+
+namespace usagi
+{
+class GraphicsPipeline;
+class GpuBuffer;
+class ShaderResource;
+
+/**
+ * \brief Records graphics commands into a packed byte stream without
+ * virtual calls or reference counting. The pipelines, buffers and resource
+ * sets are added to the stream once and referred to by handles, so their
+ * lifetime is only tracked once for each stream. The stream is executed by
+ * GraphicsCommandList::executeCommandStream(), which translates all the
+ * commands in one loop.
+ *
+ * A stream must only be recorded by one thread at a time. It may be reset
+ * and reused after being executed, which keeps the allocated memory.
+ */
+class GraphicsCommandStream : Noncopyable
+{
+public:
+    using Handle = std::uint32_t;
+
+    enum class Op : std::uint8_t
+    {
+        BIND_PIPELINE,
+        BIND_RESOURCE_SET,
+        BIND_INDEX_BUFFER,
+        BIND_VERTEX_BUFFER,
+        SET_VIEWPORT,
+        SET_SCISSOR,
+        SET_LINE_WIDTH,
+        SET_CONSTANT,
+        DRAW_INSTANCED,
+        DRAW_INDEXED_INSTANCED,
+        DRAW_INDIRECT,
+        DRAW_INDEXED_INDIRECT,
+    };
+
+    // The commands are stored as an Op followed by the struct without any
+    // padding. They are copied out before use since they are not aligned.
+
+    struct BindPipeline
+    {
+        Handle pipeline;
+    };
+
+    struct BindResourceSet
+    {
+        std::uint32_t set_id;
+        Handle resource_set;
+    };
+
+    struct BindIndexBuffer
+    {
+        std::uint64_t offset;
+        Handle buffer;
+        GraphicsIndexType type;
+    };
+
+    struct BindVertexBuffer
+    {
+        std::uint64_t offset;
+        std::uint32_t binding_index;
+        Handle buffer;
+    };
+
+    struct SetViewport
+    {
+        std::uint32_t index;
+        float origin[2];
+        float size[2];
+    };
+
+    struct SetScissor
+    {
+        std::uint32_t viewport_index;
+        std::int32_t origin[2];
+        std::uint32_t size[2];
+    };
+
+    struct SetLineWidth
+    {
+        float width;
+    };
+
+    // followed by handle.size bytes of data. decoded as ShaderConstantWrite
+    // pointing into the stream.
+    struct SetConstant
+    {
+        ShaderConstantHandle handle;
+    };
+
+    struct DrawInstanced
+    {
+        std::uint32_t vertex_count;
+        std::uint32_t instance_count;
+        std::uint32_t first_vertex;
+        std::uint32_t first_instance;
+    };
+
+    struct DrawIndexedInstanced
+    {
+        std::uint32_t index_count;
+        std::uint32_t instance_count;
+        std::uint32_t first_index;
+        std::int32_t vertex_offset;
+        std::uint32_t first_instance;
+    };
+
+    struct DrawIndirect
+    {
+        std::uint64_t offset;
+        Handle buffer;
+        std::uint32_t draw_count;
+        std::uint32_t stride;
+    };
+
+    struct DrawIndexedIndirect
+    {
+        std::uint64_t offset;
+        Handle buffer;
+        std::uint32_t draw_count;
+        std::uint32_t stride;
+    };
+
+    struct ResourceSet
+    {
+        const std::shared_ptr<ShaderResource> *resources;
+        std::size_t count;
+        // index of the first resource in setResources()
+        std::size_t first;
+    };
+
+private:
+    std::vector<std::uint8_t> mBytes;
+
+    std::vector<std::shared_ptr<GraphicsPipeline>> mPipelines;
+    std::vector<std::shared_ptr<GpuBuffer>> mBuffers;
+    // the resources of all sets, stored contiguously
+    std::vector<std::shared_ptr<ShaderResource>> mSetResources;
+    // the first resource and resource count of each set
+    std::vector<std::pair<std::size_t, std::size_t>> mResourceSets;
+    // resources used without being bound, such as bindless textures
+    std::vector<std::shared_ptr<ShaderResource>> mResources;
+    // pipelines and buffers added before. they can share the map since
+    // different objects have different addresses.
+    std::unordered_map<const void *, Handle> mHandles;
+    // a buffer may also be added as a resource, so they are kept apart
+    std::unordered_map<const void *, Handle> mResourceHandles;
+
+    template <typename Command>
+    void encode(Op op, const Command &command)
+    {
+        const auto pos = mBytes.size();
+        mBytes.resize(pos + sizeof(Op) + sizeof(Command));
+        std::memcpy(mBytes.data() + pos, &op, sizeof(Op));
+        std::memcpy(mBytes.data() + pos + sizeof(Op), &command,
+            sizeof(Command));
+    }
+
+    template <typename Command, typename Visitor>
+    static const std::uint8_t * decode(
+        const std::uint8_t *pos,
+        Visitor &visitor)
+    {
+        Command command;
+        std::memcpy(&command, pos, sizeof(Command));
+        visitor(command);
+        return pos + sizeof(Command);
+    }
+
+    template <typename T>
+    Handle addObject(
+        std::vector<std::shared_ptr<T>> &objects,
+        std::unordered_map<const void *, Handle> &handles,
+        const std::shared_ptr<T> &object);
+
+public:
+    GraphicsCommandStream() = default;
+
+    /**
+     * \brief Retain a pipeline for the stream. Adding the same pipeline
+     * again returns the same handle.
+     */
+    Handle addPipeline(const std::shared_ptr<GraphicsPipeline> &pipeline);
+    /**
+     * \brief Retain a buffer for the stream. Adding the same buffer again
+     * returns the same handle. The allocation of the buffer is resolved
+     * when the stream is executed.
+     */
+    Handle addBuffer(const std::shared_ptr<GpuBuffer> &buffer);
+    /**
+     * \brief Retain the resources bound as a set with bindResourceSet().
+     * The handle can be bound any number of times.
+     */
+    Handle addResourceSet(
+        std::initializer_list<std::shared_ptr<ShaderResource>> resources);
+    /**
+     * \brief Retain a resource which the commands use without binding it,
+     * such as a texture selected by its bindless index. Adding the same
+     * resource again returns the same handle. No command refers to the
+     * handle.
+     */
+    Handle addResource(const std::shared_ptr<ShaderResource> &resource);
+
+    void bindPipeline(Handle pipeline);
+    void bindResourceSet(std::uint32_t set_id, Handle resource_set);
+    void bindIndexBuffer(
+        Handle buffer,
+        std::size_t offset,
+        GraphicsIndexType type);
+    void bindVertexBuffer(
+        std::uint32_t binding_index,
+        Handle buffer,
+        std::size_t offset);
+
+    void setViewport(
+        std::uint32_t index,
+        const Vector2f &origin,
+        const Vector2f &size);
+    void setScissor(
+        std::uint32_t viewport_index,
+        const Vector2i32 &origin,
+        const Vector2u32 &size);
+    void setLineWidth(float width);
+
+    /**
+     * \brief The data is copied into the stream.
+     */
+    void setConstant(const ShaderConstantHandle &handle, const void *data);
+
+    void drawInstanced(
+        std::uint32_t vertex_count,
+        std::uint32_t instance_count,
+        std::uint32_t first_vertex,
+        std::uint32_t first_instance);
+    void drawIndexedInstanced(
+        std::uint32_t index_count,
+        std::uint32_t instance_count,
+        std::uint32_t first_index,
+        std::int32_t vertex_offset,
+        std::uint32_t first_instance);
+    /**
+     * \brief See GraphicsCommandList::drawIndirect().
+     */
+    void drawIndirect(
+        Handle buffer,
+        std::size_t offset,
+        std::uint32_t draw_count,
+        std::uint32_t stride);
+    void drawIndexedIndirect(
+        Handle buffer,
+        std::size_t offset,
+        std::uint32_t draw_count,
+        std::uint32_t stride);
+
+    /**
+     * \brief Remove the commands and release the resources while keeping
+     * the memory for the next recording.
+     */
+    void reset();
+
+    bool empty() const { return mBytes.empty(); }
+    std::size_t byteSize() const { return mBytes.size(); }
+
+    const std::vector<std::shared_ptr<GraphicsPipeline>> & pipelines() const
+    {
+        return mPipelines;
+    }
+
+    const std::vector<std::shared_ptr<GpuBuffer>> & buffers() const
+    {
+        return mBuffers;
+    }
+
+    const std::vector<std::shared_ptr<ShaderResource>> & resources() const
+    {
+        return mResources;
+    }
+
+    /**
+     * \brief The resources of all the sets, which the executor may resolve
+     * once for the stream.
+     */
+    const std::vector<std::shared_ptr<ShaderResource>> & setResources() const
+    {
+        return mSetResources;
+    }
+
+    ResourceSet resourceSet(const Handle handle) const
+    {
+        const auto &range = mResourceSets[handle];
+        return {
+            mSetResources.data() + range.first, range.second, range.first
+        };
+    }
+
+    /**
+     * \brief Decode the commands in the recorded order. The visitor is
+     * invoked with each command struct, except for SET_CONSTANT which is
+     * passed as ShaderConstantWrite.
+     */
+    template <typename Visitor>
+    void visit(Visitor &&visitor) const
+    {
+        auto pos = mBytes.data();
+        const auto end = pos + mBytes.size();
+        while(pos != end)
+        {
+            Op op;
+            std::memcpy(&op, pos, sizeof(Op));
+            pos += sizeof(Op);
+            switch(op)
+            {
+                case Op::BIND_PIPELINE:
+                    pos = decode<BindPipeline>(pos, visitor); break;
+                case Op::BIND_RESOURCE_SET:
+                    pos = decode<BindResourceSet>(pos, visitor); break;
+                case Op::BIND_INDEX_BUFFER:
+                    pos = decode<BindIndexBuffer>(pos, visitor); break;
+                case Op::BIND_VERTEX_BUFFER:
+                    pos = decode<BindVertexBuffer>(pos, visitor); break;
+                case Op::SET_VIEWPORT:
+                    pos = decode<SetViewport>(pos, visitor); break;
+                case Op::SET_SCISSOR:
+                    pos = decode<SetScissor>(pos, visitor); break;
+                case Op::SET_LINE_WIDTH:
+                    pos = decode<SetLineWidth>(pos, visitor); break;
+                case Op::SET_CONSTANT:
+                {
+                    SetConstant command;
+                    std::memcpy(&command, pos, sizeof(SetConstant));
+                    pos += sizeof(SetConstant);
+                    visitor(ShaderConstantWrite { command.handle, pos });
+                    pos += command.handle.size;
+                    break;
+                }
+                case Op::DRAW_INSTANCED:
+                    pos = decode<DrawInstanced>(pos, visitor); break;
+                case Op::DRAW_INDEXED_INSTANCED:
+                    pos = decode<DrawIndexedInstanced>(pos, visitor); break;
+                case Op::DRAW_INDIRECT:
+                    pos = decode<DrawIndirect>(pos, visitor); break;
+                case Op::DRAW_INDEXED_INDIRECT:
+                    pos = decode<DrawIndexedIndirect>(pos, visitor); break;
+                default:
+                    throw std::logic_error("Corrupted command stream.");
+            }
+        }
+    }
+};
+}
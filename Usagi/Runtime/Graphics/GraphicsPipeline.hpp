@@ -2,6 +2,8 @@
 
 #include <Usagi/Utility/Noncopyable.hpp>
 
+#include "Shader/ShaderConstantHandle.hpp"
+
 namespace usagi
 {
 class RenderPass;
@@ -10,5 +12,18 @@ class GraphicsPipeline : Noncopyable
 {
 public:
     virtual ~GraphicsPipeline() = default;
+
+    /**
+     * \brief Resolve a field of the constant buffer for writing it using
+     * GraphicsCommandList::setConstant() without looking up its name.
+     * Resolve the handles after creating the pipeline and keep them along
+     * with it.
+     * \param stage The shader stage within which the name is defined.
+     * \param name
+     * \return
+     */
+    virtual ShaderConstantHandle constantHandle(
+        ShaderStage stage,
+        const char *name) const = 0;
 };
 }
@@ -1,7 +1,9 @@
 ﻿#pragma once
 
+#include <future>
 #include <memory>
 #include <string>
+#include <type_traits>
 
 #include <Usagi/Utility/Noncopyable.hpp>
 
@@ -35,6 +37,51 @@ public:
         ShaderStage stage,
         std::shared_ptr<SpirvBinary> shader) = 0;
 
+    /**
+     * \brief Set the value of a specialization constant declared with
+     * layout(constant_id = N) in the shader of the stage. The value is
+     * applied when the pipeline is created and the shader is not compiled
+     * again. Constants not set keep the default values in the shader.
+     * \param stage
+     * \param constant_id
+     * \param data
+     * \param size Must be 4 or 8.
+     */
+    virtual void setSpecializationConstant(
+        ShaderStage stage,
+        std::uint32_t constant_id,
+        const void *data,
+        std::size_t size) = 0;
+
+    template <typename T>
+    void setSpecializationConstant(
+        const ShaderStage stage,
+        const std::uint32_t constant_id,
+        const T value)
+    {
+        static_assert(std::is_arithmetic_v<T>);
+        // GLSL bool constants are 32-bit
+        if constexpr(std::is_same_v<T, bool>)
+        {
+            const std::uint32_t b = value ? 1 : 0;
+            setSpecializationConstant(stage, constant_id, &b, sizeof(b));
+        }
+        else
+        {
+            static_assert(sizeof(T) == 4 || sizeof(T) == 8);
+            setSpecializationConstant(stage, constant_id, &value, sizeof(T));
+        }
+    }
+
+    /**
+     * \brief Describe the vertex buffers read by the fixed-function vertex
+     * input. Pipelines whose vertex shader declares no input attribute
+     * skip it and pull the vertex and instance data from storage buffers
+     * indexed by gl_VertexIndex and gl_InstanceIndex instead, which are
+     * bound with GraphicsCommandList::bindResourceSet(). Such pipelines
+     * need neither vertex bindings nor attributes, and instance data is
+     * not limited by the number of vertex bindings.
+     */
     virtual void setVertexBufferBinding(
         std::uint32_t binding_index,
         std::uint32_t stride,
@@ -74,5 +121,14 @@ public:
      * \return
      */
     virtual std::shared_ptr<GraphicsPipeline> compile() = 0;
+
+    /**
+     * \brief Take a snapshot of the current states and create the pipeline
+     * on a worker thread. The compiler may be modified or destroyed
+     * immediately after the call. The pipeline will derive from the first
+     * one created by compile(), if there is one.
+     * \return
+     */
+    virtual std::future<std::shared_ptr<GraphicsPipeline>> compileAsync() = 0;
 };
 }
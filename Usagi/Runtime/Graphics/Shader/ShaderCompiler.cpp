@@ -0,0 +1,313 @@
+﻿#include "ShaderCompiler.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <execution>
+
+#include <glslang/glslang/Public/ShaderLang.h>
+#include <glslang/ResourceLimits.h>
+#include <glslang/SPIRV/GlslangToSpv.h>
+
+#include <Usagi/Core/Logging.hpp>
+#include <Usagi/Utility/File.hpp>
+#include <Usagi/Utility/Hash.hpp>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+struct GlslangProcess
+{
+    GlslangProcess() { glslang::InitializeProcess(); }
+    ~GlslangProcess() { glslang::FinalizeProcess(); }
+};
+
+void initializeGlslang()
+{
+    // thread-safe initialization, finalized at exit
+    static GlslangProcess process;
+}
+
+EShLanguage translate(const usagi::ShaderStage stage)
+{
+    switch(stage)
+    {
+        case usagi::ShaderStage::VERTEX: return EShLangVertex;
+        case usagi::ShaderStage::FRAGMENT: return EShLangFragment;
+        case usagi::ShaderStage::COMPUTE: return EShLangCompute;
+        default: throw std::runtime_error("Invalid shader stage.");
+    }
+}
+
+std::string makePreamble(const usagi::ShaderDefines &defines)
+{
+    // without the extension glslang refuses #include
+    std::string preamble =
+        "#extension GL_GOOGLE_include_directive : require\n";
+    for(auto &&d : defines)
+        preamble += fmt::format("#define {} {}\n", d.first, d.second);
+    return preamble;
+}
+
+class Includer : public glslang::TShader::Includer
+{
+    const usagi::ShaderIncludeResolver &mResolver;
+
+    struct Header
+    {
+        std::string name;
+        std::string code;
+    };
+
+public:
+    explicit Includer(const usagi::ShaderIncludeResolver &resolver)
+        : mResolver(resolver)
+    {
+    }
+
+    IncludeResult * includeSystem(
+        const char *header_name,
+        const char *includer_name,
+        const std::size_t inclusion_depth) override
+    {
+        return includeLocal(header_name, includer_name, inclusion_depth);
+    }
+
+    IncludeResult * includeLocal(
+        const char *header_name,
+        const char *includer_name,
+        std::size_t inclusion_depth) override
+    {
+        if(!mResolver) return nullptr;
+
+        auto include = mResolver(header_name, includer_name);
+        if(!include)
+        {
+            LOG(error, "Could not find the shader header {} included by {}",
+                header_name, includer_name);
+            return nullptr;
+        }
+        auto header = new Header {
+            std::move(include->name), std::move(include->code)
+        };
+        return new IncludeResult(header->name,
+            header->code.data(), header->code.size(), header);
+    }
+
+    void releaseInclude(IncludeResult *result) override
+    {
+        if(!result) return;
+        delete static_cast<Header*>(result->userData);
+        delete result;
+    }
+};
+
+// default Vulkan version
+const auto CLIENT_INPUT_SEMANTICS_VERSION = 100;
+const auto VULKAN_CLIENT_VERSION = glslang::EShTargetVulkan_1_0;
+const auto TARGET_VERSION = glslang::EShTargetSpv_1_0;
+const auto DEFAULT_VERSION = 110; // defaults to desktop version
+const auto MESSAGES = EShMsgDefault;
+
+void setupShader(
+    glslang::TShader &shader,
+    const usagi::ShaderSource &source,
+    const std::string &preamble,
+    const char * const *strings,
+    const int *sizes,
+    const char * const *names)
+{
+    const auto glslang_stage = translate(source.stage);
+
+    shader.setStringsWithLengthsAndNames(strings, sizes, names, 1);
+    shader.setPreamble(preamble.c_str());
+    shader.setEnvInput(glslang::EShSourceGlsl, glslang_stage,
+        glslang::EShClientVulkan, CLIENT_INPUT_SEMANTICS_VERSION);
+    shader.setEnvClient(glslang::EShClientVulkan, VULKAN_CLIENT_VERSION);
+    shader.setEnvTarget(glslang::EShTargetSpv, TARGET_VERSION);
+}
+}
+
+usagi::ShaderCompiler::ShaderCompiler(
+    std::optional<fs::path> cache_folder,
+    ShaderIncludeResolver include_resolver)
+    : mCacheFolder(std::move(cache_folder))
+    , mIncludeResolver(std::move(include_resolver))
+{
+    initializeGlslang();
+}
+
+// refer to glslangValidator source code
+std::shared_ptr<usagi::SpirvBinary> usagi::ShaderCompiler::compile(
+    const ShaderSource &source) const
+{
+    using namespace glslang;
+    using namespace spv;
+    using Bytecode = SpirvBinary::Bytecode;
+
+    const auto glslang_stage = translate(source.stage);
+    // inserted by glslang after the #version directive
+    const auto preamble = makePreamble(source.options.defines);
+
+    const char *strings[] = { source.code.data() };
+    const int sizes[] = { static_cast<int>(source.code.size()) };
+    const char *names[] = { source.name.c_str() };
+    TBuiltInResource resources = DefaultTBuiltInResource;
+    Includer includer(mIncludeResolver);
+
+    fs::path cache_file;
+    if(mCacheFolder)
+    {
+        // the preprocessed code contains the includes and has the macros
+        // expanded
+        std::string preprocessed;
+        {
+            TShader shader(glslang_stage);
+            setupShader(shader, source, preamble, strings, sizes, names);
+            if(!shader.preprocess(&resources, DEFAULT_VERSION, ENoProfile,
+                false, false, MESSAGES, &preprocessed, includer))
+            {
+                LOG(error, "Preprocessor output:\n{}", shader.getInfoLog());
+                throw std::runtime_error("Shader preprocessing failed.");
+            }
+        }
+
+        cache_file = mCacheFolder.value();
+        create_directories(cache_file);
+        cache_file /= sha256(fmt::format("{}:{}:{}\n{}",
+            to_string(source.stage),
+            source.options.debug_info,
+            source.options.optimize,
+            preprocessed
+        ));
+        cache_file += ".spv";
+
+        // try loading from cache
+        if(exists(cache_file))
+        {
+            try
+            {
+                auto cache = SpirvBinary::fromFile(cache_file);
+                LOG(info, "Shader {} loaded from cache {}",
+                    source.name, cache_file);
+                return std::move(cache);
+            }
+            catch(const std::exception &e)
+            {
+                LOG(warn, "Could not load the shader from cache: {}, {}",
+                    e.what(), strerror(errno));
+            }
+            catch(...)
+            {
+                LOG(error, "Unknown error occurred while loading the shader "
+                    "from cache.");
+            }
+        }
+    }
+
+    LOG(info, "Compiling {} shader {}...",
+        to_string(source.stage), source.name);
+
+    // shader must be released after program because the program may reference
+    // the shaders.
+    TShader shader(glslang_stage);
+    TProgram program;
+
+    setupShader(shader, source, preamble, strings, sizes, names);
+    const auto compilation_suceeded = shader.parse(
+        &resources, DEFAULT_VERSION, false, MESSAGES, includer);
+
+    if(shader.getInfoLog()[0])
+        LOG(info, "Compiler output:\n{}", shader.getInfoLog());
+    if(shader.getInfoDebugLog()[0])
+        LOG(info, "Compiler debug output:\n{}", shader.getInfoDebugLog());
+
+    program.addShader(&shader);
+
+    const auto link_succeeded = compilation_suceeded &&
+        program.link(MESSAGES) && program.mapIO();
+
+    if(program.getInfoLog()[0])
+        LOG(info, "Linker output:\n{}", program.getInfoLog());
+    if(program.getInfoDebugLog()[0])
+        LOG(info, "Linker debug output:\n{}", program.getInfoDebugLog());
+
+    if(!compilation_suceeded || !link_succeeded)
+        throw std::runtime_error("Shader compilation failed.");
+
+    // Generate SPIR-V code
+    std::vector<Bytecode> spirv;
+    SpvBuildLogger logger;
+    SpvOptions spv_options;
+    spv_options.generateDebugInfo = source.options.debug_info;
+    spv_options.disableOptimizer = !source.options.optimize;
+    spv_options.optimizeSize = source.options.optimize;
+    // the names are kept since the pipeline compiler reflects the vertex
+    // attributes and constants by name
+    spv_options.stripDebugInfo = false;
+
+    GlslangToSpv(*program.getIntermediate(glslang_stage), spirv, &logger,
+        &spv_options);
+    const auto spv_messages = logger.getAllMessages();
+    if(!spv_messages.empty())
+        LOG(info, "SPIR-V generator output:\n{}", spv_messages);
+
+    // save bytecode to cache
+    if(mCacheFolder)
+    {
+        LOG(info, "Saving shader cache to {}", cache_file);
+        dumpBinary(cache_file, spirv.data(), spirv.size() * sizeof(Bytecode));
+    }
+
+    auto binary = std::make_shared<SpirvBinary>(std::move(spirv));
+    // reflect now so the cached loads do not have to parse the binary
+    if(mCacheFolder)
+        binary->saveReflection(cache_file);
+
+    return binary;
+}
+
+std::vector<std::shared_ptr<usagi::SpirvBinary>> usagi::ShaderCompiler::
+    compile(const std::vector<ShaderSource> &sources) const
+{
+    std::vector<std::shared_ptr<SpirvBinary>> binaries(sources.size());
+    std::vector<std::exception_ptr> errors(sources.size());
+
+    std::vector<std::size_t> indices(sources.size());
+    for(std::size_t i = 0; i < indices.size(); ++i)
+        indices[i] = i;
+
+    // exceptions escaping parallel algorithms call std::terminate()
+    std::for_each(
+        std::execution::par,
+        indices.begin(),
+        indices.end(),
+        [&](const std::size_t i) {
+            try
+            {
+                binaries[i] = compile(sources[i]);
+            }
+            catch(...)
+            {
+                errors[i] = std::current_exception();
+            }
+        }
+    );
+
+    for(auto &&e : errors)
+        if(e) std::rethrow_exception(e);
+
+    return binaries;
+}
+
+usagi::ShaderIncludeResolver usagi::ShaderCompiler::fileIncludeResolver()
+{
+    return [](const std::string &header_name, const std::string &includer_name)
+        -> std::optional<ShaderInclude>
+    {
+        const auto path = fs::path(includer_name).parent_path() / header_name;
+        if(!exists(path))
+            return { };
+        return ShaderInclude { path.u8string(), readFileAsString(path) };
+    };
+}
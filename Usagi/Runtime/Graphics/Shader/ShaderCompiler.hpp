@@ -0,0 +1,91 @@
+﻿#pragma once
+
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "ShaderStage.hpp"
+#include "SpirvBinary.hpp"
+
+namespace usagi
+{
+struct ShaderCompileOptions
+{
+    ShaderDefines defines;
+
+#ifdef NDEBUG
+    bool debug_info = false;
+    bool optimize = true;
+#else
+    bool debug_info = true;
+    bool optimize = false;
+#endif
+};
+
+struct ShaderSource
+{
+    /**
+     * \brief Identifies the source in the logs and is passed to the include
+     * resolver as the name of the includer.
+     */
+    std::string name;
+    std::string code;
+    ShaderStage stage = ShaderStage::VERTEX;
+    ShaderCompileOptions options;
+};
+
+struct ShaderInclude
+{
+    /**
+     * \brief Resolved name, which is used as the includer name of the
+     * nested includes.
+     */
+    std::string name;
+    std::string code;
+};
+
+/**
+ * \brief Find the source of a header requested by #include. The header name
+ * is the one written in the directive. Returns an empty value if the header
+ * cannot be found.
+ */
+using ShaderIncludeResolver = std::function<std::optional<ShaderInclude>(
+    const std::string &header_name, const std::string &includer_name)>;
+
+/**
+ * \brief Compiles GLSL sources into SPIR-V. glslang is initialized once per
+ * process. Compilations are thread-safe and a batch is compiled in parallel.
+ *
+ * The cache is keyed by the preprocessed source, so the includes and defines
+ * are covered, along with the stage and the code generation options.
+ */
+class ShaderCompiler
+{
+    std::optional<std::filesystem::path> mCacheFolder;
+    ShaderIncludeResolver mIncludeResolver;
+
+public:
+    explicit ShaderCompiler(
+        std::optional<std::filesystem::path> cache_folder = { },
+        ShaderIncludeResolver include_resolver = { });
+
+    std::shared_ptr<SpirvBinary> compile(const ShaderSource &source) const;
+
+    /**
+     * \brief Compile the sources in parallel. If any of them failed, the
+     * first error is rethrown after all the compilations finished.
+     * \param sources
+     * \return Binaries in the same order as the sources.
+     */
+    std::vector<std::shared_ptr<SpirvBinary>> compile(
+        const std::vector<ShaderSource> &sources) const;
+
+    /**
+     * \brief Resolve the headers relative to the folder of the includer.
+     */
+    static ShaderIncludeResolver fileIncludeResolver();
+};
+}
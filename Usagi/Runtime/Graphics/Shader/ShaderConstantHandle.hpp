@@ -0,0 +1,30 @@
+﻿#pragma once
+
+#include <cstdint>
+
+#include "ShaderStage.hpp"
+
+namespace usagi
+{
+/**
+ * \brief A field of the constant buffer resolved from a pipeline in
+ * advance, so writing it does not require looking up the name. It can be
+ * used with any pipeline declaring the same constant buffer layout.
+ */
+struct ShaderConstantHandle
+{
+    ShaderStage stage = ShaderStage::VERTEX;
+    std::uint32_t offset = 0;
+    std::uint32_t size = 0;
+};
+
+/**
+ * \brief The data written into a constant field, which must have the size
+ * of the field.
+ */
+struct ShaderConstantWrite
+{
+    ShaderConstantHandle handle;
+    const void *data = nullptr;
+};
+}
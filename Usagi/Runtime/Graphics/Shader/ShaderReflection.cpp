@@ -0,0 +1,197 @@
+﻿#include "ShaderReflection.hpp"
+
+#include <stdexcept>
+#include <type_traits>
+
+#include <spirv_cross.hpp>
+
+#include <Usagi/Utility/RAIIHelper.hpp>
+
+namespace
+{
+// "USRF"
+constexpr std::uint32_t MAGIC = 0x46525355;
+// bump when the layout of the serialized data changes
+constexpr std::uint32_t VERSION = 2;
+
+template <typename T>
+void write(std::ostream &out, const T value)
+{
+    static_assert(std::is_trivially_copyable_v<T>);
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+void write(std::ostream &out, const std::string &value)
+{
+    write(out, static_cast<std::uint32_t>(value.size()));
+    out.write(value.data(), value.size());
+}
+
+template <typename T>
+T read(std::istream &in)
+{
+    static_assert(std::is_trivially_copyable_v<T>);
+    T value;
+    in.read(reinterpret_cast<char*>(&value), sizeof(T));
+    return value;
+}
+
+template <>
+std::string read<std::string>(std::istream &in)
+{
+    std::string value(read<std::uint32_t>(in), '\0');
+    in.read(value.data(), value.size());
+    return value;
+}
+
+template <typename T, typename Func>
+void writeArray(std::ostream &out, const std::vector<T> &array, Func func)
+{
+    write(out, static_cast<std::uint32_t>(array.size()));
+    for(auto &&e : array)
+        func(e);
+}
+
+template <typename T, typename Func>
+void readArray(std::istream &in, std::vector<T> &array, Func func)
+{
+    array.resize(read<std::uint32_t>(in));
+    for(auto &&e : array)
+        func(e);
+}
+}
+
+usagi::ShaderReflection usagi::ShaderReflection::reflect(
+    const std::vector<std::uint32_t> &spirv)
+{
+    using namespace spirv_cross;
+
+    const Compiler compiler(spirv);
+    const auto resources = compiler.get_shader_resources();
+    ShaderReflection r;
+
+    for(auto &&resource : resources.push_constant_buffers)
+    {
+        const auto &type = compiler.get_type(resource.base_type_id);
+        PushConstantBuffer buffer;
+        buffer.size = static_cast<std::uint32_t>(
+            compiler.get_declared_struct_size(type));
+        const auto member_count = type.member_types.size();
+        for(unsigned i = 0; i < member_count; ++i)
+        {
+            PushConstantField field;
+            field.name = compiler.get_member_name(type.self, i);
+            field.offset = compiler.type_struct_member_offset(type, i);
+            field.size = static_cast<std::uint32_t>(
+                compiler.get_declared_struct_member_size(type, i));
+            buffer.fields.push_back(std::move(field));
+        }
+        r.push_constant_buffers.push_back(std::move(buffer));
+    }
+
+    for(auto &&resource : resources.stage_inputs)
+    {
+        r.stage_inputs.push_back({
+            resource.name,
+            compiler.get_decoration(resource.id, spv::DecorationLocation)
+        });
+    }
+
+    const auto add = [&](
+        const auto &list,
+        const ResourceType resource_type)
+    {
+        for(auto &&resource : list)
+        {
+            const auto &type = compiler.get_type(resource.type_id);
+            Resource res;
+            res.type = resource_type;
+            res.name = resource.name;
+            res.set = compiler.get_decoration(
+                resource.id, spv::DecorationDescriptorSet);
+            res.binding = compiler.get_decoration(
+                resource.id, spv::DecorationBinding);
+            res.descriptor_count = type.vecsize;
+            res.runtime_array = type.array.size() == 1 &&
+                type.array.front() == 0 && type.array_size_literal.front();
+            r.resources.push_back(std::move(res));
+        }
+    };
+    add(resources.storage_buffers, ResourceType::STORAGE_BUFFER);
+    add(resources.sampled_images, ResourceType::COMBINED_IMAGE_SAMPLER);
+    add(resources.separate_images, ResourceType::SEPARATE_IMAGE);
+    add(resources.separate_samplers, ResourceType::SEPARATE_SAMPLER);
+    add(resources.uniform_buffers, ResourceType::UNIFORM_BUFFER);
+    add(resources.subpass_inputs, ResourceType::SUBPASS_INPUT);
+    add(resources.storage_images, ResourceType::STORAGE_IMAGE);
+
+    return r;
+}
+
+void usagi::ShaderReflection::serialize(std::ostream &out) const
+{
+    write(out, MAGIC);
+    write(out, VERSION);
+
+    writeArray(out, push_constant_buffers, [&](auto &&b) {
+        write(out, b.size);
+        writeArray(out, b.fields, [&](auto &&f) {
+            write(out, f.name);
+            write(out, f.offset);
+            write(out, f.size);
+        });
+    });
+    writeArray(out, stage_inputs, [&](auto &&i) {
+        write(out, i.name);
+        write(out, i.location);
+    });
+    writeArray(out, resources, [&](auto &&r) {
+        write(out, r.type);
+        write(out, r.name);
+        write(out, r.set);
+        write(out, r.binding);
+        write(out, r.descriptor_count);
+        write(out, r.runtime_array);
+    });
+}
+
+usagi::ShaderReflection usagi::ShaderReflection::deserialize(
+    std::istream &in)
+{
+    const auto old_exceptions = in.exceptions();
+    RAIIHelper exceptions(
+        [&]() {
+            in.exceptions(std::istream::badbit | std::istream::failbit);
+        }, [&]() {
+            in.exceptions(old_exceptions);
+        });
+
+    if(read<std::uint32_t>(in) != MAGIC)
+        throw std::runtime_error("Not valid shader reflection data.");
+    if(read<std::uint32_t>(in) != VERSION)
+        throw std::runtime_error("Shader reflection data is outdated.");
+
+    ShaderReflection r;
+    readArray(in, r.push_constant_buffers, [&](auto &&b) {
+        b.size = read<std::uint32_t>(in);
+        readArray(in, b.fields, [&](auto &&f) {
+            f.name = read<std::string>(in);
+            f.offset = read<std::uint32_t>(in);
+            f.size = read<std::uint32_t>(in);
+        });
+    });
+    readArray(in, r.stage_inputs, [&](auto &&i) {
+        i.name = read<std::string>(in);
+        i.location = read<std::uint32_t>(in);
+    });
+    readArray(in, r.resources, [&](auto &&res) {
+        res.type = read<ResourceType>(in);
+        res.name = read<std::string>(in);
+        res.set = read<std::uint32_t>(in);
+        res.binding = read<std::uint32_t>(in);
+        res.descriptor_count = read<std::uint32_t>(in);
+        res.runtime_array = read<bool>(in);
+    });
+
+    return r;
+}
@@ -0,0 +1,76 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace usagi
+{
+/**
+ * \brief The interface of a shader as seen by the pipeline compiler. It is
+ * extracted from SPIR-V once and can be stored along with the binary, so
+ * the binary does not have to be parsed again when loaded from cache.
+ */
+struct ShaderReflection
+{
+    struct PushConstantField
+    {
+        std::string name;
+        std::uint32_t offset = 0;
+        std::uint32_t size = 0;
+    };
+
+    struct PushConstantBuffer
+    {
+        std::uint32_t size = 0;
+        // in declaration order
+        std::vector<PushConstantField> fields;
+    };
+
+    std::vector<PushConstantBuffer> push_constant_buffers;
+
+    struct StageInput
+    {
+        std::string name;
+        std::uint32_t location = 0;
+    };
+
+    std::vector<StageInput> stage_inputs;
+
+    enum class ResourceType : std::uint8_t
+    {
+        STORAGE_BUFFER,
+        COMBINED_IMAGE_SAMPLER,
+        SEPARATE_IMAGE,
+        SEPARATE_SAMPLER,
+        UNIFORM_BUFFER,
+        SUBPASS_INPUT,
+        STORAGE_IMAGE,
+    };
+
+    struct Resource
+    {
+        ResourceType type = ResourceType::UNIFORM_BUFFER;
+        std::string name;
+        std::uint32_t set = 0;
+        std::uint32_t binding = 0;
+        std::uint32_t descriptor_count = 1;
+        // declared as an unsized array
+        bool runtime_array = false;
+    };
+
+    // grouped by the resource types in the order of declaration of the enum
+    std::vector<Resource> resources;
+
+    static ShaderReflection reflect(const std::vector<std::uint32_t> &spirv);
+
+    void serialize(std::ostream &out) const;
+    /**
+     * \brief Throws if the data is not produced by the current version of
+     * serialize().
+     */
+    static ShaderReflection deserialize(std::istream &in);
+};
+}
@@ -6,6 +6,7 @@ enum class ShaderStage
 {
     VERTEX,
     FRAGMENT,
+    COMPUTE,
 };
 
 inline const char * to_string(const ShaderStage stage)
@@ -14,6 +15,7 @@ inline const char * to_string(const ShaderStage stage)
     {
         case ShaderStage::VERTEX: return "Vertex";
 		case ShaderStage::FRAGMENT: return "Fragment";
+        case ShaderStage::COMPUTE: return "Compute";
         default: throw std::runtime_error("Invalid shader stage");
     }
 }
@@ -0,0 +1,53 @@
+﻿#include "ShaderVariants.hpp"
+
+usagi::ShaderVariants::ShaderVariants(
+    std::string name,
+    std::string glsl_source_code,
+    const ShaderStage stage,
+    ShaderCompiler compiler)
+    : mName(std::move(name))
+    , mSource(std::move(glsl_source_code))
+    , mStage(stage)
+    , mCompiler(std::move(compiler))
+{
+}
+
+std::shared_ptr<usagi::SpirvBinary> usagi::ShaderVariants::variant(
+    const ShaderDefines &defines)
+{
+    std::lock_guard<std::mutex> lock(mLock);
+
+    auto &binary = mVariants[defines];
+    if(!binary)
+    {
+        ShaderSource source;
+        source.name = mName;
+        source.code = mSource;
+        source.stage = mStage;
+        source.options.defines = defines;
+        binary = mCompiler.compile(source);
+    }
+    return binary;
+}
+
+void usagi::ShaderVariants::prepare(const std::vector<ShaderDefines> &variants)
+{
+    std::lock_guard<std::mutex> lock(mLock);
+
+    std::vector<ShaderSource> sources;
+    for(auto &&defines : variants)
+    {
+        if(mVariants[defines]) continue;
+
+        ShaderSource source;
+        source.name = mName;
+        source.code = mSource;
+        source.stage = mStage;
+        source.options.defines = defines;
+        sources.push_back(std::move(source));
+    }
+
+    auto binaries = mCompiler.compile(sources);
+    for(std::size_t i = 0; i < sources.size(); ++i)
+        mVariants[sources[i].options.defines] = std::move(binaries[i]);
+}
@@ -0,0 +1,59 @@
+﻿#pragma once
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <Usagi/Utility/Noncopyable.hpp>
+
+#include "ShaderCompiler.hpp"
+
+namespace usagi
+{
+/**
+ * \brief The permutations of a GLSL source selected by preprocessor defines.
+ * Each permutation is compiled once when first requested and shared
+ * afterwards.
+ *
+ * Prefer specialization constants (see
+ * GraphicsPipelineCompiler::setSpecializationConstant()) for toggles which
+ * only change control flow or constant values, since they are applied when
+ * creating the pipelines and do not need another binary. Defines are
+ * needed when the declarations, such as the resource bindings, differ.
+ */
+class ShaderVariants : Noncopyable
+{
+    std::string mName;
+    std::string mSource;
+    ShaderStage mStage;
+    ShaderCompiler mCompiler;
+
+    std::mutex mLock;
+    std::map<ShaderDefines, std::shared_ptr<SpirvBinary>> mVariants;
+
+public:
+    ShaderVariants(
+        std::string name,
+        std::string glsl_source_code,
+        ShaderStage stage,
+        ShaderCompiler compiler = ShaderCompiler { });
+
+    /**
+     * \brief Get the binary compiled with the defines. Thread-safe.
+     * \param defines
+     * \return
+     */
+    std::shared_ptr<SpirvBinary> variant(const ShaderDefines &defines = { });
+
+    /**
+     * \brief Compile the variants not yet built in parallel, so they are
+     * ready before being requested. Thread-safe.
+     * \param variants
+     */
+    void prepare(const std::vector<ShaderDefines> &variants);
+
+    ShaderStage stage() const { return mStage; }
+};
+}
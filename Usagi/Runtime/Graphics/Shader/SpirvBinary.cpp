@@ -4,22 +4,20 @@
 #include <cstring>
 #include <iostream>
 
-#include <glslang/glslang/Public/ShaderLang.h>
-#include <glslang/ResourceLimits.h>
-#include <glslang/SPIRV/GlslangToSpv.h>
-#include <glslang/SPIRV/disassemble.h>
-
 #include <Usagi/Core/Logging.hpp>
 #include <Usagi/Utility/RAIIHelper.hpp>
 #include <Usagi/Utility/File.hpp>
-#include <Usagi/Utility/Hash.hpp>
 #include <Usagi/Utility/Stream.hpp>
 
+#include "ShaderCompiler.hpp"
+
 // See https://www.khronos.org/registry/spir-v/papers/WhitePaper.html for
 // SPIR-V format.
-usagi::SpirvBinary::SpirvBinary(std::vector<std::uint32_t> bytecodes)
+usagi::SpirvBinary::SpirvBinary(
+    std::vector<std::uint32_t> bytecodes,
+    std::unique_ptr<ShaderReflection> reflection)
     : mBytecodes { std::move(bytecodes) }
-    , mReflectionCompiler { mBytecodes }
+    , mReflection { std::move(reflection) }
 {
     // check header magic code
     if(mBytecodes.empty() || mBytecodes.front() != 0x07230203)
@@ -27,6 +25,16 @@ usagi::SpirvBinary::SpirvBinary(std::vector<std::uint32_t> bytecodes)
             "Not valid SPIR-V binary: header magic code does not match.");
 }
 
+const usagi::ShaderReflection & usagi::SpirvBinary::reflection() const
+{
+    std::call_once(mReflectionFlag, [this]() {
+        if(!mReflection)
+            mReflection = std::make_unique<ShaderReflection>(
+                ShaderReflection::reflect(mBytecodes));
+    });
+    return *mReflection;
+}
+
 namespace fs = std::filesystem;
 
 void usagi::SpirvBinary::dumpBytecodeBitstream(std::ostream &output)
@@ -50,7 +58,35 @@ std::shared_ptr<usagi::SpirvBinary> usagi::SpirvBinary::fromFile(
     content.resize(size / sizeof(Bytecode));
     file.read(reinterpret_cast<char*>(content.data()), size);
 
-    return std::make_shared<SpirvBinary>(std::move(content));
+    std::unique_ptr<ShaderReflection> reflection;
+    auto reflection_path = binary_path;
+    reflection_path.replace_extension(".refl");
+    if(exists(reflection_path))
+    {
+        try
+        {
+            std::ifstream in(reflection_path, std::ios::binary);
+            reflection = std::make_unique<ShaderReflection>(
+                ShaderReflection::deserialize(in));
+        }
+        catch(const std::exception &e)
+        {
+            LOG(warn, "Ignored shader reflection data {}: {}",
+                reflection_path, e.what());
+        }
+    }
+
+    return std::make_shared<SpirvBinary>(
+        std::move(content), std::move(reflection));
+}
+
+void usagi::SpirvBinary::saveReflection(const fs::path &binary_path) const
+{
+    auto reflection_path = binary_path;
+    reflection_path.replace_extension(".refl");
+    std::ofstream out(reflection_path, std::ios::binary);
+    out.exceptions(std::ofstream::badbit | std::ofstream::failbit);
+    reflection().serialize(out);
 }
 
 std::shared_ptr<usagi::SpirvBinary> usagi::SpirvBinary::fromStream(
@@ -77,149 +113,41 @@ std::shared_ptr<usagi::SpirvBinary> usagi::SpirvBinary::fromStream(
     return std::make_shared<SpirvBinary>(std::move(content));
 }
 
-namespace
-{
-EShLanguage translate(const usagi::ShaderStage stage)
-{
-    switch(stage)
-    {
-        case usagi::ShaderStage::VERTEX: return EShLangVertex;
-        case usagi::ShaderStage::FRAGMENT: return EShLangFragment;
-        default: throw std::runtime_error("Invalid shader stage.");
-    }
-}
-}
-
-// refer to glslangValidator source code
 std::shared_ptr<usagi::SpirvBinary> usagi::SpirvBinary::fromGlslSourceString(
     const std::string &glsl_source_code,
     const ShaderStage stage,
-    const std::optional<std::filesystem::path> & cache_folder)
+    const std::optional<std::filesystem::path> & cache_folder,
+    const ShaderDefines &defines)
 {
-    LOG(info, "Compiling {} shader...", to_string(stage));
-
-    std::filesystem::path cache_file;
-    if(cache_folder)
-    {
-        cache_file = cache_folder.value();
-        create_directories(cache_file);
-        cache_file /= sha256(glsl_source_code);
-        cache_file += ".spv";
-
-        // try loading from cache
-        try
-        {
-            auto cache = fromFile(cache_file);
-            LOG(info, "Shader loaded from cache {}", cache_file);
-            return std::move(cache);
-        }
-        catch(const std::exception &e)
-        {
-            LOG(warn, "Could not load the shader from cache: {}, {}",
-                e.what(), strerror(errno));
-        }
-        catch(...)
-        {
-            LOG(error,
-                "Unknown error occurred while loading the shader from cache.");
-        }
-    }
-
-    using namespace glslang;
-    using namespace spv;
-
-    // default Vulkan version
-    const auto client_input_semantics_version = 100;
-    const auto vulkan_client_version = EShTargetVulkan_1_0;
-    // doesn't influence anything yet, but maps to OpenGL 4.50
-    const auto opengl_client_version = EShTargetOpenGL_450;
-    const auto target_version = EShTargetSpv_1_0;
-    const auto default_version = 110; // defaults to desktop version
-    const auto glslang_stage = translate(stage);
-    const auto messages = EShMsgDefault;
-
-    RAIIHelper glslang_process {
-        []() { InitializeProcess(); },
-        []() { FinalizeProcess(); }
-    };
-    // shader must be released after program because the program may reference
-    // the shaders.
-    TShader shader(glslang_stage);
-    TProgram program;
-    TBuiltInResource resources = DefaultTBuiltInResource;
-
-    const char *strings[] = { glsl_source_code.data() };
-    const int sizes[] = { static_cast<int>(glsl_source_code.size()) };
-    shader.setStringsWithLengths(strings, sizes, 1);
-
-    shader.setEnvInput(EShSourceGlsl, glslang_stage, EShClientVulkan,
-        client_input_semantics_version);
-    shader.setEnvClient(EShClientVulkan, vulkan_client_version);
-    shader.setEnvTarget(EShTargetSpv, target_version);
-
-    TShader::ForbidIncluder includer;
-    const auto compilation_suceeded =
-        shader.parse(&resources, default_version, false, messages, includer);
-
-    if(shader.getInfoLog()[0])
-        LOG(info, "Compiler output:\n{}", shader.getInfoLog());
-    if(shader.getInfoDebugLog()[0])
-        LOG(info, "Compiler debug output:\n{}", shader.getInfoDebugLog());
-
-    program.addShader(&shader);
-
-    const auto link_succeeded = program.link(messages) && program.mapIO();
-
-    if(program.getInfoLog()[0])
-        LOG(info, "Linker output:\n{}", program.getInfoLog());
-	if(program.getInfoDebugLog()[0])
-        LOG(info, "Linker debug output:\n{}", program.getInfoDebugLog());
-
-    if(!compilation_suceeded || !link_succeeded)
-        throw std::runtime_error("Shader compilation failed.");
-
-    program.buildReflection();
-	LOG(info, "Reflection database:");
-	program.dumpReflection();
-
-    // Generate SPIR-V code
-    std::vector<Bytecode> spirv;
-    std::string warnings_errors;
-    SpvBuildLogger logger;
-    SpvOptions spv_options;
-    spv_options.generateDebugInfo = true;
-    spv_options.disableOptimizer = false;
-    spv_options.optimizeSize = false;
-
-    GlslangToSpv(*program.getIntermediate(glslang_stage), spirv, &logger,
-        &spv_options);
-	// LOG(info, "Disassembly:");
-    // Disassemble(std::cout, spirv);
-
-    // save bytecode to cache
-    if(cache_folder)
-    {
-        LOG(info, "Saving snader cache to {}", cache_file);
-        dumpBinary(cache_file, spirv.data(), spirv.size() * sizeof(Bytecode));
-    }
-
-    return std::make_shared<SpirvBinary>(std::move(spirv));
+    ShaderSource source;
+    source.code = glsl_source_code;
+    source.stage = stage;
+    source.options.defines = defines;
+    return ShaderCompiler(cache_folder).compile(source);
 }
 
 std::shared_ptr<usagi::SpirvBinary> usagi::SpirvBinary::fromGlslSourceFile(
     const fs::path &glsl_source_path,
     const ShaderStage stage,
-    const std::optional<std::filesystem::path> & cache_folder)
+    const std::optional<std::filesystem::path> & cache_folder,
+    const ShaderDefines &defines)
 {
-    return fromGlslSourceString(
-        readFileAsString(glsl_source_path), stage, cache_folder);
+    ShaderSource source;
+    source.name = glsl_source_path.u8string();
+    source.code = readFileAsString(glsl_source_path);
+    source.stage = stage;
+    source.options.defines = defines;
+    return ShaderCompiler(cache_folder, ShaderCompiler::fileIncludeResolver())
+        .compile(source);
 }
 
 std::shared_ptr<usagi::SpirvBinary> usagi::SpirvBinary::fromGlslSourceStream(
     std::istream &glsl_source_stream,
     const ShaderStage stage,
-    const std::optional<std::filesystem::path> & cache_folder)
+    const std::optional<std::filesystem::path> & cache_folder,
+    const ShaderDefines &defines)
 {
     return fromGlslSourceString(
-        readStreamAsString(glsl_source_stream), stage, cache_folder);
+        readStreamAsString(glsl_source_stream), stage, cache_folder,
+        defines);
 }
@@ -3,14 +3,21 @@
 #include <vector>
 #include <filesystem>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <optional>
 
-#include <spirv_cross.hpp>
-
+#include "ShaderReflection.hpp"
 #include "ShaderStage.hpp"
 
 namespace usagi
 {
+/**
+ * \brief Preprocessor macros defined before the GLSL source, from names to
+ * values. Ordered so that the same set always produces the same code.
+ */
+using ShaderDefines = std::map<std::string, std::string>;
+
 /**
  * \brief SPIR-V bytecode container. Used to derive shaders fed to the driver,
  * and can be disposed after that.
@@ -23,42 +30,71 @@ public:
 
 private:
     std::vector<Bytecode> mBytecodes;
-    spirv_cross::Compiler mReflectionCompiler;
-
-    struct ConstantFieldInfo
-    {
-        std::size_t size;
-        std::uint32_t offset;
-    };
 
-    std::map<std::string, ConstantFieldInfo> mConstantFieldInfoMap;
+    mutable std::once_flag mReflectionFlag;
+    mutable std::unique_ptr<ShaderReflection> mReflection;
 
 public:
-    explicit SpirvBinary(std::vector<Bytecode> bytecodes);
+    /**
+     * \brief
+     * \param bytecodes
+     * \param reflection If not provided, it is extracted from the bytecodes
+     * when first requested.
+     */
+    explicit SpirvBinary(
+        std::vector<Bytecode> bytecodes,
+        std::unique_ptr<ShaderReflection> reflection = { });
 
     const std::vector<Bytecode> & bytecodes() const { return mBytecodes; }
     void dumpBytecodeBitstream(std::ostream &output);
 
-    const spirv_cross::Compiler & reflectionCompiler() const
-    {
-        return mReflectionCompiler;
-    }
+    /**
+     * \brief Thread-safe.
+     */
+    const ShaderReflection & reflection() const;
 
+    /**
+     * \brief Load a SPIR-V binary. The reflection data is loaded from the
+     * file with the same name and the extension replaced by .refl if it
+     * exists (see saveReflection()).
+     * \param binary_path
+     * \return
+     */
     static std::shared_ptr<SpirvBinary> fromFile(
         const std::filesystem::path &binary_path);
+    /**
+     * \brief Save the reflection data next to the binary file.
+     * \param binary_path
+     */
+    void saveReflection(const std::filesystem::path &binary_path) const;
     static std::shared_ptr<SpirvBinary> fromStream(
         std::istream &glsl_source_stream);
+    /**
+     * \brief Compile GLSL source code.
+     * \param glsl_source_code
+     * \param stage
+     * \param cache_folder If provided, the binary is cached by the source
+     * and the defines.
+     * \param defines Selects a variant of the source. Use ShaderVariants to
+     * share the variants of a source.
+     * \see ShaderCompiler for compiling with #include support and in
+     * batches.
+     * \return
+     */
     static std::shared_ptr<SpirvBinary> fromGlslSourceString(
         const std::string &glsl_source_code,
         ShaderStage stage,
-        const std::optional<std::filesystem::path> & cache_folder = { });
+        const std::optional<std::filesystem::path> & cache_folder = { },
+        const ShaderDefines &defines = { });
     static std::shared_ptr<SpirvBinary> fromGlslSourceFile(
         const std::filesystem::path &glsl_source_path,
         ShaderStage stage,
-        const std::optional<std::filesystem::path> & cache_folder = { });
+        const std::optional<std::filesystem::path> & cache_folder = { },
+        const ShaderDefines &defines = { });
     static std::shared_ptr<SpirvBinary> fromGlslSourceStream(
         std::istream &glsl_source_stream,
         ShaderStage stage,
-        const std::optional<std::filesystem::path> & cache_folder = { });
+        const std::optional<std::filesystem::path> & cache_folder = { },
+        const ShaderDefines &defines = { });
 };
 }
@@ -0,0 +1,98 @@
+﻿#pragma once
+
+#include <vector>
+
+#include "FrameArena.hpp"
+
+namespace usagi
+{
+/**
+ * \brief STL allocator adapter over LinearArena. Deallocation is a no-op,
+ * the memory is reclaimed when the arena is reset.
+ */
+template <typename T>
+class ArenaAllocator
+{
+    template <typename U> friend class ArenaAllocator;
+
+    LinearArena *mArena = nullptr;
+
+public:
+    using value_type = T;
+
+    explicit ArenaAllocator(LinearArena *arena) noexcept
+        : mArena(arena)
+    {
+    }
+
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U> &other) noexcept
+        : mArena(other.mArena)
+    {
+    }
+
+    T * allocate(const std::size_t n)
+    {
+        return static_cast<T*>(mArena->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T *, std::size_t) noexcept
+    {
+    }
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U> &other) const noexcept
+    {
+        return mArena == other.mArena;
+    }
+
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U> &other) const noexcept
+    {
+        return mArena != other.mArena;
+    }
+};
+
+/**
+ * \brief STL allocator using the frame arena of the calling thread. The
+ * containers using it must not live longer than the current frame.
+ */
+template <typename T>
+class FrameAllocator
+{
+public:
+    using value_type = T;
+
+    FrameAllocator() noexcept = default;
+
+    template <typename U>
+    FrameAllocator(const FrameAllocator<U> &) noexcept
+    {
+    }
+
+    T * allocate(const std::size_t n)
+    {
+        return static_cast<T*>(
+            FrameArena::allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T *, std::size_t) noexcept
+    {
+    }
+
+    template <typename U>
+    bool operator==(const FrameAllocator<U> &) const noexcept
+    {
+        return true;
+    }
+
+    template <typename U>
+    bool operator!=(const FrameAllocator<U> &) const noexcept
+    {
+        return false;
+    }
+};
+
+template <typename T>
+using FrameVector = std::vector<T, FrameAllocator<T>>;
+}
@@ -3,6 +3,7 @@
 #include <algorithm>
 
 #include <Usagi/Utility/Rounding.hpp>
+#include <Usagi/Runtime/Memory/MemoryTracker.hpp>
 
 namespace usagi
 {
@@ -40,10 +41,27 @@ std::size_t BitmapMemoryAllocator::usableSize() const
     return mBlockSize * std::count(mBitmap.begin(), mBitmap.end(), BLOCK_FREE);
 }
 
+std::size_t BitmapMemoryAllocator::largestFreeBlockSize() const
+{
+    std::size_t largest = 0, current = 0;
+    for(auto &&b : mBitmap)
+    {
+        current = b == BLOCK_FREE ? current + 1 : 0;
+        largest = std::max(largest, current);
+    }
+    return largest * mBlockSize;
+}
+
+void BitmapMemoryAllocator::setMemoryTag(std::shared_ptr<MemoryTag> tag)
+{
+    mMemoryTag = std::move(tag);
+}
+
 void BitmapMemoryAllocator::markBlocksAllocated(
     std::string::iterator begin,
     std::string::iterator end)
 {
+    if(mMemoryTag) mMemoryTag->recordAllocation((end - begin) * mBlockSize);
     *begin = BLOCK_USED_BEGIN;
     std::fill(++begin, end, BLOCK_USED);
 }
@@ -102,7 +120,12 @@ void BitmapMemoryAllocator::deallocate(void *pointer)
     auto iter = mBitmap.begin() + block;
     assert(*iter == BLOCK_USED_BEGIN);
     *iter = BLOCK_FREE;
-    while(*++iter == BLOCK_USED)
+    std::size_t num_blocks = 1;
+    while(++iter != mBitmap.end() && *iter == BLOCK_USED)
+    {
         *iter = BLOCK_FREE;
+        ++num_blocks;
+    }
+    if(mMemoryTag) mMemoryTag->recordDeallocation(num_blocks * mBlockSize);
 }
 }
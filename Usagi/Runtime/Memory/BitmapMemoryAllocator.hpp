@@ -1,11 +1,14 @@
 ﻿#pragma once
 
+#include <memory>
 #include <mutex>
 
 #include <Usagi/Utility/Noncopyable.hpp>
 
 namespace usagi
 {
+class MemoryTag;
+
 /**
  * \brief A thread-safe bitmap allocator for managing remote memory.
  */
@@ -24,6 +27,8 @@ class BitmapMemoryAllocator : Noncopyable
     std::string mBitmap;
     std::mutex mBitmapLock;
 
+    std::shared_ptr<MemoryTag> mMemoryTag;
+
     std::size_t getAddressBlock(std::size_t address) const;
     void markBlocksAllocated(
         std::string::iterator begin,
@@ -49,6 +54,12 @@ public:
     std::size_t managedSize() const { return mTotalSize; }
     std::size_t usableSize() const;
     std::size_t usedSize() const { return managedSize() - usableSize(); }
+    std::size_t largestFreeBlockSize() const;
+
+    /**
+     * \brief Report allocations to the tag. Not thread-safe.
+     */
+    void setMemoryTag(std::shared_ptr<MemoryTag> tag);
 
     void * allocate(std::size_t num_bytes, std::size_t alignment = 0);
     void deallocate(void *pointer);
@@ -0,0 +1,73 @@
+﻿#include "FrameArena.hpp"
+
+#include "MemoryTracker.hpp"
+
+std::atomic<std::uint64_t> usagi::FrameArena::mFrameIndex { 0 };
+std::atomic<std::size_t> usagi::FrameArena::mNumAllocations { 0 };
+std::atomic<std::size_t> usagi::FrameArena::mNumHeapAllocations { 0 };
+std::atomic<std::size_t> usagi::FrameArena::mUsedBytes { 0 };
+usagi::FrameArenaStatistics usagi::FrameArena::mLastFrameStatistics;
+
+namespace
+{
+struct ThreadFrameArena
+{
+    usagi::LinearArena arena;
+    std::uint64_t frame = 0;
+};
+
+thread_local ThreadFrameArena gThreadArena;
+}
+
+usagi::MemoryTag * usagi::FrameArena::memoryTag()
+{
+    static const auto tag = MemoryTracker::registerTag(
+        "FrameArena", MemoryTagCategory::CPU_ALLOCATOR);
+    return tag.get();
+}
+
+usagi::LinearArena & usagi::FrameArena::current()
+{
+    const auto frame = mFrameIndex.load(std::memory_order_acquire);
+    if(gThreadArena.frame != frame)
+    {
+        gThreadArena.arena.reset();
+        gThreadArena.frame = frame;
+    }
+    return gThreadArena.arena;
+}
+
+void * usagi::FrameArena::allocate(
+    const std::size_t num_bytes,
+    const std::size_t alignment)
+{
+    auto &arena = current();
+    const auto heap_allocs = arena.numHeapAllocations();
+    const auto ptr = arena.allocate(num_bytes, alignment);
+    mNumAllocations.fetch_add(1, std::memory_order_relaxed);
+    mUsedBytes.fetch_add(num_bytes, std::memory_order_relaxed);
+    if(arena.numHeapAllocations() != heap_allocs)
+        mNumHeapAllocations.fetch_add(1, std::memory_order_relaxed);
+    if(MemoryTracker::enabled())
+        memoryTag()->recordAllocation(num_bytes);
+    return ptr;
+}
+
+void usagi::FrameArena::nextFrame()
+{
+    mLastFrameStatistics.num_allocations = mNumAllocations.exchange(0);
+    mLastFrameStatistics.num_heap_allocations =
+        mNumHeapAllocations.exchange(0);
+    mLastFrameStatistics.used_bytes = mUsedBytes.exchange(0);
+    // everything allocated in the frame is freed at once
+    if(MemoryTracker::enabled())
+        memoryTag()->recordDeallocation(
+            mLastFrameStatistics.used_bytes,
+            mLastFrameStatistics.num_allocations);
+    mFrameIndex.fetch_add(1, std::memory_order_release);
+}
+
+usagi::FrameArenaStatistics usagi::FrameArena::lastFrameStatistics()
+{
+    return mLastFrameStatistics;
+}
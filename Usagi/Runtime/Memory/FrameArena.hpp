@@ -0,0 +1,64 @@
+﻿#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+#include "LinearArena.hpp"
+
+namespace usagi
+{
+class MemoryTag;
+
+struct FrameArenaStatistics
+{
+    std::size_t num_allocations = 0;
+    std::size_t num_heap_allocations = 0;
+    std::size_t used_bytes = 0;
+};
+
+/**
+ * \brief Per-thread linear arenas whose content lives till the end of
+ * current frame. nextFrame() is called by the game loop after each frame,
+ * after which each thread resets its arena upon first using it in the new
+ * frame.
+ *
+ * Memory obtained from the arena of a thread must not be used after the
+ * frame ends, and the allocation must be done by the thread owning it,
+ * though the memory can be accessed by other threads.
+ */
+class FrameArena
+{
+    static std::atomic<std::uint64_t> mFrameIndex;
+
+    static std::atomic<std::size_t> mNumAllocations;
+    static std::atomic<std::size_t> mNumHeapAllocations;
+    static std::atomic<std::size_t> mUsedBytes;
+    static FrameArenaStatistics mLastFrameStatistics;
+
+    static MemoryTag * memoryTag();
+
+public:
+    /**
+     * \brief Get the arena of the calling thread.
+     */
+    static LinearArena & current();
+
+    static void * allocate(std::size_t num_bytes,
+        std::size_t alignment = alignof(std::max_align_t));
+
+    /**
+     * \brief Invalidate all memory allocated in the current frame.
+     */
+    static void nextFrame();
+
+    static std::uint64_t frameIndex() { return mFrameIndex; }
+
+    /**
+     * \brief Allocation counts of the last finished frame from all threads.
+     * A heap allocation happens when a thread runs out of the capacity of
+     * its arena.
+     */
+    static FrameArenaStatistics lastFrameStatistics();
+};
+}
@@ -0,0 +1,83 @@
+﻿#include "LinearArena.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <Usagi/Utility/BitHack.hpp>
+#include <Usagi/Utility/Rounding.hpp>
+
+usagi::LinearArena::LinearArena(const std::size_t min_chunk_size)
+    : mMinChunkSize { min_chunk_size }
+{
+    if(!min_chunk_size)
+        throw std::invalid_argument("chunk size must be positive");
+}
+
+void usagi::LinearArena::addChunk(const std::size_t size)
+{
+    Chunk chunk;
+    chunk.size = std::max(size, mMinChunkSize);
+    chunk.memory = std::make_unique<char[]>(chunk.size);
+    mChunks.push_back(std::move(chunk));
+    mCursor = 0;
+    ++mNumHeapAllocations;
+}
+
+void * usagi::LinearArena::allocate(
+    const std::size_t num_bytes,
+    const std::size_t alignment)
+{
+    if(!utility::isPowerOfTwo(alignment))
+        throw std::invalid_argument("alignment must be a power of two");
+
+    const auto size = std::max<std::size_t>(num_bytes, 1);
+    ++mNumAllocations;
+    mUsedBytes += size;
+
+    if(!mChunks.empty())
+    {
+        const auto &chunk = mChunks.back();
+        const auto base = reinterpret_cast<std::size_t>(chunk.memory.get());
+        const auto aligned = utility::roundUpUnsigned(
+            base + mCursor, alignment) - base;
+        if(aligned + size <= chunk.size)
+        {
+            mCursor = aligned + size;
+            return chunk.memory.get() + aligned;
+        }
+    }
+    // new[] only guarantees the fundamental alignment, reserve the padding
+    // for over-aligned allocations.
+    const auto padding = alignment > alignof(std::max_align_t)
+        ? alignment : 0;
+    addChunk(std::max(size + padding,
+        mChunks.empty() ? 0 : mChunks.back().size * 2));
+    const auto &chunk = mChunks.back();
+    const auto base = reinterpret_cast<std::size_t>(chunk.memory.get());
+    const auto aligned = utility::roundUpUnsigned(base, alignment) - base;
+    mCursor = aligned + size;
+    return chunk.memory.get() + aligned;
+}
+
+void usagi::LinearArena::reset()
+{
+    if(mChunks.size() > 1)
+    {
+        // merge the chunks so the next round fits in one chunk
+        const auto total = capacity();
+        mChunks.clear();
+        addChunk(total);
+    }
+    mCursor = 0;
+    mNumAllocations = 0;
+    mNumHeapAllocations = 0;
+    mUsedBytes = 0;
+}
+
+std::size_t usagi::LinearArena::capacity() const
+{
+    std::size_t total = 0;
+    for(auto &&c : mChunks)
+        total += c.size;
+    return total;
+}
@@ -0,0 +1,60 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include <Usagi/Utility/Noncopyable.hpp>
+
+namespace usagi
+{
+/**
+ * \brief A bump allocator for short-lived allocations. Memory is released
+ * all at once by reset(). Not thread-safe.
+ *
+ * Memory is obtained from the heap in chunks. When more than one chunk was
+ * used between two resets, they are merged into a single chunk on reset()
+ * so that the steady state of a workload does not allocate from the heap.
+ */
+class LinearArena : Noncopyable
+{
+    struct Chunk
+    {
+        std::unique_ptr<char[]> memory;
+        std::size_t size = 0;
+    };
+
+    std::vector<Chunk> mChunks;
+    std::size_t mCursor = 0;
+    const std::size_t mMinChunkSize = 0;
+
+    // Statistics since last reset
+
+    std::size_t mNumAllocations = 0;
+    std::size_t mNumHeapAllocations = 0;
+    std::size_t mUsedBytes = 0;
+
+    void addChunk(std::size_t size);
+
+public:
+    explicit LinearArena(std::size_t min_chunk_size = 64 * 1024);
+
+    /**
+     * \brief Never returns nullptr. Allocations of zero bytes get a unique
+     * address.
+     * \param alignment Must be a power of two.
+     */
+    void * allocate(std::size_t num_bytes,
+        std::size_t alignment = alignof(std::max_align_t));
+
+    /**
+     * \brief Invalidate all allocations.
+     */
+    void reset();
+
+    std::size_t capacity() const;
+    std::size_t numAllocations() const { return mNumAllocations; }
+    std::size_t numHeapAllocations() const { return mNumHeapAllocations; }
+    std::size_t usedBytes() const { return mUsedBytes; }
+};
+}
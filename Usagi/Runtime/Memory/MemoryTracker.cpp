@@ -0,0 +1,292 @@
+﻿#include "MemoryTracker.hpp"
+
+#include <algorithm>
+#include <fstream>
+
+#include <fmt/format.h>
+
+#include <Usagi/Core/Logging.hpp>
+
+std::atomic<bool> usagi::MemoryTracker::mEnabled { false };
+std::mutex usagi::MemoryTracker::mTagsLock;
+std::vector<std::weak_ptr<usagi::MemoryTag>> usagi::MemoryTracker::mTags;
+std::atomic<std::size_t> usagi::MemoryTracker::mSamplingInterval { 0 };
+std::atomic<std::size_t> usagi::MemoryTracker::mSamplingCounter { 0 };
+usagi::MemoryTracker::CallstackCaptureFunc
+    usagi::MemoryTracker::mCaptureFunc = nullptr;
+std::mutex usagi::MemoryTracker::mSamplesLock;
+std::vector<usagi::MemoryCallstackSample> usagi::MemoryTracker::mSamples;
+std::string usagi::MemoryTracker::mDumpPath;
+std::chrono::steady_clock::duration usagi::MemoryTracker::mDumpInterval { };
+std::chrono::steady_clock::time_point usagi::MemoryTracker::mLastDump;
+
+namespace
+{
+thread_local std::shared_ptr<usagi::MemoryTag> gCurrentScope;
+}
+
+const char * usagi::to_string(const MemoryTagCategory category)
+{
+    switch(category)
+    {
+        case MemoryTagCategory::SUBSYSTEM: return "subsystem";
+        case MemoryTagCategory::CPU_ALLOCATOR: return "cpu_allocator";
+        case MemoryTagCategory::GPU_POOL: return "gpu_pool";
+        default: return "unknown";
+    }
+}
+
+usagi::MemoryTag::MemoryTag(std::string name, const MemoryTagCategory category)
+    : mName(std::move(name))
+    , mCategory(category)
+{
+}
+
+void usagi::MemoryTag::doRecordAllocation(const std::size_t bytes)
+{
+    const auto size = static_cast<std::int64_t>(bytes);
+    const auto current = mCurrentBytes.fetch_add(
+        size, std::memory_order_relaxed) + size;
+    auto peak = mPeakBytes.load(std::memory_order_relaxed);
+    while(current > peak && !mPeakBytes.compare_exchange_weak(
+        peak, current, std::memory_order_relaxed))
+        ;
+    mCurrentAllocations.fetch_add(1, std::memory_order_relaxed);
+    mTotalAllocations.fetch_add(1, std::memory_order_relaxed);
+
+    if(mCategory == MemoryTagCategory::CPU_ALLOCATOR)
+        MemoryTracker::sampleCallstack(this, bytes);
+}
+
+void usagi::MemoryTag::doRecordDeallocation(
+    const std::size_t bytes,
+    const std::size_t count)
+{
+    mCurrentBytes.fetch_sub(bytes, std::memory_order_relaxed);
+    mCurrentAllocations.fetch_sub(count, std::memory_order_relaxed);
+}
+
+void usagi::MemoryTag::setRegionUsageQuery(
+    std::function<MemoryRegionUsage()> query)
+{
+    std::lock_guard<std::mutex> lock(mQueryLock);
+    mRegionUsageQuery = std::move(query);
+}
+
+usagi::MemoryTagStatistics usagi::MemoryTag::statistics()
+{
+    MemoryTagStatistics stats;
+    stats.name = mName;
+    stats.category = mCategory;
+    stats.current_bytes = mCurrentBytes;
+    stats.peak_bytes = mPeakBytes;
+    stats.current_allocations = mCurrentAllocations;
+    stats.total_allocations = mTotalAllocations;
+
+    std::lock_guard<std::mutex> lock(mQueryLock);
+    if(mRegionUsageQuery)
+    {
+        stats.has_region_usage = true;
+        stats.region_usage = mRegionUsageQuery();
+        if(stats.region_usage.free_bytes)
+            stats.fragmentation = 1.0 -
+                double(stats.region_usage.largest_free_block) /
+                stats.region_usage.free_bytes;
+    }
+    return stats;
+}
+
+void usagi::MemoryTracker::setEnabled(const bool enabled)
+{
+    mEnabled = enabled;
+}
+
+std::shared_ptr<usagi::MemoryTag> usagi::MemoryTracker::registerTag(
+    std::string name,
+    const MemoryTagCategory category)
+{
+    auto tag = std::make_shared<MemoryTag>(std::move(name), category);
+
+    std::lock_guard<std::mutex> lock(mTagsLock);
+    // remove expired entries
+    mTags.erase(std::remove_if(mTags.begin(), mTags.end(),
+        [](auto &&t) { return t.expired(); }), mTags.end());
+    mTags.push_back(tag);
+    return tag;
+}
+
+const std::shared_ptr<usagi::MemoryTag> & usagi::MemoryTracker::currentScope()
+{
+    return gCurrentScope;
+}
+
+std::vector<usagi::MemoryTagStatistics> usagi::MemoryTracker::snapshot()
+{
+    std::vector<std::shared_ptr<MemoryTag>> tags;
+    {
+        std::lock_guard<std::mutex> lock(mTagsLock);
+        for(auto &&t : mTags)
+            if(auto tag = t.lock())
+                tags.push_back(std::move(tag));
+    }
+    std::vector<MemoryTagStatistics> stats;
+    stats.reserve(tags.size());
+    for(auto &&t : tags)
+        stats.push_back(t->statistics());
+    return stats;
+}
+
+void usagi::MemoryTracker::sampleCallstack(
+    const MemoryTag *tag,
+    const std::size_t bytes)
+{
+    const auto interval = mSamplingInterval.load(std::memory_order_relaxed);
+    if(!interval || !mCaptureFunc) return;
+    if(mSamplingCounter.fetch_add(1, std::memory_order_relaxed)
+        % interval != 0) return;
+
+    void *frames[32];
+    const auto num_frames = mCaptureFunc(frames, std::size(frames));
+
+    std::lock_guard<std::mutex> lock(mSamplesLock);
+    auto iter = std::find_if(mSamples.begin(), mSamples.end(),
+        [&](const MemoryCallstackSample &s) {
+            return s.tag == tag->name() && s.frames.size() == num_frames &&
+                std::equal(s.frames.begin(), s.frames.end(), frames);
+        }
+    );
+    if(iter == mSamples.end())
+    {
+        MemoryCallstackSample sample;
+        sample.tag = tag->name();
+        sample.frames.assign(frames, frames + num_frames);
+        mSamples.push_back(std::move(sample));
+        iter = mSamples.end() - 1;
+    }
+    ++iter->num_samples;
+    iter->sampled_bytes += bytes;
+}
+
+void usagi::MemoryTracker::setCallstackSampling(const std::size_t interval)
+{
+    mSamplingInterval = interval;
+}
+
+void usagi::MemoryTracker::setCallstackCaptureFunc(
+    const CallstackCaptureFunc func)
+{
+    mCaptureFunc = func;
+}
+
+std::vector<usagi::MemoryCallstackSample>
+    usagi::MemoryTracker::callstackSamples()
+{
+    std::lock_guard<std::mutex> lock(mSamplesLock);
+    return mSamples;
+}
+
+namespace
+{
+std::string escapeJsonString(const std::string &str)
+{
+    std::string result;
+    result.reserve(str.size());
+    for(auto &&c : str)
+    {
+        switch(c)
+        {
+            case '"': result += "\\\""; break;
+            case '\\': result += "\\\\"; break;
+            case '\n': result += "\\n"; break;
+            default:
+                if(static_cast<unsigned char>(c) < 0x20)
+                    result += fmt::format("\\u{:04x}", int(c));
+                else
+                    result += c;
+        }
+    }
+    return result;
+}
+}
+
+std::string usagi::MemoryTracker::toJson()
+{
+    std::string out;
+    out += fmt::format("{{\n  \"enabled\": {},\n  \"tags\": [", enabled());
+
+    const auto stats = snapshot();
+    for(std::size_t i = 0; i < stats.size(); ++i)
+    {
+        auto &&s = stats[i];
+        out += fmt::format(
+            "{}\n    {{ \"name\": \"{}\", \"category\": \"{}\", "
+            "\"current_bytes\": {}, \"peak_bytes\": {}, "
+            "\"current_allocations\": {}, \"total_allocations\": {}",
+            i ? "," : "", escapeJsonString(s.name), to_string(s.category),
+            s.current_bytes, s.peak_bytes,
+            s.current_allocations, s.total_allocations);
+        if(s.has_region_usage)
+            out += fmt::format(
+                ", \"managed_bytes\": {}, \"free_bytes\": {}, "
+                "\"largest_free_block\": {}, \"fragmentation\": {}",
+                s.region_usage.managed_bytes, s.region_usage.free_bytes,
+                s.region_usage.largest_free_block, s.fragmentation);
+        out += fmt::format(" }}");
+    }
+    out += fmt::format("\n  ],\n  \"callstack_samples\": [");
+
+    const auto samples = callstackSamples();
+    for(std::size_t i = 0; i < samples.size(); ++i)
+    {
+        auto &&s = samples[i];
+        out += fmt::format(
+            "{}\n    {{ \"tag\": \"{}\", \"samples\": {}, "
+            "\"bytes\": {}, \"frames\": [",
+            i ? "," : "", escapeJsonString(s.tag),
+            s.num_samples, s.sampled_bytes);
+        for(std::size_t j = 0; j < s.frames.size(); ++j)
+            out += fmt::format("{}\"{}\"", j ? ", " : "", s.frames[j]);
+        out += fmt::format("] }}");
+    }
+    out += fmt::format("\n  ]\n}}\n");
+
+    return out;
+}
+
+void usagi::MemoryTracker::setPeriodicDump(
+    std::string path,
+    const std::chrono::steady_clock::duration interval)
+{
+    mDumpPath = std::move(path);
+    mDumpInterval = interval;
+    mLastDump = std::chrono::steady_clock::now();
+}
+
+void usagi::MemoryTracker::update()
+{
+    if(mDumpPath.empty()) return;
+
+    const auto now = std::chrono::steady_clock::now();
+    if(now - mLastDump < mDumpInterval) return;
+    mLastDump = now;
+
+    std::ofstream out(mDumpPath, std::ios::trunc);
+    if(!out)
+    {
+        LOG(error, "Failed to open memory telemetry dump file: {}",
+            mDumpPath);
+        return;
+    }
+    out << toJson();
+}
+
+usagi::MemoryTagScope::MemoryTagScope(std::shared_ptr<MemoryTag> tag)
+    : mPrevious(std::move(gCurrentScope))
+{
+    gCurrentScope = std::move(tag);
+}
+
+usagi::MemoryTagScope::~MemoryTagScope()
+{
+    gCurrentScope = std::move(mPrevious);
+}
@@ -0,0 +1,213 @@
+﻿#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <Usagi/Utility/Noncopyable.hpp>
+
+namespace usagi
+{
+enum class MemoryTagCategory
+{
+    SUBSYSTEM,
+    CPU_ALLOCATOR,
+    GPU_POOL,
+};
+
+const char * to_string(MemoryTagCategory category);
+
+/**
+ * \brief The state of the memory region managed by an allocator, used for
+ * calculating fragmentation.
+ */
+struct MemoryRegionUsage
+{
+    std::size_t managed_bytes = 0;
+    std::size_t free_bytes = 0;
+    std::size_t largest_free_block = 0;
+};
+
+struct MemoryTagStatistics
+{
+    std::string name;
+    MemoryTagCategory category = MemoryTagCategory::SUBSYSTEM;
+    std::int64_t current_bytes = 0;
+    std::int64_t peak_bytes = 0;
+    std::int64_t current_allocations = 0;
+    std::int64_t total_allocations = 0;
+    /**
+     * \brief Only available if the owner of the tag provided a region
+     * usage query.
+     */
+    bool has_region_usage = false;
+    MemoryRegionUsage region_usage;
+    /**
+     * \brief 1 - largest free block / total free bytes. 0 means all free
+     * memory is contiguous.
+     */
+    double fragmentation = 0;
+};
+
+struct MemoryCallstackSample
+{
+    std::string tag;
+    std::vector<void*> frames;
+    std::size_t num_samples = 0;
+    std::size_t sampled_bytes = 0;
+};
+
+/**
+ * \brief An accounting entry for memory allocations. Owners of the tags
+ * report allocations and deallocations, which are ignored when the tracker
+ * is disabled.
+ *
+ * Statistics are signed since deallocations of memory allocated before
+ * enabling the tracker could make them drop below zero.
+ */
+class MemoryTag : Noncopyable
+{
+    friend class MemoryTracker;
+
+    const std::string mName;
+    const MemoryTagCategory mCategory;
+
+    std::atomic<std::int64_t> mCurrentBytes { 0 };
+    std::atomic<std::int64_t> mPeakBytes { 0 };
+    std::atomic<std::int64_t> mCurrentAllocations { 0 };
+    std::atomic<std::int64_t> mTotalAllocations { 0 };
+
+    std::mutex mQueryLock;
+    std::function<MemoryRegionUsage()> mRegionUsageQuery;
+
+    void doRecordAllocation(std::size_t bytes);
+    void doRecordDeallocation(std::size_t bytes, std::size_t count);
+
+public:
+    MemoryTag(std::string name, MemoryTagCategory category);
+
+    const std::string & name() const { return mName; }
+    MemoryTagCategory category() const { return mCategory; }
+
+    inline void recordAllocation(std::size_t bytes);
+    inline void recordDeallocation(std::size_t bytes, std::size_t count = 1);
+
+    /**
+     * \brief The function is called when taking snapshots. The owner of
+     * the tag must reset the query before destructing the objects used by
+     * it.
+     */
+    void setRegionUsageQuery(std::function<MemoryRegionUsage()> query);
+
+    MemoryTagStatistics statistics();
+};
+
+/**
+ * \brief Global registry of memory tags.
+ *
+ * When disabled, recording an allocation costs one relaxed atomic load.
+ */
+class MemoryTracker
+{
+    friend class MemoryTag;
+
+    static std::atomic<bool> mEnabled;
+
+    static std::mutex mTagsLock;
+    static std::vector<std::weak_ptr<MemoryTag>> mTags;
+
+    // Callstack Sampling
+
+    using CallstackCaptureFunc = std::size_t(*)(
+        void **frames, std::size_t max_frames);
+    static std::atomic<std::size_t> mSamplingInterval;
+    static std::atomic<std::size_t> mSamplingCounter;
+    static CallstackCaptureFunc mCaptureFunc;
+    static std::mutex mSamplesLock;
+    static std::vector<MemoryCallstackSample> mSamples;
+
+    static void sampleCallstack(const MemoryTag *tag, std::size_t bytes);
+
+    // Periodic Dump
+
+    static std::string mDumpPath;
+    static std::chrono::steady_clock::duration mDumpInterval;
+    static std::chrono::steady_clock::time_point mLastDump;
+
+public:
+    static bool enabled()
+    {
+        return mEnabled.load(std::memory_order_relaxed);
+    }
+    static void setEnabled(bool enabled);
+
+    /**
+     * \brief The tag is unregistered when all references to it are
+     * released.
+     */
+    static std::shared_ptr<MemoryTag> registerTag(
+        std::string name,
+        MemoryTagCategory category);
+
+    /**
+     * \brief The tag of the innermost MemoryTagScope on the calling thread.
+     */
+    static const std::shared_ptr<MemoryTag> & currentScope();
+
+    static std::vector<MemoryTagStatistics> snapshot();
+
+    /**
+     * \brief Capture the callstack of every interval-th allocation reported
+     * by CPU allocators. Zero disables sampling. Requires a capture
+     * function to be set by the platform runtime.
+     */
+    static void setCallstackSampling(std::size_t interval);
+    static void setCallstackCaptureFunc(CallstackCaptureFunc func);
+    static std::vector<MemoryCallstackSample> callstackSamples();
+
+    static std::string toJson();
+
+    /**
+     * \brief Write toJson() to the file every interval when update() is
+     * called. An empty path disables the dump.
+     */
+    static void setPeriodicDump(
+        std::string path,
+        std::chrono::steady_clock::duration interval);
+
+    /**
+     * \brief Called by the game loop once per frame.
+     */
+    static void update();
+};
+
+/**
+ * \brief Attribute GPU resource allocations made by the current thread to
+ * the tag while the scope is alive.
+ */
+class MemoryTagScope : Noncopyable
+{
+    std::shared_ptr<MemoryTag> mPrevious;
+
+public:
+    explicit MemoryTagScope(std::shared_ptr<MemoryTag> tag);
+    ~MemoryTagScope();
+};
+
+void MemoryTag::recordAllocation(const std::size_t bytes)
+{
+    if(MemoryTracker::enabled()) doRecordAllocation(bytes);
+}
+
+void MemoryTag::recordDeallocation(
+    const std::size_t bytes,
+    const std::size_t count)
+{
+    if(MemoryTracker::enabled()) doRecordDeallocation(bytes, count);
+}
+}
@@ -0,0 +1,370 @@
+﻿#include "TlsfMemoryAllocator.hpp"
+
+#include <algorithm>
+#include <new>
+#include <stdexcept>
+
+#include <Usagi/Utility/BitHack.hpp>
+#include <Usagi/Runtime/Memory/MemoryTracker.hpp>
+#include <Usagi/Utility/Rounding.hpp>
+
+namespace usagi
+{
+TlsfMemoryAllocator::TlsfMemoryAllocator(
+    void *base,
+    const std::size_t total_size,
+    const std::size_t granularity)
+    : mBase { reinterpret_cast<std::size_t>(base) }
+    , mTotalSize { total_size - total_size % std::max<std::size_t>(
+        granularity, 1) }
+    , mGranularity { granularity }
+{
+    if(!utility::isPowerOfTwo(granularity))
+        throw std::invalid_argument(
+            "granularity must be a power of two");
+    if(mBase % granularity != 0)
+        throw std::invalid_argument(
+            "base address must be aligned to granularity");
+    if(mTotalSize == 0)
+        throw std::invalid_argument(
+            "total size cannot hold a single granule");
+
+    // sizes smaller than this are linearly mapped into the first level
+    mGranularityLog2 = utility::findLastSet(granularity);
+    mFlIndexShift = SL_INDEX_COUNT_LOG2 + mGranularityLog2;
+    mSmallBlockSize = std::size_t(1) << mFlIndexShift;
+
+    mAllocatedBlocks.assign(64, NULL_BLOCK);
+    mAllocatedBlocksShift = 64 - 6;
+
+    for(auto &&fl : mFreeLists)
+        fl.fill(NULL_BLOCK);
+
+    const auto block = newBlock();
+    mBlocks[block].address = mBase;
+    mBlocks[block].size = mTotalSize;
+    insertFreeBlock(block);
+}
+
+std::uint32_t TlsfMemoryAllocator::newBlock()
+{
+    if(!mUnusedBlocks.empty())
+    {
+        const auto block = mUnusedBlocks.back();
+        mUnusedBlocks.pop_back();
+        mBlocks[block] = { };
+        return block;
+    }
+    mBlocks.emplace_back();
+    return static_cast<std::uint32_t>(mBlocks.size() - 1);
+}
+
+void TlsfMemoryAllocator::recycleBlock(const std::uint32_t block)
+{
+    mUnusedBlocks.push_back(block);
+}
+
+std::size_t TlsfMemoryAllocator::allocatedBlockSlot(
+    const std::size_t address) const
+{
+    // fibonacci hashing of the granule index
+    const auto granule = static_cast<std::uint64_t>(
+        (address - mBase) >> mGranularityLog2);
+    return static_cast<std::size_t>(
+        granule * 0x9E3779B97F4A7C15ull >> mAllocatedBlocksShift);
+}
+
+void TlsfMemoryAllocator::insertAllocatedBlock(const std::uint32_t block)
+{
+    // keep the load factor under one half
+    if((mNumAllocatedBlocks + 1) * 2 > mAllocatedBlocks.size())
+    {
+        std::vector<std::uint32_t> old(mAllocatedBlocks.size() * 2,
+            NULL_BLOCK);
+        old.swap(mAllocatedBlocks);
+        --mAllocatedBlocksShift;
+        mNumAllocatedBlocks = 0;
+        for(auto &&b : old)
+            if(b != NULL_BLOCK) insertAllocatedBlock(b);
+    }
+
+    const auto mask = mAllocatedBlocks.size() - 1;
+    auto slot = allocatedBlockSlot(mBlocks[block].address);
+    while(mAllocatedBlocks[slot] != NULL_BLOCK)
+        slot = (slot + 1) & mask;
+    mAllocatedBlocks[slot] = block;
+    ++mNumAllocatedBlocks;
+}
+
+std::uint32_t TlsfMemoryAllocator::removeAllocatedBlock(
+    const std::size_t address)
+{
+    const auto mask = mAllocatedBlocks.size() - 1;
+    auto slot = allocatedBlockSlot(address);
+    for(;; slot = (slot + 1) & mask)
+    {
+        const auto b = mAllocatedBlocks[slot];
+        if(b == NULL_BLOCK) return NULL_BLOCK;
+        if(mBlocks[b].address == address) break;
+    }
+    const auto block = mAllocatedBlocks[slot];
+
+    // shift the following entries of the probe sequence back into the hole
+    // so that lookups never stop early
+    for(auto next = (slot + 1) & mask;
+        mAllocatedBlocks[next] != NULL_BLOCK; next = (next + 1) & mask)
+    {
+        const auto home = allocatedBlockSlot(
+            mBlocks[mAllocatedBlocks[next]].address);
+        // skip entries whose home lies cyclically in (slot, next]
+        const bool in_place = slot <= next
+            ? slot < home && home <= next
+            : slot < home || home <= next;
+        if(in_place) continue;
+        mAllocatedBlocks[slot] = mAllocatedBlocks[next];
+        slot = next;
+    }
+    mAllocatedBlocks[slot] = NULL_BLOCK;
+    --mNumAllocatedBlocks;
+    return block;
+}
+
+void TlsfMemoryAllocator::mappingInsert(
+    const std::size_t size,
+    unsigned &fl,
+    unsigned &sl) const
+{
+    if(size < mSmallBlockSize)
+    {
+        fl = 0;
+        sl = static_cast<unsigned>(size / (mSmallBlockSize / SL_INDEX_COUNT));
+    }
+    else
+    {
+        const auto msb = utility::findLastSet(size);
+        sl = static_cast<unsigned>(
+            size >> (msb - SL_INDEX_COUNT_LOG2)) ^ SL_INDEX_COUNT;
+        fl = msb - mFlIndexShift + 1;
+    }
+}
+
+void TlsfMemoryAllocator::mappingSearch(
+    const std::size_t size,
+    unsigned &fl,
+    unsigned &sl) const
+{
+    auto rounded = size;
+    // round up to the next list so any block in it is big enough
+    if(size >= mSmallBlockSize)
+    {
+        const auto round = (std::size_t(1) << (
+            utility::findLastSet(size) - SL_INDEX_COUNT_LOG2)) - 1;
+        rounded += round;
+    }
+    mappingInsert(rounded, fl, sl);
+}
+
+std::uint32_t TlsfMemoryAllocator::searchSuitableBlock(
+    unsigned &fl,
+    unsigned &sl) const
+{
+    if(fl >= FL_INDEX_COUNT) return NULL_BLOCK;
+
+    // search for a non-empty list in the same first-level class
+    auto sl_map = mSlBitmap[fl] & (~0u << sl);
+    if(!sl_map)
+    {
+        // go to next first-level class
+        if(fl + 1 >= FL_INDEX_COUNT) return NULL_BLOCK;
+        const auto fl_map = mFlBitmap & (~std::uint64_t(0) << (fl + 1));
+        if(!fl_map) return NULL_BLOCK;
+        fl = utility::findFirstSet(fl_map);
+        sl_map = mSlBitmap[fl];
+        assert(sl_map);
+    }
+    sl = utility::findFirstSet(sl_map);
+    return mFreeLists[fl][sl];
+}
+
+void TlsfMemoryAllocator::insertFreeBlock(const std::uint32_t block)
+{
+    auto &b = mBlocks[block];
+    unsigned fl, sl;
+    mappingInsert(b.size, fl, sl);
+
+    const auto head = mFreeLists[fl][sl];
+    b.free = true;
+    b.prev_free = NULL_BLOCK;
+    b.next_free = head;
+    if(head != NULL_BLOCK)
+        mBlocks[head].prev_free = block;
+    mFreeLists[fl][sl] = block;
+    mFlBitmap |= std::uint64_t(1) << fl;
+    mSlBitmap[fl] |= 1u << sl;
+}
+
+void TlsfMemoryAllocator::removeFreeBlock(const std::uint32_t block)
+{
+    auto &b = mBlocks[block];
+    assert(b.free);
+    unsigned fl, sl;
+    mappingInsert(b.size, fl, sl);
+
+    if(b.prev_free != NULL_BLOCK)
+        mBlocks[b.prev_free].next_free = b.next_free;
+    if(b.next_free != NULL_BLOCK)
+        mBlocks[b.next_free].prev_free = b.prev_free;
+    if(mFreeLists[fl][sl] == block)
+    {
+        mFreeLists[fl][sl] = b.next_free;
+        if(b.next_free == NULL_BLOCK)
+        {
+            mSlBitmap[fl] &= ~(1u << sl);
+            if(!mSlBitmap[fl])
+                mFlBitmap &= ~(std::uint64_t(1) << fl);
+        }
+    }
+    b.free = false;
+    b.prev_free = b.next_free = NULL_BLOCK;
+}
+
+std::uint32_t TlsfMemoryAllocator::splitBlock(
+    const std::uint32_t block,
+    const std::size_t size)
+{
+    // mBlocks may be reallocated by newBlock()
+    const auto remaining = newBlock();
+    auto &b = mBlocks[block];
+    auto &r = mBlocks[remaining];
+    assert(b.size > size);
+
+    r.address = b.address + size;
+    r.size = b.size - size;
+    r.prev_physical = block;
+    r.next_physical = b.next_physical;
+    if(b.next_physical != NULL_BLOCK)
+        mBlocks[b.next_physical].prev_physical = remaining;
+    b.next_physical = remaining;
+    b.size = size;
+
+    return remaining;
+}
+
+void TlsfMemoryAllocator::absorbNextBlock(const std::uint32_t block)
+{
+    auto &b = mBlocks[block];
+    const auto next = b.next_physical;
+    auto &n = mBlocks[next];
+    assert(n.address == b.address + b.size);
+
+    b.size += n.size;
+    b.next_physical = n.next_physical;
+    if(n.next_physical != NULL_BLOCK)
+        mBlocks[n.next_physical].prev_physical = block;
+    recycleBlock(next);
+}
+
+std::size_t TlsfMemoryAllocator::usableSize() const
+{
+    return mTotalSize - mUsedSize;
+}
+
+std::size_t TlsfMemoryAllocator::usedSize() const
+{
+    return mUsedSize;
+}
+
+std::size_t TlsfMemoryAllocator::largestFreeBlockSize() const
+{
+    if(!mFlBitmap) return 0;
+    const auto fl = utility::findLastSet(mFlBitmap);
+    std::size_t largest = 0;
+    // blocks in the same list have different sizes
+    for(auto sl_map = mSlBitmap[fl]; sl_map; sl_map &= sl_map - 1)
+    {
+        const auto sl = utility::findFirstSet(sl_map);
+        for(auto b = mFreeLists[fl][sl]; b != NULL_BLOCK;
+            b = mBlocks[b].next_free)
+            largest = std::max(largest, mBlocks[b].size);
+    }
+    return largest;
+}
+
+void TlsfMemoryAllocator::setMemoryTag(std::shared_ptr<MemoryTag> tag)
+{
+    mMemoryTag = std::move(tag);
+}
+
+void * TlsfMemoryAllocator::allocate(
+    const std::size_t num_bytes,
+    const std::size_t alignment)
+{
+    if(num_bytes == 0)
+        throw std::invalid_argument("allocation size must be greater than 0");
+    if(!utility::isPowerOfTwoOrZero(alignment))
+        throw std::invalid_argument("alignment must be a power of two");
+
+    const auto size = utility::roundUpUnsigned(num_bytes, mGranularity);
+    const auto align = std::max(alignment, mGranularity);
+    // all blocks are aligned to the granularity, so this is the maximum
+    // padding required to align the allocation.
+    const auto padded_size = size + (align - mGranularity);
+
+    unsigned fl, sl;
+    mappingSearch(padded_size, fl, sl);
+    auto block = searchSuitableBlock(fl, sl);
+    if(block == NULL_BLOCK)
+        throw std::bad_alloc();
+    removeFreeBlock(block);
+    assert(mBlocks[block].size >= padded_size);
+
+    // return the leading gap to the free lists
+    const auto gap = utility::roundUpUnsigned(
+        mBlocks[block].address, align) - mBlocks[block].address;
+    if(gap)
+    {
+        const auto aligned = splitBlock(block, gap);
+        // the previous physical block is in use or it would have been
+        // merged with this one
+        insertFreeBlock(block);
+        block = aligned;
+    }
+    // trim the trailing part
+    if(mBlocks[block].size > size)
+    {
+        insertFreeBlock(splitBlock(block, size));
+    }
+
+    const auto &b = mBlocks[block];
+    mUsedSize += b.size;
+    insertAllocatedBlock(block);
+    if(mMemoryTag) mMemoryTag->recordAllocation(b.size);
+    return reinterpret_cast<void*>(b.address);
+}
+
+void TlsfMemoryAllocator::deallocate(void *pointer)
+{
+    auto block = removeAllocatedBlock(reinterpret_cast<std::size_t>(pointer));
+    if(block == NULL_BLOCK)
+        throw std::invalid_argument("pointer was not allocated by this "
+            "allocator or is already freed");
+    mUsedSize -= mBlocks[block].size;
+    if(mMemoryTag) mMemoryTag->recordDeallocation(mBlocks[block].size);
+
+    // coalesce with free neighbors
+    const auto prev = mBlocks[block].prev_physical;
+    if(prev != NULL_BLOCK && mBlocks[prev].free)
+    {
+        removeFreeBlock(prev);
+        absorbNextBlock(prev);
+        block = prev;
+    }
+    const auto next = mBlocks[block].next_physical;
+    if(next != NULL_BLOCK && mBlocks[next].free)
+    {
+        removeFreeBlock(next);
+        absorbNextBlock(block);
+    }
+    insertFreeBlock(block);
+}
+}
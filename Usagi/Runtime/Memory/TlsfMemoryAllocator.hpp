@@ -0,0 +1,126 @@
+﻿#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <Usagi/Utility/Noncopyable.hpp>
+
+namespace usagi
+{
+class MemoryTag;
+
+/**
+ * \brief A Two-Level Segregated Fit allocator for managing
+ * remote memory. Allocation and deallocation are O(1) and freed blocks are
+ * immediately coalesced with their free neighbors.
+ *
+ * Block metadata is kept outside of the managed region so it can be used
+ * for memory not accessible by the CPU, such as device-local memory.
+ *
+ * The allocator is not thread-safe. Its users already serialize the access,
+ * as VulkanBlockPool does under its own lock, so a lock per call would only
+ * add to the cost of each operation.
+ *
+ * References:
+ * http://www.gii.upv.es/tlsf/files/ecrts04_tlsf.pdf
+ * https://github.com/mattconte/tlsf
+ */
+class TlsfMemoryAllocator : Noncopyable
+{
+    static constexpr unsigned SL_INDEX_COUNT_LOG2 = 5;
+    static constexpr unsigned SL_INDEX_COUNT = 1u << SL_INDEX_COUNT_LOG2;
+    static constexpr unsigned FL_INDEX_COUNT = 64;
+    static constexpr std::uint32_t NULL_BLOCK = ~0u;
+
+    struct Block
+    {
+        std::size_t address = 0;
+        std::size_t size = 0;
+        bool free = false;
+        std::uint32_t prev_physical = NULL_BLOCK;
+        std::uint32_t next_physical = NULL_BLOCK;
+        std::uint32_t prev_free = NULL_BLOCK;
+        std::uint32_t next_free = NULL_BLOCK;
+    };
+
+    const std::size_t mBase = 0;
+    const std::size_t mTotalSize = 0;
+    const std::size_t mGranularity = 0;
+    unsigned mGranularityLog2 = 0;
+    unsigned mFlIndexShift = 0;
+    std::size_t mSmallBlockSize = 0;
+
+    std::size_t mUsedSize = 0;
+
+    std::vector<Block> mBlocks;
+    std::vector<std::uint32_t> mUnusedBlocks;
+    // open addressing hash table of the allocated blocks keyed by their
+    // addresses. unlike a node-based map it does not touch the heap on
+    // each allocation.
+    std::vector<std::uint32_t> mAllocatedBlocks;
+    std::size_t mNumAllocatedBlocks = 0;
+    unsigned mAllocatedBlocksShift = 0;
+
+    std::uint64_t mFlBitmap = 0;
+    std::array<std::uint32_t, FL_INDEX_COUNT> mSlBitmap { };
+    std::array<std::array<std::uint32_t, SL_INDEX_COUNT>, FL_INDEX_COUNT>
+        mFreeLists;
+
+    std::shared_ptr<MemoryTag> mMemoryTag;
+
+    std::uint32_t newBlock();
+    void recycleBlock(std::uint32_t block);
+
+    void mappingInsert(std::size_t size, unsigned &fl, unsigned &sl) const;
+    void mappingSearch(std::size_t size, unsigned &fl, unsigned &sl) const;
+    std::uint32_t searchSuitableBlock(unsigned &fl, unsigned &sl) const;
+
+    std::size_t allocatedBlockSlot(std::size_t address) const;
+    void insertAllocatedBlock(std::uint32_t block);
+    std::uint32_t removeAllocatedBlock(std::size_t address);
+
+    void insertFreeBlock(std::uint32_t block);
+    void removeFreeBlock(std::uint32_t block);
+
+    /**
+     * \brief Cut the block at the specified size and return the remaining
+     * part as a new block.
+     */
+    std::uint32_t splitBlock(std::uint32_t block, std::size_t size);
+    /**
+     * \brief Merge the next physical block into the given one.
+     */
+    void absorbNextBlock(std::uint32_t block);
+
+public:
+    /**
+     * \brief
+     * \param base The starting address of the memory region. It must be
+     * aligned to granularity, and can be nullptr to allocate based on
+     * offsets.
+     * \param total_size Total usable size. The tail not big enough to hold
+     * a granule will not be used.
+     * \param granularity The minimum allocation unit and the minimum
+     * alignment of all allocations. Must be a power of two.
+     */
+    TlsfMemoryAllocator(
+        void *base,
+        std::size_t total_size,
+        std::size_t granularity = 16);
+
+    std::size_t managedSize() const { return mTotalSize; }
+    std::size_t usableSize() const;
+    std::size_t usedSize() const;
+    std::size_t largestFreeBlockSize() const;
+
+    /**
+     * \brief Report allocations to the tag. Not thread-safe.
+     */
+    void setMemoryTag(std::shared_ptr<MemoryTag> tag);
+
+    void * allocate(std::size_t num_bytes, std::size_t alignment = 0);
+    void deallocate(void *pointer);
+};
+}
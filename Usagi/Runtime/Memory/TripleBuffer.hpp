@@ -1,60 +1,147 @@
 ﻿#pragma once
 
-#include <memory>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <utility>
 
-namespace yuki::memory
+#include <Usagi/Utility/Noncopyable.hpp>
+
+namespace usagi
 {
 /**
- * \brief Buffer for asynchronize read and write at different speed.
- * Can be customized for both CPU and GPU usages.
- * 
- * Requirements:
- * No assumption on the operations supported by Buffer.
- * Support resource staging.
- * 
- * Invariants:
- * read() != write()
- * 
- * Considerations:
- * Updating status before & after each frame is too costly.
- * Synchronize implicitly?
- * 
- * todo Triple buffer should be enough for games, but consider extending to multiple buffers
- * 
+ * \brief The wait-free index exchange protocol of a triple buffer. One
+ * producer and one consumer each own a buffer index, while the third one is
+ * shared through a single atomic byte which also carries a flag telling
+ * whether the shared buffer contains data not seen by the consumer yet.
+ *
+ * Neither side ever blocks: the producer can publish at any rate and the
+ * consumer always gets the latest completed buffer, skipping stale ones.
+ *
+ * The producer-side methods must only be called from one thread, and so are
+ * the consumer-side ones.
+ *
  * References:
- * https://users.rust-lang.org/t/spmc-buffer-triple-buffering-for-multiple-consumers/10118/2
  * https://docs.unrealengine.com/latest/INT/API/Runtime/Core/Containers/TTripleBuffer/
- * 
- * Memory Management Startegies:
- * https://msdn.microsoft.com/en-us/library/windows/desktop/mt613239(v=vs.85).aspx
- * elements like gui must be copied before rendering
- * object streaming can be done at the background
- * https://github.com/KhronosGroup/Vulkan-Docs/wiki/Synchronization-Examples
- * 
- * \tparam Buffer 
- * \tparam FallbackPolicy 
+ * https://github.com/HadrienG2/triple-buffer
  */
-template <
-    typename Buffer,
-    typename WriteProxy,
-    typename FallbackPolicy
->
-class TripleBuffer
+class TripleBufferIndex : Noncopyable
 {
-    std::shared_ptr<Buffer> mBuffers[3];
-    uint8_t mBack = 0, mStaging = 1, mFront = 2;
+    enum : std::uint8_t
+    {
+        INDEX_MASK = 0b011,
+        DIRTY_BIT = 0b100,
+    };
+
+    /**
+     * \brief Padded to prevent the producer and consumer from sharing the
+     * cache line of the shared state with their private indices.
+     */
+    alignas(64) std::atomic<std::uint8_t> mShared { 1 };
+    alignas(64) std::uint8_t mBack = 0;
+    alignas(64) std::uint8_t mFront = 2;
 
 public:
-    std::shared_ptr<Buffer> & read()
+    // ~~ Producer ~~
+
+    std::uint8_t backIndex() const { return mBack; }
+
+    /**
+     * \brief Swap the back buffer with the shared one and mark the shared
+     * buffer as containing new data.
+     */
+    void publish()
+    {
+        const auto old = mShared.exchange(
+            mBack | DIRTY_BIT, std::memory_order_acq_rel);
+        mBack = old & INDEX_MASK;
+    }
+
+    // ~~ Consumer ~~
+
+    std::uint8_t frontIndex() const { return mFront; }
+
+    bool hasNewData() const
     {
-        return mBuffers[mFront];
+        return mShared.load(std::memory_order_relaxed) & DIRTY_BIT;
     }
 
-    Buffer & write()
+    /**
+     * \brief If the producer published a buffer since the last call, swap
+     * the front buffer with it.
+     * \return Whether the front buffer changed.
+     */
+    bool fetch()
     {
-        if(mBuffers[mBack].count() )
-        return *mBuffers[mBack].get();
+        if(!hasNewData()) return false;
+        const auto old = mShared.exchange(
+            mFront, std::memory_order_acq_rel);
+        mFront = old & INDEX_MASK;
+        return true;
     }
+};
+
+/**
+ * \brief A wait-free triple buffer for passing data from a producer thread
+ * to a consumer thread running at a different rate, such as from the
+ * simulation thread to the render thread.
+ *
+ * The producer fills writeBuffer() and calls publish(). The consumer calls
+ * fetch() and reads readBuffer(), which stays valid and unchanged until the
+ * next fetch(). The content of the back buffer after publish() is whatever
+ * the buffer previously held, so the producer should either overwrite it
+ * entirely or clear() it first.
+ *
+ * \tparam Payload Any default-constructible type. For GPU buffers see
+ * GpuTripleBuffer.
+ */
+template <typename Payload>
+class TripleBuffer : Noncopyable
+{
+    std::array<Payload, 3> mBuffers;
+    TripleBufferIndex mIndex;
 
+public:
+    TripleBuffer() = default;
+
+    /**
+     * \brief Initialize all three buffers with a copy of the given value.
+     */
+    explicit TripleBuffer(const Payload &initial)
+        : mBuffers { initial, initial, initial }
+    {
+    }
+
+    // ~~ Producer ~~
+
+    Payload & writeBuffer() { return mBuffers[mIndex.backIndex()]; }
+    void publish() { mIndex.publish(); }
+
+    template <typename T>
+    void write(T &&value)
+    {
+        writeBuffer() = std::forward<T>(value);
+        publish();
+    }
+
+    // ~~ Consumer ~~
+
+    bool hasNewData() const { return mIndex.hasNewData(); }
+    bool fetch() { return mIndex.fetch(); }
+    Payload & readBuffer() { return mBuffers[mIndex.frontIndex()]; }
+    const Payload & readBuffer() const
+    {
+        return mBuffers[mIndex.frontIndex()];
+    }
+
+    /**
+     * \brief Fetch the latest published buffer if there is any and return
+     * the front buffer.
+     */
+    const Payload & read()
+    {
+        fetch();
+        return readBuffer();
+    }
 };
 }
@@ -1,5 +1,12 @@
 #pragma once
 
+#include <cassert>
+#include <cstdint>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
 namespace usagi::utility
 {
 // https://stackoverflow.com/questions/108318/whats-the-simplest-way-to-test-whether-a-number-is-a-power-of-2-in-c
@@ -14,4 +21,34 @@ bool isPowerOfTwo(T value)
 {
     return (value & (value - 1)) == 0 && value != 0;
 }
+
+/**
+ * \brief Index of the least significant set bit. Value must not be zero.
+ */
+inline unsigned findFirstSet(const std::uint64_t value)
+{
+    assert(value != 0);
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, value);
+    return index;
+#else
+    return __builtin_ctzll(value);
+#endif
+}
+
+/**
+ * \brief Index of the most significant set bit. Value must not be zero.
+ */
+inline unsigned findLastSet(const std::uint64_t value)
+{
+    assert(value != 0);
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse64(&index, value);
+    return index;
+#else
+    return 63 - __builtin_clzll(value);
+#endif
+}
 }